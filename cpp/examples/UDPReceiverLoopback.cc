@@ -0,0 +1,174 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+/** Loopback test for {@link UDPPacketReceiver}. <br>
+ *  <br>
+ *  Sends data packets of varying lengths to a receiver on 127.0.0.1 from a plain UDP
+ *  socket, mixed in with datagrams that must be rejected: ones too short to hold a
+ *  VRT header, ones whose length does not match the packet length in the header and
+ *  ones longer than the receive buffer (truncated). Checks that every valid packet
+ *  arrives once, in order and intact, with its source address and arrival time, and
+ *  that every bad datagram is counted and dropped. <br>
+ *  <br>
+ *  Usage: <tt>UDPReceiverLoopback [packets]</tt> <br>
+ *  Exit status: 0 if passed, 1 if failed, 77 if the loopback socket can not be
+ *  opened (reported as skipped by <tt>make check</tt>).
+ */
+
+#include "UDPPacketReceiver.h"
+#include "BasicDataPacket.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace vrt;
+
+/** Size of the receive buffers (datagrams longer than this are truncated). */
+static const int32_t BUFFER_SIZE = 2048;
+
+/** Number of datagrams sent between each drain of the receiver. */
+static const int32_t BURST = 16;
+
+/** Fills in a data packet with a known pattern based on its sequence number. */
+static void makePacket (BasicDataPacket &p, int32_t seq) {
+  int32_t words = 1 + (seq % 64);
+  vector<int32_t> data(words);
+  for (int32_t i = 0; i < words; i++) data[i] = seq * 1000 + i;
+
+  p.setStreamIdentifier(seq);
+  p.setPacketCount(seq & 0xF);
+  p.setDataInt(PayloadFormat_INT32, data);
+}
+
+/** Checks a received packet against the pattern. */
+static bool checkPacket (const VRTPacketView &v, int32_t seq) {
+  BasicDataPacket expected;
+  makePacket(expected, seq);
+  return (v.getPacketLength() == expected.getPacketLength())
+      && (memcmp(v.getPacketPointer(), &expected.bbuf[0], expected.getPacketLength()) == 0);
+}
+
+int main (int argc, char **argv) {
+  int32_t numPackets = (argc > 1)? atoi(argv[1]) : 20000;
+  int32_t errors     = 0;
+  int32_t tooShort   = 0;   // bad datagrams sent (by type)
+  int32_t mismatch   = 0;
+  int32_t oversize   = 0;
+  int32_t next       = 0;   // next sequence number expected
+
+  try {
+    UDPPacketReceiver rx(0, "127.0.0.1", 32, BUFFER_SIZE, true);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in dst;
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family      = AF_INET;
+    dst.sin_port        = htons((uint16_t)rx.getPort());
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sock < 0) || (connect(sock, (struct sockaddr*)&dst, sizeof(dst)) != 0)) {
+      printf("SKIP: Unable to open loopback socket\n");
+      return 77;
+    }
+    struct sockaddr_in src;
+    socklen_t          srcLen = sizeof(src);
+    getsockname(sock, (struct sockaddr*)&src, &srcLen);
+
+    BasicDataPacket p;
+    vector<char>    junk(BUFFER_SIZE + 512);
+    for (int32_t seq = 0; seq < numPackets; ) {
+      int32_t end = min(seq + BURST, numPackets);
+      for (; seq < end; seq++) {
+        makePacket(p, seq);
+        if (::send(sock, &p.bbuf[0], p.getPacketLength(), 0) < 0) {
+          printf("FAIL: Unable to send packet %d\n", seq);
+          return 1;
+        }
+
+        // Every so often follow the packet with a bad datagram
+        if (seq % 97 == 10) {
+          ::send(sock, &p.bbuf[0], 3, 0);                          // no room for a header
+          tooShort++;
+        }
+        else if (seq % 97 == 40) {
+          ::send(sock, &p.bbuf[0], p.getPacketLength() - 4, 0);    // header says longer
+          mismatch++;
+        }
+        else if (seq % 97 == 70) {
+          int32_t len = (int32_t)junk.size();
+          memcpy(&junk[0], &p.bbuf[0], 4);
+          VRTMath::packShort(&junk[0], 2, (int16_t)(len / 4));     // valid, but too long
+          ::send(sock, &junk[0], len, 0);
+          oversize++;
+        }
+      }
+
+      // Drain everything sent so far
+      while (next < seq) {
+        int32_t n = rx.receive(1000);
+        if (n == 0) {
+          printf("FAIL: Timed out waiting for packet %d\n", next);
+          return 1;
+        }
+        for (int32_t i = 0; i < n; i++, next++) {
+          VRTPacketView v = rx.getPacket(i);
+          if (!checkPacket(v, next)) {
+            if (errors++ < 10) printf("FAIL: Packet %d: %s\n", next, v.toString().c_str());
+            next = v.getStreamIdentifier(); // re-sync to what arrived
+          }
+          if ((rx.getSourcePort(i) != ntohs(src.sin_port)) ||
+              (rx.getSourceAddress(i).getHostAddress() != "127.0.0.1")) {
+            if (errors++ < 10) printf("FAIL: Packet %d: wrong source address\n", next);
+          }
+          if (rx.getArrivalTime(i).tv_sec == 0) {
+            if (errors++ < 10) printf("FAIL: Packet %d: no arrival time\n", next);
+          }
+        }
+      }
+    }
+    ::close(sock);
+
+    printf("%s\n", rx.toString().c_str());
+    if (rx.getPacketsReceived() != numPackets) {
+      printf("FAIL: Received %" PRId64 " of %d packets\n", rx.getPacketsReceived(), numPackets);
+      errors++;
+    }
+    if (rx.getInvalidCount() != tooShort + mismatch) {
+      printf("FAIL: Invalid count %" PRId64 " expected %d\n", rx.getInvalidCount(), tooShort + mismatch);
+      errors++;
+    }
+    if (rx.getTruncatedCount() != oversize) {
+      printf("FAIL: Truncated count %" PRId64 " expected %d\n", rx.getTruncatedCount(), oversize);
+      errors++;
+    }
+  }
+  catch (VRTException e) {
+    printf("FAIL: %s\n", e.toString().c_str());
+    return 1;
+  }
+
+  printf("%s: %d packets, %d short, %d mismatched, %d oversize\n",
+         (errors == 0)? "PASS" : "FAIL", numPackets, tooShort, mismatch, oversize);
+  return (errors == 0)? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+/** Loopback test for {@link UDPPacketSender}. <br>
+ *  <br>
+ *  Sends batches of packets to a plain UDP socket on 127.0.0.1 using a destination
+ *  with a pool of sockets: runs of same-length packets (which go through segmentation
+ *  offload where supported), batches of mixed lengths, a batch containing a packet
+ *  too long for a datagram, VRL frames, and single packets. Checks that every
+ *  datagram arrives intact, that packets sent with the same key come from the same
+ *  source port and stay in order, and that the oversized packet is counted as an
+ *  error without affecting the rest of its batch. <br>
+ *  <br>
+ *  Usage: <tt>UDPSenderLoopback [rounds]</tt> <br>
+ *  Exit status: 0 if passed, 1 if failed, 77 if the loopback socket can not be
+ *  opened (reported as skipped by <tt>make check</tt>).
+ */
+
+#include "UDPPacketSender.h"
+#include "BasicDataPacket.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+using namespace vrt;
+
+/** Number of keys used (more than the number of sockets in the pool). */
+static const int32_t NUM_KEYS = 8;
+
+/** Number of sockets in the destination's pool. */
+static const int32_t NUM_SOCKETS = 4;
+
+static int                      rxSock = -1;  // Receiving socket
+static map<int32_t,vector<char> > expected;   // Datagrams sent but not yet received (by seq)
+static map<int32_t,int32_t>     keyOf;        // Key used to send each datagram (by seq)
+static map<int32_t,int32_t>     keyPort;      // Source port seen for each key
+static map<int32_t,int32_t>     lastSeq;      // Last seq seen from each source port
+static int32_t                  errors   = 0;
+static int64_t                  received = 0;
+
+/** Creates a data packet whose stream identifier is its sequence number. */
+static BasicDataPacket *makePacket (int32_t seq, int32_t words) {
+  BasicDataPacket *p = new BasicDataPacket();
+  vector<int32_t>  data(words);
+  for (int32_t i = 0; i < words; i++) data[i] = (int32_t)((uint32_t)seq ^ ((uint32_t)i * 0x01010101U));
+
+  p->setStreamIdentifier(seq);
+  p->setPacketCount(seq & 0xF);
+  p->setDataInt(PayloadFormat_INT32, data);
+  return p;
+}
+
+/** Records a datagram as sent. */
+static void expect (int32_t seq, int32_t key, const void *ptr, int32_t len) {
+  expected[seq] = vector<char>((const char*)ptr, (const char*)ptr + len);
+  keyOf[seq]    = key;
+}
+
+/** Receives datagrams until all of those expected have arrived (or it times out). */
+static void drain () {
+  char buf[65536];
+  while (!expected.empty()) {
+    struct pollfd pfd;
+    pfd.fd      = rxSock;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 1000) <= 0) {
+      printf("FAIL: Timed out with %d datagrams outstanding (first seq %d)\n",
+             (int32_t)expected.size(), expected.begin()->first);
+      errors++;
+      expected.clear();
+      return;
+    }
+
+    struct sockaddr_in src;
+    socklen_t          srcLen = sizeof(src);
+    ssize_t            len    = recvfrom(rxSock, buf, sizeof(buf), 0, (struct sockaddr*)&src, &srcLen);
+    if (len < 8) {
+      if (errors++ < 10) printf("FAIL: Runt datagram of %d octets\n", (int32_t)len);
+      continue;
+    }
+
+    // VRL frames carry a single packet, the sequence number is in its stream ID
+    bool    vrl  = (memcmp(buf, "VRLP", 4) == 0);
+    int32_t seq  = VRTMath::unpackInt(buf, (vrl)? 12 : 4);
+    int32_t port = ntohs(src.sin_port);
+    map<int32_t,vector<char> >::iterator it = expected.find(seq);
+    received++;
+
+    if (it == expected.end()) {
+      if (errors++ < 10) printf("FAIL: Unexpected datagram %d\n", seq);
+      continue;
+    }
+    if ((it->second.size() != (size_t)len) || (memcmp(&it->second[0], buf, len) != 0)) {
+      if (errors++ < 10) printf("FAIL: Datagram %d corrupted (length %d)\n", seq, (int32_t)len);
+    }
+    expected.erase(it);
+
+    int32_t key = keyOf[seq];
+    if (keyPort.count(key) == 0) {
+      keyPort[key] = port;
+    }
+    else if (keyPort[key] != port) {
+      if (errors++ < 10) printf("FAIL: Key %d sent from port %d and %d\n", key, keyPort[key], port);
+    }
+    if ((lastSeq.count(port) != 0) && (lastSeq[port] > seq)) {
+      if (errors++ < 10) printf("FAIL: Datagram %d from port %d after %d\n", seq, port, lastSeq[port]);
+    }
+    lastSeq[port] = seq;
+  }
+}
+
+/** Sends a batch of packets, recording them as expected (except those too long). */
+static void sendBatch (UDPPacketSender &tx, int32_t dest, vector<BasicVRTPacket*> &batch,
+                       int32_t key) {
+  for (size_t i = 0; i < batch.size(); i++) {
+    BasicVRTPacket *p = batch[i];
+    if (p->getPacketLength() <= 65507) {
+      expect(p->getStreamIdentifier(), key, &p->bbuf[0], p->getPacketLength());
+    }
+  }
+  tx.send(dest, batch, (uint32_t)key);
+  drain();
+
+  for (size_t i = 0; i < batch.size(); i++) delete batch[i];
+  batch.clear();
+}
+
+int main (int argc, char **argv) {
+  int32_t rounds = (argc > 1)? atoi(argv[1]) : 200;
+  int32_t seq    = 0;
+  int32_t sent   = 0;
+
+  rxSock = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr;
+  socklen_t          addrLen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = 0;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((rxSock < 0) || (bind(rxSock, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+      (getsockname(rxSock, (struct sockaddr*)&addr, &addrLen) != 0)) {
+    printf("SKIP: Unable to open loopback socket\n");
+    return 77;
+  }
+  int rcvbuf = 8*1024*1024;
+  setsockopt(rxSock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  try {
+    UDPPacketSender         tx(16, true);
+    int32_t                 dest = tx.addDestination(InetAddress("127.0.0.1"), ntohs(addr.sin_port),
+                                                     NUM_SOCKETS);
+    vector<BasicVRTPacket*> batch;
+
+    // Runs of same-length packets (segmentation offload)
+    for (int32_t r = 0; r < rounds; r++) {
+      int32_t n     = 1 + (r % 48);
+      int32_t words = 16 + (r % 50);
+      for (int32_t i = 0; i < n; i++) batch.push_back(makePacket(seq++, words));
+      sent += n;
+      sendBatch(tx, dest, batch, r % NUM_KEYS);
+    }
+
+    // Mixed lengths (short runs)
+    for (int32_t r = 0; r < rounds; r++) {
+      int32_t n = 1 + (r % 32);
+      for (int32_t i = 0; i < n; i++, seq++) batch.push_back(makePacket(seq, 1 + (seq * 7) % 300));
+      sent += n;
+      sendBatch(tx, dest, batch, r % NUM_KEYS);
+    }
+
+    // A packet too long for a datagram in the middle of a run
+    for (int32_t i = 0; i < 8; i++) batch.push_back(makePacket(seq++, 32));
+    batch.push_back(makePacket(seq++, 17000));
+    for (int32_t i = 0; i < 8; i++) batch.push_back(makePacket(seq++, 32));
+    sent += 16;
+    sendBatch(tx, dest, batch, 1);
+    if ((tx.getErrorCount() != 1) || (tx.getLastError() != EMSGSIZE)) {
+      printf("FAIL: Oversized packet gave %" PRId64 " errors (last error %d)\n",
+             tx.getErrorCount(), tx.getLastError());
+      errors++;
+    }
+
+    // VRL frames
+    vector<BasicVRLFrame*> frames;
+    for (int32_t i = 0; i < 20; i++) {
+      BasicDataPacket *p = makePacket(seq++, 1 + i * 10);
+      BasicVRLFrame   *f = new BasicVRLFrame();
+      f->setVRTPackets(p);
+      f->updateCRC();
+      expect(p->getStreamIdentifier(), 2, &f->bbuf[0], f->getFrameLength());
+      frames.push_back(f);
+      delete p;
+    }
+    sent += (int32_t)frames.size();
+    tx.send(dest, frames, 2);
+    drain();
+    for (size_t i = 0; i < frames.size(); i++) delete frames[i];
+
+    // Single packets
+    for (int32_t i = 0; i < 20; i++) {
+      BasicDataPacket *p = makePacket(seq++, 4);
+      expect(p->getStreamIdentifier(), 3, &p->bbuf[0], p->getPacketLength());
+      if (!tx.send(dest, &p->bbuf[0], p->getPacketLength(), 3)) errors++;
+      sent++;
+      delete p;
+      drain();
+    }
+
+    printf("%s Segmented=%s\n", tx.toString().c_str(), (tx.isSegmented(dest))? "true" : "false");
+    if ((tx.getPacketsSent() != sent) || (received != sent)) {
+      printf("FAIL: Sent %" PRId64 " received %" PRId64 " of %d\n", tx.getPacketsSent(), received, sent);
+      errors++;
+    }
+    if (tx.isSegmented(dest) && (tx.getSegmentedCount() == 0)) {
+      printf("FAIL: Segmentation offload enabled but not used\n");
+      errors++;
+    }
+  }
+  catch (VRTException e) {
+    printf("FAIL: %s\n", e.toString().c_str());
+    return 1;
+  }
+  close(rxSock);
+
+  printf("%s: %d datagrams from %d keys over %d sockets\n",
+         (errors == 0)? "PASS" : "FAIL", sent, NUM_KEYS, (int32_t)lastSeq.size());
+  return (errors == 0)? 0 : 1;
+}
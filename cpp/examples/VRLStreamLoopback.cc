@@ -0,0 +1,303 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+/** Loopback test for {@link VRLStreamReader} and {@link VRLStreamWriter}. <br>
+ *  <br>
+ *  Each test runs a writer thread connected over TCP on 127.0.0.1 to a reader (with
+ *  CRC checks on) whose ring buffer is the smallest allowed, so it wraps many times.
+ *  The reader checks that every packet arrives intact and in order. The tests are:
+ *  <pre>
+ *    append    Mixed-size packets via VRLStreamWriter.append(..), with junk
+ *              injected mid-stream (must be skipped with a resync).
+ *    zerocopy  As "append" with MSG_ZEROCOPY requested (falls back to normal
+ *              sends where not supported).
+ *    write     Batches of packets via VRLStreamWriter.write(..).
+ *    partial   Frames built with BasicVRLFrame and written to a plain socket in
+ *              small, irregular pieces so the reader sees partial frames, with one
+ *              frame's CRC corrupted (that frame's packets must be dropped with a
+ *              resync and the rest must arrive).
+ *  </pre>
+ *  Usage: <tt>VRLStreamLoopback [packets [test]]</tt> <br>
+ *  Exit status: 0 if passed, 1 if failed, 77 if the loopback socket can not be
+ *  opened (reported as skipped by <tt>make check</tt>).
+ */
+
+#include "VRLStream.h"
+#include "BasicDataPacket.h"
+#include "BasicVRLFrame.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace vrt;
+
+/** The tests. */
+enum LoopbackTest {
+  LoopbackTest_Append,
+  LoopbackTest_ZeroCopy,
+  LoopbackTest_Write,
+  LoopbackTest_Partial
+};
+
+static const char *TEST_NAMES[] = { "append", "zerocopy", "write", "partial" };
+
+/** Junk written between frames in the "append" tests. */
+static const char JUNK[] = "not a frame VRLP\x00\x00\x00\x01 still not a frame";
+
+/** Parameters shared with the writer thread. */
+struct LoopbackWriter {
+  LoopbackTest    test;
+  int             sock;
+  int32_t         numPackets;
+  int32_t         badFrame;   // Frame number to corrupt (partial test)
+  vector<int32_t> dropped;    // Packets in the corrupted frame (partial test)
+  string          error;      // Error reported by the writer ("" if none)
+};
+
+/** Creates a data packet whose stream identifier is its sequence number. */
+static void makePacket (BasicDataPacket &p, int32_t seq) {
+  int32_t         words = 1 + (seq % 97);
+  vector<int32_t> data(words);
+  for (int32_t i = 0; i < words; i++) data[i] = seq * 31 + i;
+
+  p.setStreamIdentifier(seq);
+  p.setPacketCount(seq & 0xF);
+  p.setDataInt(PayloadFormat_INT32, data);
+}
+
+/** Writes all of the given octets to a socket. */
+static void sendAll (int sock, const char *ptr, int32_t len) {
+  while (len > 0) {
+    ssize_t n = ::send(sock, ptr, len, MSG_NOSIGNAL);
+    if (n <= 0) throw VRTException("Unable to write to socket");
+    ptr += n;
+    len -= (int32_t)n;
+  }
+}
+
+/** Writes the frames in small pieces of irregular size so that the reader sees
+ *  partial frames (including partial frame headers).
+ */
+static void runPartialWriter (LoopbackWriter *w) {
+  int on = 1;
+  setsockopt(w->sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  BasicVRLFrame           frame;
+  vector<BasicDataPacket> held;
+  vector<BasicVRTPacket*> ptrs;
+  int32_t                 frameNum = 0;
+  uint32_t                rnd      = 12345;
+
+  for (int32_t seq = 0; seq < w->numPackets; frameNum++) {
+    int32_t n = min(1 + (frameNum % 8), w->numPackets - seq);
+    held.resize(n);
+    ptrs.resize(n);
+    for (int32_t i = 0; i < n; i++) {
+      makePacket(held[i], seq + i);
+      ptrs[i] = &held[i];
+    }
+    frame.setVRTPackets(ptrs);
+    frame.setFrameCount(frameNum & 0xFFF);
+    frame.updateCRC();
+
+    if (frameNum == w->badFrame) {
+      frame.bbuf[frame.getFrameLength() - 8] ^= 0x5A; // corrupt the last payload word
+    }
+
+    const char *ptr = &frame.bbuf[0];
+    int32_t     len = frame.getFrameLength();
+    while (len > 0) {
+      rnd = rnd * 1103515245 + 12345;
+      int32_t chunk = min(len, (int32_t)(1 + (rnd >> 16) % 700));
+      sendAll(w->sock, ptr, chunk);
+      ptr += chunk;
+      len -= chunk;
+      if ((rnd & 0x700) == 0) {
+        struct timespec ts = { 0, 20000 }; // let the reader catch up mid-frame
+        nanosleep(&ts, NULL);
+      }
+    }
+    seq += n;
+  }
+  ::close(w->sock);
+}
+
+/** Runs the writer side of a test. */
+static void *runWriter (void *arg) {
+  LoopbackWriter *w = (LoopbackWriter*)arg;
+  try {
+    if (w->test == LoopbackTest_Partial) {
+      runPartialWriter(w);
+      return NULL;
+    }
+
+    VRLStreamWriter         out(w->sock, VRLStreamWriter::DEFAULT_FRAME_LENGTH, true,
+                                (w->test == LoopbackTest_ZeroCopy));
+    BasicDataPacket         pkt;
+    vector<BasicVRTPacket*> batch;
+
+    for (int32_t seq = 0; seq < w->numPackets; seq++) {
+      if (w->test == LoopbackTest_Write) {
+        BasicDataPacket *p = new BasicDataPacket();
+        makePacket(*p, seq);
+        batch.push_back(p);
+        if ((batch.size() == 256) || (seq == w->numPackets - 1)) {
+          out.write(batch);
+          for (size_t i = 0; i < batch.size(); i++) delete batch[i];
+          batch.clear();
+        }
+      }
+      else {
+        makePacket(pkt, seq);
+        out.append(pkt);
+        if (seq == w->numPackets / 2) {
+          out.flush();
+          sendAll(out.getSocket(), JUNK, sizeof(JUNK) - 1);
+        }
+      }
+    }
+    out.close();
+  }
+  catch (VRTException e) {
+    w->error = e.toString();
+  }
+  return NULL;
+}
+
+/** Runs one test, returns the number of errors. */
+static int32_t runTest (LoopbackTest test, int32_t numPackets) {
+  int32_t errors = 0;
+
+  // Set up the connection
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t          addrLen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((listener < 0) || (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+      (listen(listener, 1) != 0) || (getsockname(listener, (struct sockaddr*)&addr, &addrLen) != 0)) {
+    return -1;
+  }
+  LoopbackWriter w;
+  w.test       = test;
+  w.numPackets = numPackets;
+  w.badFrame   = (test == LoopbackTest_Partial)? 100 : -1;
+  w.sock       = socket(AF_INET, SOCK_STREAM, 0);
+  if ((w.sock < 0) || (connect(w.sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)) {
+    return -1;
+  }
+  int sock = accept(listener, NULL, NULL);
+  ::close(listener);
+  if (sock < 0) return -1;
+
+  // Packets in the corrupted frame (frame N holds 1 + N%8 packets)
+  int32_t first = 0;
+  for (int32_t f = 0; f < w.badFrame; f++) first += 1 + (f % 8);
+  for (int32_t i = 0; (w.badFrame >= 0) && (i < 1 + (w.badFrame % 8)); i++) {
+    w.dropped.push_back(first + i);
+  }
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, runWriter, &w);
+
+  int64_t received = 0;
+  int32_t next     = 0;
+  size_t  drop     = 0;
+  try {
+    VRLStreamReader in(sock, BasicVRLFrame::MAX_FRAME_LENGTH, true);
+    BasicDataPacket expected;
+    time_t          deadline = time(NULL) + 60;
+
+    while (!in.isEndOfStream()) {
+      int32_t n = in.receive(1000);
+      if (time(NULL) > deadline) {
+        printf("FAIL: [%s] Timed out after %" PRId64 " packets\n", TEST_NAMES[test], received);
+        errors++;
+        break;
+      }
+      for (int32_t i = 0; i < n; i++, next++, received++) {
+        while ((drop < w.dropped.size()) && (next == w.dropped[drop])) { next++; drop++; }
+
+        VRTPacketView v = in.getPacket(i);
+        makePacket(expected, next);
+        if ((v.getPacketLength() != expected.getPacketLength()) ||
+            (memcmp(v.getPacketPointer(), &expected.bbuf[0], expected.getPacketLength()) != 0)) {
+          if (errors++ < 10) {
+            printf("FAIL: [%s] Expected packet %d got %s\n", TEST_NAMES[test], next,
+                   v.toString().c_str());
+          }
+          next = v.getStreamIdentifier(); // re-sync to what arrived
+        }
+      }
+    }
+
+    int64_t wanted = numPackets - (int64_t)w.dropped.size();
+    printf("[%s] %s\n", TEST_NAMES[test], in.toString().c_str());
+    if (received != wanted) {
+      printf("FAIL: [%s] Received %" PRId64 " of %" PRId64 " packets\n", TEST_NAMES[test],
+             received, wanted);
+      errors++;
+    }
+    bool resyncWanted = (test != LoopbackTest_Write);
+    if (resyncWanted != (in.getResyncCount() > 0)) {
+      printf("FAIL: [%s] Resync count %" PRId64 "\n", TEST_NAMES[test], in.getResyncCount());
+      errors++;
+    }
+  }
+  catch (VRTException e) {
+    printf("FAIL: [%s] %s\n", TEST_NAMES[test], e.toString().c_str());
+    errors++;
+  }
+  pthread_join(thread, NULL);
+
+  if (!w.error.empty()) {
+    printf("FAIL: [%s] Writer: %s\n", TEST_NAMES[test], w.error.c_str());
+    errors++;
+  }
+  printf("%s: [%s] %" PRId64 " packets\n", (errors == 0)? "PASS" : "FAIL", TEST_NAMES[test], received);
+  return errors;
+}
+
+int main (int argc, char **argv) {
+  int32_t numPackets = (argc > 1)? atoi(argv[1]) : 200000;
+  string  only       = (argc > 2)? argv[2] : "";
+  int32_t errors     = 0;
+
+  for (int32_t t = LoopbackTest_Append; t <= LoopbackTest_Partial; t++) {
+    if (!only.empty() && (only != TEST_NAMES[t])) continue;
+
+    int32_t e = runTest((LoopbackTest)t, numPackets);
+    if (e < 0) {
+      printf("SKIP: Unable to open loopback connection\n");
+      return 77;
+    }
+    errors += e;
+  }
+  return (errors == 0)? 0 : 1;
+}
@@ -24,6 +24,7 @@
 #include "BasicVRLFrame.h"
 #include "BasicVRTPacket.h"
 #include "PacketIterator.h"
+#include "VRAIndex.h"
 
 /** Indicator used with <tt>write(..)</tt> calls indicating the write should
  *  be made to the end-of-file.
@@ -51,6 +52,9 @@ namespace vrt {
    *  </pre>
    */
   class AbstractVRAFile : public VRTObject, public PacketContainer {
+    public: friend class PacketReadAhead;
+    public: friend class ParallelVRAScanner;
+
     /** The minimum file version supported by this version of the library.
      *  <pre>
      *    MIN_VERSION_SUPPORTED = 1
@@ -146,20 +150,30 @@ namespace vrt {
     /** This is the 4th recorded byte of the 32-bit FWA ({@link #VRA_FAW}). */
     public: static const char VRA_FAW_3 = 0x46;
 
+    /** The default read-ahead window size used by iterators (0, packets are read
+     *  individually unless read-ahead is turned on with {@link #setReadAhead}).
+     */
+    public: static const int32_t DEFAULT_READ_AHEAD = 0;
+
     private:   char     header[HEADER_LENGTH];        // A copy of the header
     private:   int32_t  hdrVersion;    // Local copy of file version (from header)
     private:   int64_t  hdrFileLength; // Local copy of file size    (from header)
     private:   int32_t  hdrCRC;        // Local copy of CRC          (from header)
+    private: mutable int32_t payloadCRC;    // Running CRC of the payload (see computeCRC())
+    private: mutable int64_t payloadCRCLen; // Payload octets included in payloadCRC (-1 if unknown)
     protected: string   uri;           // The URI for the file (null if n/a).
     protected: bool     isRead;        // Is the file being opened for reading?
     protected: bool     isWrite;       // Is the file being opened for writing?
     protected: bool     isSetSize;     // Should the size be set on write?
     protected: bool     isSetCRC;      // Should the CRC  be set on write?
     protected: bool     isStrict;      // Should strict packet checks be used on write?
+    private: mutable VRAIndex *index;  // The packet index (NULL if n/a)
+    private:   int32_t  readAhead;     // Read-ahead window for iterators (0=none)
+    private:   bool     prefetch;      // Use a prefetch thread with the read-ahead?
 
 
     /** Basic destructor for the class. */
-    public: ~AbstractVRAFile () { }
+    public: ~AbstractVRAFile ();
 
     /** Basic copy constructor for the class. */
     public: AbstractVRAFile (const AbstractVRAFile &f);
@@ -177,6 +191,14 @@ namespace vrt {
                                              bool _isSetSize, bool _isSetCRC,
                                              bool _isStrict);
 
+    /** <b>Internal Use Only:</b> Converts a local file name to a <tt>file:</tt> URI
+     *  suitable for passing to the constructor.
+     *  @param fname The file name.
+     *  @return The URI.
+     *  @throws VRTException If the file name is null or the path can not be resolved.
+     */
+    protected: static string toURI (string fname);
+
     /** Gets a free-form description of the file. Note that the content and structure of this
      *  string is implementation dependant and may change at any time.
      *  @return A free-form string describing the file.
@@ -245,7 +267,10 @@ namespace vrt {
     /** This will compute the CRC value for the file and set it in the CRC field. All successful
      *  calls to one of the set methods on this file will result in the CRC field being updated,
      *  but that usually means that the CRC was merely set to the special {@link BasicVRLFrame#NO_CRC}
-     *  value.
+     *  value. <br>
+     *  <br>
+     *  A running CRC of the payload is maintained as packets are added via {@link #append} so
+     *  this only needs to read the file the first time it is called on an existing file.
      */
     public: virtual void updateCRC ();
 
@@ -289,6 +314,28 @@ namespace vrt {
       return header;
     }
 
+    /** Sets the read-ahead used by iterators over this file. Rather than reading each
+     *  packet individually, iterators read the file in blocks of the given size and
+     *  parse the packets from memory (any partial packet at the end of a block is
+     *  carried over to the next). This applies to any iterator that has not yet read
+     *  from the file. <br>
+     *  <br>
+     *  If <tt>prefetch</tt> is set (and supported by the implementation, see
+     *  {@link #isReadConcurrent()}), each iterator also starts a background thread
+     *  that reads the next block while the current one is being processed. This
+     *  allows sequential scans to run at close to disk bandwidth.
+     *  @param windowSize The block size in octets (0 to read packets individually).
+     *  @param prefetch   Should a prefetch thread be used?
+     *  @throws VRTException If the window size is negative.
+     */
+    public: void setReadAhead (int32_t windowSize, bool prefetch=false);
+
+    /** Gets the read-ahead window size used by iterators (see {@link #setReadAhead}). */
+    public: inline int32_t getReadAhead () const { return readAhead; }
+
+    /** Is a prefetch thread used by iterators (see {@link #setReadAhead})? */
+    public: inline bool isPrefetch () const { return prefetch && isReadConcurrent(); }
+
     public: virtual ConstPacketIterator begin () const;
     public: virtual ConstPacketIterator end () const;
     public: virtual void                gotoNextPacket (ConstPacketIterator &pi) const;
@@ -301,6 +348,72 @@ namespace vrt {
      */
     public: virtual void append (BasicVRTPacket &p);
 
+    /** Appends a block of one or more packets, laid end-to-end, to the end of the file.
+     *  This is the same as calling {@link #append(BasicVRTPacket&)} for each packet, but
+     *  with a single write and without checking the validity of each packet (only that
+     *  the packet lengths exactly fill the block). It is intended for use by writers that
+     *  coalesce packets into large blocks (see {@link AsyncVRAWriter}).
+     *  @param ptr Pointer to the packets.
+     *  @param len The total length of the packets in octets.
+     *  @throws VRTException If the packet lengths are inconsistent with the block length
+     *                       or if the write fails.
+     */
+    public: void appendPackets (const void *ptr, int32_t len);
+
+    /** Sets the packet index for the file. The file takes ownership of the index and
+     *  will delete it when a new one is set or when the file is destroyed. The index is
+     *  brought up to date with the file (see {@link #updateIndex}) and is then updated by
+     *  every call to {@link #append}; when the file is closed the index is also closed.
+     *  To maintain a sidecar index while recording:
+     *  <pre>
+     *    BasicVRAFile file(fname, FileMode_Write);
+     *    VRAIndex    *idx = new VRAIndex(16);
+     *    idx-&gt;startWriting(VRAIndex::getIndexFileName(fname));
+     *    file.setIndex(idx);
+     *  </pre>
+     *  @param idx The index (NULL to remove the index).
+     *  @throws VRTException If the index can not be updated.
+     */
+    public: void setIndex (VRAIndex *idx);
+
+    /** Gets the packet index for the file.
+     *  @return The index, or NULL if none has been set or built by {@link #seek}.
+     */
+    public: inline VRAIndex* getIndex () const {
+      return index;
+    }
+
+    /** Scans the file for packets not yet covered by the given index and adds them to
+     *  it. For a new (empty) index this scans the entire file. Only the packet headers
+     *  are read.
+     *  @param idx The index to update.
+     *  @throws VRTException If an invalid packet is found.
+     */
+    public: void updateIndex (VRAIndex &idx) const;
+
+    /** Gets an iterator starting at the packets for the given time (see
+     *  {@link VRAIndex#seek(const TimeStamp&)}). If no index has been set, one is read
+     *  from the sidecar file (if present) and then brought up to date by scanning the
+     *  file; this index is then kept for subsequent calls.
+     *  @param ts The time stamp.
+     *  @return The iterator, or {@link #end()} if there are no packets with comparable
+     *          time stamps.
+     */
+    public: ConstPacketIterator seek (const TimeStamp &ts) const;
+
+    /** Gets an iterator starting at the packets on the given stream for the given
+     *  time (see {@link VRAIndex#seek(int32_t,const TimeStamp&)}). Note that packets on
+     *  other streams may be interleaved with those on the given stream. See
+     *  {@link #seek(const TimeStamp&)} for details on the index used.
+     *  @param streamID The stream identifier.
+     *  @param ts       The time stamp.
+     *  @return The iterator, or {@link #end()} if there are no applicable packets.
+     */
+    public: ConstPacketIterator seek (int32_t streamID, const TimeStamp &ts) const;
+
+    /** Gets the index to use with {@link #seek}, reading/building it if required. */
+    private: VRAIndex *getSeekIndex () const;
+
     /** Flushes this file by writing any buffered output to the underlying stream. If no "flushing"
      *  is required (e.g. for a read-only file), invoking this method has no effect.
      */
@@ -325,9 +438,20 @@ namespace vrt {
     /** The very basic frame validity checks. */
     private: bool isFileValid0 () const;
 
-    /** Computes the CRC for the frame, but does not insert it into the frame. */
+    /** Computes the CRC for the frame, but does not insert it into the frame. This uses the
+     *  running CRC of the payload when it covers the entire payload, otherwise the payload is
+     *  read in and the running CRC is reset to match. Implementations that write to the payload
+     *  other than through {@link #append} must call {@link #resetPayloadCRC} afterwards.
+     */
     private: int32_t computeCRC () const;
 
+    /** Discards the running CRC of the payload (see {@link #computeCRC}) so the next CRC
+     *  computation reads the payload from the file.
+     */
+    protected: inline void resetPayloadCRC () {
+      payloadCRCLen = -1;
+    }
+
     /** Sets the version, but does not write header to disk.
      *  @param ver The new version.
      *  @return true if header needs to be written to disk; false if no changes made.
@@ -398,6 +522,24 @@ namespace vrt {
      */
     protected: virtual int32_t read (int64_t off, void *ptr, int32_t len) const = 0;
 
+    /** Indicates if {@link #readConcurrent} is supported. The default implementation
+     *  returns false.
+     */
+    protected: virtual bool isReadConcurrent () const;
+
+    /** Reads from the file. This is the same as {@link #read}, except that it may be
+     *  called from a thread other than the one(s) using the file, concurrently with any
+     *  other reads or appends (e.g. using <tt>pread(..)</tt>). This is used by the
+     *  prefetch thread (see {@link #setReadAhead}). The default implementation throws
+     *  an exception.
+     *  @param off  File offset at which to begin reading.
+     *  @param ptr  Pointer to the buffer to hold the data read in.
+     *  @param len  The maximum number of octets to read.
+     *  @return The number of octets actually read in.
+     *  @throws VRTException If not supported or on error.
+     */
+    protected: virtual int32_t readConcurrent (int64_t off, void *ptr, int32_t len) const;
+
     /** Writes to the file.
      *  @param off  File offset at which to begin writing (EOF to write at end of file).
      *  @param ptr  Pointer to the buffer containing the data to write.
@@ -418,5 +560,70 @@ namespace vrt {
      */
     protected: virtual void write (int64_t off, void *ptr, int32_t len, bool flush) = 0;
   };
+
+  /** <b>Internal Use Only:</b> The read-ahead state used by a {@link ConstPacketIterator}
+   *  over an {@link AbstractVRAFile} (see {@link AbstractVRAFile#setReadAhead}).
+   */
+  class PacketReadAhead {
+    /** Space reserved at the start of each buffer for a partial packet carried over
+     *  from the previous block.
+     */
+    private: static const int32_t CARRY_OVER = BasicVRTPacket::MAX_PACKET_LENGTH;
+
+    private: const AbstractVRAFile *file;        // The file
+    private: int32_t                size;        // Block size
+    private: bool                   prefetch;    // Use a prefetch thread?
+    private: vector<char>           buf;         // The current window
+    private: int32_t                winBase;     // Index of window start in buf
+    private: int64_t                winOffset;   // File offset of window start
+    private: int32_t                winLength;   // Length of window
+    private: vector<char>           spare;       // Prefetch buffer (data at CARRY_OVER)
+    private: int64_t                spareOffset; // File offset of prefetched data
+    private: int32_t                spareLength; // Length of prefetched data
+    private: int64_t                reqOffset;   // Prefetch request offset
+    private: int32_t                reqLength;   // Prefetch request length
+    private: bool                   pending;     // Prefetch requested but not started?
+    private: bool                   busy;        // Prefetch in progress?
+    private: bool                   stopping;    // Shut down prefetch thread?
+    private: bool                   running;     // Is the prefetch thread running?
+    private: pthread_t              thread;      // The prefetch thread
+    private: pthread_mutex_t        lock;        // Lock for prefetch state
+    private: pthread_cond_t         cond;        // Signalled on prefetch state changes
+
+    /** Creates a new instance.
+     *  @param file     The file.
+     *  @param size     The block size.
+     *  @param prefetch Use a prefetch thread?
+     */
+    public: PacketReadAhead (const AbstractVRAFile *file, int32_t size, bool prefetch);
+
+    /** Basic destructor for the class, stops the prefetch thread (if applicable). */
+    public: ~PacketReadAhead ();
+
+    /** Gets a pointer to the given portion of the file.
+     *  @param off The file offset.
+     *  @param len The number of octets required.
+     *  @return Pointer to the data or NULL if the file does not contain that many
+     *          octets at the given offset. The pointer is valid until the next call.
+     *  @throws VRTException If there is an error reading from the file.
+     */
+    public: inline const char* get (int64_t off, int32_t len) {
+      if ((off >= winOffset) && (off + len <= winOffset + winLength)) {
+        return &buf[winBase + (int32_t)(off - winOffset)];
+      }
+      return refill(off, len);
+    }
+
+    /** Reads a new window to satisfy a call to {@link #get}. */
+    private: const char* refill (int64_t off, int32_t len);
+    private: void        startPrefetch (int64_t off, int64_t fileLength);
+    private: void        waitPrefetch ();
+    private: void        runPrefetch ();
+    private: static void *runPrefetch (void *arg);
+
+    // The prefetch thread is owned by this instance.
+    private: PacketReadAhead (const PacketReadAhead &r);
+    private: PacketReadAhead& operator= (const PacketReadAhead &r);
+  };
 } END_NAMESPACE
 #endif /* _AbstractVRAFile_h */
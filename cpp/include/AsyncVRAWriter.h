@@ -0,0 +1,198 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _AsyncVRAWriter_h
+#define _AsyncVRAWriter_h
+
+#include "VRTObject.h"
+#include "AbstractVRAFile.h"
+#include "BasicVRTPacket.h"
+#include <pthread.h>
+
+namespace vrt {
+  /** Writes packets to a VRA file from a dedicated writer thread. This keeps disk
+   *  latency (and the CRC computation) off of the thread receiving the packets. <br>
+   *  <br>
+   *  Packets are copied into large, page-aligned blocks. Once a block is full it
+   *  is handed to the writer thread, which appends it to the file with a single
+   *  write (see {@link AbstractVRAFile#appendPackets}) and then returns it to the
+   *  pool. With the default two blocks this is simple double-buffering; more blocks
+   *  can be used to ride out longer disk stalls. The hand-off is lock-free, the only
+   *  locking is on the (rare) occasions where one side needs to wait for the other.
+   *  <br>
+   *  <br>
+   *  If all of the blocks are waiting to be written, the {@link OverflowPolicy}
+   *  determines whether {@link #append} waits or drops the packet. <br>
+   *  <br>
+   *  The writer takes over the file until {@link #close()} is called; the file must
+   *  not be used by any other means until then. The <tt>append(..)</tt> and
+   *  {@link #flush()} functions must all be called from the same thread (a single
+   *  producer), the metrics functions may be called from any thread. Typical usage:
+   *  <pre>
+   *    BasicVRAFile   file(fname, FileMode_Write, true, true);
+   *    AsyncVRAWriter writer(file, 8*1024*1024, 4, OverflowPolicy_Drop);
+   *    while (running) {
+   *      writer.append(receivePacket());
+   *    }
+   *    writer.close();
+   *    file.close();
+   *  </pre>
+   */
+  class AsyncVRAWriter : public VRTObject {
+    /** The default block size (8 MiB). */
+    public: static const int32_t DEFAULT_BLOCK_SIZE = 8*1024*1024;
+
+    /** The alignment of the blocks in memory. */
+    public: static const int32_t BLOCK_ALIGNMENT = 4096;
+
+    private: AbstractVRAFile  *file;           // The file being written
+    private: int32_t           blockSize;      // Size of each block
+    private: int32_t           numBlocks;      // Number of blocks
+    private: OverflowPolicy    policy;         // What to do when all blocks are in use
+    private: char            **blocks;         // The blocks
+    private: int32_t          *blockLength;    // Octets used in each block
+    private: int32_t           current;        // Octets used in current block (producer only)
+    private: volatile int64_t  submitted;      // Number of blocks submitted (producer only)
+    private: volatile int64_t  completed;      // Number of blocks written (writer only)
+    private: volatile bool     stopping;       // Has close() been called?
+    private: volatile bool     failed;         // Has the writer thread failed?
+    private: string            error;          // The error from the writer thread
+    private: bool              running;        // Is the writer thread running?
+    private: pthread_t         thread;         // The writer thread
+    private: pthread_mutex_t   lock;           // Lock used when waiting
+    private: pthread_cond_t    notFull;        // Signalled when a block is written
+    private: pthread_cond_t    notEmpty;       // Signalled when a block is submitted
+    private: volatile int64_t  packetsQueued;  // Metrics (see get functions)
+    private: volatile int64_t  bytesQueued;
+    private: volatile int64_t  packetsDropped;
+    private: volatile int64_t  bytesDropped;
+    private: volatile int64_t  bytesWritten;
+    private: volatile int64_t  blockedCount;
+    private: volatile int32_t  maxQueueDepth;
+
+    /** Creates a new instance and starts the writer thread.
+     *  @param file      The file to write to, this must be open for writing and must
+     *                   remain valid until {@link #close()} is called.
+     *  @param blockSize The size of each block in octets (must be at least
+     *                   {@link BasicVRTPacket#MAX_PACKET_LENGTH}).
+     *  @param numBlocks The number of blocks (at least 2).
+     *  @param policy    What to do when all blocks are waiting to be written.
+     *  @throws VRTException If any of the parameters are invalid or the writer thread
+     *                       can not be started.
+     */
+    public: AsyncVRAWriter (AbstractVRAFile &file, int32_t blockSize=DEFAULT_BLOCK_SIZE,
+                            int32_t numBlocks=2, OverflowPolicy policy=OverflowPolicy_Block);
+
+    /** Basic destructor for the class. This calls {@link #close()}, any errors are
+     *  ignored.
+     */
+    public: ~AsyncVRAWriter ();
+
+    public: virtual string toString () const;
+
+    /** Queues a packet to be written. Only the packet header is checked here (see
+     *  {@link BasicVRTPacket#getPacketValid(bool)}), the CRC and all file I/O are done
+     *  on the writer thread.
+     *  @param p The packet.
+     *  @return true if queued, false if dropped (see {@link OverflowPolicy_Drop}).
+     *  @throws VRTException If the packet is invalid, the writer is closed or the writer
+     *                       thread has failed.
+     */
+    public: bool append (const BasicVRTPacket &p);
+
+    /** Queues a packet to be written. This is the same as {@link #append(const BasicVRTPacket&)}
+     *  except that no validity check (other than the packet length) is done.
+     *  @param ptr Pointer to the packet.
+     *  @param len The length of the packet in octets.
+     *  @return true if queued, false if dropped (see {@link OverflowPolicy_Drop}).
+     *  @throws VRTException If the packet length is invalid, the writer is closed or the
+     *                       writer thread has failed.
+     */
+    public: bool append (const void *ptr, int32_t len);
+
+    /** Hands any partially-filled block to the writer thread so that it will be written
+     *  without waiting for additional packets. This does not wait for the write to
+     *  complete.
+     *  @throws VRTException If the writer is closed or the writer thread has failed.
+     */
+    public: void flush ();
+
+    /** Writes any queued packets, stops the writer thread and updates the file header.
+     *  This does not close the file. Calling this a second time has no effect.
+     *  @throws VRTException If the writer thread failed.
+     */
+    public: void close ();
+
+    /** Gets the number of full blocks waiting to be written. */
+    public: inline int32_t getQueueDepth () const {
+      return (int32_t)(submitted - completed);
+    }
+
+    /** Gets the maximum value seen for {@link #getQueueDepth()}. */
+    public: inline int32_t getMaxQueueDepth () const { return maxQueueDepth; }
+
+    /** Gets the number of blocks. */
+    public: inline int32_t getNumBlocks () const { return numBlocks; }
+
+    /** Gets the size of each block in octets. */
+    public: inline int32_t getBlockSize () const { return blockSize; }
+
+    /** Gets the number of packets queued for writing. */
+    public: inline int64_t getPacketsQueued () const { return packetsQueued; }
+
+    /** Gets the number of octets queued for writing. */
+    public: inline int64_t getBytesQueued () const { return bytesQueued; }
+
+    /** Gets the number of octets written to the file so far. */
+    public: inline int64_t getBytesWritten () const { return bytesWritten; }
+
+    /** Gets the number of packets dropped (see {@link OverflowPolicy_Drop}). */
+    public: inline int64_t getPacketsDropped () const { return packetsDropped; }
+
+    /** Gets the number of octets dropped (see {@link OverflowPolicy_Drop}). */
+    public: inline int64_t getBytesDropped () const { return bytesDropped; }
+
+    /** Gets the number of times the producer had to wait for the writer thread
+     *  (see {@link OverflowPolicy_Block}).
+     */
+    public: inline int64_t getBlockedCount () const { return blockedCount; }
+
+    /** Submits the current block to the writer thread and moves to the next. */
+    private: void submit ();
+
+    /** Waits for the current block to be written so it can be reused. */
+    private: void waitForBlock ();
+
+    /** Checks that the writer is usable, throwing an exception if not. */
+    private: void checkState ();
+
+    /** The body of the writer thread. */
+    private: void runWriter ();
+
+    /** Entry point for the writer thread. */
+    private: static void *runWriter (void *arg);
+
+    // The blocks and writer thread are owned by this instance.
+    private: AsyncVRAWriter (const AsyncVRAWriter &w);
+    private: AsyncVRAWriter& operator= (const AsyncVRAWriter &w);
+  };
+} END_NAMESPACE
+#endif /* _AsyncVRAWriter_h */
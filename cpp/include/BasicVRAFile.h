@@ -98,6 +98,12 @@ namespace vrt {
     FileMode_WriteSynchData            = 0x12
   };
 
+  // FileMode bit fields (for testing the flags within a FileMode)
+# define FileMode_READ       0x01
+# define FileMode_WRITE      0x02
+# define FileMode_SYNCH_DATA 0x10
+# define FileMode_SYNCH_META 0x20
+
   /** Defines a VRA file type. The most frequently used implementations of interface
    *  this is {@link BasicVRAFile}. Most implementations that extend this class will
    *  only need to override the following methods:
@@ -139,6 +145,8 @@ namespace vrt {
     protected: virtual int64_t getFileLengthOS () const;
     protected: virtual int64_t getFileLengthRW () const;
     protected: virtual int32_t read (int64_t off, void *ptr, int32_t len) const;
+    protected: virtual bool    isReadConcurrent () const;
+    protected: virtual int32_t readConcurrent (int64_t off, void *ptr, int32_t len) const;
     protected: virtual void    write (int64_t off, void *ptr, int32_t len, bool flush);
   };
 } END_NAMESPACE
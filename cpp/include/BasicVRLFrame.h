@@ -28,11 +28,14 @@
 #include <vector>
 #include "BasicDataPacket.h"
 #include "BasicContextPacket.h"
+#include "VRTPacketView.h"
 
 
 using namespace std;
 
 namespace vrt {
+  class BasicVRLFrame_PacketIterator;
+
   /** Defines a VITA 49.1 VRL frame type. <br>
    *  <br>
    *  Note that the numeric representation (byte order) used by all VRL frames is
@@ -127,6 +130,8 @@ namespace vrt {
     public: vector<char> bbuf;
     // End TODO FIXME
     private: bool         readOnly;  // Is this instance read-only?
+    private: int32_t      payloadCRC;    // CRC of the packets in the frame (see updateCRC())
+    private: int32_t      payloadCRCLen; // Octets included in payloadCRC (-1 if unknown)
 
     /** Basic destructor for the class. */
     public: ~BasicVRLFrame ();
@@ -265,10 +270,24 @@ namespace vrt {
      *  and just wastes extra computational time on both the sender and receiver.
      *  As such, this method should only be called when absolutely necessary and
      *  such a call should usually be the responsibility of the frame sending
-     *  routines.
+     *  routines. <br>
+     *  <br>
+     *  The CRC of the packets is computed as they are copied in by
+     *  {@link #setVRTPackets} so this only needs to process the frame header.
+     *  Any code that modifies the packets in the frame through <tt>bbuf</tt>
+     *  directly (rather than via {@link #getFramePointer} or
+     *  {@link #getVRTPacketsRW}) must call {@link #resetPayloadCRC} first.
      */
     public: void updateCRC ();
 
+    /** <b>Internal Use Only:</b> Discards the CRC of the packets computed by
+     *  {@link #setVRTPackets} so the next call to {@link #updateCRC} reads the
+     *  entire frame.
+     */
+    public: inline void resetPayloadCRC () {
+      payloadCRCLen = -1;
+    }
+
     /** Clears the CRC by setting it to the NO_CRC value. */
     private: void clearCRC ();
 
@@ -329,6 +348,19 @@ namespace vrt {
      */
     public: vector<BasicVRTPacket*> getVRTPackets () const;
 
+    /** Gets an iterator over the packets contained in the VRL frame. Unlike
+     *  {@link #getVRTPackets()} this does not copy the packets; each one is
+     *  presented as a view into this frame's buffer (see
+     *  {@link BasicVRLFrame_PacketIterator}).
+     *  @throws VRTException If the first packet in the frame is invalid.
+     */
+    public: BasicVRLFrame_PacketIterator begin () const;
+
+    /** Gets an iterator pointing to one position past the last packet in the
+     *  frame. See {@link #begin()} for details.
+     */
+    public: BasicVRLFrame_PacketIterator end () const;
+
     /** <i>Optional functionality:</i> Sets all of the VRT packets contained in
      *  the VRL frame. Strictly based on the maximum size of a VRT packet and the
      *  maximum size of a VRL frame, a minimum of 15 packets can be included. In
@@ -540,36 +572,68 @@ namespace vrt {
     public: inline void swap (vector<char> *buffer) {
       if (readOnly) throw VRTException("Frame is read-only");
       bbuf.swap(*buffer);
+      resetPayloadCRC();
     }
   };
 
-//  /** tbd */
-//  class BasicVRLFrame_PacketIterator : public VRTObject, public iterator<input_iterator_tag,BasicVRTPacket> {
-//    private: BasicVRLFrame *frame;
-//    private: int32_t        start; // start of next packet (i.e. current offset)
-//    private: int32_t        end;   // end   of next packet (i.e. next    offset)
-//
-//    /** Default constructor. */
-//    public: BasicVRLFrame_PacketIterator ();
-//
-//    /** Copy constructor. */
-//    public: BasicVRLFrame_PacketIterator (BasicVRLFrame_PacketIterator &pi);
-//
-//    /** Internal Use Only */
-//    public: BasicVRLFrame_PacketIterator (BasicVRLFrame *frame, bool begin);
-//
-//    public: virtual string toString () const;
-//
-//    public: virtual bool equals (const VRTObject &pi) const;
-//
-//    /** Iterator ++ operator (prefix). */
-//    public: BasicVRLFrame_PacketIterator& operator++ ();
-//
-//    /** Iterator ++ operator (postfix). */
-//    public: BasicVRLFrame_PacketIterator operator++ (int i);
-//
-//    /** Iterator * operator. */
-//    public: BasicVRTPacket& operator* ();
-//  };
+  /** Forward iterator over the packets in a VRL frame. Each packet is presented
+   *  as a {@link VRTPacketView} referencing the frame's buffer, so iterating
+   *  over a frame does no copying and no heap allocation. The views (and the
+   *  iterator itself) are only valid until the frame is modified or destroyed.
+   *  <pre>
+   *    for (BasicVRLFrame_PacketIterator pi = frame.begin(); pi != frame.end(); ++pi) {
+   *      if (pi->isData()) handleData(pi->getStreamIdentifier(), pi->getPayloadPointer());
+   *    }
+   *  </pre>
+   *  The length of each packet is checked against the frame length before it
+   *  is presented; a malformed frame causes a <tt>VRTException</tt> to be thrown
+   *  when the offending packet is reached.
+   */
+  class BasicVRLFrame_PacketIterator : public VRTPacketViewIterator {
+    /** Creates a null iterator. */
+    public: BasicVRLFrame_PacketIterator () : VRTPacketViewIterator() { }
+
+    /** Basic copy constructor for the class. */
+    public: BasicVRLFrame_PacketIterator (const BasicVRLFrame_PacketIterator &pi) :
+      VRTPacketViewIterator(pi) { }
+
+    /** Creates an iterator over the packets in the given frame.
+     *  @param frame The frame.
+     *  @param begin Point to the first packet (true) or to one past the last (false)?
+     *  @throws VRTException If <tt>begin</tt> is true and the first packet is invalid.
+     */
+    public: BasicVRLFrame_PacketIterator (const BasicVRLFrame &frame, bool begin);
+
+    /** Creates an iterator over the packets in the VRL frame held in the given
+     *  buffer. This permits iterating over a frame as received (e.g. in a socket
+     *  buffer) without first copying it into a {@link BasicVRLFrame}.
+     *  @param ptr   The pointer to the start of the frame.
+     *  @param len   The number of octets available in the buffer.
+     *  @param begin Point to the first packet (true) or to one past the last (false)?
+     *  @throws VRTException If the buffer does not hold a complete VRL frame or if
+     *                       <tt>begin</tt> is true and the first packet is invalid.
+     */
+    public: BasicVRLFrame_PacketIterator (const void *ptr, int32_t len, bool begin);
+
+    /** Basic destructor for the class. */
+    public: ~BasicVRLFrame_PacketIterator () { }
+
+    /** Iterator ++ operator (prefix).
+     *  @throws VRTException If the next packet is invalid.
+     */
+    public: inline BasicVRLFrame_PacketIterator& operator++ () {
+      VRTPacketViewIterator::operator++();
+      return *this;
+    }
+
+    /** Iterator ++ operator (postfix).
+     *  @throws VRTException If the next packet is invalid.
+     */
+    public: inline BasicVRLFrame_PacketIterator operator++ (int) {
+      BasicVRLFrame_PacketIterator pi(*this);
+      VRTPacketViewIterator::operator++();
+      return pi;
+    }
+  };
 } END_NAMESPACE
 #endif /* BasicVRLFrame_h */
@@ -606,6 +606,12 @@ namespace vrt {
 
     /** <b>Internal Use Only:</b> Get VRT packet length using a buffer input. */
     public: inline static int32_t getPacketLength (const vector<char> &buf, int32_t off) {
+      return getPacketLength(&buf[0], off);
+    }
+
+    /** <b>Internal Use Only:</b> Get VRT packet length using a buffer input. */
+    public: inline static int32_t getPacketLength (const void *ptr, int32_t off) {
+      const char *buf = (const char*)ptr;
       return ((0xFF & ((int32_t)buf[off+2])) << 10) | ((0xFF & ((int32_t)buf[off+3])) << 2);
     }
 
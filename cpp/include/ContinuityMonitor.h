@@ -0,0 +1,184 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _ContinuityMonitor_h
+#define _ContinuityMonitor_h
+
+#include "VRTObject.h"
+#include "BasicVRTPacket.h"
+#include "PayloadFormat.h"
+#include "StreamTable.h"
+#include "VRTPacketView.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  struct ContinuityState;
+
+  /** The result of checking one packet with a {@link ContinuityMonitor}. */
+  enum ContinuityEvent {
+    /** The packet follows on from the previous one. */
+    ContinuityEvent_None       = 0,
+    /** The first packet seen on the stream (or of its type on the stream). */
+    ContinuityEvent_First      = 1,
+    /** One or more packets before this one are missing. */
+    ContinuityEvent_Lost       = 2,
+    /** The packet is a repeat of the previous one. */
+    ContinuityEvent_Duplicate  = 3,
+    /** The packet arrived after a packet that should have followed it. */
+    ContinuityEvent_Reordered  = 4,
+    /** The packet's time stamp is earlier than expected, but later than the previous
+     *  packet's (i.e. the data overlaps), usually the result of an incorrect sample
+     *  rate or payload format.
+     */
+    ContinuityEvent_Overlap    = 5,
+    /** The packet is too far out of sequence to classify, the stream has been
+     *  re-synchronized to it (e.g. after the source restarted).
+     */
+    ContinuityEvent_Resync     = 6
+  };
+
+  /** Continuity counters for one stream (or the total for all streams). */
+  typedef struct ContinuityStats {
+    int64_t streamID;     ///< Stream identifier (-1 for packets without one or for totals)
+    int64_t packets;      ///< Number of packets checked
+    int64_t lostPackets;  ///< Number of packets missing (less those that arrived late)
+    int64_t lostSamples;  ///< Number of samples missing, from the data packet time stamps
+    int64_t duplicates;   ///< Number of duplicate packets
+    int64_t reordered;    ///< Number of packets that arrived out of order
+    int64_t overlaps;     ///< Number of data packets that overlap the previous one
+    int64_t resyncs;      ///< Number of times the stream was re-synchronized
+  } ContinuityStats_t;
+
+  /** Monitors the continuity of each stream in a sequence of packets, detecting lost,
+   *  duplicated and reordered packets. <br>
+   *  <br>
+   *  Each packet's 4-bit packet count is compared with the one expected (each packet
+   *  type on a stream has its own count, as in VITA 49). On its own, the count can
+   *  not tell a packet 3 behind from one 13 ahead, so a forward step of up to 7 is
+   *  taken as loss, a step back of up to 7 as reordering and a repeat as duplication
+   *  (if the packet after one taken as reordered follows on from it, the stream is
+   *  re-synchronized instead). <br>
+   *  <br>
+   *  When the sample rate and payload format of a stream are known, the time stamp of
+   *  each data packet is also compared with the one expected from the previous packet
+   *  (its time stamp plus its duration, as {@link BasicDataPacket#getNextTimeStamp}).
+   *  A gap in time gives the number of samples lost and, from the packet size, the
+   *  approximate number of packets lost; this is then corrected to the nearest value
+   *  that agrees with the packet count, so losses of 16 or more packets are counted
+   *  correctly. A time stamp equal to the previous one is a duplicate, one earlier
+   *  than the previous one is reordering. <br>
+   *  <br>
+   *  The sample rate and payload format are taken from the (standard) context packets
+   *  on the stream (only re-read when a context packet is marked as a change, or when
+   *  they are not yet known), or can be given directly with {@link #setSampleRate}.
+   *  <br>
+   *  <br>
+   *  Only the packet headers are read (no packet objects are created for data
+   *  packets) and the per-stream state is found with a hash table, so the cost per
+   *  packet is constant. A packet that arrives late is not used to update the
+   *  expected values. Instances are not thread-safe. Typical usage:
+   *  <pre>
+   *    ContinuityMonitor monitor;
+   *    while (receiver.receive(100) >= 0) {
+   *      for (int32_t i = 0; i < receiver.getCount(); i++) {
+   *        monitor.check(receiver.getPacketPointer(i), receiver.getPacketLength(i));
+   *      }
+   *    }
+   *    ContinuityStats_t totals = monitor.getTotals();
+   *  </pre>
+   */
+  class ContinuityMonitor : public VRTObject {
+    /** The stream identifier used for packets without a stream identifier. */
+    public: static const int64_t NO_STREAM = __INT64_C(-1);
+
+    private: vector<ContinuityState*> states;      // State for each stream (in order first seen)
+    private: StreamTable              table;       // Index into states for each stream ID
+    private: int32_t                  lastIndex;   // Index of the last stream used (-1 if none)
+    private: int64_t                  invalid;     // Number of packets too short to check
+
+    /** Creates a new instance. */
+    public: ContinuityMonitor ();
+
+    /** Basic destructor for the class. */
+    public: ~ContinuityMonitor ();
+
+    public: virtual string toString () const;
+
+    /** Sets the sample rate and payload format for the data packets on a stream, these
+     *  are used until a context packet on the stream gives new values.
+     *  @param streamID The stream identifier.
+     *  @param sr       The sample rate in Hz (NaN to clear).
+     *  @param pf       The payload format of the data packets.
+     */
+    public: void setSampleRate (int64_t streamID, double sr, const PayloadFormat &pf);
+
+    /** Checks a packet.
+     *  @param ptr Pointer to the packet.
+     *  @param len The number of octets available (at least the packet length).
+     *  @return The classification of the packet.
+     */
+    public: ContinuityEvent check (const void *ptr, int32_t len);
+
+    /** Checks a packet. See {@link #check(const void*,int32_t)}. */
+    public: inline ContinuityEvent check (const VRTPacketView &p) {
+      return check(p.getPacketPointer(), p.getPacketLength());
+    }
+
+    /** Checks a packet. See {@link #check(const void*,int32_t)}. */
+    public: inline ContinuityEvent check (const BasicVRTPacket &p) {
+      return check(&p.bbuf[0], p.getPacketLength());
+    }
+
+    /** Gets the number of streams seen. */
+    public: inline int32_t getStreamCount () const { return (int32_t)states.size(); }
+
+    /** Gets the identifiers of all of the streams seen, in the order first seen. */
+    public: vector<int64_t> getStreamIDs () const;
+
+    /** Gets the counters for one stream (all zero if the stream has not been seen). */
+    public: ContinuityStats_t getStats (int64_t streamID) const;
+
+    /** Gets the counters summed over all of the streams. */
+    public: ContinuityStats_t getTotals () const;
+
+    /** Gets the number of packets too short to check. */
+    public: inline int64_t getInvalidCount () const { return invalid; }
+
+    /** Forgets all of the streams and resets all of the counters. */
+    public: void reset ();
+
+    /** Gets the state for a stream, adding it if not found. */
+    private: ContinuityState *getState (int64_t streamID);
+
+    /** Checks a data packet using its packet count and time stamp. */
+    private: ContinuityEvent checkData (ContinuityState *s, const VRTPacketView &p);
+
+    /** Reads the sample rate and payload format from a context packet. */
+    private: void readContext (ContinuityState *s, const VRTPacketView &p);
+
+    // The state is owned by this instance.
+    private: ContinuityMonitor (const ContinuityMonitor &m);
+    private: ContinuityMonitor& operator= (const ContinuityMonitor &m);
+  };
+} END_NAMESPACE
+#endif /* _ContinuityMonitor_h */
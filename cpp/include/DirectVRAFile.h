@@ -0,0 +1,172 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _DirectVRAFile_h
+#define _DirectVRAFile_h
+
+#include "BasicVRAFile.h"
+
+namespace vrt {
+  class DirectIOEngine;
+
+  /** The I/O submission mechanism used by a {@link DirectVRAFile}. */
+  enum DirectIOMode {
+    /** Use io_uring if available, otherwise use a thread pool. */
+    DirectIOMode_Auto       = 0,
+    /** Use io_uring (fail if not available). */
+    DirectIOMode_IOUring    = 1,
+    /** Use a pool of threads calling <tt>pwrite(..)</tt>. */
+    DirectIOMode_ThreadPool = 2
+  };
+
+  /** A VRA file intended for high-rate recording. Writes bypass the page cache
+   *  (<tt>O_DIRECT</tt>) and are submitted asynchronously, using io_uring where the
+   *  kernel supports it and a small pool of writer threads otherwise. <br>
+   *  <br>
+   *  Appended packets are copied into one of a set of aligned staging buffers; each
+   *  buffer is submitted as soon as it is full, so up to <tt>queueDepth</tt> writes
+   *  may be in progress while the next buffer is filled. The file header (including
+   *  the FileLength and CRC, when enabled) is maintained in memory exactly as it is
+   *  for {@link BasicVRAFile} and is written out by {@link #flush()} and
+   *  {@link #close()}. Note that, unlike {@link BasicVRAFile}, appending a packet
+   *  does not by itself make it visible to other readers of the file; call
+   *  {@link #flush()} to do so (or use one of the "Synch" file modes to do this
+   *  on every write, at considerable cost). <br>
+   *  <br>
+   *  If <tt>preallocate</tt> is given, disk space is reserved in chunks of that size
+   *  (via <tt>fallocate(..)</tt>) ahead of the writes to avoid fragmentation and
+   *  allocation stalls. The OS-level length of the file may then exceed the length
+   *  of the VRA content until the file is closed, so <tt>isSetSize</tt> should be
+   *  used if the file is to be read while it is being written. <br>
+   *  <br>
+   *  If the file system does not support <tt>O_DIRECT</tt> the file is opened with
+   *  normal buffered I/O (see {@link #isDirect()}). This class only supports
+   *  appending packets (random-access writes other than to the header are not
+   *  supported), reading is supported but requires any buffered data to be written
+   *  out first. Instances are not thread-safe.
+   */
+  class DirectVRAFile : public AbstractVRAFile {
+    /** The default staging buffer size (4 MiB). */
+    public: static const int32_t DEFAULT_BUFFER_SIZE = 4*1024*1024;
+
+    /** The alignment used for buffers, offsets and lengths with <tt>O_DIRECT</tt>. */
+    public: static const int32_t ALIGNMENT = 4096;
+
+    private: string           fname;           // The file name (not in URI form)
+    private: FileMode         mode;            // The underlying mode
+    private: DirectIOMode     ioMode;          // The requested I/O submission mode
+    private: int32_t          queueDepth;      // Max writes in progress
+    private: int32_t          bufferSize;      // Size of each staging buffer
+    private: int64_t          preallocate;     // Preallocation chunk size (0=none)
+    private: int              fd;              // Descriptor used for writing (-1 if closed)
+    private: int              rfd;             // Descriptor used for reading (-1 if closed)
+    private: bool             direct;          // Is O_DIRECT in use?
+    private: DirectIOEngine  *engine;          // The I/O submission engine
+    private: int32_t          numBuffers;      // Number of staging buffers
+    private: char           **buffers;         // The staging buffers (plus head block)
+    private: int32_t         *inFlight;        // Length being written from each buffer (0=idle)
+    private: int32_t          numInFlight;     // Number of buffers being written
+    private: int32_t          cur;             // The buffer being filled
+    private: int64_t          bufStart;        // File offset of the buffer being filled
+    private: int32_t          bufUsed;         // Octets used in the buffer being filled
+    private: int32_t          bufSynced;       // Octets of the buffer already written (aligned)
+    private: char            *headBlock;       // Copy of the first ALIGNMENT octets of the file
+    private: bool             headSaved;       // Is headBlock in use?
+    private: bool             headDirty;       // Has the header changed since last written?
+    private: int64_t          fileLength;      // Logical length of the file
+    private: int64_t          syncedLength;    // Length of the file as written to disk
+    private: int64_t          allocLength;     // Length preallocated
+
+    /** Basic destructor for the class. */
+    public: ~DirectVRAFile ();
+
+    /** Creates a new instance for a local file on disk.
+     *  @param fname       The file name.
+     *  @param fmode       The mode to use when opening the file (must include write
+     *                     access).
+     *  @param isSetSize   Should the size be set on write?
+     *  @param isSetCRC    Should the CRC  be set on write?
+     *  @param isStrict    Should strict packet checks be used on write?
+     *  @param queueDepth  The maximum number of writes in progress at any one time.
+     *  @param bufferSize  The size of each staging buffer (a multiple of {@link #ALIGNMENT}).
+     *  @param preallocate The size of the chunks in which to preallocate disk space
+     *                     (0 for none).
+     *  @param ioMode      The I/O submission mechanism to use.
+     *  @throws VRTException If any of the parameters are invalid or the file can not be
+     *                       opened.
+     */
+    public: DirectVRAFile (string fname, FileMode fmode, bool isSetSize=false,
+                           bool isSetCRC=false, bool isStrict=false, int32_t queueDepth=4,
+                           int32_t bufferSize=DEFAULT_BUFFER_SIZE, int64_t preallocate=0,
+                           DirectIOMode ioMode=DirectIOMode_Auto);
+
+    public: virtual string toString () const;
+
+    /** Is <tt>O_DIRECT</tt> in use? This will be false if the file system does not
+     *  support it.
+     */
+    public: inline bool isDirect () const { return direct; }
+
+    /** Gets the I/O submission mechanism in use. This will be one of
+     *  {@link DirectIOMode_IOUring} or {@link DirectIOMode_ThreadPool}.
+     */
+    public: DirectIOMode getIOMode () const;
+
+    /** Writes out all buffered data and updates the header on disk so that the content
+     *  is visible to other readers of the file (this is {@link AbstractVRAFile#flush()}
+     *  which would otherwise be hidden by <tt>flush(bool)</tt>).
+     */
+    public: inline void flush () {
+      flush(true);
+    }
+
+    protected: virtual void    open ();
+    public:    virtual void    close ();
+    protected: virtual void    flush (bool force);
+    protected: virtual int64_t getFileLengthOS () const;
+    protected: virtual int64_t getFileLengthRW () const;
+    protected: virtual int32_t read (int64_t off, void *ptr, int32_t len) const;
+    protected: virtual void    write (int64_t off, void *ptr, int32_t len, bool flush);
+
+    /** Submits a write from the given buffer (numBuffers for the head block). */
+    private: void submit (int32_t buf, char *ptr, int32_t len, int64_t off);
+
+    /** Waits for one write to complete. */
+    private: void waitOne ();
+
+    /** Submits the (full) current buffer and moves to the next. */
+    private: void nextBuffer ();
+
+    /** Writes out all buffered data and the header, waiting for completion. */
+    private: void drain ();
+
+    /** Reserves disk space up to (at least) the given length. */
+    private: void reserve (int64_t len);
+
+    /** Releases all resources (used by close and on error in open). */
+    private: void release ();
+
+    // The buffers, descriptors and engine are owned by this instance.
+    private: DirectVRAFile (const DirectVRAFile &f);
+    private: DirectVRAFile& operator= (const DirectVRAFile &f);
+  };
+} END_NAMESPACE
+#endif /* _DirectVRAFile_h */
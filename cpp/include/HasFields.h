@@ -103,15 +103,68 @@ namespace vrt {
       setField(id, &val);
     }
 
+    /** Gets the value of a field converted to the given type, based on the
+     *  field's id. This is a convenience function that avoids the need for the
+     *  caller to manage the memory referenced by the pointer returned from
+     *  {@link #getField}. Since the underlying {@link Value} instances are
+     *  recycled (see <tt>Value::operator new</tt>) repeated calls do not incur
+     *  any heap allocation when <tt>T</tt> is a numeric, <tt>bool</tt> or
+     *  <tt>boolNull</tt> type. <br>
+     *  <br>
+     *  <b>Note that <tt>T</tt> MUST be a by-value type (e.g. <tt>int32_t</tt>,
+     *  <tt>double</tt>, <tt>boolNull</tt>, <tt>string</tt>); pointer types
+     *  would reference memory that has already been released.</b>
+     *  @param id The field ID (on range <tt>[0,getFieldCount())</tt>).
+     *  @return The field value converted to the given type.
+     */
+    public: template <typename T> T getFieldAs (int32_t id) const {
+      Value *val = getField(id);
+      try {
+        T t = val->as<T>();
+        delete val;
+        return t;
+      }
+      catch (...) {
+        delete val;
+        throw;
+      }
+    }
+
     /** Gets the ID of the given field. There is a 1:1 mapping of field ID's and
      *  names such that for all <tt>n = [0,getFieldCount())</tt>,
-     *  <tt>n == getFieldID(getFieldName(n))</tt> is true.
+     *  <tt>n == getFieldID(getFieldName(n))</tt> is true. <br>
+     *  <br>
+     *  The lookup uses a hash index of the field names that is built once per
+     *  class (on first use) so subsequent lookups do not require any calls to
+     *  {@link #getFieldName} or any memory allocation. Classes where the field
+     *  names may vary from one instance to the next must override
+     *  {@link #hasFixedFieldNames} so the index is bypassed.
      *  @param name The field name.
      *  @return     The field ID (on range <tt>[0,getFieldCount())</tt>).
      *  @throws VRTException if the field name is invalid.
      */
     public: int32_t getFieldID (const string &name) const;
 
+    /** Gets the ID of the given field. This is identical to the version that
+     *  takes in a <tt>string</tt> except that it operates on a (not necessarily
+     *  null-terminated) character sequence so the caller can avoid creating a
+     *  temporary <tt>string</tt>.
+     *  @param name The field name.
+     *  @param len  The length of the field name in characters.
+     *  @return     The field ID (on range <tt>[0,getFieldCount())</tt>).
+     *  @throws VRTException if the field name is invalid.
+     */
+    public: int32_t getFieldID (const char *name, size_t len) const;
+
+    /** Indicates if the field names are fixed for all instances of a given
+     *  class (true) or if they may vary from one instance to the next (false).
+     *  When false, {@link #getFieldID} falls back to a linear search of the
+     *  names rather than using the per-class index. The default is true.
+     */
+    protected: virtual inline bool hasFixedFieldNames () const {
+      return true;
+    }
+
     /** Gets the value of a field, based on the field's name. This will accept
      *  array entries and sub-fields. Examples:
      *  <pre>
@@ -192,6 +245,17 @@ namespace vrt {
     public: inline void setFieldByName (const string &name, const Value &val) {
       setFieldByName(name, &val);
     }
+
+    /** <b>Internal Use Only:</b> Version of {@link #getFieldByName} that works on a
+     *  character sequence to avoid creating temporary strings for sub-fields.
+     */
+    protected: Value* getFieldByName (const char *name, size_t len) const
+                                            __attribute__((warn_unused_result));
+
+    /** <b>Internal Use Only:</b> Version of {@link #setFieldByName} that works on a
+     *  character sequence to avoid creating temporary strings for sub-fields.
+     */
+    protected: void setFieldByName (const char *name, size_t len, const Value* val);
   };
 
   /** Checks to see if a {@link HasFields} pointer is null. This is the same as
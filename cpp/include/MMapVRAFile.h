@@ -0,0 +1,123 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _MMapVRAFile_h
+#define _MMapVRAFile_h
+
+#include "AbstractVRAFile.h"
+#include "VRTPacketView.h"
+
+namespace vrt {
+  /** Access pattern hints for a memory-mapped file. These map directly on to the
+   *  <tt>madvise(..)</tt> advice values.
+   */
+  enum MMapAdvice {
+    /** No special treatment (<tt>MADV_NORMAL</tt>). */
+    MMapAdvice_Normal     = 0,
+    /** Expect sequential access, read ahead aggressively (<tt>MADV_SEQUENTIAL</tt>). */
+    MMapAdvice_Sequential = 1,
+    /** Expect random access, minimize read ahead (<tt>MADV_RANDOM</tt>). */
+    MMapAdvice_Random     = 2
+  };
+
+  /** A read-only VRA file accessed via <tt>mmap(..)</tt>. This avoids the per-packet
+   *  system calls and copies done by {@link BasicVRAFile} so that replaying a large
+   *  recording is limited by page-cache (or disk) bandwidth. <br>
+   *  <br>
+   *  In addition to the usual {@link ConstPacketIterator} (which returns copies of
+   *  the packets), {@link #beginViews()} and {@link #endViews()} provide zero-copy
+   *  iteration where each packet is presented as a {@link VRTPacketView} pointing
+   *  directly into the mapping:
+   *  <pre>
+   *    MMapVRAFile file("recording.vra");
+   *    for (VRTPacketViewIterator pi = file.beginViews(); pi != file.endViews(); ++pi) {
+   *      process(*pi);
+   *    }
+   *  </pre>
+   *  The views are only valid while the file remains open. Since the whole file is
+   *  mapped at once, files larger than the available address space (i.e. beyond a
+   *  few GiB on 32-bit systems) can not be opened.
+   */
+  class MMapVRAFile : public AbstractVRAFile {
+    private: string      fname;  // The file name (not in URI form)
+    private: int         fd;     // The underlying file descriptor (-1 if closed)
+    private: const char *map;    // The mapping (NULL if n/a)
+    private: int64_t     length; // The length of the file/mapping
+    private: MMapAdvice  advice; // The access pattern hint
+
+    /** Basic destructor for the class. */
+    public: ~MMapVRAFile ();
+
+    /** Creates a new instance for a local file on disk. The file is opened read-only.
+     *  @param fname  The file name.
+     *  @param advice The expected access pattern.
+     *  @throws VRTException If the file can not be opened or mapped.
+     */
+    public: MMapVRAFile (string fname, MMapAdvice advice=MMapAdvice_Sequential);
+
+    public: virtual void close ();
+
+    /** Gets the current access pattern hint. */
+    public: inline MMapAdvice getAdvice () const { return advice; }
+
+    /** Changes the access pattern hint (e.g. switching to random access after
+     *  building an index with a sequential pass).
+     *  @param advice The expected access pattern.
+     */
+    public: void setAdvice (MMapAdvice advice);
+
+    /** Gets a zero-copy iterator over the packets in the file.
+     *  @throws VRTException If the file is closed or the first packet is invalid.
+     */
+    public: VRTPacketViewIterator beginViews () const;
+
+    /** Gets an iterator pointing to one position past the end of the packets in
+     *  the file. See {@link #beginViews()}.
+     */
+    public: VRTPacketViewIterator endViews () const;
+
+    /** Gets a view of the packet at the given offset in the file (e.g. from an
+     *  index of packet offsets).
+     *  @param off The offset of the packet from the start of the file.
+     *  @return The view of the packet.
+     *  @throws VRTException If the offset is outside of the file or the packet there
+     *                       extends past the end of the file.
+     */
+    public: VRTPacketView getPacketView (int64_t off) const;
+
+    /** <b>Internal Use Only:</b> Gets a pointer to the start of the mapping. */
+    public: inline const void *getMapPointer () const { return map; }
+
+    protected: virtual void    open ();
+    protected: virtual void    flush (bool force);
+    protected: virtual int64_t getFileLengthOS () const;
+    protected: virtual int64_t getFileLengthRW () const;
+    protected: virtual int32_t read (int64_t off, void *ptr, int32_t len) const;
+    protected: virtual bool    isReadConcurrent () const;
+    protected: virtual int32_t readConcurrent (int64_t off, void *ptr, int32_t len) const;
+    protected: virtual void    write (int64_t off, void *ptr, int32_t len, bool flush);
+
+    // The mapping is owned by this instance.
+    private: MMapVRAFile (const MMapVRAFile &f);
+    private: MMapVRAFile& operator= (const MMapVRAFile &f);
+  };
+} END_NAMESPACE
+#endif /* _MMapVRAFile_h */
@@ -29,6 +29,7 @@
 
 namespace vrt {
   class PacketContainer;
+  class PacketReadAhead;
 
   /** Provides iteration capabilities over a given {@link PacketContainer}. The
    *  intent here is that the packet container will hold the underlying iteration
@@ -48,6 +49,7 @@ namespace vrt {
     private: int64_t                offset;    // The current offset.
     private: int64_t                length;    // Length of current packet (-1 if n/a)
     private: vector<char>           buf;       // Buffer used when reading the packet.
+    private: PacketReadAhead       *ahead;     // Read-ahead state (NULL if n/a, never copied)
 
     /** <b>Internal Use Only:</b> Creates a new instance.
      *  @param container The container.
@@ -60,7 +62,12 @@ namespace vrt {
     public: ConstPacketIterator (const ConstPacketIterator &pi);
 
     /** Basic destructor for the class. */
-    public: ~ConstPacketIterator () { }
+    public: ~ConstPacketIterator ();
+
+    /** Basic assignment operator for the class. Any read-ahead state is not copied
+     *  (it is rebuilt as required).
+     */
+    public: ConstPacketIterator& operator= (const ConstPacketIterator &pi);
 
     /** String describing the object. */
     public: virtual string toString () const;
@@ -85,7 +92,7 @@ namespace vrt {
     public: ConstPacketIterator operator++ (int); // postfix ++
 
     /** Moves to the next element. */
-    public: ConstPacketIterator operator++ (); // prefix ++
+    public: ConstPacketIterator& operator++ (); // prefix ++
 
     /** Gets the packet at the current offset. */
     public: BasicVRTPacket* operator* ();
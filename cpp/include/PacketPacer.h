@@ -0,0 +1,258 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _PacketPacer_h
+#define _PacketPacer_h
+
+#include "VRTObject.h"
+#include "BasicVRTPacket.h"
+#include "BasicDataPacket.h"
+#include "PayloadFormat.h"
+#include "TimeStamp.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Specifies how a {@link PacketPacer} maps packet time stamps to local time. */
+  enum PacingClock {
+    /** Relative: the first time-stamped packet is due at the start time and the rest
+     *  follow at the same spacing as their time stamps (scaled by the speed), using
+     *  <tt>CLOCK_MONOTONIC</tt>. Used for replay.
+     */
+    PacingClock_Monotonic = 0,
+    /** Absolute: each packet is due at the time given by its time stamp (plus a fixed
+     *  offset), using <tt>CLOCK_TAI</tt> so there are no leap-second jumps. This
+     *  requires the system TAI offset to be set (e.g. by NTP or PTP).
+     */
+    PacingClock_TAI = 1
+  };
+
+  /** Paces the output of VRT packets to the real-time rate implied by their time
+   *  stamps. <br>
+   *  <br>
+   *  Each packet is given a deadline (in nanoseconds on the pacing clock, see
+   *  {@link PacingClock}) from its time stamp. If a sample rate is set (see
+   *  {@link #setSampleRate}) the time stamp used for a data packet is the one given by
+   *  {@link BasicDataPacket#getNextTimeStamp}, i.e. the packet is released once its
+   *  last sample would have been taken, as a real-time source would; otherwise it is
+   *  the packet's own time stamp. A packet without an integer time stamp (e.g. a
+   *  context packet between data packets) shares the deadline of the packet before
+   *  it. <br>
+   *  <br>
+   *  Waits use a hybrid of sleeping and busy-waiting: the thread sleeps until shortly
+   *  before the deadline (the "spin time") and then polls the clock, which gives
+   *  accuracy in the microsecond range without consuming a CPU between packets that
+   *  are well spaced. Packets whose deadlines fall within a tolerance of the first are
+   *  released together, so they can be passed to the sender as one batch (see
+   *  {@link UDPPacketSender}). <br>
+   *  <br>
+   *  The error between each packet's deadline and its actual release time is recorded
+   *  in a histogram with power-of-two bins (see {@link #getHistogramCount}). Instances
+   *  are not thread-safe. Typical usage:
+   *  <pre>
+   *    PacketPacer pacer;
+   *    for (int32_t i = 0; i < n; ) {
+   *      int32_t count = pacer.waitForBatch(&packets[i], n - i);
+   *      sender.send(dest, &packets[i], count);
+   *      i += count;
+   *    }
+   *    cout << pacer.getHistogramString() << endl;
+   *  </pre>
+   */
+  class PacketPacer : public VRTObject {
+    /** The default spin time in nanoseconds (100 us). */
+    public: static const int64_t DEFAULT_SPIN_TIME = 100000;
+
+    /** The default batching tolerance in nanoseconds (50 us). */
+    public: static const int64_t DEFAULT_TOLERANCE = 50000;
+
+    /** The number of histogram bins. Bin <i>k</i> counts errors in the range
+     *  <tt>[2<sup>k-1</sup>, 2<sup>k</sup>)</tt> nanoseconds (bin 0 is exactly 0) and
+     *  the last bin counts everything larger.
+     */
+    public: static const int32_t NUM_BINS = 40;
+
+    private: PacingClock   clock;          // The clock used
+    private: double        speed;          // Replay speed (relative mode only)
+    private: int64_t       tolerance;      // Batching tolerance (ns)
+    private: int64_t       spinTime;       // Time to busy-wait before a deadline (ns)
+    private: int64_t       offset;         // Offset added to deadlines (absolute mode only)
+    private: int64_t       maxLag;         // Re-anchor if this late (relative mode, 0=never)
+    private: double        sampleRate;     // Sample rate (NaN if not set)
+    private: PayloadFormat payloadFormat;  // Payload format used with the sample rate
+    private: bool          anchored;       // Has the first time-stamped packet been seen?
+    private: int64_t       startTime;      // Requested start time (relative mode, <0=now)
+    private: int32_t       anchorEpoch;    // Integer mode of the first time stamp
+    private: uint32_t      anchorSeconds;  // Integer time of the first time stamp
+    private: uint64_t      anchorPicos;    // Fractional time of the first time stamp
+    private: int64_t       anchorClock;    // Clock time matching the first time stamp
+    private: bool          haveLast;       // Has a packet been released since the last reset?
+    private: int64_t       lastDeadline;   // Deadline of the last packet released
+    private: int64_t       packetsReleased; // Metrics (see get functions)
+    private: int64_t       batchesReleased;
+    private: int64_t       lateCount;
+    private: int64_t       maxLateness;
+    private: int64_t       reanchorCount;
+    private: double        errorSum;
+    private: int64_t       lateBins[NUM_BINS];
+    private: int64_t       earlyBins[NUM_BINS];
+
+    /** Creates a new instance.
+     *  @param clock     The clock (and mapping) used for deadlines.
+     *  @param speed     The replay speed relative to real time (e.g. 2.0 for twice as
+     *                   fast), used with {@link PacingClock_Monotonic} only.
+     *  @param tolerance The batching tolerance in nanoseconds, packets due up to this
+     *                   long after the first in a batch are released with it.
+     *  @param spinTime  How long before a deadline to stop sleeping and start
+     *                   busy-waiting, in nanoseconds (0 to never busy-wait).
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: PacketPacer (PacingClock clock=PacingClock_Monotonic, double speed=1.0,
+                         int64_t tolerance=DEFAULT_TOLERANCE, int64_t spinTime=DEFAULT_SPIN_TIME);
+
+    /** Basic destructor for the class. */
+    public: ~PacketPacer () { }
+
+    public: virtual string toString () const;
+
+    /** Sets the sample rate (and payload format) used to compute the time at which the
+     *  last sample in a data packet was taken (see {@link BasicDataPacket#getNextTimeStamp}).
+     *  This is also required for packets using {@link FractionalMode_SampleCount}. This
+     *  applies only to packets that are {@link BasicDataPacket} instances.
+     *  @param sr The sample rate in Hz (NaN to clear).
+     *  @param pf The payload format of the data packets.
+     */
+    public: void setSampleRate (double sr, const PayloadFormat &pf);
+
+    /** Sets the time at which the first time-stamped packet is due, for
+     *  {@link PacingClock_Monotonic}. By default it is due when it is first seen.
+     *  @param ns The time in nanoseconds on <tt>CLOCK_MONOTONIC</tt> (see {@link #now()}).
+     */
+    public: inline void setStartTime (int64_t ns) { startTime = ns; }
+
+    /** Sets the offset added to each deadline, for {@link PacingClock_TAI}. A positive
+     *  value delays the output, a negative value sends it ahead of time.
+     *  @param ns The offset in nanoseconds.
+     */
+    public: inline void setOffset (int64_t ns) { offset = ns; }
+
+    /** Sets the maximum lateness before the schedule is moved back, for
+     *  {@link PacingClock_Monotonic}. Without this, packets held up (e.g. by a slow
+     *  disk) are then sent as fast as possible until the output catches up; with it,
+     *  once a packet is more than this late the schedule is restarted from that
+     *  packet. This is counted by {@link #getReanchorCount()}.
+     *  @param ns The maximum lateness in nanoseconds (0 to never move the schedule).
+     */
+    public: inline void setMaxLag (int64_t ns) { maxLag = ns; }
+
+    /** Restarts the schedule, the next time-stamped packet will be due at the start
+     *  time (or immediately). This does not reset the statistics.
+     */
+    public: void reset ();
+
+    /** Gets the current time on the pacing clock in nanoseconds. */
+    public: int64_t now () const;
+
+    /** Gets the deadline for a packet. This does not wait or change the schedule,
+     *  except that the first time-stamped packet seen sets the start of a relative
+     *  schedule.
+     *  @param p The packet.
+     *  @return The deadline in nanoseconds on the pacing clock.
+     *  @throws VRTException If the time stamp can not be converted for the clock in use.
+     */
+    public: int64_t getDeadline (const BasicVRTPacket &p);
+
+    /** Gets the deadline for a time stamp. See {@link #getDeadline(const BasicVRTPacket&)}.
+     *  @param ts The time stamp (null to use the deadline of the last packet released).
+     *  @return The deadline in nanoseconds on the pacing clock.
+     */
+    public: int64_t getDeadline (const TimeStamp &ts);
+
+    /** Waits until the given deadline, using the hybrid sleep and busy-wait.
+     *  @param deadline The deadline in nanoseconds on the pacing clock.
+     *  @return The time (on the pacing clock) the wait ended.
+     */
+    public: int64_t waitUntil (int64_t deadline);
+
+    /** Waits until the first packet is due and then gets the number of packets
+     *  (starting with the first) that are due within the tolerance, these should all be
+     *  sent immediately. The timing error for each packet released is recorded.
+     *  @param packets The packets (in time order).
+     *  @param n       The number of packets (must be at least 1).
+     *  @return The number of packets to send now (1 to n).
+     *  @throws VRTException If <tt>n</tt> is less than 1 or a time stamp can not be
+     *                       converted for the clock in use.
+     */
+    public: int32_t waitForBatch (const BasicVRTPacket *const *packets, int32_t n);
+
+    /** Waits for the next batch. See {@link #waitForBatch(const BasicVRTPacket*const*,int32_t)}. */
+    public: inline int32_t waitForBatch (const vector<BasicVRTPacket*> &packets, size_t off=0) {
+      return waitForBatch(&packets[off], (int32_t)(packets.size() - off));
+    }
+
+    /** Gets the number of packets released. */
+    public: inline int64_t getPacketsReleased () const { return packetsReleased; }
+
+    /** Gets the number of batches released. */
+    public: inline int64_t getBatchesReleased () const { return batchesReleased; }
+
+    /** Gets the number of packets released more than the tolerance after their
+     *  deadline.
+     */
+    public: inline int64_t getLateCount () const { return lateCount; }
+
+    /** Gets the largest lateness seen, in nanoseconds. */
+    public: inline int64_t getMaxLateness () const { return maxLateness; }
+
+    /** Gets the mean timing error (release time minus deadline) in nanoseconds. */
+    public: inline double getMeanError () const {
+      return (packetsReleased == 0)? 0.0 : errorSum / packetsReleased;
+    }
+
+    /** Gets the number of times the schedule was moved (see {@link #setMaxLag}). */
+    public: inline int64_t getReanchorCount () const { return reanchorCount; }
+
+    /** Gets the count in a histogram bin.
+     *  @param bin   The bin number (0 to {@link #NUM_BINS}-1).
+     *  @param early Get the count of packets released early (within a batch) rather
+     *               than late?
+     *  @return The count (0 if the bin number is invalid).
+     */
+    public: inline int64_t getHistogramCount (int32_t bin, bool early=false) const {
+      if ((bin < 0) || (bin >= NUM_BINS)) return 0;
+      return (early)? earlyBins[bin] : lateBins[bin];
+    }
+
+    /** Gets a printable version of the timing-error histogram (non-empty bins only). */
+    public: string getHistogramString () const;
+
+    /** Resets all of the statistics. */
+    public: void resetStatistics ();
+
+    /** Gets the time stamp used for pacing a packet (null if it has none). */
+    private: TimeStamp getPacingTime (const BasicVRTPacket &p) const;
+
+    /** Records the timing error for one packet. */
+    private: void record (int64_t error);
+  };
+} END_NAMESPACE
+#endif /* _PacketPacer_h */
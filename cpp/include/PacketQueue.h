@@ -0,0 +1,282 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _PacketQueue_h
+#define _PacketQueue_h
+
+#include "VRTObject.h"
+#include "BasicVRTPacket.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  struct PacketQueueSlot;
+
+  /** A bounded queue of packet pointers for passing packets between the threads of a
+   *  processing pipeline (e.g. receive, decode, process, record) without locks. <br>
+   *  <br>
+   *  Any number of threads may add and remove packets at the same time. The queue is
+   *  an array of slots, each on its own cache line and holding a sequence number that
+   *  says whether it is ready to be written or read on the current pass round the
+   *  array; a thread claims a position with a single compare-and-swap on the shared
+   *  write (or read) position and then uses the slot without further synchronization.
+   *  The batch forms claim several consecutive positions with one compare-and-swap. <br>
+   *  <br>
+   *  The <tt>offer(..)</tt> and <tt>poll(..)</tt> functions never wait. The
+   *  <tt>put(..)</tt> and <tt>take(..)</tt> functions wait for space (or packets),
+   *  spinning briefly and then sleeping on a futex; the cost of the wake-up is only paid
+   *  when a thread is known to be waiting. {@link #close()} wakes any waiting threads
+   *  so a pipeline can be shut down cleanly. <br>
+   *  <br>
+   *  The queue only passes the pointers, ownership of the packets goes with them.
+   *  Typical usage:
+   *  <pre>
+   *    PacketQueue queue(4096);
+   *
+   *    // Receive thread                     // Process thread
+   *    queue.put(packets, n);                 n = queue.take(packets, 64);
+   *  </pre>
+   */
+  class PacketQueue : public VRTObject {
+    /** The number of times a waiting function checks the queue before sleeping. */
+    public: static const int32_t SPIN_COUNT = 100;
+
+    private: PacketQueueSlot   *slots;         // The slots (cache-line aligned)
+    private: uint64_t           mask;          // Capacity less one (capacity is a power of two)
+    private: volatile bool      closed;        // Has close() been called?
+    private: char               pad0[64];      // Keeps the positions on separate cache lines
+    private: volatile uint64_t  writePos;      // Next position to write
+    private: char               pad1[64];
+    private: volatile uint64_t  readPos;       // Next position to read
+    private: char               pad2[64];
+    private: volatile uint32_t  notEmpty;      // Futex incremented when packets are added
+    private: volatile uint32_t  emptyWaiters;  // Number of threads waiting on notEmpty
+    private: volatile uint32_t  notFull;       // Futex incremented when packets are removed
+    private: volatile uint32_t  fullWaiters;   // Number of threads waiting on notFull
+    private: char               pad3[64];
+
+    /** Creates a new instance.
+     *  @param capacity The maximum number of packets held, this is rounded up to a power
+     *                  of two.
+     *  @throws VRTException If the capacity is invalid.
+     */
+    public: PacketQueue (int32_t capacity);
+
+    /** Basic destructor for the class. Any packets still in the queue are <b>not</b>
+     *  deleted.
+     */
+    public: ~PacketQueue ();
+
+    public: virtual string toString () const;
+
+    /** Gets the capacity of the queue. */
+    public: inline int32_t getCapacity () const { return (int32_t)(mask + 1); }
+
+    /** Gets the number of packets in the queue. Since other threads may be changing
+     *  the queue this is only a snapshot.
+     */
+    public: int32_t getSize () const;
+
+    /** Is the queue empty? See {@link #getSize()}. */
+    public: inline bool isEmpty () const { return (getSize() == 0); }
+
+    /** Closes the queue. Threads waiting to add packets return without adding them and
+     *  threads waiting for packets return once the queue is empty; packets already in
+     *  the queue can still be removed.
+     */
+    public: void close ();
+
+    /** Has the queue been closed? */
+    public: inline bool isClosed () const { return closed; }
+
+    /** Adds a packet if there is space.
+     *  @param p The packet.
+     *  @return true if added, false if the queue is full or closed.
+     */
+    public: bool offer (BasicVRTPacket *p);
+
+    /** Adds as many of the packets as there is space for, in order.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     *  @return The number of packets added (0 if the queue is closed).
+     */
+    public: int32_t offer (BasicVRTPacket *const *packets, int32_t n);
+
+    /** Removes a packet if there is one.
+     *  @return The packet or NULL if the queue is empty.
+     */
+    public: BasicVRTPacket *poll ();
+
+    /** Removes up to the given number of packets.
+     *  @param packets The array to hold the packets.
+     *  @param max     The maximum number of packets to remove.
+     *  @return The number of packets removed.
+     */
+    public: int32_t poll (BasicVRTPacket **packets, int32_t max);
+
+    /** Adds a packet, waiting for space if the queue is full.
+     *  @param p       The packet.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever).
+     *  @return true if added, false on timeout or if the queue is closed.
+     */
+    public: bool put (BasicVRTPacket *p, int32_t timeout=-1);
+
+    /** Adds all of the packets, waiting for space as required.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever).
+     *  @return The number of packets added (less than n on timeout or if the queue is
+     *          closed).
+     */
+    public: int32_t put (BasicVRTPacket *const *packets, int32_t n, int32_t timeout=-1);
+
+    /** Adds all of the packets. See {@link #put(BasicVRTPacket*const*,int32_t,int32_t)}. */
+    public: inline int32_t put (const vector<BasicVRTPacket*> &packets, int32_t timeout=-1) {
+      if (packets.empty()) return 0;
+      return put(&packets[0], (int32_t)packets.size(), timeout);
+    }
+
+    /** Removes a packet, waiting for one if the queue is empty.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever).
+     *  @return The packet, or NULL on timeout or if the queue is closed and empty.
+     */
+    public: BasicVRTPacket *take (int32_t timeout=-1);
+
+    /** Removes up to the given number of packets, waiting for at least one if the queue
+     *  is empty.
+     *  @param packets The array to hold the packets.
+     *  @param max     The maximum number of packets to remove.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever).
+     *  @return The number of packets removed, 0 on timeout or if the queue is closed and
+     *          empty.
+     */
+    public: int32_t take (BasicVRTPacket **packets, int32_t max, int32_t timeout=-1);
+
+    /** Wakes threads waiting for packets after packets have been added. */
+    private: void signalNotEmpty (int32_t count);
+
+    /** Wakes threads waiting for space after packets have been removed. */
+    private: void signalNotFull (int32_t count);
+
+    /** Waits until woken or the deadline passes, returns false if the deadline passed.
+     *  The 'ready' check is repeated once registered as a waiter to avoid a lost wake-up.
+     */
+    private: bool waitFor (bool forSpace, int64_t deadline);
+
+    // The slots are owned by this instance.
+    private: PacketQueue (const PacketQueue &q);
+    private: PacketQueue& operator= (const PacketQueue &q);
+  };
+
+  /** A pool of reusable packets, so a pipeline can run without allocating a new packet
+   *  (and buffer) for every packet received. <br>
+   *  <br>
+   *  The free packets are held in a {@link PacketQueue}, so packets can be taken from
+   *  the pool by one thread and released back to it by another (typically the last
+   *  stage of the pipeline) without locks. If the pool is empty a new packet is
+   *  created; if the pool is full when a packet is released that packet is deleted.
+   *  A released packet is returned as-is; the user is expected to overwrite its
+   *  content. <br>
+   *  <br>
+   *  By default the pool holds {@link BasicVRTPacket} instances with a buffer of the
+   *  given size; subclasses can override {@link #createPacket()} to create some other
+   *  type of packet (call {@link #reserve} from the subclass's constructor to create the
+   *  packets up front).
+   */
+  class PacketPool : public VRTObject {
+    private: PacketQueue     freeList;       // The free packets
+    private: int32_t         bufferSize;     // Buffer size for new packets
+    private: volatile int64_t createdCount;  // Metrics (see get functions)
+    private: volatile int64_t deletedCount;
+
+    /** Creates a new instance, the pool is initially empty.
+     *  @param capacity   The maximum number of free packets held (rounded up to a power
+     *                    of two).
+     *  @param bufferSize The buffer size for each new packet (up to
+     *                    {@link BasicVRTPacket#MAX_PACKET_LENGTH}).
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: PacketPool (int32_t capacity, int32_t bufferSize);
+
+    /** Basic destructor for the class. This deletes all of the free packets, packets
+     *  that are in use are not affected.
+     */
+    public: virtual ~PacketPool ();
+
+    public: virtual string toString () const;
+
+    /** Creates packets until the pool holds the given number of free packets (or is
+     *  full).
+     *  @param count The number of free packets.
+     */
+    public: void reserve (int32_t count);
+
+    /** Gets a packet from the pool (creating a new one if the pool is empty). */
+    public: inline BasicVRTPacket *get () {
+      BasicVRTPacket *p = freeList.poll();
+      return (p != NULL)? p : newPacket();
+    }
+
+    /** Gets up to the given number of packets from the pool, creating new ones if the
+     *  pool is empty.
+     *  @param packets The array to hold the packets.
+     *  @param n       The number of packets.
+     */
+    public: void get (BasicVRTPacket **packets, int32_t n);
+
+    /** Returns a packet to the pool (deleting it if the pool is full). */
+    public: inline void release (BasicVRTPacket *p) {
+      if (!freeList.offer(p)) deletePacket(p);
+    }
+
+    /** Returns packets to the pool (deleting any that do not fit). */
+    public: void release (BasicVRTPacket *const *packets, int32_t n);
+
+    /** Gets the number of free packets in the pool. */
+    public: inline int32_t getAvailable () const { return freeList.getSize(); }
+
+    /** Gets the buffer size used for new packets. */
+    public: inline int32_t getBufferSize () const { return bufferSize; }
+
+    /** Gets the number of packets created by the pool. */
+    public: inline int64_t getCreatedCount () const { return createdCount; }
+
+    /** Gets the number of packets deleted because the pool was full. */
+    public: inline int64_t getDeletedCount () const { return deletedCount; }
+
+    /** Creates a new packet for the pool. The default creates a {@link BasicVRTPacket}
+     *  with a buffer of {@link #getBufferSize()} octets.
+     */
+    protected: virtual BasicVRTPacket *createPacket () const;
+
+    /** Creates a new packet and counts it. */
+    private: BasicVRTPacket *newPacket ();
+
+    /** Deletes a packet and counts it. */
+    private: void deletePacket (BasicVRTPacket *p);
+
+    // The free packets are owned by this instance.
+    private: PacketPool (const PacketPool &p);
+    private: PacketPool& operator= (const PacketPool &p);
+  };
+} END_NAMESPACE
+#endif /* _PacketQueue_h */
@@ -0,0 +1,276 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _Packetizer_h
+#define _Packetizer_h
+
+#include "VRTObject.h"
+#include "BasicContextPacket.h"
+#include "BasicDataPacket.h"
+#include "PayloadFormat.h"
+#include "TimeStamp.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Turns a continuous stream of samples into data packets (and the paired context
+   *  packets). <br>
+   *  <br>
+   *  Samples are written in blocks of any size and of any of the types supported by
+   *  {@link PackUnpack} (see the <tt>write*(..)</tt> functions); they are converted
+   *  to the payload format and split into data packets of a fixed number of samples,
+   *  with any remainder held until the next block. Each packet's time stamp is
+   *  computed from the start time and the total number of samples before it, so time
+   *  stamps advance by exact sample counts with no accumulated rounding error; the
+   *  packet count rolls over modulo 16. <br>
+   *  <br>
+   *  The data packets are copied from a template (see {@link #getDataTemplate()}),
+   *  which gives the class identifier and trailer flags (e.g.
+   *  {@link BasicDataPacket#setCalibratedTimeStamp}); changes to the template apply to
+   *  the next packet. A context packet, copied from its own template (see
+   *  {@link #getContextTemplate()}) which has the sample rate and data payload format
+   *  filled in, is sent before the first data packet, before the next data packet
+   *  after {@link #setContextChanged()} is called (with the change indicator set),
+   *  and every <i>N</i> data packets if an interval is set. It has the same stream
+   *  identifier and time stamp as the data packet that follows. <br>
+   *  <br>
+   *  The packets produced are held in a batch (see {@link #getPackets()}) until
+   *  {@link #clear()} is called, after which the packet objects (and buffers) are
+   *  reused, so once the batch size settles there is no allocation per packet.
+   *  Instances are not thread-safe. Typical usage:
+   *  <pre>
+   *    Packetizer packetizer(0x100, PayloadFormat_INT16, 1e6, 2048,
+   *                          TimeStamp::getSystemTime());
+   *    packetizer.setContextInterval(100);
+   *    while (running) {
+   *      int32_t n = source.read(samples, 10000);
+   *      packetizer.writeShort(samples, n);
+   *      sender.send(dest, packetizer.getPackets());
+   *      packetizer.clear();
+   *    }
+   *  </pre>
+   */
+  class Packetizer : public VRTObject {
+    private: PayloadFormat               payloadFormat;   // Payload format of the data packets
+    private: double                      sampleRate;      // Sample rate in Hz
+    private: int32_t                     samplesPerPacket;// Number of samples in each data packet
+    private: int32_t                     complexMult;     // 2 for complex data, 1 otherwise
+    private: TimeStamp                   startTime;       // Time of the sample at index 0 (null if none)
+    private: int64_t                     sampleIndex;     // Index of the next sample to be packetized (from startTime)
+    private: int32_t                     dataCount;       // Packet count for the next data packet
+    private: int32_t                     contextCount;    // Packet count for the next context packet
+    private: int32_t                     contextInterval; // Data packets between context packets (0=never)
+    private: int32_t                     sinceContext;    // Data packets since the last context packet
+    private: bool                        contextChanged;  // Send a context packet (as a change)?
+    private: bool                        contextSent;     // Has a context packet been sent?
+    private: BasicDataPacket             dataTemplate;    // Template for the data packets
+    private: BasicContextPacket          contextTemplate; // Template for the context packets
+    private: vector<char>                residual;        // Values held over (in the input type)
+    private: int32_t                     residualType;    // Input type of the values held over
+    private: int32_t                     residualCount;   // Number of values held over (scalars)
+    private: vector<BasicDataPacket*>    dataPackets;     // Reusable data packets
+    private: vector<BasicContextPacket*> contextPackets;  // Reusable context packets
+    private: size_t                      dataUsed;        // Number of data packets in the batch
+    private: size_t                      contextUsed;     // Number of context packets in the batch
+    private: vector<BasicVRTPacket*>     packets;         // The batch (in order)
+    private: int64_t                     dataPacketsSent; // Metrics (see get functions)
+    private: int64_t                     contextPacketsSent;
+    private: int64_t                     samplesSent;
+
+    /** Creates a new instance.
+     *  @param streamID         The stream identifier for the data and context packets.
+     *  @param pf               The payload format of the data packets.
+     *  @param sampleRate       The sample rate in Hz.
+     *  @param samplesPerPacket The number of samples in each data packet (for complex
+     *                          data, a sample is a real/imaginary pair), see
+     *                          {@link #getSamplesPerPacket}.
+     *  @param startTime        The time of the first sample (UTC or GPS, with a real-time,
+     *                          sample-count or no fractional part), or null for packets
+     *                          without time stamps.
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: Packetizer (int32_t streamID, const PayloadFormat &pf, double sampleRate,
+                        int32_t samplesPerPacket, const TimeStamp &startTime);
+
+    /** Basic destructor for the class. */
+    public: ~Packetizer ();
+
+    public: virtual string toString () const;
+
+    /** Gets the largest number of samples that fit in a payload of the given length,
+     *  keeping the payload a whole number of 32-bit words.
+     *  @param pf            The payload format.
+     *  @param payloadLength The maximum payload length in octets (e.g. the target packet
+     *                       length less the header and trailer).
+     *  @return The number of samples (0 if not even one fits).
+     */
+    public: static int32_t getSamplesPerPacket (const PayloadFormat &pf, int32_t payloadLength);
+
+    /** Gets the template for the data packets, changes to this (e.g. to the trailer
+     *  flags) apply from the next data packet. The stream identifier, packet count,
+     *  time stamp and payload are set for each packet.
+     */
+    public: inline BasicDataPacket &getDataTemplate () { return dataTemplate; }
+
+    /** Gets the template for the context packets. Call {@link #setContextChanged()}
+     *  once finished changing it so the change is sent.
+     */
+    public: inline BasicContextPacket &getContextTemplate () { return contextTemplate; }
+
+    /** Sends a context packet (marked as a change) before the next data packet. */
+    public: inline void setContextChanged () { contextChanged = true; }
+
+    /** Sets the number of data packets between context packets (0 to only send a context
+     *  packet at the start and when changed).
+     */
+    public: void setContextInterval (int32_t packets);
+
+    /** Changes the sample rate. Any samples held over are sent in a short packet first,
+     *  time stamps then continue from the end of that packet at the new rate, and a
+     *  context packet with the new rate is sent.
+     *  @param sr The new sample rate in Hz.
+     *  @throws VRTException If the sample rate is invalid.
+     */
+    public: void setSampleRate (double sr);
+
+    /** Gets the sample rate in Hz. */
+    public: inline double getSampleRate () const { return sampleRate; }
+
+    /** Gets the payload format of the data packets. */
+    public: inline PayloadFormat getPayloadFormat () const { return payloadFormat; }
+
+    /** Gets the number of samples in each data packet. */
+    public: inline int32_t getSamplesPerPacket () const { return samplesPerPacket; }
+
+    /** Gets the time stamp for the next data packet, i.e. the time of the first sample
+     *  held over, if any (null if the packets have no time stamps).
+     */
+    public: TimeStamp getNextTimeStamp () const;
+
+    /** Writes samples from a double array.
+     *  @param array The values (real/imaginary pairs for complex data).
+     *  @param len   The number of scalar values.
+     *  @return The number of packets added to the batch.
+     */
+    public: inline int32_t writeDouble (const double *array, int32_t len) {
+      return write(TYPE_DOUBLE, array, len);
+    }
+
+    /** Writes samples from a float array. See {@link #writeDouble}. */
+    public: inline int32_t writeFloat (const float *array, int32_t len) {
+      return write(TYPE_FLOAT, array, len);
+    }
+
+    /** Writes samples from a 64-bit integer array. See {@link #writeDouble}. */
+    public: inline int32_t writeLong (const int64_t *array, int32_t len) {
+      return write(TYPE_LONG, array, len);
+    }
+
+    /** Writes samples from a 32-bit integer array. See {@link #writeDouble}. */
+    public: inline int32_t writeInt (const int32_t *array, int32_t len) {
+      return write(TYPE_INT, array, len);
+    }
+
+    /** Writes samples from a 16-bit integer array. See {@link #writeDouble}. */
+    public: inline int32_t writeShort (const int16_t *array, int32_t len) {
+      return write(TYPE_SHORT, array, len);
+    }
+
+    /** Writes samples from an 8-bit integer array. See {@link #writeDouble}. */
+    public: inline int32_t writeByte (const int8_t *array, int32_t len) {
+      return write(TYPE_BYTE, array, len);
+    }
+
+    /** Writes samples from a double vector. See {@link #writeDouble}. */
+    public: inline int32_t writeDouble (const vector<double>  &array) { return writeDouble(&array[0], (int32_t)array.size()); }
+
+    /** Writes samples from a float vector. See {@link #writeDouble}. */
+    public: inline int32_t writeFloat  (const vector<float>   &array) { return writeFloat( &array[0], (int32_t)array.size()); }
+
+    /** Writes samples from a 64-bit integer vector. See {@link #writeDouble}. */
+    public: inline int32_t writeLong   (const vector<int64_t> &array) { return writeLong(  &array[0], (int32_t)array.size()); }
+
+    /** Writes samples from a 32-bit integer vector. See {@link #writeDouble}. */
+    public: inline int32_t writeInt    (const vector<int32_t> &array) { return writeInt(   &array[0], (int32_t)array.size()); }
+
+    /** Writes samples from a 16-bit integer vector. See {@link #writeDouble}. */
+    public: inline int32_t writeShort  (const vector<int16_t> &array) { return writeShort( &array[0], (int32_t)array.size()); }
+
+    /** Writes samples from an 8-bit integer vector. See {@link #writeDouble}. */
+    public: inline int32_t writeByte   (const vector<int8_t>  &array) { return writeByte(  &array[0], (int32_t)array.size()); }
+
+    /** Sends any samples held over in a short packet (e.g. at the end of the stream).
+     *  For complex data, an unpaired real value is kept.
+     *  @return The number of packets added to the batch.
+     */
+    public: int32_t flush ();
+
+    /** Gets the packets produced since {@link #clear()} was last called, in order. These
+     *  remain valid until {@link #clear()} is called.
+     */
+    public: inline const vector<BasicVRTPacket*> &getPackets () const { return packets; }
+
+    /** Clears the batch so its packets can be reused. */
+    public: inline void clear () {
+      packets.clear();
+      dataUsed    = 0;
+      contextUsed = 0;
+    }
+
+    /** Gets the number of data packets produced. */
+    public: inline int64_t getDataPacketsSent () const { return dataPacketsSent; }
+
+    /** Gets the number of context packets produced. */
+    public: inline int64_t getContextPacketsSent () const { return contextPacketsSent; }
+
+    /** Gets the number of samples sent in data packets (not including any held over). */
+    public: inline int64_t getSamplesSent () const { return samplesSent; }
+
+    // Input types (the element size is the low 4 bits)
+    private: static const int32_t TYPE_DOUBLE = 0x08;
+    private: static const int32_t TYPE_FLOAT  = 0x14;
+    private: static const int32_t TYPE_LONG   = 0x28;
+    private: static const int32_t TYPE_INT    = 0x34;
+    private: static const int32_t TYPE_SHORT  = 0x42;
+    private: static const int32_t TYPE_BYTE   = 0x51;
+
+    /** Writes samples of the given input type. */
+    private: int32_t write (int32_t type, const void *array, int32_t len);
+
+    /** Adds a data packet (and a context packet first, if due) to the batch. */
+    private: void addPacket (int32_t type, const void *array, int32_t len);
+
+    /** Adds a context packet to the batch. */
+    private: void addContext (const TimeStamp &ts);
+
+    /** Gets the largest payload length (in octets) of a data packet. */
+    private: int32_t getMaxPayloadLength () const;
+
+    /** Gets the time stamp for the given sample index. */
+    private: TimeStamp getTimeStamp (int64_t index) const;
+
+    // The packets are owned by this instance.
+    private: Packetizer (const Packetizer &p);
+    private: Packetizer& operator= (const Packetizer &p);
+  };
+} END_NAMESPACE
+#endif /* _Packetizer_h */
@@ -0,0 +1,240 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _ParallelVRAScanner_h
+#define _ParallelVRAScanner_h
+
+#include "VRTObject.h"
+#include "AbstractVRAFile.h"
+#include "VRAIndex.h"
+#include "VRTPacketView.h"
+#include <pthread.h>
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Specifies the order in which a {@link ParallelVRAScanner} delivers packets. */
+  enum ScanOrder {
+    /** No ordering, packets from different parts of the file are delivered concurrently. */
+    ScanOrder_None   = 0,
+    /** Packets with the same stream ID are delivered in file order (and never
+     *  concurrently), packets on different streams may be delivered concurrently.
+     */
+    ScanOrder_Stream = 1,
+    /** All packets are delivered in file order from a single thread (an ordered merge
+     *  of the parallel reads).
+     */
+    ScanOrder_File   = 2
+  };
+
+  /** Receives the packets found by a {@link ParallelVRAScanner}. */
+  class VRAScanHandler {
+    /** Basic destructor for the class. */
+    public: virtual ~VRAScanHandler () { }
+
+    /** Processes a single packet. This will be called from multiple threads at once
+     *  unless {@link ScanOrder_File} is used (see {@link ScanOrder}).
+     *  @param p      The packet, this is only valid until the function returns.
+     *  @param offset The offset of the packet in the file.
+     *  @param worker The number of the calling thread (0 to N-1), which can be used to
+     *                index per-thread state without locking.
+     *  @throws VRTException To abort the scan.
+     */
+    public: virtual void processPacket (const VRTPacketView &p, int64_t offset, int32_t worker) = 0;
+  };
+
+  /** Scans a VRA file using multiple threads. The file is split into chunks which are
+   *  read and processed in parallel, with the packets passed to a {@link VRAScanHandler}.
+   *  <br>
+   *  <br>
+   *  Since packets may span chunks, the start of each chunk is first moved to a
+   *  packet boundary. Where the file has an index (see
+   *  {@link AbstractVRAFile#getIndex()}, or a sidecar index next to the file) this is
+   *  taken from the index. Otherwise it is found by looking for a position where the
+   *  next {@link #RESYNC_PACKETS} packet headers are all plausible (valid packet type,
+   *  length long enough for the fields present and within the file, not part of a run
+   *  of identical words) and where any packets on the same stream have matching header
+   *  settings. The boundary used is taken from the middle of that chain, since a chain
+   *  that begins inside a packet payload will usually land on a real packet within a
+   *  hop or two. Each chunk is then read in full and its packets are checked to
+   *  exactly fill it before any are delivered, so an incorrect boundary results in an
+   *  exception rather than bogus packets; use an index where this is a concern. <br>
+   *  <br>
+   *  The {@link ScanOrder} controls the order of delivery. With
+   *  {@link ScanOrder_None} each thread delivers the packets from the chunks it reads.
+   *  Otherwise the chunks are read in parallel but handed (in order) to a set of
+   *  delivery threads, one per group of stream IDs for {@link ScanOrder_Stream} and a
+   *  single one for {@link ScanOrder_File}; up to {@link #getMaxChunks()} chunks are
+   *  held in memory at once. <br>
+   *  <br>
+   *  The file must not be modified during the scan. Reads use
+   *  {@link AbstractVRAFile#readConcurrent} where supported, otherwise they are
+   *  serialized. Typical usage:
+   *  <pre>
+   *    class Counter : public VRAScanHandler {
+   *      public: vector<int64_t> counts;
+   *      public: Counter (int32_t n) : counts(n) { }
+   *      public: void processPacket (const VRTPacketView &p, int64_t off, int32_t worker) {
+   *        counts[worker]++;
+   *      }
+   *    };
+   *    BasicVRAFile       file(fname, FileMode_Read);
+   *    ParallelVRAScanner scanner(file, 8);
+   *    Counter            counter(scanner.getNumWorkers());
+   *    scanner.scan(counter);
+   *  </pre>
+   */
+  class ParallelVRAScanner : public VRTObject {
+    /** The default chunk size (16 MiB). */
+    public: static const int32_t DEFAULT_CHUNK_SIZE = 16*1024*1024;
+
+    /** The number of consecutive plausible packet headers required when finding a
+     *  packet boundary without an index (fewer if the end of the file is reached).
+     */
+    public: static const int32_t RESYNC_PACKETS = 32;
+
+    private: const AbstractVRAFile *file;          // The file being scanned
+    private: int32_t                numThreads;    // Number of reader threads
+    private: int32_t                chunkSize;     // Nominal chunk size
+    private: ScanOrder              order;         // Delivery order
+    private: int32_t                numWorkers;    // Number of delivery threads
+    private: int32_t                numSlots;      // Max chunks held for delivery
+    private: VRAScanHandler        *handler;       // Handler for the current scan
+    private: const VRAIndex        *index;         // Index for the current scan (NULL if n/a)
+    private: int64_t                fileLength;    // File length for the current scan
+    private: int64_t                numChunks;     // Number of chunks in the current scan
+    private: vector<int64_t>        bounds;        // Start of each chunk (plus end of file)
+    private: volatile int64_t       nextChunk;     // Next chunk to be claimed
+    private: volatile bool          failed;        // Has the scan failed?
+    private: string                 error;         // The first error seen
+    private: pthread_mutex_t        lock;          // Lock for the scan state
+    private: pthread_cond_t         cond;          // Signalled on chunk state changes
+    private: pthread_mutex_t        readLock;      // Serializes non-concurrent reads
+    private: vector<vector<char> >  slotData;      // Chunk data by slot
+    private: vector<vector<int32_t> > slotPackets; // Packet offsets (in chunk) by slot
+    private: vector<int64_t>        slotChunk;     // Chunk each slot holds (or is next for)
+    private: vector<bool>           slotReady;     // Is the chunk in each slot ready?
+    private: vector<int32_t>        slotRefs;      // Workers yet to finish with each slot
+    private: volatile int64_t       packetsScanned; // Metrics (see get functions)
+    private: volatile int64_t       bytesScanned;
+    private: volatile int64_t       indexBounds;
+    private: volatile int64_t       resyncBounds;
+
+    /** Creates a new instance.
+     *  @param file       The file to scan, this must be open for reading and must remain
+     *                    valid for the life of the scanner.
+     *  @param numThreads The number of threads used to read the file (0 to use one per
+     *                    online CPU).
+     *  @param chunkSize  The nominal chunk size in octets (must be at least
+     *                    {@link BasicVRTPacket#MAX_PACKET_LENGTH}).
+     *  @param order      The order in which to deliver packets.
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: ParallelVRAScanner (const AbstractVRAFile &file, int32_t numThreads=0,
+                                int32_t chunkSize=DEFAULT_CHUNK_SIZE,
+                                ScanOrder order=ScanOrder_None);
+
+    /** Basic destructor for the class. */
+    public: ~ParallelVRAScanner ();
+
+    public: virtual string toString () const;
+
+    /** Scans the file, passing every packet to the given handler. This returns once
+     *  all of the threads have finished.
+     *  @param handler The handler.
+     *  @throws VRTException If there is an error reading the file, a packet boundary
+     *                       can not be found, or the handler throws an exception. All
+     *                       threads are stopped at the first error, so some packets
+     *                       may not have been delivered.
+     */
+    public: void scan (VRAScanHandler &handler);
+
+    /** Gets the number of threads used to read the file. */
+    public: inline int32_t getNumThreads () const { return numThreads; }
+
+    /** Gets the number of distinct <tt>worker</tt> values that will be passed to
+     *  {@link VRAScanHandler#processPacket}.
+     */
+    public: inline int32_t getNumWorkers () const { return numWorkers; }
+
+    /** Gets the nominal chunk size in octets. */
+    public: inline int32_t getChunkSize () const { return chunkSize; }
+
+    /** Gets the delivery order. */
+    public: inline ScanOrder getScanOrder () const { return order; }
+
+    /** Gets the maximum number of chunks held in memory waiting for delivery (not
+     *  applicable to {@link ScanOrder_None}).
+     */
+    public: inline int32_t getMaxChunks () const { return numSlots; }
+
+    /** Gets the number of packets delivered by the last scan. */
+    public: inline int64_t getPacketsScanned () const { return packetsScanned; }
+
+    /** Gets the number of octets delivered by the last scan. */
+    public: inline int64_t getBytesScanned () const { return bytesScanned; }
+
+    /** Gets the number of chunk boundaries taken from the index in the last scan. */
+    public: inline int64_t getIndexedBoundaries () const { return indexBounds; }
+
+    /** Gets the number of chunk boundaries found by header validation in the last scan. */
+    public: inline int64_t getResyncBoundaries () const { return resyncBounds; }
+
+    /** Finds a packet boundary at or after the nominal start of a chunk, returns -1 if none found. */
+    private: int64_t findBoundary (int64_t chunk);
+
+    /** Finds a packet boundary using the index, returns -1 if not possible. */
+    private: int64_t findIndexBoundary (int64_t start, int64_t limit) const;
+
+    /** Finds a packet boundary using header validation, returns -1 if none found. */
+    private: int64_t findResyncBoundary (int64_t start, int64_t limit);
+
+    /** Reads a chunk and checks that its packets exactly fill it. */
+    private: void readChunk (int64_t chunk, vector<char> &data, vector<int32_t> &packets);
+
+    /** Reads from the file (concurrently if supported). */
+    private: void readFully (int64_t off, void *ptr, int32_t len);
+
+    /** Records an error and stops all threads. */
+    private: void fail (const string &err);
+
+    /** Claims the next chunk, returns -1 if none left or the scan has failed. */
+    private: int64_t claimChunk ();
+
+    /** Delivers the packets from a chunk that are assigned to the given worker. */
+    private: void deliver (int32_t worker, int64_t chunk, const vector<char> &data,
+                           const vector<int32_t> &packets);
+
+    /** Runs a set of threads and waits for them all to finish. */
+    private: void runThreads (bool boundaries);
+
+    private: void runBoundaries ();
+    private: void runReader (int32_t worker);
+    private: void runDelivery (int32_t worker);
+    private: static void *runThread (void *arg);
+
+    // The threads and buffers are owned by this instance.
+    private: ParallelVRAScanner (const ParallelVRAScanner &s);
+    private: ParallelVRAScanner& operator= (const ParallelVRAScanner &s);
+  };
+} END_NAMESPACE
+#endif /* _ParallelVRAScanner_h */
@@ -0,0 +1,218 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _ReorderBuffer_h
+#define _ReorderBuffer_h
+
+#include "VRTObject.h"
+#include "BasicDataPacket.h"
+#include "PayloadFormat.h"
+#include "TimeStamp.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Puts the data packets of one stream back in order when they arrive slightly out
+   *  of order (e.g. when received over several NIC queues or bonded links). <br>
+   *  <br>
+   *  The buffer is a ring of slots, one per packet position, starting at the next
+   *  packet due out. When the sample rate and payload format are known (see
+   *  {@link #setSampleRate}) and the packets have UTC or GPS time stamps with real-time
+   *  (picosecond) fractional parts, a packet's position comes from its time stamp: the
+   *  number of samples between it and the time stamp expected next (see
+   *  {@link BasicDataPacket#getLostSamples}) divided by the number of samples per
+   *  packet. Otherwise (or for a packet without a usable time stamp) the position
+   *  comes from the 4-bit packet count relative to the newest packet held, which only
+   *  works if the packets are no more than 7 out of place. Either
+   *  way, inserting a packet and releasing it are O(1); there is no sorting. <br>
+   *  <br>
+   *  Packets are released as soon as they are contiguous. A missing packet holds up
+   *  the ones after it until either the number of packets held reaches the limit or
+   *  the first of them has been held for the maximum latency (measured from its
+   *  arrival, or from when the gap before it was filled), at which point the gap is
+   *  skipped. The gaps are counted and, in time-stamp mode, the number of samples
+   *  lost is found with {@link BasicDataPacket#getLostSamples}. A packet that arrives
+   *  after its position has been released (or skipped) is rejected as late. A packet
+   *  further behind than the window (by its time stamp, or for two packets in a row
+   *  that follow on from each other, by its packet count) is taken to mean that the
+   *  source has restarted and the buffer is re-synchronized to it. <br>
+   *  <br>
+   *  The buffer owns the packets it holds; released packets pass to the caller and
+   *  rejected packets stay with the caller. Instances are not thread-safe. Typical
+   *  usage:
+   *  <pre>
+   *    ReorderBuffer buffer(64, 2000000); // 64 packets or 2 ms
+   *    buffer.setSampleRate(sampleRate, PayloadFormat_INT16);
+   *    vector<BasicDataPacket*> ready;
+   *    while (running) {
+   *      BasicDataPacket *p = receive();
+   *      if (!buffer.insert(p)) delete p; // late or duplicate
+   *      buffer.release(ready);
+   *      process(ready); // deletes the packets
+   *      ready.clear();
+   *    }
+   *  </pre>
+   */
+  class ReorderBuffer : public VRTObject {
+    /** The default maximum latency in nanoseconds (2 ms). */
+    public: static const int64_t DEFAULT_MAX_LATENCY = 2000000;
+
+    private: vector<BasicDataPacket*> slots;       // The ring of slots (NULL if empty)
+    private: vector<BasicDataPacket*> ready;       // Packets released by insert(..) but not collected
+    private: int32_t                  mask;        // Number of slots less one (a power of two)
+    private: int32_t                  head;        // Slot for the next packet due out
+    private: int32_t                  held;        // Number of packets in the slots
+    private: int64_t                  headSeq;     // Number of slots moved past (position of the head)
+    private: int64_t                  newestSeq;   // Position of the newest packet held (< headSeq if none)
+    private: int32_t                  newestCount; // Packet count of the newest packet held
+    private: int32_t                  maxPackets;  // Maximum number of packets held
+    private: int64_t                  maxLatency;  // Maximum time a packet is held (ns)
+    private: double                   sampleRate;  // Sample rate (NaN if not set)
+    private: PayloadFormat            payloadFormat; // Payload format used with the sample rate
+    private: bool                     anchored;    // Is the next position known?
+    private: TimeStamp                nextTime;    // Time stamp expected at the head (null if unknown)
+    private: TimeStamp                expectedTime; // Time stamp expected after the last packet released
+    private: int32_t                  nextCount;   // Packet count expected next
+    private: int32_t                  packetSize;  // Samples per packet (0 if unknown)
+    private: bool                     stalled;     // Is a gap holding up the packets?
+    private: int64_t                  stallStart;  // Arrival time of the first packet held up by the gap
+    private: int32_t                  lateCount;   // Count of the last packet behind the window (-1 if none)
+    private: int64_t                  packetsReleased; // Metrics (see get functions)
+    private: int64_t                  packetsLate;
+    private: int64_t                  duplicates;
+    private: int64_t                  gaps;
+    private: int64_t                  lostPackets;
+    private: int64_t                  lostSamples;
+    private: int64_t                  resyncs;
+    private: int32_t                  maxHeld;
+
+    /** Creates a new instance.
+     *  @param maxPackets The maximum number of packets held while waiting for a missing
+     *                    one (this also sets the size of the window).
+     *  @param maxLatency The maximum time to hold a packet while waiting for a missing
+     *                    one, in nanoseconds.
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: ReorderBuffer (int32_t maxPackets=64, int64_t maxLatency=DEFAULT_MAX_LATENCY);
+
+    /** Basic destructor for the class. Any packets still held are deleted. */
+    public: ~ReorderBuffer ();
+
+    public: virtual string toString () const;
+
+    /** Sets the sample rate and payload format used to place packets by their time
+     *  stamps. Until the next packet is released (or the first packet is inserted)
+     *  packets are placed by packet count.
+     *  @param sr The sample rate in Hz (NaN to clear, placing packets by packet count).
+     *  @param pf The payload format of the data packets.
+     */
+    public: void setSampleRate (double sr, const PayloadFormat &pf);
+
+    /** Gets the current time on <tt>CLOCK_MONOTONIC</tt> in nanoseconds, as used for
+     *  the arrival times.
+     */
+    public: static int64_t now ();
+
+    /** Adds a packet using the current time as its arrival time.
+     *  See {@link #insert(BasicDataPacket*,int64_t)}.
+     */
+    public: inline bool insert (BasicDataPacket *p) { return insert(p, now()); }
+
+    /** Adds a packet. If the packet is too far ahead to fit in the window, the packets
+     *  held are released (skipping any gaps) to make room.
+     *  @param p       The packet (the buffer takes ownership if accepted).
+     *  @param arrival The arrival time in nanoseconds (see {@link #now()}).
+     *  @return true if accepted, false if the packet is late or a duplicate (the caller
+     *          keeps ownership).
+     *  @throws VRTException If the packet is null.
+     */
+    public: bool insert (BasicDataPacket *p, int64_t arrival);
+
+    /** Releases the packets that are ready using the current time.
+     *  See {@link #release(vector<BasicDataPacket*>&,int64_t)}.
+     */
+    public: inline int32_t release (vector<BasicDataPacket*> &out) { return release(out, now()); }
+
+    /** Releases the packets that are ready: those that are contiguous with the last
+     *  packet released, plus those after a gap once the packet or time limit is
+     *  reached.
+     *  @param out The vector to append the packets to (in order).
+     *  @param now The current time in nanoseconds (see {@link #now()}).
+     *  @return The number of packets released.
+     */
+    public: int32_t release (vector<BasicDataPacket*> &out, int64_t now);
+
+    /** Releases all of the packets held, skipping any gaps.
+     *  @param out The vector to append the packets to (in order).
+     *  @return The number of packets released.
+     */
+    public: int32_t flush (vector<BasicDataPacket*> &out);
+
+    /** Gets the number of packets held. */
+    public: inline int32_t getHeld () const { return held + (int32_t)ready.size(); }
+
+    /** Gets the number of packets released. */
+    public: inline int64_t getPacketsReleased () const { return packetsReleased; }
+
+    /** Gets the number of packets rejected because they arrived too late. */
+    public: inline int64_t getPacketsLate () const { return packetsLate; }
+
+    /** Gets the number of packets rejected as duplicates. */
+    public: inline int64_t getDuplicates () const { return duplicates; }
+
+    /** Gets the number of gaps skipped. */
+    public: inline int64_t getGaps () const { return gaps; }
+
+    /** Gets the number of packet positions skipped. */
+    public: inline int64_t getLostPackets () const { return lostPackets; }
+
+    /** Gets the number of samples lost in the gaps (time-stamp mode only). */
+    public: inline int64_t getLostSamples () const { return lostSamples; }
+
+    /** Gets the number of times the buffer was re-synchronized. */
+    public: inline int64_t getResyncs () const { return resyncs; }
+
+    /** Gets the largest number of packets held at once. */
+    public: inline int32_t getMaxHeld () const { return maxHeld; }
+
+    /** Gets the position of a packet relative to the next one due out (INT64_NULL if
+     *  it can not be placed by time stamp).
+     */
+    private: int64_t getTimePosition (const BasicDataPacket *p) const;
+
+    /** Gets the position of a packet relative to the next one due out from its
+     *  packet count.
+     */
+    private: int64_t getCountPosition (int32_t cnt) const;
+
+    /** Releases the packet at the head of the ring (if any) and moves on one slot. */
+    private: void advance (vector<BasicDataPacket*> &out);
+
+    /** Releases one packet, checking it against the expected time stamp. */
+    private: void emit (BasicDataPacket *p, vector<BasicDataPacket*> &out);
+
+    // The packets are owned by this instance.
+    private: ReorderBuffer (const ReorderBuffer &b);
+    private: ReorderBuffer& operator= (const ReorderBuffer &b);
+  };
+} END_NAMESPACE
+#endif /* _ReorderBuffer_h */
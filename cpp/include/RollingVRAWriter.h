@@ -0,0 +1,219 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _RollingVRAWriter_h
+#define _RollingVRAWriter_h
+
+#include "VRTObject.h"
+#include "AbstractVRAFile.h"
+#include "BasicVRTPacket.h"
+#include "TimeStamp.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Describes one segment written by a {@link RollingVRAWriter}. */
+  typedef struct VRASegmentInfo {
+    int32_t   index;      ///< Segment number (starting at 0)
+    string    fileName;   ///< The file name
+    TimeStamp startTime;  ///< Time stamp of the first time-stamped packet (null if n/a)
+    TimeStamp endTime;    ///< Time stamp of the last time-stamped packet (null if n/a)
+    int64_t   packets;    ///< Number of packets in the segment
+    int64_t   length;     ///< Length of the file in octets (including the file header)
+  } VRASegmentInfo_t;
+
+  /** Records packets to a series of VRA files ("segments"), each limited in size
+   *  and/or duration, with no gaps or overlap between them. <br>
+   *  <br>
+   *  Segment <i>n</i> is written to <tt>basePath + "_" + n + ".vra"</tt> (with
+   *  <i>n</i> zero-padded to 6 digits) as a {@link BasicVRAFile} with the FileLength
+   *  (and optionally CRC) header fields set. The switch to a new segment is made
+   *  before any packet that would take the current one over the size limit, or that
+   *  has a time stamp at least the maximum duration after the first time stamp in the
+   *  current one (packets without an integer time stamp do not count towards the
+   *  duration). A segment always contains at least one packet, so a single packet
+   *  larger than the size limit is written on its own. <br>
+   *  <br>
+   *  To keep the switch from stalling the caller, a background thread opens the
+   *  next segment (and reserves disk space for it, if requested) ahead of time, and
+   *  closes completed segments (writing the final FileLength and CRC, and releasing
+   *  any unused reserved space). As each segment is closed a line is added to a
+   *  manifest file (<tt>basePath + ".manifest"</tt>) giving the segment number, file
+   *  name, first and last time stamps, packet count and length (separated by tabs,
+   *  with "-" for a missing time stamp). <br>
+   *  <br>
+   *  The <tt>append(..)</tt>, {@link #rollover()}, {@link #flush()} and
+   *  {@link #close()} functions must all be called from the same thread, the metrics
+   *  functions may be called from any thread. Typical usage:
+   *  <pre>
+   *    RollingVRAWriter writer("/data/rec", 1024*1024*1024, 60.0);
+   *    while (running) {
+   *      writer.append(receivePacket());
+   *    }
+   *    writer.close();
+   *  </pre>
+   */
+  class RollingVRAWriter : public VRTObject {
+    /** The file name extension used for the manifest (".manifest"). */
+    public: static const string MANIFEST_EXT;
+
+    private: string                    basePath;       // The base path for file names
+    private: int64_t                   maxLength;      // Max segment length (0=none)
+    private: double                    maxDuration;    // Max segment duration (0=none)
+    private: bool                      isSetCRC;       // Set the CRC in each segment?
+    private: bool                      preallocate;    // Reserve disk space for segments?
+    private: string                    manifestName;   // The manifest file name
+    private: FILE                     *manifest;       // The manifest file
+    private: AbstractVRAFile          *current;        // The segment being written
+    private: VRASegmentInfo            info;           // Info for the segment being written
+    private: int32_t                   tsiMode;        // TSI mode of the first time stamp
+    private: int32_t                   tsfMode;        // TSF mode of the first time stamp
+    private: uint32_t                  firstTSI;       // First TSI in the segment
+    private: uint64_t                  firstTSF;       // First TSF in the segment
+    private: AbstractVRAFile          *next;           // The next segment (NULL if not ready)
+    private: int32_t                   nextIndex;      // The number of the next segment
+    private: deque<AbstractVRAFile*>   closing;        // Segments waiting to be closed
+    private: deque<VRASegmentInfo>     closingInfo;    // Info for segments waiting to be closed
+    private: vector<VRASegmentInfo>    finished;       // Info for segments closed
+    private: bool                      stopping;       // Has close() been called?
+    private: bool                      failed;         // Has the background thread failed?
+    private: string                    error;          // The error from the background thread
+    private: bool                      running;        // Is the background thread running?
+    private: pthread_t                 thread;         // The background thread
+    private: mutable pthread_mutex_t   lock;           // Lock for the shared state
+    private: pthread_cond_t            cond;           // Signalled on state changes
+    private: volatile int64_t          packetsWritten; // Metrics (see get functions)
+    private: volatile int64_t          bytesWritten;
+    private: volatile int64_t          waitCount;
+
+    /** Creates a new instance, opening the first segment and the manifest.
+     *  @param basePath    The base path for the segment and manifest file names.
+     *  @param maxLength   The maximum length of a segment in octets (0 for no limit).
+     *  @param maxDuration The maximum duration of a segment in seconds (0 for no limit).
+     *  @param isSetCRC    Should the CRC be set in each segment?
+     *  @param preallocate Should disk space for each segment (<tt>maxLength</tt>) be
+     *                     reserved when it is opened? This is ignored where the file
+     *                     system does not support it or if there is no size limit.
+     *  @throws VRTException If any of the parameters are invalid or the files can not
+     *                       be opened.
+     */
+    public: RollingVRAWriter (const string &basePath, int64_t maxLength, double maxDuration=0,
+                              bool isSetCRC=true, bool preallocate=true);
+
+    /** Basic destructor for the class. This calls {@link #close()}, any errors are
+     *  ignored.
+     */
+    public: ~RollingVRAWriter ();
+
+    public: virtual string toString () const;
+
+    /** Gets the file name used for a given segment. */
+    public: inline string getSegmentFileName (int32_t index) const {
+      return basePath + Utilities::format("_%06d", index) + AbstractVRAFile::FILE_NAME_EXT;
+    }
+
+    /** Gets the manifest file name. */
+    public: inline string getManifestFileName () const { return manifestName; }
+
+    /** Writes a packet, switching to a new segment first if required.
+     *  @param p The packet.
+     *  @throws VRTException If the packet is invalid, the writer is closed or there is
+     *                       an error writing the file or opening the next segment.
+     */
+    public: void append (const BasicVRTPacket &p);
+
+    /** Writes a packet. This is the same as {@link #append(const BasicVRTPacket&)}
+     *  except that no validity check (other than the packet length) is done.
+     *  @param ptr Pointer to the packet.
+     *  @param len The length of the packet in octets.
+     *  @throws VRTException If the packet length is invalid, the writer is closed or
+     *                       there is an error writing the file or opening the next
+     *                       segment.
+     */
+    public: void append (const void *ptr, int32_t len);
+
+    /** Switches to a new segment now (unless the current one is empty).
+     *  @throws VRTException If the writer is closed or the next segment could not be
+     *                       opened.
+     */
+    public: void rollover ();
+
+    /** Updates the header of the current segment on disk (see
+     *  {@link AbstractVRAFile#flush()}).
+     *  @throws VRTException If the writer is closed or there is an error writing the file.
+     */
+    public: void flush ();
+
+    /** Closes the current segment, waits for all of the segments to be closed and
+     *  closes the manifest. An unused (pre-opened) segment file is removed. Calling
+     *  this a second time has no effect.
+     *  @throws VRTException If any segment could not be opened or closed.
+     */
+    public: void close ();
+
+    /** Gets the number of the segment being written. */
+    public: inline int32_t getSegmentIndex () const { return info.index; }
+
+    /** Gets the name of the segment file being written. */
+    public: inline string getCurrentFileName () const { return info.fileName; }
+
+    /** Gets information on the segments that have been closed (in order). */
+    public: vector<VRASegmentInfo> getSegments () const;
+
+    /** Gets the number of packets written. */
+    public: inline int64_t getPacketsWritten () const { return packetsWritten; }
+
+    /** Gets the number of octets of packets written (excluding file headers). */
+    public: inline int64_t getBytesWritten () const { return bytesWritten; }
+
+    /** Gets the number of times a switch to a new segment had to wait for it to be
+     *  opened by the background thread.
+     */
+    public: inline int64_t getWaitCount () const { return waitCount; }
+
+    /** Checks that the writer is usable, throwing an exception if not. */
+    private: void checkState () const;
+
+    /** Takes the next segment (waiting for it if required) and makes it current. */
+    private: void takeNext ();
+
+    /** Opens the given segment (used by the background thread). */
+    private: AbstractVRAFile *openSegment (int32_t index);
+
+    /** Closes a segment and adds it to the manifest (used by the background thread). */
+    private: void closeSegment (AbstractVRAFile *file, VRASegmentInfo &segInfo);
+
+    /** The body of the background thread. */
+    private: void runBackground ();
+
+    /** Entry point for the background thread. */
+    private: static void *runBackground (void *arg);
+
+    // The files and background thread are owned by this instance.
+    private: RollingVRAWriter (const RollingVRAWriter &w);
+    private: RollingVRAWriter& operator= (const RollingVRAWriter &w);
+  };
+} END_NAMESPACE
+#endif /* _RollingVRAWriter_h */
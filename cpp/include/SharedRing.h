@@ -0,0 +1,360 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _SharedRing_h
+#define _SharedRing_h
+
+#include "VRTObject.h"
+#include "BasicVRTPacket.h"
+#include "BasicVRLFrame.h"
+#include "VRTPacketView.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  struct SharedRingHeader;
+
+  /** Writes VRT packets (or VRL frames) to a shared-memory ring for other processes on
+   *  the same host to read with a {@link SharedRingReader}. This avoids the copies
+   *  into and out of the kernel and the context switches of sending over loopback
+   *  UDP. <br>
+   *  <br>
+   *  The ring is a file in <tt>/dev/shm</tt> (or an unnamed <tt>memfd</tt> passed to
+   *  the readers by the caller, see {@link #getFD()}) holding a small header followed
+   *  by the data area. The data area is mapped twice, back to back, so every packet is
+   *  contiguous in memory even when it wraps around the end of the ring; this lets the
+   *  readers use the packets in place. <br>
+   *  <br>
+   *  There is a single writer and any number of readers (up to the limit set when the
+   *  ring is created), each reader sees every packet. The writer publishes packets by
+   *  advancing a shared write position and each reader has its own read position,
+   *  both updated without locks. Readers waiting for data sleep on a futex, as does
+   *  the writer when a slow reader leaves no space and {@link OverflowPolicy_Block} is
+   *  in use; the futex calls are only made when the other side is known to be waiting.
+   *  With {@link OverflowPolicy_Drop} packets that do not fit are dropped instead, so a
+   *  slow reader can not hold up the writer. A reader whose process has exited without
+   *  detaching is removed when the writer finds the ring full (after waiting briefly
+   *  for space, or when dropping, at most once every few milliseconds). <br>
+   *  <br>
+   *  Packets can be copied in (<tt>write(..)</tt>), or built in place using
+   *  {@link #reserve} and {@link #commit}. Packets are not visible to the readers until
+   *  {@link #flush()} is called (<tt>write(..)</tt> calls it automatically), so a batch
+   *  costs a single update of the write position and at most one wake-up. Instances
+   *  are not thread-safe. Typical usage:
+   *  <pre>
+   *    SharedRingWriter ring("vrt-rx0");
+   *    ...
+   *    ring.write(packets, n);
+   *  </pre>
+   */
+  class SharedRingWriter : public VRTObject {
+    /** The default capacity of the data area in octets (16 MiB). */
+    public: static const int32_t DEFAULT_CAPACITY = 16*1024*1024;
+
+    /** The default maximum number of readers (16). */
+    public: static const int32_t DEFAULT_MAX_READERS = 16;
+
+    private: string            path;           // Path of the shared memory file ("" if unnamed)
+    private: int               fd;             // The shared memory file (-1 if closed)
+    private: OverflowPolicy    policy;         // What to do when there is no space
+    private: SharedRingHeader *header;         // The shared header
+    private: char             *data;           // The data area (mapped twice)
+    private: size_t            mapLength;      // Length of the mapping
+    private: uint32_t          capacity;       // Capacity of the data area (power of two)
+    private: int32_t           maxReaders;     // Max number of readers
+    private: uint64_t          pending;        // Write position including unpublished packets
+    private: uint64_t          limit;          // Write position known to be free up to
+    private: int32_t           pendingCount;   // Number of unpublished packets
+    private: int64_t           pendingBytes;   // Octets of unpublished packets
+    private: char             *reserved;       // Space given by reserve(..) (NULL if none)
+    private: int32_t           reservedLength; // Length requested in reserve(..)
+    private: int64_t           packetsWritten; // Metrics (see get functions)
+    private: int64_t           bytesWritten;
+    private: int64_t           packetsDropped;
+    private: int64_t           waitCount;
+    private: int64_t           readersRemoved;
+    private: int64_t           lastReap;       // Time of the last check for dead readers (ms)
+
+    /** Creates a new ring.
+     *  @param name       The name of the file in <tt>/dev/shm</tt> (or the full path to a
+     *                    file on another memory-backed file system, e.g. hugetlbfs). Any
+     *                    existing file of that name is replaced. If this is "" an unnamed
+     *                    <tt>memfd</tt> is used, see {@link #getFD()}.
+     *  @param capacity   The capacity of the data area in octets, this is rounded up to
+     *                    a power of two. The largest packet that can be written is just
+     *                    under half of this.
+     *  @param maxReaders The maximum number of readers attached at any one time.
+     *  @param policy     What to do when a reader has not yet read the space needed.
+     *  @throws VRTException If any of the parameters are invalid or the ring can not be
+     *                       created.
+     */
+    public: SharedRingWriter (const string &name, int32_t capacity=DEFAULT_CAPACITY,
+                              int32_t maxReaders=DEFAULT_MAX_READERS,
+                              OverflowPolicy policy=OverflowPolicy_Block);
+
+    /** Basic destructor for the class. This calls {@link #close()}. */
+    public: ~SharedRingWriter ();
+
+    public: virtual string toString () const;
+
+    /** Closes the ring. Any unpublished packets are published first, the readers are
+     *  told that the ring is closed and a named file is removed (readers already
+     *  attached are not affected).
+     */
+    public: void close ();
+
+    /** Is the ring open? */
+    public: inline bool isOpen () const { return (fd >= 0); }
+
+    /** Gets the file descriptor for the shared memory. This can be passed to another
+     *  process (e.g. inherited across <tt>fork(..)</tt> or sent over a UNIX domain socket)
+     *  and given to {@link SharedRingReader#SharedRingReader(int,int32_t)}.
+     */
+    public: inline int getFD () const { return fd; }
+
+    /** Gets the path of the shared memory file ("" if unnamed). */
+    public: inline const string &getPath () const { return path; }
+
+    /** Gets the capacity of the data area in octets. */
+    public: inline int32_t getCapacity () const { return (int32_t)capacity; }
+
+    /** Gets the number of readers currently attached. */
+    public: int32_t getReaderCount () const;
+
+    /** Reserves space for a packet to be built in place. The pointer returned is valid
+     *  until {@link #commit} is called.
+     *  @param len The maximum length of the packet in octets.
+     *  @return Pointer to the space, or NULL if the space is not available and
+     *          {@link OverflowPolicy_Drop} is in use (counted as a drop).
+     *  @throws VRTException If the ring is closed or the length is invalid.
+     */
+    public: char *reserve (int32_t len);
+
+    /** Adds the packet built in the space given by the last call to {@link #reserve}
+     *  to the packets waiting for {@link #flush()}.
+     *  @param len The actual length of the packet in octets (not more than reserved).
+     *  @throws VRTException If the length is invalid.
+     */
+    public: void commit (int32_t len);
+
+    /** Copies a packet (or frame) into the ring. It is not visible to the readers until
+     *  {@link #flush()} is called.
+     *  @param ptr Pointer to the packet.
+     *  @param len The length of the packet in octets.
+     *  @return true if added, false if dropped (see {@link OverflowPolicy_Drop}).
+     *  @throws VRTException If the ring is closed or the length is invalid.
+     */
+    public: bool append (const void *ptr, int32_t len);
+
+    /** Copies a packet into the ring. See {@link #append(const void*,int32_t)}. */
+    public: inline bool append (const BasicVRTPacket &p) {
+      return append(&p.bbuf[0], p.getPacketLength());
+    }
+
+    /** Copies a VRL frame into the ring. See {@link #append(const void*,int32_t)}. */
+    public: inline bool append (const BasicVRLFrame &f) {
+      return append(&f.bbuf[0], f.getFrameLength());
+    }
+
+    /** Publishes all of the packets added since the last flush and wakes any readers
+     *  waiting for them.
+     */
+    public: void flush ();
+
+    /** Writes a batch of packets, this adds each packet and then calls
+     *  {@link #flush()}.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     *  @return The number of packets written (the rest were dropped).
+     *  @throws VRTException If the ring is closed.
+     */
+    public: int32_t write (const BasicVRTPacket *const *packets, int32_t n);
+
+    /** Writes a batch of packets. See {@link #write(const BasicVRTPacket*const*,int32_t)}. */
+    public: inline int32_t write (const vector<BasicVRTPacket*> &packets) {
+      if (packets.empty()) return 0;
+      return write(&packets[0], (int32_t)packets.size());
+    }
+
+    /** Writes a single packet (or frame) and calls {@link #flush()}.
+     *  @return true if written, false if dropped (see {@link OverflowPolicy_Drop}).
+     */
+    public: inline bool write (const void *ptr, int32_t len) {
+      bool ok = append(ptr, len);
+      flush();
+      return ok;
+    }
+
+    /** Gets the number of packets written (published). */
+    public: inline int64_t getPacketsWritten () const { return packetsWritten; }
+
+    /** Gets the number of octets of packets written (published). */
+    public: inline int64_t getBytesWritten () const { return bytesWritten; }
+
+    /** Gets the number of packets dropped (see {@link OverflowPolicy_Drop}). */
+    public: inline int64_t getPacketsDropped () const { return packetsDropped; }
+
+    /** Gets the number of times the writer had to wait for a reader to free space
+     *  (see {@link OverflowPolicy_Block}).
+     */
+    public: inline int64_t getWaitCount () const { return waitCount; }
+
+    /** Gets the number of readers removed because their process had exited. */
+    public: inline int64_t getReadersRemoved () const { return readersRemoved; }
+
+    /** Makes sure there is space for a record of the given length at the current write
+     *  position, waiting if required.
+     *  @return true if there is space, false if there is not and the policy is to drop.
+     */
+    private: bool waitSpace (uint32_t need);
+
+    /** Removes any readers whose process has gone away.
+     *  @return The number of readers removed.
+     */
+    private: int32_t removeDeadReaders ();
+
+    /** Gets the lowest read position of all active readers. */
+    private: uint64_t getMinReadPosition ();
+
+    // The shared memory is owned by this instance.
+    private: SharedRingWriter (const SharedRingWriter &w);
+    private: SharedRingWriter& operator= (const SharedRingWriter &w);
+  };
+
+  /** Reads VRT packets (or VRL frames) from a shared-memory ring written by a
+   *  {@link SharedRingWriter}, usually in another process. Packets are returned in
+   *  batches as views directly into the shared memory, with no copies. The writer will
+   *  not overwrite the packets in the current batch, so they remain valid until the
+   *  next call to {@link #receive} (or {@link #close()}), but a reader that holds on to
+   *  a batch for a long time will hold up (or cause drops in) the writer. <br>
+   *  <br>
+   *  A new reader starts with the next packet published after it attaches. Instances
+   *  are not thread-safe. Typical usage:
+   *  <pre>
+   *    SharedRingReader ring("vrt-rx0");
+   *    while (!ring.isEndOfStream()) {
+   *      int32_t count = ring.receive(1000);
+   *      for (int32_t i = 0; i < count; i++) {
+   *        VRTPacketView p = ring.getPacket(i);
+   *        ...
+   *      }
+   *    }
+   *  </pre>
+   */
+  class SharedRingReader : public VRTObject {
+    /** The default maximum number of packets returned per batch (1024). */
+    public: static const int32_t DEFAULT_BATCH_SIZE = 1024;
+
+    private: SharedRingHeader   *header;          // The shared header (NULL if closed)
+    private: char               *data;            // The data area (mapped twice)
+    private: size_t              mapLength;       // Length of the mapping
+    private: uint32_t            capacity;        // Capacity of the data area
+    private: int32_t             slot;            // This reader's slot in the header
+    private: int32_t             batchSize;       // Max packets per batch
+    private: uint64_t            position;        // Read position of the current batch
+    private: uint64_t            batchEnd;        // Read position following the current batch
+    private: bool                eof;             // Has the writer closed the ring?
+    private: vector<const char*> packets;         // Packets in the current batch
+    private: vector<int32_t>     lengths;         // Packet lengths in the current batch
+    private: int64_t             packetsReceived; // Metrics (see get functions)
+    private: int64_t             bytesReceived;
+
+    /** Attaches to a ring by name.
+     *  @param name      The name used by the writer.
+     *  @param batchSize The maximum number of packets returned per batch.
+     *  @throws VRTException If the ring can not be opened, is not valid or already has
+     *                       the maximum number of readers.
+     */
+    public: SharedRingReader (const string &name, int32_t batchSize=DEFAULT_BATCH_SIZE);
+
+    /** Attaches to a ring using a file descriptor from {@link SharedRingWriter#getFD()}.
+     *  The file descriptor is not needed once this returns and remains owned by the
+     *  caller.
+     *  @param fd        The file descriptor.
+     *  @param batchSize The maximum number of packets returned per batch.
+     *  @throws VRTException If the ring is not valid or already has the maximum number
+     *                       of readers.
+     */
+    public: SharedRingReader (int fd, int32_t batchSize=DEFAULT_BATCH_SIZE);
+
+    /** Basic destructor for the class. This calls {@link #close()}. */
+    public: ~SharedRingReader ();
+
+    public: virtual string toString () const;
+
+    /** Detaches from the ring. */
+    public: void close ();
+
+    /** Is the reader attached? */
+    public: inline bool isOpen () const { return (header != NULL); }
+
+    /** Has the writer closed the ring and all of its packets been read? */
+    public: inline bool isEndOfStream () const { return eof; }
+
+    /** Receives the next batch of packets, waiting for some to be published if there
+     *  are none available. All views from the previous batch become invalid.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever, 0
+     *                 to return immediately).
+     *  @return The number of packets received, 0 on timeout or at the end of the stream
+     *          (see {@link #isEndOfStream()}).
+     *  @throws VRTException If the reader is closed or the ring is corrupt.
+     */
+    public: int32_t receive (int32_t timeout=-1);
+
+    /** Gets the number of packets in the current batch. */
+    public: inline int32_t getCount () const { return (int32_t)packets.size(); }
+
+    /** Gets a packet from the current batch. The view is only valid until the next
+     *  call to {@link #receive}.
+     *  @param i The packet number (0 to {@link #getCount()}-1).
+     */
+    public: inline VRTPacketView getPacket (int32_t i) const {
+      return VRTPacketView(packets[i], lengths[i]);
+    }
+
+    /** Gets a pointer to a packet (or frame) in the current batch. */
+    public: inline const char *getPacketPointer (int32_t i) const { return packets[i]; }
+
+    /** Gets the length of a packet (or frame) in the current batch. */
+    public: inline int32_t getPacketLength (int32_t i) const { return lengths[i]; }
+
+    /** Gets the number of octets published but not yet received by this reader. */
+    public: int64_t getBacklog () const;
+
+    /** Gets the number of packets received. */
+    public: inline int64_t getPacketsReceived () const { return packetsReceived; }
+
+    /** Gets the number of octets of packets received. */
+    public: inline int64_t getBytesReceived () const { return bytesReceived; }
+
+    /** Maps the ring and claims a reader slot. */
+    private: void init (int fd);
+
+    /** Marks the current batch as read, waking the writer if it is waiting. */
+    private: void release ();
+
+    // The mapping and reader slot are owned by this instance.
+    private: SharedRingReader (const SharedRingReader &r);
+    private: SharedRingReader& operator= (const SharedRingReader &r);
+  };
+} END_NAMESPACE
+#endif /* _SharedRing_h */
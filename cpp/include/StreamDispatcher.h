@@ -0,0 +1,297 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _StreamDispatcher_h
+#define _StreamDispatcher_h
+
+#include "VRTObject.h"
+#include "BasicVRTPacket.h"
+#include "PacketQueue.h"
+#include "StreamTable.h"
+#include "VRTPacketView.h"
+#include <pthread.h>
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  struct DispatchRoute;
+  struct DispatchWorker;
+
+  /** Receives the packets routed to it by a {@link StreamDispatcher}. */
+  class StreamHandler {
+    /** Basic destructor for the class. */
+    public: virtual ~StreamHandler () { }
+
+    /** Handles a single packet. When the dispatcher has worker threads, all of the
+     *  packets for a given stream identifier are passed to the same worker, in order.
+     *  @param p      The packet, this is only valid until the function returns.
+     *  @param worker The number of the calling worker thread (0 to N-1), or -1 if
+     *                called from the thread calling <tt>dispatch(..)</tt>.
+     *  @throws VRTException If the packet can not be handled (counted, see
+     *                       {@link StreamDispatcher#getHandlerErrors()}).
+     */
+    public: virtual void handlePacket (const VRTPacketView &p, int32_t worker) = 0;
+  };
+
+  /** Routes incoming packets to handlers (or queues) by stream identifier and packet
+   *  type. <br>
+   *  <br>
+   *  Only the first two words of each packet are read: the packet type comes from the
+   *  header word and the stream identifier (if present) from the next, via
+   *  {@link BasicVRTPacket#getStreamCode(const void*)}. Routes for a specific stream
+   *  identifier are held in a hash table; each has a packet type filter (e.g. one route
+   *  for the data packets on a stream and another for its context packets). Packets
+   *  that match no specific route are checked against the wildcard routes, which match
+   *  on the stream identifier under a bit mask, in the order they were added. Packets
+   *  that match nothing are counted and discarded. Routes must be set up before
+   *  packets are dispatched. <br>
+   *  <br>
+   *  With no worker threads each handler is called directly from <tt>dispatch(..)</tt>
+   *  using a view of the caller's buffer, so there are no copies. With worker threads,
+   *  each packet bound for a handler is copied into a pooled packet and passed (via a
+   *  {@link PacketQueue}) to the worker chosen by a hash of its stream identifier. The
+   *  data and context packets of a stream therefore always go to the same worker and
+   *  stay in order, while different streams are processed in parallel without any
+   *  shared locks. <br>
+   *  <br>
+   *  A route can also deliver to a {@link PacketQueue} owned by the user, in which
+   *  case the packets are copied into packets from {@link #getPool()}, which the user
+   *  should return to the pool once finished with them. <br>
+   *  <br>
+   *  The <tt>dispatch(..)</tt> functions must only be called from one thread at a time.
+   *  Typical usage:
+   *  <pre>
+   *    StreamDispatcher dispatcher(4);
+   *    dispatcher.addRoute(0x100, &tunerHandler);
+   *    dispatcher.addRoute(0x200, &audioHandler, StreamDispatcher::TYPES_DATA);
+   *    dispatcher.addWildcardRoute(0, 0, &logHandler, StreamDispatcher::TYPES_CONTEXT);
+   *    dispatcher.start();
+   *
+   *    while (receiver.receive(100) >= 0) {
+   *      for (int32_t i = 0; i < receiver.getCount(); i++) {
+   *        dispatcher.route(receiver.getPacketPointer(i), receiver.getPacketLength(i));
+   *      }
+   *      dispatcher.flush();
+   *    }
+   *  </pre>
+   */
+  class StreamDispatcher : public VRTObject {
+    /** Packet type filter bit for the given type. */
+    public: static inline int32_t typeBit (PacketType t) { return 1 << (int32_t)t; }
+
+    /** Packet type filter matching all data packets (including extension data). */
+    public: static const int32_t TYPES_DATA    = 0x000F;
+
+    /** Packet type filter matching all context packets (including extension context). */
+    public: static const int32_t TYPES_CONTEXT = 0x0030;
+
+    /** Packet type filter matching all command packets (including extension command). */
+    public: static const int32_t TYPES_COMMAND = 0x00C0;
+
+    /** Packet type filter matching all packet types. */
+    public: static const int32_t TYPES_ALL     = 0xFFFF;
+
+    /** The stream identifier used to route packets without a stream identifier (note
+     *  that this is not a valid stream identifier since it is outside the 32-bit
+     *  range).
+     */
+    public: static const int64_t NO_STREAM     = __INT64_C(-1);
+
+    /** The default capacity of each worker's queue (4096 packets). */
+    public: static const int32_t DEFAULT_QUEUE_SIZE = 4096;
+
+    /** The maximum number of packets staged for a worker before they are passed on. */
+    public: static const int32_t STAGE_SIZE = 64;
+
+    private: vector<DispatchRoute*>  routes;       // All routes
+    private: vector<int32_t>         wildcards;    // Wildcard routes (indexes into routes) in order
+    private: StreamTable             table;        // First route for each stream ID
+    private: PacketPool              pool;         // Pool for packets copied to workers or queues
+    private: OverflowPolicy          policy;       // What to do when a queue is full
+    private: vector<DispatchWorker*> workers;      // The worker threads
+    private: bool                    started;      // Have the workers been started?
+    private: bool                    stopped;      // Have the workers been stopped?
+    private: int64_t                 packetsDispatched; // Metrics (see get functions)
+    private: int64_t                 packetsUnrouted;
+    private: int64_t                 packetsInvalid;
+    private: int64_t                 packetsDropped;
+    private: volatile int64_t        handlerErrors;
+
+    /** Creates a new instance.
+     *  @param numWorkers The number of worker threads (0 to call the handlers from the
+     *                    thread calling <tt>dispatch(..)</tt>).
+     *  @param queueSize  The capacity of each worker's queue (also used to size the
+     *                    packet pool).
+     *  @param bufferSize The initial buffer size for pooled packets (the buffer of a
+     *                    pooled packet grows if a larger packet is copied into it).
+     *  @param policy     What to do when a worker's queue (or a route's queue) is full.
+     *  @throws VRTException If any of the parameters are invalid.
+     */
+    public: StreamDispatcher (int32_t numWorkers=0, int32_t queueSize=DEFAULT_QUEUE_SIZE,
+                              int32_t bufferSize=65536, OverflowPolicy policy=OverflowPolicy_Block);
+
+    /** Basic destructor for the class. This calls {@link #stop()}. */
+    public: ~StreamDispatcher ();
+
+    public: virtual string toString () const;
+
+    /** Adds a route for a specific stream identifier.
+     *  @param streamID The stream identifier, or {@link #NO_STREAM} for packets without
+     *                  one.
+     *  @param handler  The handler for the packets.
+     *  @param types    The packet type filter (see {@link #typeBit} and the
+     *                  <tt>TYPES_*</tt> constants).
+     *  @throws VRTException If the dispatcher has been started or the parameters are
+     *                       invalid.
+     */
+    public: void addRoute (int64_t streamID, StreamHandler *handler, int32_t types=TYPES_ALL);
+
+    /** Adds a route for a specific stream identifier that delivers to a queue. See
+     *  {@link #addRoute(int64_t,StreamHandler*,int32_t)}.
+     */
+    public: void addRoute (int64_t streamID, PacketQueue *queue, int32_t types=TYPES_ALL);
+
+    /** Adds a wildcard route, matching any stream identifier for which
+     *  <tt>(streamID &amp; mask) == value</tt>. For example a mask of 0 matches all
+     *  packets (including those without a stream identifier) and a mask of 0xFFFF0000
+     *  matches a block of 65536 stream identifiers. Packets without a stream identifier
+     *  only match a wildcard with a mask of 0 or a value of {@link #NO_STREAM}.
+     *  @param value   The stream identifier value to match.
+     *  @param mask    The stream identifier mask.
+     *  @param handler The handler for the packets.
+     *  @param types   The packet type filter.
+     *  @throws VRTException If the dispatcher has been started or the parameters are
+     *                       invalid.
+     */
+    public: void addWildcardRoute (int64_t value, int64_t mask, StreamHandler *handler,
+                                   int32_t types=TYPES_ALL);
+
+    /** Adds a wildcard route that delivers to a queue. See
+     *  {@link #addWildcardRoute(int64_t,int64_t,StreamHandler*,int32_t)}.
+     */
+    public: void addWildcardRoute (int64_t value, int64_t mask, PacketQueue *queue,
+                                   int32_t types=TYPES_ALL);
+
+    /** Starts the worker threads (if any). This is called automatically by the first
+     *  call to <tt>dispatch(..)</tt> or {@link #route}.
+     *  @throws VRTException If a thread can not be started.
+     */
+    public: void start ();
+
+    /** Stops the worker threads (if any) once they have processed all of the packets
+     *  already dispatched. No routes can be added once stopped.
+     */
+    public: void stop ();
+
+    /** Gets the number of worker threads. */
+    public: inline int32_t getNumWorkers () const { return (int32_t)workers.size(); }
+
+    /** Gets the worker used for the given stream identifier (-1 if there are no
+     *  worker threads).
+     */
+    public: inline int32_t getWorker (int64_t streamID) const {
+      return (workers.empty())? -1 : StreamTable::getShard(streamID, (int32_t)workers.size());
+    }
+
+    /** Gets the pool holding the packets passed to routes that deliver to a queue. */
+    public: inline PacketPool &getPool () { return pool; }
+
+    /** Routes a single packet, packets for worker threads are staged until
+     *  {@link #flush()} is called (or enough are staged). This is used to dispatch a
+     *  batch of packets at the lowest cost.
+     *  @param ptr Pointer to the packet.
+     *  @param len The number of octets available (at least the packet length).
+     */
+    public: void route (const void *ptr, int32_t len);
+
+    /** Passes any packets staged by {@link #route} to the worker threads. */
+    public: void flush ();
+
+    /** Dispatches a single packet. This is the same as {@link #route} followed by
+     *  {@link #flush()}.
+     */
+    public: inline void dispatch (const void *ptr, int32_t len) {
+      route(ptr, len);
+      flush();
+    }
+
+    /** Dispatches a single packet. */
+    public: inline void dispatch (const VRTPacketView &p) {
+      dispatch(p.getPacketPointer(), p.getPacketLength());
+    }
+
+    /** Dispatches a single packet. */
+    public: inline void dispatch (const BasicVRTPacket &p) {
+      dispatch(&p.bbuf[0], p.getPacketLength());
+    }
+
+    /** Dispatches a batch of packets.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     */
+    public: void dispatch (const BasicVRTPacket *const *packets, int32_t n);
+
+    /** Gets the number of packets dispatched to a handler or queue. */
+    public: inline int64_t getPacketsDispatched () const { return packetsDispatched; }
+
+    /** Gets the number of packets that matched no route. */
+    public: inline int64_t getPacketsUnrouted () const { return packetsUnrouted; }
+
+    /** Gets the number of packets discarded as invalid (too short for their header). */
+    public: inline int64_t getPacketsInvalid () const { return packetsInvalid; }
+
+    /** Gets the number of packets dropped because a queue was full (see
+     *  {@link OverflowPolicy_Drop}) or the workers have been stopped.
+     */
+    public: inline int64_t getPacketsDropped () const { return packetsDropped; }
+
+    /** Gets the number of exceptions thrown by handlers. */
+    public: inline int64_t getHandlerErrors () const { return handlerErrors; }
+
+    /** Finds the route for a packet, returns -1 if none. */
+    private: int32_t findRoute (int64_t streamID, int32_t type) const;
+
+    /** Calls a handler, counting any exception thrown. */
+    private: void callHandler (StreamHandler *handler, const VRTPacketView &p, int32_t worker);
+
+    /** Copies a packet into a packet from the pool. */
+    private: BasicVRTPacket *copyPacket (const char *ptr, int32_t len);
+
+    /** Adds a route (common code). */
+    private: void addRoute (int64_t streamID, int64_t mask, bool wildcard, StreamHandler *handler,
+                            PacketQueue *queue, int32_t types);
+
+    /** Passes the packets staged for a worker to its queue. */
+    private: void flushWorker (DispatchWorker *w);
+
+    /** Runs a worker thread. */
+    private: void runWorker (DispatchWorker *w);
+
+    /** Thread entry point for a worker. */
+    private: static void *runThread (void *arg);
+
+    // The worker threads are owned by this instance.
+    private: StreamDispatcher (const StreamDispatcher &d);
+    private: StreamDispatcher& operator= (const StreamDispatcher &d);
+  };
+} END_NAMESPACE
+#endif /* _StreamDispatcher_h */
@@ -0,0 +1,95 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _StreamTable_h
+#define _StreamTable_h
+
+#include "VRTObject.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> An open-addressing hash table mapping a stream identifier
+   *  to an index (e.g. into a list of per-stream state). This is used on the per-packet
+   *  path of the classes that keep state by stream, so a lookup is a multiply and
+   *  (usually) a single probe. The table is kept no more than half full so the probes
+   *  stay short. Entries can not be removed, other than by clearing the table. <br>
+   *  <br>
+   *  This also provides the hash used to spread streams over worker threads so that
+   *  all of the classes doing so pick the same worker for a given stream.
+   */
+  class StreamTable : public VRTObject {
+    /** The initial number of slots in the table. */
+    public: static const int32_t INITIAL_SIZE = 64;
+
+    private: vector<int64_t> keys;    // The keys (stream ID, INT64_NULL if empty)
+    private: vector<int32_t> values;  // The values (-1 if empty)
+    private: int32_t         used;    // Number of entries in use
+
+    /** Creates a new, empty instance. */
+    public: StreamTable ();
+
+    public: virtual string toString () const;
+
+    /** Removes all of the entries (the table keeps its current size). */
+    public: void clear ();
+
+    /** Gets the number of entries in the table. */
+    public: inline int32_t getSize () const { return used; }
+
+    /** Finds the value for a stream identifier.
+     *  @param streamID The stream identifier.
+     *  @return The value or -1 if not found.
+     */
+    public: inline int32_t find (int64_t streamID) const {
+      uint32_t mask = (uint32_t)keys.size() - 1;
+      for (uint32_t i = hash(streamID) & mask; !isNull(keys[i]); i = (i + 1) & mask) {
+        if (keys[i] == streamID) return values[i];
+      }
+      return -1;
+    }
+
+    /** Adds the value for a stream identifier, unless it is already present.
+     *  @param streamID The stream identifier (must not be INT64_NULL).
+     *  @param value    The value (must not be negative).
+     *  @return The existing value (unchanged) or -1 if the value was added.
+     */
+    public: int32_t insert (int64_t streamID, int32_t value);
+
+    /** Hash used for the table slots. */
+    public: static inline uint32_t hash (int64_t streamID) {
+      uint64_t h = (uint64_t)streamID * __UINT64_C(0x9E3779B97F4A7C15);
+      return (uint32_t)(h >> 32);
+    }
+
+    /** Gets the shard (e.g. worker thread) used for a stream identifier.
+     *  @param streamID The stream identifier.
+     *  @param count    The number of shards (must be positive).
+     *  @return The shard number (0 to count-1).
+     */
+    public: static inline int32_t getShard (int64_t streamID, int32_t count) {
+      uint32_t h = (uint32_t)streamID * 0x9E3779B1u;
+      return (int32_t)((h >> 16) % (uint32_t)count);
+    }
+  };
+} END_NAMESPACE
+#endif /* _StreamTable_h */
@@ -0,0 +1,260 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _UDPPacketReceiver_h
+#define _UDPPacketReceiver_h
+
+#include "VRTObject.h"
+#include "InetAddress.h"
+#include "VRTPacketView.h"
+#include <sys/socket.h>
+#include <time.h>
+
+struct mmsghdr;
+struct iovec;
+
+namespace vrt {
+  /** Receives VRT packets sent over UDP, one packet per datagram. <br>
+   *  <br>
+   *  Datagrams are received in batches (using <tt>recvmmsg(..)</tt> where available)
+   *  directly into a slab of buffers allocated when the receiver is created, so no
+   *  allocation or copying is done per packet. Each call to {@link #receive} fills
+   *  the batch and the packets are then accessed as {@link VRTPacketView} instances
+   *  that point into the slab; these are only valid until the next call to
+   *  {@link #receive} (or {@link #close()}). <br>
+   *  <br>
+   *  Datagrams that were truncated (longer than the buffer size) or whose length does
+   *  not match the packet length in the VRT header are dropped and counted, they are
+   *  not included in the batch. If enabled, the kernel receive time of each datagram
+   *  is available via {@link #getArrivalTime}. Where supported, the number of
+   *  datagrams dropped by the kernel due to a full socket buffer is reported via
+   *  {@link #getDroppedCount()}. <br>
+   *  <br>
+   *  Instances are not thread-safe, use one receiver per thread. Typical usage:
+   *  <pre>
+   *    UDPPacketReceiver rx(port, "0.0.0.0");
+   *    rx.setReceiveBufferSize(32*1024*1024);
+   *    rx.joinGroup(InetAddress("239.1.2.3"), "eth0");
+   *
+   *    while (running) {
+   *      int32_t n = rx.receive(100);
+   *      for (int32_t i = 0; i < n; i++) {
+   *        VRTPacketView p = rx.getPacket(i);
+   *        ...
+   *      }
+   *    }
+   *  </pre>
+   */
+  class UDPPacketReceiver : public VRTObject {
+    /** The default number of datagrams received per batch (64). */
+    public: static const int32_t DEFAULT_BATCH_SIZE = 64;
+
+    /** The default size of each datagram buffer in octets (65536, large enough for
+     *  any UDP datagram).
+     */
+    public: static const int32_t DEFAULT_BUFFER_SIZE = 65536;
+
+    private: int                      sock;          // The socket (-1 if closed)
+    private: int32_t                  family;        // The address family (AF_INET/AF_INET6)
+    private: int32_t                  port;          // The local port
+    private: int32_t                  batchSize;     // Number of datagrams per batch
+    private: int32_t                  bufferSize;    // Size of each datagram buffer
+    private: bool                     timestamps;    // Are arrival times enabled?
+    private: char                    *slab;          // The datagram buffers
+    private: struct mmsghdr          *msgs;          // Message headers (one per buffer)
+    private: struct iovec            *iovs;          // I/O vectors (one per buffer)
+    private: struct sockaddr_storage *addrs;         // Source addresses (one per buffer)
+    private: char                    *control;       // Control buffers (one per buffer)
+    private: int32_t                  controlSize;   // Size of each control buffer
+    private: struct timespec         *times;         // Arrival times (one per buffer)
+    private: int32_t                 *index;         // Buffer used for each packet in the batch
+    private: int32_t                  count;         // Number of packets in the batch
+    private: int32_t                  used;          // Number of buffers used by the last batch
+    private: int64_t                  packetsReceived; // Metrics (see get functions)
+    private: int64_t                  bytesReceived;
+    private: int64_t                  batchCount;
+    private: int64_t                  invalidCount;
+    private: int64_t                  truncatedCount;
+    private: int64_t                  droppedCount;
+
+    /** Creates a new instance, opening and binding the socket.
+     *  @param port       The local port to bind to (0 to have one assigned, see
+     *                    {@link #getPort()}).
+     *  @param host       The local address to bind to, or "" for any IPv4 address
+     *                    (use "::" for any IPv6 address). To receive multicast
+     *                    traffic bind to the group address (or any address) and then
+     *                    call {@link #joinGroup}.
+     *  @param batchSize  The maximum number of datagrams received per batch.
+     *  @param bufferSize The size of each datagram buffer in octets, longer datagrams
+     *                    are counted as truncated and dropped.
+     *  @param timestamps Should the kernel receive time of each datagram be recorded
+     *                    (<tt>SO_TIMESTAMPNS</tt>)?
+     *  @throws VRTException If any of the parameters are invalid or the socket can not
+     *                       be opened.
+     */
+    public: UDPPacketReceiver (int32_t port, const string &host="",
+                               int32_t batchSize=DEFAULT_BATCH_SIZE,
+                               int32_t bufferSize=DEFAULT_BUFFER_SIZE,
+                               bool timestamps=false);
+
+    /** Basic destructor for the class. This calls {@link #close()}. */
+    public: ~UDPPacketReceiver ();
+
+    public: virtual string toString () const;
+
+    /** Closes the socket and releases the buffers. Calling this a second time has no
+     *  effect.
+     */
+    public: void close ();
+
+    /** Is the receiver open? */
+    public: inline bool isOpen () const { return (sock >= 0); }
+
+    /** Gets the socket file descriptor (-1 if closed). This is intended for use with
+     *  <tt>poll(..)</tt> and similar, reading from it directly will lose packets.
+     */
+    public: inline int getSocket () const { return sock; }
+
+    /** Gets the local port the socket is bound to. */
+    public: inline int32_t getPort () const { return port; }
+
+    /** Gets the maximum number of datagrams received per batch. */
+    public: inline int32_t getBatchSize () const { return batchSize; }
+
+    /** Gets the size of each datagram buffer in octets. */
+    public: inline int32_t getBufferSize () const { return bufferSize; }
+
+    /** Sets the socket receive buffer size (<tt>SO_RCVBUF</tt>). If the size is above
+     *  the system limit (<tt>net.core.rmem_max</tt>) <tt>SO_RCVBUFFORCE</tt> is tried
+     *  first, which requires <tt>CAP_NET_ADMIN</tt>. Use
+     *  {@link #getReceiveBufferSize()} to see the size actually set.
+     *  @param size The requested size in octets.
+     *  @throws VRTException If the size is invalid or the receiver is closed.
+     */
+    public: void setReceiveBufferSize (int32_t size);
+
+    /** Gets the socket receive buffer size in octets (as reported by the system,
+     *  which on Linux is double the usable size).
+     *  @throws VRTException If the receiver is closed.
+     */
+    public: int32_t getReceiveBufferSize () const;
+
+    /** Joins a multicast group.
+     *  @param group  The group address (IPv4 or IPv6, matching the bound address).
+     *  @param device The name of the network interface to join on (e.g. "eth0"), or
+     *                "" to let the system choose.
+     *  @throws VRTException If the address is not a multicast address, the device is
+     *                       unknown or the join fails.
+     */
+    public: void joinGroup (const InetAddress &group, const string &device="");
+
+    /** Leaves a multicast group previously joined with {@link #joinGroup}.
+     *  @param group  The group address.
+     *  @param device The name of the network interface, as passed to {@link #joinGroup}.
+     *  @throws VRTException If the leave fails.
+     */
+    public: void leaveGroup (const InetAddress &group, const string &device="");
+
+    /** Receives the next batch of packets. This waits for at least one datagram to
+     *  arrive (or the timeout to expire) and then takes all of the datagrams already
+     *  queued, up to the batch size. All views from the previous batch become invalid.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever, 0
+     *                 to return immediately if nothing is queued).
+     *  @return The number of packets received, 0 on timeout (or if interrupted by a
+     *          signal, or if all of the datagrams received were invalid).
+     *  @throws VRTException If the receiver is closed or there is a socket error.
+     */
+    public: int32_t receive (int32_t timeout=-1);
+
+    /** Gets the number of packets in the current batch. */
+    public: inline int32_t getCount () const { return count; }
+
+    /** Gets a packet from the current batch. The view is only valid until the next
+     *  call to {@link #receive}.
+     *  @param i The packet number (0 to {@link #getCount()}-1).
+     */
+    public: inline VRTPacketView getPacket (int32_t i) const {
+      int32_t b = index[i];
+      return VRTPacketView(&slab[(size_t)b * bufferSize], msgLength(b));
+    }
+
+    /** Gets a pointer to a packet in the current batch. */
+    public: inline const char *getPacketPointer (int32_t i) const {
+      return &slab[(size_t)index[i] * bufferSize];
+    }
+
+    /** Gets the length of a packet in the current batch. */
+    public: inline int32_t getPacketLength (int32_t i) const { return msgLength(index[i]); }
+
+    /** Gets the kernel receive time (<tt>CLOCK_REALTIME</tt>) of a packet in the
+     *  current batch. This is zero if arrival times were not enabled.
+     */
+    public: inline const struct timespec &getArrivalTime (int32_t i) const {
+      return times[index[i]];
+    }
+
+    /** Gets the source address of a packet in the current batch. */
+    public: InetAddress getSourceAddress (int32_t i) const;
+
+    /** Gets the source port of a packet in the current batch. */
+    public: int32_t getSourcePort (int32_t i) const;
+
+    /** Gets the number of packets received (excluding any dropped as invalid). */
+    public: inline int64_t getPacketsReceived () const { return packetsReceived; }
+
+    /** Gets the number of octets of packets received. */
+    public: inline int64_t getBytesReceived () const { return bytesReceived; }
+
+    /** Gets the number of non-empty batches received. */
+    public: inline int64_t getBatchCount () const { return batchCount; }
+
+    /** Gets the number of datagrams dropped because the length did not match the
+     *  packet length in the VRT header.
+     */
+    public: inline int64_t getInvalidCount () const { return invalidCount; }
+
+    /** Gets the number of datagrams dropped because they exceeded the buffer size. */
+    public: inline int64_t getTruncatedCount () const { return truncatedCount; }
+
+    /** Gets the number of datagrams the kernel reports as dropped due to a full socket
+     *  buffer (<tt>SO_RXQ_OVFL</tt>), this is always 0 where not supported. The count
+     *  is only updated when a datagram is received.
+     */
+    public: inline int64_t getDroppedCount () const { return droppedCount; }
+
+    /** Gets the length of the datagram in the given buffer. */
+    private: int32_t msgLength (int32_t b) const;
+
+    /** Checks the datagrams just received and builds the batch index. */
+    private: int32_t processBatch (int32_t n);
+
+    /** Resets the message headers for the buffers used by the last batch. */
+    private: void resetHeaders ();
+
+    /** Joins or leaves a multicast group. */
+    private: void changeGroup (const InetAddress &group, const string &device, bool join);
+
+    // The socket and buffers are owned by this instance.
+    private: UDPPacketReceiver (const UDPPacketReceiver &r);
+    private: UDPPacketReceiver& operator= (const UDPPacketReceiver &r);
+  };
+} END_NAMESPACE
+#endif /* _UDPPacketReceiver_h */
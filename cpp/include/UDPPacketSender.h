@@ -0,0 +1,236 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _UDPPacketSender_h
+#define _UDPPacketSender_h
+
+#include "VRTObject.h"
+#include "InetAddress.h"
+#include "BasicVRTPacket.h"
+#include "BasicVRLFrame.h"
+#include <vector>
+
+struct mmsghdr;
+struct iovec;
+
+using namespace std;
+
+namespace vrt {
+  class SenderDestination;
+
+  /** Sends VRT packets (or VRL frames) over UDP, one packet per datagram. <br>
+   *  <br>
+   *  Packets are sent in batches using <tt>sendmmsg(..)</tt>. Where the system
+   *  supports UDP generic segmentation offload (<tt>UDP_SEGMENT</tt>), consecutive
+   *  packets in a batch that have the same length (as is typical for data packets)
+   *  are passed to the kernel as a single "super-datagram" that is split into the
+   *  individual datagrams further down the stack (or by the network card), which
+   *  greatly reduces the per-packet cost. If a destination rejects a segmented send
+   *  (e.g. when the packet length exceeds the path MTU), segmentation is switched off
+   *  for that destination and the packets are re-sent individually. <br>
+   *  <br>
+   *  Each destination (see {@link #addDestination}) has a pool of one or more
+   *  connected sockets. The socket used for each send is selected by a caller-supplied
+   *  key (typically the stream identifier) so that all packets in a stream go via the
+   *  same socket and stay in order, while different streams can be spread over
+   *  several sockets (and hence source ports, which lets the receiver spread them over
+   *  several receive queues). <br>
+   *  <br>
+   *  The <tt>send(..)</tt> functions do not throw exceptions: packets that could not
+   *  be sent (including those given an invalid destination number, which are reported
+   *  as <tt>EINVAL</tt>) are counted and the most recent error is recorded (see
+   *  {@link #getErrorCount()} and {@link #getLastError()}). The other functions throw
+   *  a {@link VRTException} on error. Instances are not thread-safe, use one sender
+   *  per thread. Typical usage:
+   *  <pre>
+   *    UDPPacketSender sender;
+   *    int32_t         dest = sender.addDestination(InetAddress("239.1.2.3"), port);
+   *
+   *    vector<BasicVRTPacket*> batch;
+   *    ...
+   *    sender.send(dest, batch);
+   *  </pre>
+   */
+  class UDPPacketSender : public VRTObject {
+    /** The default number of messages passed to the kernel per call (64). */
+    public: static const int32_t DEFAULT_BATCH_SIZE = 64;
+
+    /** The maximum number of packets combined into one segmented send (64). */
+    public: static const int32_t MAX_SEGMENTS = 64;
+
+    private: vector<SenderDestination*> dests;        // The destinations
+    private: int32_t                    batchSize;    // Max messages per call
+    private: bool                       gso;          // Use segmentation offload if available?
+    private: int32_t                    sendBufferSize; // Socket send buffer size (0=default)
+    private: struct mmsghdr            *msgs;         // Message headers (one per message)
+    private: struct iovec              *iovs;         // Packet vectors for packet/frame objects
+    private: int32_t                   *segs;         // Number of packets in each message
+    private: char                      *control;      // Control buffers (one per message)
+    private: int64_t                    packetsSent;  // Metrics (see get functions)
+    private: int64_t                    bytesSent;
+    private: int64_t                    callCount;
+    private: int64_t                    segmentedCount;
+    private: int64_t                    errorCount;
+    private: int32_t                    lastError;
+
+    /** Creates a new instance with no destinations.
+     *  @param batchSize The maximum number of messages passed to the kernel per call
+     *                   (1 to 1024). Without segmentation offload each message is one
+     *                   packet, with it a message can hold up to {@link #MAX_SEGMENTS}
+     *                   packets.
+     *  @param gso       Should UDP segmentation offload be used where available?
+     *  @throws VRTException If the batch size is invalid.
+     */
+    public: UDPPacketSender (int32_t batchSize=DEFAULT_BATCH_SIZE, bool gso=true);
+
+    /** Basic destructor for the class. This calls {@link #close()}. */
+    public: ~UDPPacketSender ();
+
+    public: virtual string toString () const;
+
+    /** Closes all of the sockets and removes all of the destinations. */
+    public: void close ();
+
+    /** Adds a destination.
+     *  @param host       The destination address (unicast or multicast).
+     *  @param port       The destination port.
+     *  @param numSockets The number of sockets in the pool for the destination.
+     *  @param device     The name of the network interface to send multicast traffic
+     *                    on (e.g. "eth0"), or "" to let the system choose. This is
+     *                    ignored for unicast destinations.
+     *  @param ttl        The time-to-live (hop limit) to use, or -1 for the system
+     *                    default.
+     *  @return The destination number, used when calling <tt>send(..)</tt>.
+     *  @throws VRTException If any of the parameters are invalid or the sockets can not
+     *                       be opened.
+     */
+    public: int32_t addDestination (const InetAddress &host, int32_t port, int32_t numSockets=1,
+                                    const string &device="", int32_t ttl=-1);
+
+    /** Gets the number of destinations. */
+    public: inline int32_t getNumDestinations () const { return (int32_t)dests.size(); }
+
+    /** Is segmentation offload in use for the given destination? This will be false if
+     *  it was not requested, is not supported or was switched off following an error.
+     */
+    public: bool isSegmented (int32_t dest) const;
+
+    /** Sets the socket send buffer size (<tt>SO_SNDBUF</tt>) for all current and future
+     *  sockets. If the size is above the system limit (<tt>net.core.wmem_max</tt>)
+     *  <tt>SO_SNDBUFFORCE</tt> is tried first, which requires <tt>CAP_NET_ADMIN</tt>.
+     *  @param size The requested size in octets.
+     *  @throws VRTException If the size is invalid or can not be set.
+     */
+    public: void setSendBufferSize (int32_t size);
+
+    /** Sends a batch of packets.
+     *  @param dest    The destination number.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     *  @param key     Selects the socket used from the destination's pool (typically
+     *                 the stream identifier).
+     *  @return The number of packets sent (packets not sent are counted as errors).
+     */
+    public: int32_t send (int32_t dest, const BasicVRTPacket *const *packets, int32_t n,
+                          uint32_t key=0);
+
+    /** Sends a batch of packets. See {@link #send(int32_t,const BasicVRTPacket*const*,int32_t,uint32_t)}. */
+    public: inline int32_t send (int32_t dest, const vector<BasicVRTPacket*> &packets,
+                                 uint32_t key=0) {
+      if (packets.empty()) return 0;
+      return send(dest, &packets[0], (int32_t)packets.size(), key);
+    }
+
+    /** Sends a batch of VRL frames.
+     *  @param dest   The destination number.
+     *  @param frames The frames.
+     *  @param n      The number of frames.
+     *  @param key    Selects the socket used from the destination's pool.
+     *  @return The number of frames sent (frames not sent are counted as errors).
+     */
+    public: int32_t send (int32_t dest, const BasicVRLFrame *const *frames, int32_t n,
+                          uint32_t key=0);
+
+    /** Sends a batch of VRL frames. See {@link #send(int32_t,const BasicVRLFrame*const*,int32_t,uint32_t)}. */
+    public: inline int32_t send (int32_t dest, const vector<BasicVRLFrame*> &frames,
+                                 uint32_t key=0) {
+      if (frames.empty()) return 0;
+      return send(dest, &frames[0], (int32_t)frames.size(), key);
+    }
+
+    /** Sends a batch of packets (or frames) already in memory. This is the lowest-cost
+     *  form since the vectors are passed to the kernel as-is.
+     *  @param dest The destination number.
+     *  @param iov  The packets, one vector per packet.
+     *  @param n    The number of packets.
+     *  @param key  Selects the socket used from the destination's pool.
+     *  @return The number of packets sent (packets not sent are counted as errors).
+     */
+    public: int32_t send (int32_t dest, const struct iovec *iov, int32_t n, uint32_t key=0);
+
+    /** Sends a single packet (or frame) already in memory.
+     *  @param dest The destination number.
+     *  @param ptr  Pointer to the packet.
+     *  @param len  The length of the packet in octets.
+     *  @param key  Selects the socket used from the destination's pool.
+     *  @return true if sent, false otherwise (counted as an error).
+     */
+    public: bool send (int32_t dest, const void *ptr, int32_t len, uint32_t key=0);
+
+    /** Gets the number of packets sent. */
+    public: inline int64_t getPacketsSent () const { return packetsSent; }
+
+    /** Gets the number of octets of packets sent. */
+    public: inline int64_t getBytesSent () const { return bytesSent; }
+
+    /** Gets the number of calls made to the kernel. */
+    public: inline int64_t getCallCount () const { return callCount; }
+
+    /** Gets the number of segmented (multi-packet) datagrams sent. */
+    public: inline int64_t getSegmentedCount () const { return segmentedCount; }
+
+    /** Gets the number of packets that could not be sent. */
+    public: inline int64_t getErrorCount () const { return errorCount; }
+
+    /** Gets the error number (<tt>errno</tt>) of the most recent send error, or 0 if
+     *  there has not been one.
+     */
+    public: inline int32_t getLastError () const { return lastError; }
+
+    /** Gets the socket for the given destination and key, or -1 if the destination
+     *  is invalid.
+     */
+    private: int getSocket (int32_t dest, uint32_t key) const;
+
+    /** Sends packets via the given socket, passing up to batchSize messages to the
+     *  kernel per call.
+     */
+    private: int32_t sendVectors (SenderDestination *d, int sock, const struct iovec *iov, int32_t n);
+
+    /** Applies the socket options to a new socket. */
+    private: void setSocketOptions (int sock);
+
+    // The sockets and buffers are owned by this instance.
+    private: UDPPacketSender (const UDPPacketSender &s);
+    private: UDPPacketSender& operator= (const UDPPacketSender &s);
+  };
+} END_NAMESPACE
+#endif /* _UDPPacketSender_h */
@@ -47,6 +47,21 @@ namespace vrt {
      */
     int64_t currentTimeMillis ();
 
+    /** <b>Internal Use Only:</b> Gets the current time on the monotonic clock in
+     *  milliseconds. Unlike <tt>currentTimeMillis()</tt> this is not affected by
+     *  changes to the system time, which makes it the one to use for timeouts.
+     */
+    int64_t monotonicTimeMillis ();
+
+    /** <b>Internal Use Only:</b> Hints to the processor that the caller is in a
+     *  busy-wait loop (a no-op where there is no such hint).
+     */
+    inline void cpuRelax () {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_ia32_pause();
+#endif
+    }
+
     /** Sleeps for the given period and ignores any interrupted exceptions (EINTR).
      *  @param ms The time to sleep in ms.
      */
@@ -0,0 +1,218 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRAIndex_h
+#define _VRAIndex_h
+
+#include "VRTObject.h"
+#include "VRTPacketView.h"
+#include "TimeStamp.h"
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** A single entry in a {@link VRAIndex}. */
+  typedef struct VRAIndexEntry {
+    int64_t  offset;     ///< Offset of the packet in the VRA file
+    int64_t  classID;    ///< Class identifier (INT64_NULL if n/a)
+    uint64_t tsf;        ///< Fractional time stamp (0 if n/a)
+    uint32_t tsi;        ///< Integer time stamp (0 if n/a)
+    int32_t  streamID;   ///< Stream identifier (INT32_NULL if n/a)
+    int8_t   packetType; ///< Packet type (see PacketType)
+    int8_t   tsiMode;    ///< Integer time stamp mode (see IntegerMode)
+    int8_t   tsfMode;    ///< Fractional time stamp mode (see FractionalMode)
+  } VRAIndexEntry_t;
+
+  /** An index of the packets in a VRA file, permitting random access by time and
+   *  stream ID. The index records the file offset, stream ID, packet type, class ID
+   *  and time stamp for every packet, or for every Nth packet on each stream (the
+   *  first packet on each stream is always recorded). <br>
+   *  <br>
+   *  An index is normally kept in a "sidecar" file next to the VRA file (with
+   *  {@link #FILE_NAME_EXT} appended to the name). It can be written incrementally
+   *  as packets are appended to a VRA file (see {@link AbstractVRAFile#setIndex}),
+   *  or built/extended by scanning an existing file (see
+   *  {@link AbstractVRAFile#updateIndex}). The sidecar format is:
+   *  <pre>
+   *    Header (24 octets, big-endian):
+   *      0..3    'V','R','A','I'
+   *      4       Version (1)
+   *      5..7    Reserved (0)
+   *      8..11   Interval (N)
+   *      12..15  Reserved (0)
+   *      16..23  Covered length (VRA file offset one past the last packet seen)
+   *    Entries (40 octets each, big-endian):
+   *      0..7    Packet offset
+   *      8..15   Class ID (INT64_NULL if n/a)
+   *      16..23  TSF
+   *      24..27  TSI
+   *      28..31  Stream ID (INT32_NULL if n/a)
+   *      32      Packet type
+   *      33      TSI mode
+   *      34      TSF mode
+   *      35..39  Reserved (0)
+   *  </pre>
+   *  Entries whose offset is at or beyond the covered length are discarded when
+   *  the sidecar is read (this handles a sidecar that was not closed cleanly), and
+   *  the remainder of the file can then be picked up by a scan. <br>
+   *  <br>
+   *  Time searches only consider entries with UTC or GPS time stamps; these are
+   *  compared as GPS seconds plus picoseconds (the fractional part is ignored unless
+   *  it is real-time), so UTC and GPS streams in the same file can be searched
+   *  together. The searches assume that time stamps are non-decreasing within a
+   *  stream (for {@link #seek(int32_t,const TimeStamp&)}) or across the file as a
+   *  whole (for {@link #seek(const TimeStamp&)}), as is the case for a normal
+   *  recording.
+   *  Instances are not thread-safe.
+   */
+  class VRAIndex : public VRTObject {
+    /** The file name extension for sidecar index files (".idx"). */
+    public: static const string FILE_NAME_EXT;
+
+    /** The length of the sidecar header in octets. */
+    public: static const int32_t HEADER_LENGTH = 24;
+
+    /** The length of each sidecar entry in octets. */
+    public: static const int32_t ENTRY_LENGTH = 40;
+
+    /** Returned by the seek functions if no applicable entry exists. */
+    public: static const int64_t NOT_FOUND = -1;
+
+    private: int32_t                        interval;      // Record every Nth packet per stream
+    private: int64_t                        coveredLength; // Offset one past the last packet seen
+    private: vector<VRAIndexEntry>          entries;       // All entries, in file order
+    /** A time stamp as GPS seconds and picoseconds (0 unless real-time). */
+    private: typedef pair<int64_t,uint64_t> TimeKey;
+
+    private: vector<TimeKey>                keys;          // Time key for each entry (unused if untimed)
+    private: vector<int32_t>                timed;         // Entries with UTC/GPS time stamps
+    private: map<int32_t,vector<int32_t> >  byStream;      // Entries with UTC/GPS time stamps by stream ID
+    private: map<int64_t,int32_t>           counts;        // Packets since last entry by stream code
+    private: string                         fname;         // Sidecar being written ("" if n/a)
+    private: FILE                          *out;           // Sidecar being written (NULL if n/a)
+
+    /** Creates a new (empty) index.
+     *  @param interval Record every Nth packet on each stream (1=every packet).
+     *  @throws VRTException If the interval is less than 1.
+     */
+    public: VRAIndex (int32_t interval=1);
+
+    /** Basic destructor for the class. Any sidecar being written is closed. */
+    public: ~VRAIndex ();
+
+    public: virtual string toString () const;
+
+    /** Gets the sidecar file name to use for the given VRA file name. */
+    public: static inline string getIndexFileName (const string &vraFileName) {
+      return vraFileName + FILE_NAME_EXT;
+    }
+
+    /** Gets the indexing interval. */
+    public: inline int32_t getInterval () const { return interval; }
+
+    /** Gets the number of entries in the index. */
+    public: inline size_t size () const { return entries.size(); }
+
+    /** Gets the entry at the given position (entries are in file order). */
+    public: inline const VRAIndexEntry& getEntry (size_t i) const { return entries.at(i); }
+
+    /** Gets the offset one past the end of the last packet seen by the index. A scan
+     *  of the VRA file to extend the index should begin here.
+     */
+    public: inline int64_t getCoveredLength () const { return coveredLength; }
+
+    /** Notes the presence of a packet in the VRA file, adding an entry if required
+     *  by the interval. Packets must be given in file order.
+     *  @param offset The offset of the packet in the VRA file.
+     *  @param p      The packet.
+     *  @return true if an entry was added, false otherwise.
+     *  @throws VRTException If writing to the sidecar fails.
+     */
+    public: bool add (int64_t offset, const VRTPacketView &p);
+
+    /** Removes all entries from the index (does not affect the sidecar file). */
+    public: void clear ();
+
+    /** Reads the index from a sidecar file, replacing the current content. The interval
+     *  is taken from the file.
+     *  @param fname The sidecar file name.
+     *  @throws VRTException If the file can not be read or is not a valid index.
+     */
+    public: void read (const string &fname);
+
+    /** Writes the complete index to a sidecar file. If a sidecar is currently being
+     *  written incrementally it is closed first.
+     *  @param fname The sidecar file name.
+     *  @throws VRTException If the file can not be written.
+     */
+    public: void write (const string &fname);
+
+    /** Starts writing the index incrementally to the given sidecar file. The current
+     *  content is written immediately; entries added later are appended as they are
+     *  added and the header is updated by {@link #flush()} and {@link #close()}.
+     *  @param fname The sidecar file name.
+     *  @throws VRTException If the file can not be written.
+     */
+    public: void startWriting (const string &fname);
+
+    /** Flushes any sidecar being written incrementally, updating its header. */
+    public: void flush ();
+
+    /** Closes any sidecar being written incrementally, updating its header. */
+    public: void close ();
+
+    /** Finds where to start reading to get the packets at the given time. This is the
+     *  offset of the last entry with a time stamp before the one given (or the first
+     *  entry with a time stamp if none are before it), so that no packet at the given
+     *  time is skipped; the caller reads forward from there to the packets wanted.
+     *  @param ts The time stamp.
+     *  @return The offset of the entry or {@link #NOT_FOUND} if the index has no entries
+     *          with UTC/GPS time stamps (or the time stamp given is not UTC/GPS).
+     */
+    public: int64_t seek (const TimeStamp &ts) const;
+
+    /** Finds where to start reading to get the packets on a given stream at the given
+     *  time. This is the same as {@link #seek(const TimeStamp&)} except only entries
+     *  for the given stream are considered.
+     *  @param streamID The stream identifier (INT32_NULL for packets with no stream ID).
+     *  @param ts       The time stamp.
+     *  @return The offset of the entry or {@link #NOT_FOUND} if the index has no entries
+     *          for that stream with UTC/GPS time stamps (or the time stamp given is not
+     *          UTC/GPS).
+     */
+    public: int64_t seek (int32_t streamID, const TimeStamp &ts) const;
+
+    private: int64_t seek (const vector<int32_t> &list, const TimeStamp &ts) const;
+    private: static bool getTimeKey (IntegerMode tsiMode, FractionalMode tsfMode,
+                                     uint32_t tsi, uint64_t tsf, TimeKey &key);
+    private: void    addEntry (const VRAIndexEntry &e);
+    private: void    writeHeader (FILE *f) const;
+    private: void    writeEntry (FILE *f, const VRAIndexEntry &e) const;
+
+    // The sidecar file handle is owned by this instance.
+    private: VRAIndex (const VRAIndex &idx);
+    private: VRAIndex& operator= (const VRAIndex &idx);
+  };
+} END_NAMESPACE
+#endif /* _VRAIndex_h */
@@ -0,0 +1,138 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRAMergeReader_h
+#define _VRAMergeReader_h
+
+#include "VRTObject.h"
+#include "AbstractVRAFile.h"
+#include "PacketIterator.h"
+#include "VRTPacketView.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  class MergeSource;
+
+  /** Reads packets from several sources (typically VRA files recorded on different
+   *  receivers) merged into a single, time-ordered sequence. <br>
+   *  <br>
+   *  The merge is a k-way merge using a heap holding the next packet from each
+   *  source, so each packet costs <tt>O(log k)</tt> comparisons. Packets are ordered
+   *  by integer time stamp and then by fractional time stamp (for the
+   *  {@link FractionalMode_RealTime} mode, other fractional modes are not comparable
+   *  across streams and are ignored). Packets with the same time, and packets from the
+   *  same source, retain their relative order; a packet with no integer time stamp is
+   *  given the time of the previous packet from the same source (or sorts first if
+   *  there is none). All time stamps are compared in the integer mode of the first
+   *  time-stamped packet seen, packets using UTC when that is GPS (or vice versa) are
+   *  converted, other mixes are compared as-is. Each source is assumed to already be
+   *  in time order. <br>
+   *  <br>
+   *  For {@link AbstractVRAFile} sources no copy of the packet is made: each source is
+   *  read through its own read-ahead window (sized per {@link AbstractVRAFile#getReadAhead()},
+   *  or 64 KiB if that is 0, and using the file's prefetch setting) and {@link #next}
+   *  returns a view into that window. Other {@link PacketContainer} sources are read
+   *  via their iterators. <br>
+   *  <br>
+   *  The sources must remain valid (and unmodified) for the life of the reader.
+   *  Instances are not thread-safe. Typical usage:
+   *  <pre>
+   *    BasicVRAFile   a(fname1, FileMode_Read);
+   *    BasicVRAFile   b(fname2, FileMode_Read);
+   *    VRAMergeReader merge;
+   *    merge.addSource(a);
+   *    merge.addSource(b);
+   *
+   *    VRTPacketView p;
+   *    while (merge.next(p)) {
+   *      send(p.getPacketPointer(), p.getPacketLength());
+   *    }
+   *  </pre>
+   */
+  class VRAMergeReader : public VRTObject {
+    /** The default block size used by {@link #writeTo} (1 MiB). */
+    public: static const int32_t DEFAULT_BLOCK_SIZE = 1024*1024;
+
+    private: vector<MergeSource*> sources;    // The sources
+    private: vector<int32_t>      heap;       // Sources with a packet pending (min-heap)
+    private: bool                 started;    // Has reading started?
+    private: int32_t              current;    // Source of the last packet returned (-1 if n/a)
+    private: int32_t              tsiMode;    // Integer mode used for comparisons (-1 if n/a)
+    private: int64_t              packetsRead; // Number of packets returned
+
+    /** Creates a new instance with no sources. */
+    public: VRAMergeReader ();
+
+    /** Basic destructor for the class. */
+    public: ~VRAMergeReader ();
+
+    public: virtual string toString () const;
+
+    /** Adds a source. All sources must be added before the first call to {@link #next}.
+     *  @param src The source, this must remain valid for the life of the reader.
+     *  @throws VRTException If reading has already started.
+     */
+    public: void addSource (const PacketContainer &src);
+
+    /** Gets the number of sources. */
+    public: inline int32_t getNumSources () const { return (int32_t)sources.size(); }
+
+    /** Gets the next packet in time order.
+     *  @param p (OUTPUT) The view to update with the packet. This is only valid until the
+     *           next call to this function.
+     *  @return true if a packet was returned, false if all sources are exhausted.
+     *  @throws VRTException If there is an error reading from a source.
+     */
+    public: bool next (VRTPacketView &p);
+
+    /** Gets the index (in the order added) of the source of the packet most recently
+     *  returned by {@link #next}, or -1 if there is none.
+     */
+    public: inline int32_t getSource () const { return current; }
+
+    /** Gets the number of packets returned so far. */
+    public: inline int64_t getPacketsRead () const { return packetsRead; }
+
+    /** Writes all of the remaining packets, in time order, to a VRA file. Packets are
+     *  gathered into blocks and written using {@link AbstractVRAFile#appendPackets}.
+     *  @param out       The file to write to (must be open for writing).
+     *  @param blockSize The block size in octets (at least
+     *                   {@link BasicVRTPacket#MAX_PACKET_LENGTH}).
+     *  @return The number of packets written.
+     *  @throws VRTException If the block size is invalid or there is an error reading
+     *                       from a source or writing to the file.
+     */
+    public: int64_t writeTo (AbstractVRAFile &out, int32_t blockSize=DEFAULT_BLOCK_SIZE);
+
+    /** Moves a source on to its next packet and (if it has one) adds it to the heap. */
+    private: void advance (int32_t src);
+
+    /** Is the pending packet from source a later than that from source b? */
+    private: bool isAfter (int32_t a, int32_t b) const;
+
+    // The sources are owned by this instance.
+    private: VRAMergeReader (const VRAMergeReader &r);
+    private: VRAMergeReader& operator= (const VRAMergeReader &r);
+  };
+} END_NAMESPACE
+#endif /* _VRAMergeReader_h */
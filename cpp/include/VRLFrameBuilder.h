@@ -0,0 +1,156 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRLFrameBuilder_h
+#define _VRLFrameBuilder_h
+
+#include "VRTObject.h"
+#include "BasicVRLFrame.h"
+#include <sys/uio.h>    // for struct iovec
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Packs VRT packets into VITA 49.1 VRL frames without copying them. Packets
+   *  are added one at a time and the builder tracks how many will fit in a
+   *  frame of up to the target length; the completed frame is presented as a
+   *  list of <tt>iovec</tt> entries (header, packets, trailer) that can be
+   *  passed directly to <tt>writev(..)</tt> or <tt>sendmsg(..)</tt>. <br>
+   *  <br>
+   *  The frame count is advanced automatically each time {@link #nextFrame()}
+   *  is called and the CRC is accumulated as packets are added, so completing a
+   *  frame only requires a CRC over the 8-octet header. <br>
+   *  <br>
+   *  The builder holds pointers to the packet buffers; these must not be
+   *  modified or freed until the frame has been sent and {@link #nextFrame()}
+   *  called. Typical usage:
+   *  <pre>
+   *    VRLFrameBuilder builder(9000);
+   *    while (haveMorePackets()) {
+   *      BasicVRTPacket *p = getNextPacket();
+   *      if (!builder.addPacket(*p)) {
+   *        const vector&lt;struct iovec&gt; &amp;iov = builder.getFrame();
+   *        writev(fd, &amp;iov[0], iov.size());
+   *        builder.nextFrame();
+   *        builder.addPacket(*p);
+   *      }
+   *    }
+   *  </pre>
+   */
+  class VRLFrameBuilder : public VRTObject {
+    private: int32_t              maxFrameLength; // Target (maximum) frame length
+    private: bool                 crc;            // Compute CRC (true) or use NO_CRC (false)?
+    private: bool                 done;           // Has getFrame() been called on the current frame?
+    private: int32_t              frameCount;     // Count for the current frame
+    private: int32_t              frameLength;    // Length of the current frame (incl header & trailer)
+    private: int32_t              payloadCRC;     // CRC of the packets in the current frame
+    private: char                 header[BasicVRLFrame::HEADER_LENGTH];
+    private: char                 trailer[BasicVRLFrame::TRAILER_LENGTH];
+    private: vector<struct iovec> iov;            // Header, packets and (once done) trailer
+
+    /** Creates a new instance.
+     *  @param maxFrameLength The target (maximum) frame length in octets, inclusive of the
+     *                        header and trailer. A frame will be closed out once the next
+     *                        packet would take it past this length.
+     *  @param crc            Compute a CRC for each frame (true) or mark frames as having no
+     *                        CRC (false)?
+     *  @throws VRTException If <tt>maxFrameLength</tt> is invalid.
+     */
+    public: VRLFrameBuilder (int32_t maxFrameLength=BasicVRLFrame::MAX_FRAME_LENGTH, bool crc=true);
+
+    /** Basic destructor for the class. */
+    public: ~VRLFrameBuilder () { }
+
+    public: virtual string toString () const;
+
+    /** Adds a packet to the current frame. The packet is not copied; its buffer must
+     *  remain unchanged until the frame has been sent.
+     *  @param p The packet.
+     *  @return true if added, false if the packet will not fit in the current frame (in
+     *          which case the frame should be sent, {@link #nextFrame()} called, and the
+     *          packet added again).
+     *  @throws VRTException If the packet is invalid or is too large to fit in any frame.
+     */
+    public: inline bool addPacket (const BasicVRTPacket &p) {
+      int32_t len = p.getPacketLength();
+      if ((size_t)len > p.bbuf.size()) {
+        throw VRTException("Packet length %d exceeds buffer length %d", len, (int32_t)p.bbuf.size());
+      }
+      return addPacket(&p.bbuf[0], len);
+    }
+
+    /** Adds a packet to the current frame. The packet is not copied; its buffer must
+     *  remain unchanged until the frame has been sent.
+     *  @param ptr Pointer to the start of the packet.
+     *  @param len The packet length in octets (must match the length in the header).
+     *  @return true if added, false if the packet will not fit in the current frame.
+     *  @throws VRTException If the packet is invalid or is too large to fit in any frame.
+     */
+    public: bool addPacket (const void *ptr, int32_t len);
+
+    /** Is the current frame empty (i.e. no packets added yet)? */
+    public: inline bool isEmpty () const { return (getPacketCount() == 0); }
+
+    /** Gets the number of packets in the current frame. */
+    public: inline int32_t getPacketCount () const {
+      return (int32_t)iov.size() - ((done)? 2 : 1);
+    }
+
+    /** Gets the length of the current frame in octets, inclusive of header and trailer. */
+    public: inline int32_t getFrameLength () const { return frameLength; }
+
+    /** Gets the target (maximum) frame length in octets. */
+    public: inline int32_t getMaxFrameLength () const { return maxFrameLength; }
+
+    /** Gets the frame count that will be used for the current frame. */
+    public: inline int32_t getFrameCount () const { return frameCount; }
+
+    /** Sets the frame count that will be used for the current frame.
+     *  @param count The frame count (0..4095).
+     *  @throws VRTException If the count is outside of the allowable range.
+     */
+    public: void setFrameCount (int32_t count);
+
+    /** Completes the current frame, filling in the header and trailer, and returns the
+     *  list of buffers making up the frame. The returned list is valid until the next
+     *  call to {@link #addPacket} or {@link #nextFrame()}.
+     *  @return The frame as a list of buffers (header, packets, trailer).
+     */
+    public: const vector<struct iovec>& getFrame ();
+
+    /** Copies the current frame into a contiguous buffer. This is a convenience method
+     *  for cases where scatter-gather output is not available.
+     *  @param buf The buffer to write into (will be resized to {@link #getFrameLength()}).
+     */
+    public: void getFrame (vector<char> &buf);
+
+    /** Discards the current frame and starts a new (empty) one, advancing the frame
+     *  count by one. This is normally called after the frame has been sent.
+     */
+    public: void nextFrame ();
+
+    // The iovec list references this instance's header and trailer buffers.
+    private: VRLFrameBuilder (const VRLFrameBuilder &b);
+    private: VRLFrameBuilder& operator= (const VRLFrameBuilder &b);
+  };
+} END_NAMESPACE
+#endif /* _VRLFrameBuilder_h */
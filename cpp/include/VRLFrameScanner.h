@@ -0,0 +1,115 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRLFrameScanner_h
+#define _VRLFrameScanner_h
+
+#include "VRTObject.h"
+#include "BasicVRLFrame.h"
+
+namespace vrt {
+  /** Locates VRL frame boundaries in a byte stream. This is used to recover
+   *  when a VRL stream (e.g. over TCP) loses synchronization following a partial
+   *  write, a restart of the sender, or a corrupted frame length. <br>
+   *  <br>
+   *  The scanner searches for the frame alignment word ({@link BasicVRLFrame#VRL_FAW})
+   *  16 octets at a time (using SSE2 where available) and then checks each
+   *  candidate: the frame length must be legal, the packets within the frame
+   *  must exactly fill it, and (optionally) the CRC must match. Candidates that
+   *  fail are skipped over and the search continues. <br>
+   *  <br>
+   *  Counts of the octets skipped and the number of times synchronization was
+   *  lost are kept for monitoring purposes. Instances are not thread-safe.
+   */
+  class VRLFrameScanner : public VRTObject {
+    /** Returned by {@link #findFrame} when no frame was found. */
+    public: static const int32_t NOT_FOUND = -1;
+
+    private: bool    checkCRC;     // Check the CRC of each candidate frame?
+    private: bool    inSync;       // Was the last frame found without skipping?
+    private: int64_t skippedBytes; // Total octets skipped
+    private: int64_t resyncCount;  // Number of times octets were skipped
+    private: int64_t framesFound;  // Number of frames found
+
+    /** Creates a new instance.
+     *  @param checkCRC Should the CRC of a candidate frame be checked (when the
+     *                  complete frame is available and it has a CRC)?
+     */
+    public: VRLFrameScanner (bool checkCRC=false);
+
+    /** Basic copy constructor for the class. */
+    public: VRLFrameScanner (const VRLFrameScanner &s);
+
+    /** Basic destructor for the class. */
+    public: ~VRLFrameScanner () { }
+
+    public: virtual string toString () const;
+
+    /** Finds the next VRL frame in the buffer at or after the given offset. <br>
+     *  <br>
+     *  If the frame found extends past the end of the buffer it can not be fully
+     *  checked; its offset is returned provided that the portion available is
+     *  consistent with a valid frame. The caller should read more data and then
+     *  call this again starting at the returned offset. <br>
+     *  <br>
+     *  If no frame is found, the final 3 octets of the buffer may still hold the
+     *  start of a frame alignment word; these are not counted as skipped and should
+     *  be retained by the caller when more data is read.
+     *  @param ptr The buffer.
+     *  @param len The number of octets in the buffer.
+     *  @param off The offset to start searching at.
+     *  @return The offset of the next frame or {@link #NOT_FOUND}.
+     */
+    public: int32_t findFrame (const void *ptr, int32_t len, int32_t off=0);
+
+    /** Checks the frame at the given offset. This is the same check used by
+     *  {@link #findFrame} for each candidate.
+     *  @param ptr The buffer.
+     *  @param len The number of octets in the buffer.
+     *  @param off The offset of the frame.
+     *  @return true if the frame appears valid (see {@link #findFrame} for the handling
+     *          of frames that extend past the end of the buffer), false otherwise.
+     */
+    public: bool isFrameValid (const void *ptr, int32_t len, int32_t off) const;
+
+    /** Gets the total number of octets skipped while searching for frames. */
+    public: inline int64_t getSkippedBytes () const { return skippedBytes; }
+
+    /** Gets the number of times octets were skipped (i.e. synchronization was lost). */
+    public: inline int64_t getResyncCount () const { return resyncCount; }
+
+    /** Gets the number of complete frames found. */
+    public: inline int64_t getFramesFound () const { return framesFound; }
+
+    /** Resets the skipped-octet, resync and frame counters. */
+    public: void resetCounters ();
+
+    /** Searches for the next frame alignment word at or after the given offset
+     *  without performing any frame checks.
+     *  @param ptr The buffer.
+     *  @param len The number of octets in the buffer.
+     *  @param off The offset to start searching at.
+     *  @return The offset of the next frame alignment word or {@link #NOT_FOUND}.
+     */
+    public: static int32_t findFAW (const void *ptr, int32_t len, int32_t off);
+  };
+} END_NAMESPACE
+#endif /* _VRLFrameScanner_h */
@@ -0,0 +1,363 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRLStream_h
+#define _VRLStream_h
+
+#include "VRTObject.h"
+#include "InetAddress.h"
+#include "BasicVRTPacket.h"
+#include "BasicVRLFrame.h"
+#include "VRLFrameBuilder.h"
+#include "VRLFrameScanner.h"
+#include "VRTPacketView.h"
+#include <vector>
+
+using namespace std;
+
+namespace vrt {
+  /** Reads VRT packets carried in VITA 49.1 VRL frames over a TCP connection. <br>
+   *  <br>
+   *  Data is read from the socket straight into a large ring buffer and frames are
+   *  parsed in place. The ring buffer is mapped twice, back to back, in virtual
+   *  memory so a frame that wraps around the end of the buffer is still contiguous;
+   *  this means no frame (or packet) is ever copied. Each call to {@link #receive}
+   *  returns all of the packets in the complete frames available, as
+   *  {@link VRTPacketView} instances that point into the ring buffer and remain valid
+   *  until the next call to {@link #receive}. A partial frame at the end of the data
+   *  read is kept until the rest of it arrives. <br>
+   *  <br>
+   *  Each frame is checked using a {@link VRLFrameScanner} (the packets must exactly
+   *  fill the frame and, if enabled, the CRC must match); if a frame fails the check
+   *  the reader skips forward to the next valid frame. Instances are not thread-safe.
+   *  Typical usage:
+   *  <pre>
+   *    VRLStreamReader in(InetAddress("10.0.0.1"), port);
+   *    while (!in.isEndOfStream()) {
+   *      int32_t n = in.receive(100);
+   *      for (int32_t i = 0; i < n; i++) {
+   *        VRTPacketView p = in.getPacket(i);
+   *        ...
+   *      }
+   *    }
+   *  </pre>
+   */
+  class VRLStreamReader : public VRTObject {
+    /** The default size of the ring buffer in octets (16 MiB). */
+    public: static const int32_t DEFAULT_BUFFER_SIZE = 16*1024*1024;
+
+    private: int                 sock;            // The socket (-1 if closed)
+    private: bool                closed;          // Has the other end closed the connection?
+    private: bool                eof;             // Has the end of the stream been reached?
+    private: int32_t             size;            // Size of the ring buffer
+    private: char               *base;            // Start of the ring buffer (mapped twice)
+    private: int64_t             head;            // Stream position of the oldest data held
+    private: int64_t             parsed;          // Stream position of the next frame to parse
+    private: int64_t             tail;            // Stream position of the end of the data
+    private: VRLFrameScanner     scanner;         // Frame checks and resync
+    private: vector<const char*> packets;         // Packets in the current batch
+    private: vector<int32_t>     lengths;         // Packet lengths in the current batch
+    private: int64_t             framesReceived;  // Metrics (see get functions)
+    private: int64_t             packetsReceived;
+    private: int64_t             bytesReceived;
+
+    /** Creates a new instance, connecting to the given host.
+     *  @param host       The host to connect to.
+     *  @param port       The port to connect to.
+     *  @param bufferSize The ring buffer size in octets (at least
+     *                    {@link BasicVRLFrame#MAX_FRAME_LENGTH}, rounded up to a
+     *                    multiple of the page size).
+     *  @param checkCRC   Should the CRC of each frame be checked?
+     *  @throws VRTException If the buffer size is invalid or the connection fails.
+     */
+    public: VRLStreamReader (const InetAddress &host, int32_t port,
+                             int32_t bufferSize=DEFAULT_BUFFER_SIZE, bool checkCRC=false);
+
+    /** Creates a new instance using an existing connection (e.g. one returned by
+     *  <tt>accept(..)</tt>). The socket is owned by the reader from then on.
+     *  @param sock       The connected socket.
+     *  @param bufferSize The ring buffer size in octets.
+     *  @param checkCRC   Should the CRC of each frame be checked?
+     *  @throws VRTException If the buffer size is invalid.
+     */
+    public: VRLStreamReader (int sock, int32_t bufferSize=DEFAULT_BUFFER_SIZE,
+                             bool checkCRC=false);
+
+    /** Basic destructor for the class. This calls {@link #close()}. */
+    public: ~VRLStreamReader ();
+
+    public: virtual string toString () const;
+
+    /** Closes the connection and releases the buffer. Calling this a second time has
+     *  no effect.
+     */
+    public: void close ();
+
+    /** Is the reader open? */
+    public: inline bool isOpen () const { return (sock >= 0); }
+
+    /** Has the end of the stream been reached (i.e. the other end closed the
+     *  connection and all complete frames have been returned)?
+     */
+    public: inline bool isEndOfStream () const { return eof; }
+
+    /** Gets the socket file descriptor (-1 if closed). */
+    public: inline int getSocket () const { return sock; }
+
+    /** Gets the size of the ring buffer in octets. */
+    public: inline int32_t getBufferSize () const { return size; }
+
+    /** Receives the next batch of packets. This reads whatever data is available
+     *  (waiting for some to arrive if there are no complete frames buffered) and then
+     *  returns the packets in all of the complete frames. All views from the previous
+     *  batch become invalid.
+     *  @param timeout The maximum time to wait in milliseconds (-1 to wait forever, 0
+     *                 to return immediately).
+     *  @return The number of packets received, 0 on timeout, at the end of the stream
+     *          (see {@link #isEndOfStream()}) or if interrupted by a signal.
+     *  @throws VRTException If the reader is closed or there is a socket error.
+     */
+    public: int32_t receive (int32_t timeout=-1);
+
+    /** Gets the number of packets in the current batch. */
+    public: inline int32_t getCount () const { return (int32_t)packets.size(); }
+
+    /** Gets a packet from the current batch. The view is only valid until the next
+     *  call to {@link #receive}.
+     *  @param i The packet number (0 to {@link #getCount()}-1).
+     */
+    public: inline VRTPacketView getPacket (int32_t i) const {
+      return VRTPacketView(packets[i], lengths[i]);
+    }
+
+    /** Gets a pointer to a packet in the current batch. */
+    public: inline const char *getPacketPointer (int32_t i) const { return packets[i]; }
+
+    /** Gets the length of a packet in the current batch. */
+    public: inline int32_t getPacketLength (int32_t i) const { return lengths[i]; }
+
+    /** Gets the number of frames received. */
+    public: inline int64_t getFramesReceived () const { return framesReceived; }
+
+    /** Gets the number of packets received. */
+    public: inline int64_t getPacketsReceived () const { return packetsReceived; }
+
+    /** Gets the number of octets read from the connection. */
+    public: inline int64_t getBytesReceived () const { return bytesReceived; }
+
+    /** Gets the number of octets skipped due to invalid frames. */
+    public: inline int64_t getSkippedBytes () const { return scanner.getSkippedBytes(); }
+
+    /** Gets the number of times an invalid frame caused data to be skipped. */
+    public: inline int64_t getResyncCount () const { return scanner.getResyncCount(); }
+
+    /** Sets up the ring buffer. */
+    private: void init (int32_t bufferSize);
+
+    /** Reads from the socket into the ring buffer, returns the number of octets read
+     *  (0 if none are available, the buffer is full or the connection has closed).
+     */
+    private: int32_t readData ();
+
+    /** Parses all of the complete frames in the ring buffer. */
+    private: void parseFrames ();
+
+    // The socket and buffer are owned by this instance.
+    private: VRLStreamReader (const VRLStreamReader &r);
+    private: VRLStreamReader& operator= (const VRLStreamReader &r);
+  };
+
+  /** Writes VRT packets in VITA 49.1 VRL frames over a TCP connection. <br>
+   *  <br>
+   *  There are two ways to write packets:
+   *  <ul>
+   *    <li>{@link #append} copies each packet into a frame being built in an internal
+   *        buffer, so many small packets are coalesced into one frame and sent with a
+   *        single call. The frame is sent once the next packet will not fit (or on
+   *        {@link #flush()}). If enabled (and supported), these frames are sent with
+   *        <tt>MSG_ZEROCOPY</tt> so the kernel sends directly from the internal
+   *        buffers, a small pool of which is rotated through while the kernel finishes
+   *        with them.</li>
+   *    <li>{@link #write} sends a batch of packets without copying them: frames are
+   *        described as a list of buffers (see {@link VRLFrameBuilder}) and each is
+   *        sent with a single vectored write before the call returns.</li>
+   *  </ul>
+   *  The two can be mixed, {@link #write} sends any appended packets first so order is
+   *  preserved. Instances are not thread-safe. Typical usage:
+   *  <pre>
+   *    VRLStreamWriter out(InetAddress("10.0.0.1"), port);
+   *    while (running) {
+   *      out.append(nextPacket());
+   *    }
+   *    out.close();
+   *  </pre>
+   */
+  class VRLStreamWriter : public VRTObject {
+    /** The default maximum frame length in octets (65536). */
+    public: static const int32_t DEFAULT_FRAME_LENGTH = 65536;
+
+    /** The number of internal frame buffers used by {@link #append}. */
+    public: static const int32_t NUM_BUFFERS = 4;
+
+    private: int              sock;             // The socket (-1 if closed)
+    private: int32_t          frameLength;      // Max frame length
+    private: bool             zeroCopy;         // Use MSG_ZEROCOPY for appended frames?
+    private: VRLFrameBuilder  builder;          // Builds the frames
+    private: vector<char>     buffers;          // Buffers for appended frames
+    private: int32_t          current;          // Buffer in use by append(..)
+    private: int32_t          used;             // Octets of packets in the current buffer
+    private: uint32_t         bufferId[NUM_BUFFERS];   // Last zero-copy send for each buffer
+    private: bool             bufferBusy[NUM_BUFFERS]; // Is the kernel using each buffer?
+    private: vector<struct iovec> pending;      // Part of a frame still to be sent
+    private: uint32_t         nextId;           // Next zero-copy send number
+    private: uint32_t         doneId;           // Zero-copy sends completed (all before this)
+    private: int64_t          framesWritten;    // Metrics (see get functions)
+    private: int64_t          packetsWritten;
+    private: int64_t          bytesWritten;
+    private: int64_t          zeroCopyCopied;
+
+    /** Creates a new instance, connecting to the given host.
+     *  @param host        The host to connect to.
+     *  @param port        The port to connect to.
+     *  @param frameLength The maximum frame length in octets.
+     *  @param crc         Compute a CRC for each frame (true) or mark frames as having
+     *                     no CRC (false)?
+     *  @param zeroCopy    Use <tt>MSG_ZEROCOPY</tt> for appended frames (ignored if not
+     *                     supported)?
+     *  @throws VRTException If the frame length is invalid or the connection fails.
+     */
+    public: VRLStreamWriter (const InetAddress &host, int32_t port,
+                             int32_t frameLength=DEFAULT_FRAME_LENGTH, bool crc=true,
+                             bool zeroCopy=false);
+
+    /** Creates a new instance using an existing connection (e.g. one returned by
+     *  <tt>accept(..)</tt>). The socket is owned by the writer from then on.
+     *  @param sock        The connected socket.
+     *  @param frameLength The maximum frame length in octets.
+     *  @param crc         Compute a CRC for each frame?
+     *  @param zeroCopy    Use <tt>MSG_ZEROCOPY</tt> for appended frames?
+     *  @throws VRTException If the frame length is invalid.
+     */
+    public: VRLStreamWriter (int sock, int32_t frameLength=DEFAULT_FRAME_LENGTH,
+                             bool crc=true, bool zeroCopy=false);
+
+    /** Basic destructor for the class. This calls {@link #close()}, any errors are
+     *  ignored.
+     */
+    public: ~VRLStreamWriter ();
+
+    public: virtual string toString () const;
+
+    /** Sends any appended packets, waits for the kernel to finish with the internal
+     *  buffers and closes the connection. Calling this a second time has no effect.
+     *  @throws VRTException If there is an error writing to the connection.
+     */
+    public: void close ();
+
+    /** Is the writer open? */
+    public: inline bool isOpen () const { return (sock >= 0); }
+
+    /** Gets the socket file descriptor (-1 if closed). */
+    public: inline int getSocket () const { return sock; }
+
+    /** Is <tt>MSG_ZEROCOPY</tt> in use? */
+    public: inline bool isZeroCopy () const { return zeroCopy; }
+
+    /** Appends a packet to the frame being built, sending the frame first if the
+     *  packet will not fit.
+     *  @param p The packet.
+     *  @throws VRTException If the packet is invalid or too large for a frame, the writer
+     *                       is closed or there is an error writing to the connection.
+     */
+    public: inline void append (const BasicVRTPacket &p) {
+      append(&p.bbuf[0], p.getPacketLength());
+    }
+
+    /** Appends a packet to the frame being built. See {@link #append(const BasicVRTPacket&)}.
+     *  @param ptr Pointer to the packet.
+     *  @param len The length of the packet in octets.
+     */
+    public: void append (const void *ptr, int32_t len);
+
+    /** Sends a batch of packets without copying them. Any appended packets are sent
+     *  first. The packets may be reused once this returns.
+     *  @param packets The packets.
+     *  @param n       The number of packets.
+     *  @throws VRTException If a packet is invalid or too large for a frame, the writer
+     *                       is closed or there is an error writing to the connection.
+     */
+    public: void write (const BasicVRTPacket *const *packets, int32_t n);
+
+    /** Sends a batch of packets without copying them. See {@link #write(const BasicVRTPacket*const*,int32_t)}. */
+    public: inline void write (const vector<BasicVRTPacket*> &packets) {
+      if (!packets.empty()) write(&packets[0], (int32_t)packets.size());
+    }
+
+    /** Sends the frame holding any appended packets now.
+     *  @throws VRTException If the writer is closed or there is an error writing to the
+     *                       connection.
+     */
+    public: void flush ();
+
+    /** Gets the number of frames written. */
+    public: inline int64_t getFramesWritten () const { return framesWritten; }
+
+    /** Gets the number of packets written. */
+    public: inline int64_t getPacketsWritten () const { return packetsWritten; }
+
+    /** Gets the number of octets written (including frame headers and trailers). */
+    public: inline int64_t getBytesWritten () const { return bytesWritten; }
+
+    /** Gets the number of <tt>MSG_ZEROCOPY</tt> sends where the kernel reported it had
+     *  to copy the data anyway (as is always the case over the loopback interface).
+     */
+    public: inline int64_t getZeroCopyCopied () const { return zeroCopyCopied; }
+
+    /** Sets up the buffers and socket options. */
+    private: void init ();
+
+    /** Gets the internal buffer with the given number. */
+    private: inline char *getBuffer (int32_t b) { return &buffers[(size_t)b * frameLength]; }
+
+    /** Sends a complete frame from the list of buffers given.
+     *  @param iov The buffers.
+     *  @param cnt The number of buffers.
+     *  @param len The frame length.
+     *  @param buf The internal buffer holding the frame, -1 if n/a (only internal buffers
+     *             are sent with MSG_ZEROCOPY).
+     */
+    private: void sendFrame (const struct iovec *iov, int32_t cnt, int32_t len, int32_t buf);
+
+    /** Sends the frame in the builder (from {@link #write}). */
+    private: void sendBuilt ();
+
+    /** Reads zero-copy completions, optionally waiting for at least one. */
+    private: void readCompletions (bool wait);
+
+    /** Waits until the kernel has finished with the given internal buffer. */
+    private: void waitBuffer (int32_t b);
+
+    // The socket and buffers are owned by this instance.
+    private: VRLStreamWriter (const VRLStreamWriter &w);
+    private: VRLStreamWriter& operator= (const VRLStreamWriter &w);
+  };
+} END_NAMESPACE
+#endif /* _VRLStream_h */
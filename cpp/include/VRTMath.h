@@ -1647,6 +1647,35 @@ namespace vrt {
     inline void packBytes (vector<char> &buf, int32_t off, const void *buffer, int32_t len) {
       memcpy(&buf[off], buffer, len);
     }
+
+    /** Computes the CRC-32 used by VITA 49.1 for VRL frames and VRA files. This uses
+     *  the CRC-32 polynomial (0x04C11DB7) with the bits processed most-significant
+     *  first, an initial value of zero and no final XOR; the result is bit-identical
+     *  to the algorithm given in Appendix A of VITA 49.1. <br>
+     *  <br>
+     *  The CRC can be computed incrementally by passing the result of one call in
+     *  as the <tt>crc</tt> for the next call. Internally this uses a table-driven
+     *  (slicing-by-8) algorithm, or carry-less multiply (PCLMULQDQ) folding on x86
+     *  processors that support it, as determined at run time.
+     *  @param crc The CRC computed over the preceding data (0 if at the start).
+     *  @param ptr Pointer to the data.
+     *  @param len The length of the data in octets.
+     *  @return The updated CRC.
+     */
+    int32_t crc32 (int32_t crc, const void *ptr, size_t len);
+
+    /** Combines two CRC-32 values computed with {@link #crc32}. Given the CRC of
+     *  a block of data (A) and the CRC of the data immediately following it (B)
+     *  with both having been started from 0, this computes the CRC of A followed
+     *  by B without needing to re-read either. This permits CRCs to be computed
+     *  on separate chunks in parallel or to be maintained incrementally and then
+     *  merged. The cost is O(log(lenB)).
+     *  @param crcA The CRC of the first block of data.
+     *  @param crcB The CRC of the second block of data.
+     *  @param lenB The length of the second block of data in octets.
+     *  @return The CRC of the two blocks concatenated together.
+     */
+    int32_t crc32Combine (int32_t crcA, int32_t crcB, int64_t lenB);
 ////////////////////////////////////////////////////////////////////////////////
 #endif /* NOT_USING_JNI */
 ////////////////////////////////////////////////////////////////////////////////
@@ -197,6 +197,16 @@ namespace vrt {
    */
   enum boolNull { _FALSE=-1, _NULL=0, _TRUE=+1 };
 
+  /** Specifies what to do when a bounded queue or buffer is full (used by
+   *  {@link AsyncVRAWriter}, {@link SharedRingWriter} and {@link StreamDispatcher}).
+   */
+  enum OverflowPolicy {
+    /** Wait for space to become available (apply backpressure to the caller). */
+    OverflowPolicy_Block = 0,
+    /** Discard the new entry and count it as dropped. */
+    OverflowPolicy_Drop  = 1
+  };
+
   /** A pseudo-null value for an 8-bit integer. This value is equal to <tt>-128</tt>
    *  which is unlikely to be used in the normal course of events. In Java the <tt>Byte</tt> class
    *  would be used which can hold any 8-bit integer or could be null.
@@ -286,16 +296,30 @@ namespace vrt {
   class VRTObject {
     friend class MutexLock;
 
-    private: MutexObj mutexObj; // Mutex object to use
+    // The mutex object is allocated on first use by a MutexLock (see getMutexObj())
+    // since the vast majority of objects are never locked. This keeps construction,
+    // copying and destruction of small value types (e.g. TimeStamp) cheap.
+    private: MutexObj *mutexObj; // Mutex object to use (NULL if not yet allocated)
 
-    /** Basic copy constructor. */
-    public: VRTObject (const VRTObject &o) { UNUSED_VARIABLE(o); }
+    /** Basic copy constructor (the mutex is not copied). */
+    public: VRTObject (const VRTObject &o) : mutexObj(NULL) { UNUSED_VARIABLE(o); }
 
     /** Basic no-argument constructor. */
-    public: VRTObject () { }
+    public: VRTObject () : mutexObj(NULL) { }
 
     /** Basic destructor. */
-    public: virtual ~VRTObject() { }
+    public: virtual ~VRTObject() {
+      if (mutexObj != NULL) delete mutexObj;
+    }
+
+    /** Basic assignment operator (the mutex is not copied). */
+    public: inline VRTObject& operator= (const VRTObject &o) {
+      UNUSED_VARIABLE(o);
+      return *this;
+    }
+
+    /** <b>Internal Use Only:</b> Gets the mutex object, allocating it if required. */
+    private: MutexObj* getMutexObj () const;
 
     /** Converts this class its string form. */
     public: virtual string toString () const;
@@ -0,0 +1,325 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _VRTPacketView_h
+#define _VRTPacketView_h
+
+#include "VRTObject.h"
+#include "VRTMath.h"
+#include "BasicVRTPacket.h"
+#include "TimeStamp.h"
+#include <iterator>
+
+namespace vrt {
+  /** A lightweight, non-owning, read-only view of a VRT packet held in some
+   *  other buffer (a VRL frame, a memory-mapped file, a receive buffer, etc.).
+   *  Unlike {@link BasicVRTPacket} no copy of the packet is made and no heap
+   *  memory is used; the view is only valid for as long as the underlying
+   *  buffer is. <br>
+   *  <br>
+   *  The accessors here cover the fields in the packet header that are needed
+   *  to route a packet (type, stream ID, class ID, count, time stamp). Where
+   *  full access to the packet is required, {@link #toPacket()} will create a
+   *  copy of the packet resolved to its specific type.
+   */
+  class VRTPacketView : public VRTObject {
+    private: const char *buf; // The packet (NULL if n/a)
+    private: int32_t     len; // The packet length in octets
+
+    /** Creates a null view. */
+    public: VRTPacketView () : buf(NULL), len(0) { }
+
+    /** Creates a new view of the given packet. The length given is the number
+     *  of octets available in the buffer, which is normally equal to the packet
+     *  length reported in the header.
+     *  @param ptr The pointer to the start of the packet.
+     *  @param len The number of octets available.
+     */
+    public: VRTPacketView (const void *ptr, int32_t len) : buf((const char*)ptr), len(len) { }
+
+    /** Basic copy constructor for the class. */
+    public: VRTPacketView (const VRTPacketView &v) : VRTObject(), buf(v.buf), len(v.len) { }
+
+    /** Basic destructor for the class. */
+    public: ~VRTPacketView () { }
+
+    /** Basic assignment operator for the class. */
+    public: inline VRTPacketView& operator= (const VRTPacketView &v) {
+      buf = v.buf;
+      len = v.len;
+      return *this;
+    }
+
+    public: virtual string toString () const;
+
+    using VRTObject::equals;
+    /** Checks for equality with an unknown object. Two views are equal if the
+     *  packets they reference are bit-for-bit identical (they need not refer to
+     *  the same memory location).
+     */
+    public: virtual bool equals (const VRTObject &o) const;
+
+    /** Checks for equality with another view. */
+    public: bool equals (const VRTPacketView &v) const;
+
+    public: virtual inline bool isNullValue () const { return (buf == NULL); }
+
+    /** Checks to see if the view references a valid packet. This is limited to
+     *  checks that can be done using the header alone (i.e. the length reported
+     *  in the header is consistent with the length of the view and with the
+     *  fields the header says are present).
+     *  @return An error message if invalid or "" if valid.
+     */
+    public: string getPacketValid () const;
+
+    /** Checks to see if the view references a valid packet. */
+    public: inline bool isPacketValid () const { return (getPacketValid() == ""); }
+
+    /** Gets a pointer to the start of the packet. */
+    public: inline const void *getPacketPointer () const { return buf; }
+
+    /** Gets the packet length in octets as reported in the header. */
+    public: inline int32_t getPacketLength () const {
+      return BasicVRTPacket::getPacketLength(buf, 0);
+    }
+
+    /** Gets the packet type. */
+    public: inline PacketType getPacketType () const {
+      return (PacketType)((buf[0] >> 4) & 0xF);
+    }
+
+    /** Is this a data packet? */
+    public: inline bool isData () const { return PacketType_isData(getPacketType()); }
+
+    /** Is this a context packet? */
+    public: inline bool isContext () const { return PacketType_isContext(getPacketType()); }
+
+    /** Is this a command packet? */
+    public: inline bool isCommand () const { return PacketType_isCommand(getPacketType()); }
+
+    /** Does the packet have a stream identifier? */
+    public: inline bool hasStreamIdentifier () const {
+      return PacketType_hasStreamIdentifier(getPacketType());
+    }
+
+    /** Does the packet have a class identifier? */
+    public: inline bool hasClassIdentifier () const { return ((buf[0] & 0x08) != 0); }
+
+    /** Does the packet have a trailer? (Only applicable to data packets.) */
+    public: inline bool hasTrailer () const { return isData() && ((buf[0] & 0x04) != 0); }
+
+    /** Gets the 4-bit packet count. */
+    public: inline int32_t getPacketCount () const { return buf[1] & 0xF; }
+
+    /** Gets the stream identifier or <tt>INT32_NULL</tt> if not present. */
+    public: inline int32_t getStreamIdentifier () const {
+      return (hasStreamIdentifier())? VRTMath::unpackInt(buf, 4) : INT32_NULL;
+    }
+
+    /** Gets the class identifier or <tt>INT64_NULL</tt> if not present. */
+    public: inline int64_t getClassIdentifier () const {
+      if (!hasClassIdentifier()) return INT64_NULL;
+      int32_t off = (hasStreamIdentifier())? 8 : 4;
+      return VRTMath::unpackLong(buf, off) & __INT64_C(0x00FFFFFFFFFFFFFF);
+    }
+
+    /** Gets the packet stream code (see {@link BasicVRTPacket#getStreamCode()}). */
+    public: inline int64_t getStreamCode () const {
+      return BasicVRTPacket::getStreamCode(buf);
+    }
+
+    /** Gets the length of the header in octets. */
+    public: inline int32_t getHeaderLength () const {
+      return 4 + ((hasStreamIdentifier())?             4 : 0)
+               + ((hasClassIdentifier())?              8 : 0)
+               + (((buf[1] & 0xC0) != 0)?              4 : 0)
+               + (((buf[1] & 0x30) != 0)?              8 : 0);
+    }
+
+    /** Gets the length of the trailer in octets. */
+    public: inline int32_t getTrailerLength () const { return (hasTrailer())? 4 : 0; }
+
+    /** Gets a pointer to the octets following the header. For data and context
+     *  packets this is the start of the payload; for command packets this is
+     *  the start of the packet-specific prologue.
+     */
+    public: inline const void *getPayloadPointer () const { return &buf[getHeaderLength()]; }
+
+    /** Gets the number of octets between the header and the trailer. */
+    public: inline int32_t getPayloadLength () const {
+      return getPacketLength() - getHeaderLength() - getTrailerLength();
+    }
+
+    /** Gets the integer time stamp mode (TSI). */
+    public: inline IntegerMode getIntegerMode () const {
+      return (IntegerMode)((buf[1] >> 6) & 0x3);
+    }
+
+    /** Gets the fractional time stamp mode (TSF). */
+    public: inline FractionalMode getFractionalMode () const {
+      return (FractionalMode)((buf[1] >> 4) & 0x3);
+    }
+
+    /** Gets the integer time stamp value (0 if not present). */
+    public: inline uint32_t getTimeStampInteger () const {
+      if (getIntegerMode() == IntegerMode_None) return 0;
+      return VRTMath::unpackUInt(buf, getTimeStampOffset());
+    }
+
+    /** Gets the fractional time stamp value (0 if not present). */
+    public: inline uint64_t getTimeStampFractional () const {
+      if (getFractionalMode() == FractionalMode_None) return 0;
+      int32_t off = getTimeStampOffset() + ((getIntegerMode() == IntegerMode_None)? 0 : 4);
+      return VRTMath::unpackULong(buf, off);
+    }
+
+    /** Gets the time stamp of the packet. */
+    public: inline TimeStamp getTimeStamp () const {
+      return TimeStamp(getIntegerMode(), getFractionalMode(),
+                       getTimeStampInteger(), getTimeStampFractional());
+    }
+
+    /** Gets the offset of the first time stamp field. */
+    private: inline int32_t getTimeStampOffset () const {
+      return 4 + ((hasStreamIdentifier())? 4 : 0) + ((hasClassIdentifier())? 8 : 0);
+    }
+
+    /** Creates a copy of the packet resolved to its specific type using the
+     *  current packet factory (see {@link VRTConfig#getPacket}). This is the
+     *  only method on this class that allocates memory.
+     *  @return A new packet that the caller is responsible for deleting.
+     *  @throws VRTException If this is a null view.
+     */
+    public: BasicVRTPacket *toPacket () const __attribute__((warn_unused_result));
+  };
+
+  /** Forward iterator over a contiguous run of VRT packets held in memory (e.g.
+   *  the payload of a VRL frame or of a memory-mapped VRA file). Each packet is
+   *  presented as a {@link VRTPacketView}; no copies are made and no heap memory
+   *  is used. The length of each packet is checked against the end of the run
+   *  before it is presented, a <tt>VRTException</tt> is thrown when a packet with
+   *  an invalid length is reached.
+   */
+  class VRTPacketViewIterator : public VRTObject {
+    public: typedef forward_iterator_tag  iterator_category;
+    public: typedef VRTPacketView         value_type;
+    public: typedef ptrdiff_t             difference_type;
+    public: typedef const VRTPacketView*  pointer;
+    public: typedef const VRTPacketView&  reference;
+
+    private: const char    *buf;  // The buffer (NULL if n/a)
+    private: int64_t        off;  // Offset of the current packet
+    private: int64_t        max;  // Offset of the end of the packets
+    private: VRTPacketView  view; // View of the current packet
+
+    /** Creates a null iterator. */
+    public: VRTPacketViewIterator ();
+
+    /** Basic copy constructor for the class. */
+    public: VRTPacketViewIterator (const VRTPacketViewIterator &pi);
+
+    /** Creates an iterator over the packets in the given buffer.
+     *  @param ptr   The buffer.
+     *  @param start The offset of the first packet.
+     *  @param end   The offset one past the end of the last packet.
+     *  @param begin Point to the first packet (true) or to the end (false)?
+     *  @throws VRTException If <tt>begin</tt> is true and the first packet is invalid.
+     */
+    public: VRTPacketViewIterator (const void *ptr, int64_t start, int64_t end, bool begin);
+
+    /** Basic destructor for the class. */
+    public: ~VRTPacketViewIterator () { }
+
+    /** Basic assignment operator for the class. */
+    public: VRTPacketViewIterator& operator= (const VRTPacketViewIterator &pi);
+
+    public: virtual string toString () const;
+
+    using VRTObject::equals;
+    public: virtual bool equals (const VRTObject &o) const;
+
+    /** Equality check for the object. */
+    public: inline bool equals (const VRTPacketViewIterator &pi) const {
+      return (buf == pi.buf) && (off == pi.off);
+    }
+
+    /** Iterator == operator (avoids the dynamic cast in {@link VRTObject#operator==}). */
+    public: inline bool operator== (const VRTPacketViewIterator &pi) const { return  equals(pi); }
+
+    /** Iterator != operator (avoids the dynamic cast in {@link VRTObject#operator!=}). */
+    public: inline bool operator!= (const VRTPacketViewIterator &pi) const { return !equals(pi); }
+
+    /** Iterator ++ operator (prefix).
+     *  @throws VRTException If the next packet is invalid.
+     */
+    public: inline VRTPacketViewIterator& operator++ () {
+      off += view.getPacketLength();
+      setView();
+      return *this;
+    }
+
+    /** Iterator ++ operator (postfix).
+     *  @throws VRTException If the next packet is invalid.
+     */
+    public: inline VRTPacketViewIterator operator++ (int) {
+      VRTPacketViewIterator pi(*this);
+      ++(*this);
+      return pi;
+    }
+
+    /** Iterator * operator. */
+    public: inline const VRTPacketView& operator* () const { return view; }
+
+    /** Iterator -&gt; operator. */
+    public: inline const VRTPacketView* operator-> () const { return &view; }
+
+    /** Gets the offset of the current packet from the start of the buffer. */
+    public: inline int64_t getOffset () const { return off; }
+
+    /** Sets up the iterator, for use by subclass constructors. */
+    protected: inline void init (const void *ptr, int64_t start, int64_t end, bool begin) {
+      buf = (const char*)ptr;
+      off = (begin)? start : end;
+      max = end;
+      setView();
+    }
+
+    /** Updates the view to reference the packet at the current offset. */
+    private: inline void setView () {
+      if (off >= max) {
+        off  = max;
+        view = VRTPacketView();
+        return;
+      }
+      int32_t len = (max - off < 4)? 0 : BasicVRTPacket::getPacketLength(&buf[off], 0);
+      if ((len < 4) || (off+len > max)) {
+        throw VRTException("Invalid packet length %d at offset %" PRId64, len, off);
+      }
+      VRTPacketView v(&buf[off], len);
+      if (len < v.getHeaderLength() + v.getTrailerLength()) {
+        throw VRTException("Packet length %d at offset %" PRId64 " is too short for the "
+                           "fields present", len, off);
+      }
+      view = v;
+    }
+  };
+} END_NAMESPACE
+#endif /* _VRTPacketView_h */
@@ -187,6 +187,16 @@ namespace vrt {
     /** Initializer. */
     private: void init ();
 
+    /** Allocates memory for a new value. Since values are frequently created
+     *  and deleted in quick succession (e.g. via {@link HasFields#getField})
+     *  a small per-thread cache of released blocks is kept and re-used before
+     *  going to the heap.
+     */
+    public: static void* operator new (size_t size);
+
+    /** Releases memory for a value (see <tt>operator new</tt>). */
+    public: static void operator delete (void *ptr, size_t size);
+
     /** Converts this class its string form. */
     public: virtual string toString () const;
 
@@ -25,10 +25,22 @@
 #include "Utilities.h"
 #include "VRTMath.h"
 #include <string.h>     // for memcmp(..)
+#include <limits.h>     // for realpath(..)
+#include <stdlib.h>     // for realpath(..)
+#include <unistd.h>     // for getcwd(..) / access(..)
+#include <errno.h>      // Required when using errno / ERRNO_STR
 
 
 using namespace vrt;
 
+#ifndef PATH_MAX
+// Per the realpath(..) man page, not all systems have PATH_MAX defined. If this
+// is the case, just issue a warning and use a max of 4096. (The warning may be
+// removed in the future if this gets a lot of testing and seems fine.)
+#  warning "Using PATH_MAX=4096"
+#  define PATH_MAX 4096
+#endif
+
 const string AbstractVRAFile::FILE_NAME_EXT = ".vra";
 const string AbstractVRAFile::MIME_TYPE     = "application/x-vita-radio-archive";
 
@@ -43,12 +55,17 @@ AbstractVRAFile::AbstractVRAFile (const AbstractVRAFile &f) :
   hdrVersion(f.hdrVersion),
   hdrFileLength(f.hdrFileLength),
   hdrCRC(f.hdrCRC),
+  payloadCRC(f.payloadCRC),
+  payloadCRCLen(f.payloadCRCLen),
   uri(f.uri),
   isRead(f.isRead),
   isWrite(f.isWrite),
   isSetSize(f.isSetSize),
   isSetCRC(f.isSetCRC),
-  isStrict(f.isStrict)
+  isStrict(f.isStrict),
+  index(NULL),
+  readAhead(f.readAhead),
+  prefetch(f.prefetch)
 {
   memcpy(header, f.header, HEADER_LENGTH);
 }
@@ -59,16 +76,70 @@ AbstractVRAFile::AbstractVRAFile (string uri, bool isRead,    bool isWrite,
   hdrVersion(DEFAULT_VERSION),
   hdrFileLength(0),
   hdrCRC(BasicVRLFrame::NO_CRC),
+  payloadCRC(0),
+  payloadCRCLen(-1),
   uri(uri),
   isRead(isRead),
   isWrite(isWrite),
   isSetSize(isSetSize),
   isSetCRC(isSetCRC),
-  isStrict(isStrict)
+  isStrict(isStrict),
+  index(NULL),
+  readAhead(DEFAULT_READ_AHEAD),
+  prefetch(false)
 {
   memcpy(header, DEFAULT_HEADER, HEADER_LENGTH);
 }
 
+AbstractVRAFile::~AbstractVRAFile () {
+  safe_delete(index);
+}
+
+string AbstractVRAFile::toURI (string fname) {
+  if (isNull(fname)) {
+    throw VRTException("Invalid use of null file name ''");
+  }
+  
+  // Get absolute path
+#if defined(_WIN32)
+# warning "Windows version of toURI(..) is untested"
+  // Get absolute path
+  if ((fname[0] != '/') && (fname[0] != '\\') && ((fname.size() < 3) || (fname[1] != ':')) {
+    char cwd[PATH_MAX];
+    
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+      throw VRTException("Unable to get CWD: %s", ERRNO_STR);
+    }
+    fname = (fname[0] != '/')? string(cwd) + '/' + fname
+                             : string(cwd) + '\\' + fname;
+  }
+  return string("file:") + fname;
+#else
+  // Get absolute path
+  if (fname[0] != '/') {
+    char cwd[PATH_MAX];
+    
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+      throw VRTException("Unable to get CWD: %s", ERRNO_STR);
+    }
+    fname = string(cwd) + '/' + fname;
+  }
+  
+  // Get the canonical path (if possible)
+# if defined(_BSD_SOURCE) || (_XOPEN_SOURCE >= 500)
+  char *resolved = realpath(fname.c_str(), NULL);
+  
+  if (resolved == NULL) {
+    throw VRTException("Unable to get real path for '%s': %s", fname.c_str(), ERRNO_STR);
+  }
+  fname = string(resolved);
+  free(resolved);
+# endif
+
+  return string("file://") + fname;
+#endif
+}
+
 string AbstractVRAFile::toString () const {
     // Do not include the file length or version since it may not be readable if
     // the file isn't open and this may result in errors with exception handling,
@@ -170,13 +241,120 @@ int64_t AbstractVRAFile::getFileLength () const {
 void AbstractVRAFile::append (BasicVRTPacket &p) {
   string err = p.getPacketValid(isStrict);
   if (!isNull(err)) throw VRTException(err);
-  write(EOF, p.getPacketPointer(), p.getPacketLength());
+
+  appendPackets(p.getPacketPointer(), p.getPacketLength());
+}
+
+void AbstractVRAFile::appendPackets (const void *ptr, int32_t len) {
+  const char *buf = (const char*)ptr;
+
+  for (int32_t off = 0; off < len; ) {
+    int32_t n = ((len - off) < 4)? 0 : BasicVRTPacket::getPacketLength(buf, off);
+    if ((n < 4) || (n > len - off)) {
+      throw VRTException("Invalid packet length at offset %d in block of %d octets", off, len);
+    }
+    off += n;
+  }
+
+  // Update the running CRC *before* the write since the write may trigger a
+  // flush(..) which will need the updated value.
+  if (isSetCRC && (payloadCRCLen >= 0)) {
+    payloadCRC     = VRTMath::crc32(payloadCRC, buf, len);
+    payloadCRCLen += len;
+  }
+  try {
+    write(EOF, const_cast<char*>(buf), len);
+  }
+  catch (VRTException e) {
+    resetPayloadCRC();
+    throw e;
+  }
+
+  // The index is kept in step with the file, so it already knows the offset
+  if (index != NULL) {
+    for (int32_t off = 0; off < len; ) {
+      int32_t n = BasicVRTPacket::getPacketLength(buf, off);
+      index->add(index->getCoveredLength(), VRTPacketView(&buf[off], n));
+      off += n;
+    }
+  }
+}
+
+void AbstractVRAFile::setIndex (VRAIndex *idx) {
+  if (idx == index) return;
+  safe_delete(index);
+  index = idx;
+  if ((index != NULL) && isRead) {
+    updateIndex(*index);
+  }
+}
+
+void AbstractVRAFile::updateIndex (VRAIndex &idx) const {
+  int64_t end = getFileLength();
+  int64_t off = idx.getCoveredLength();
+  char    buf[BasicVRTPacket::MAX_HEADER_LENGTH];
+
+  while (off < end) {
+    // Only the header is needed, but it must not be read past the end of the file
+    int32_t toRead = (int32_t)min((int64_t)sizeof(buf), end - off);
+    int32_t numRead = 0;
+    while (numRead < toRead) {
+      int32_t n = read(off+numRead, &buf[numRead], toRead-numRead);
+      if (n <= 0) break;
+      numRead += n;
+    }
+    int32_t len = (numRead < 4)? 0 : BasicVRTPacket::getPacketLength(buf, 0);
+    if ((len < 4) || (off+len > end)) {
+      throw VRTException("Error reading from %s at %" PRId64, toString().c_str(), off);
+    }
+    idx.add(off, VRTPacketView(buf, min(numRead, len)));
+    off += len;
+  }
+}
+
+VRAIndex *AbstractVRAFile::getSeekIndex () const {
+  if (index == NULL) {
+    VRAIndex *idx = new VRAIndex();
+
+    // Start with the sidecar (if any), a stale or invalid sidecar is ignored
+    if (uri.find("file://") == 0) {
+      string fname = VRAIndex::getIndexFileName(uri.substr(7));
+      if (access(fname.c_str(), R_OK) == 0) {
+        try {
+          idx->read(fname);
+          if (idx->getCoveredLength() > getFileLength()) idx->clear();
+        }
+        catch (VRTException e) {
+          UNUSED_VARIABLE(e);
+          idx->clear();
+        }
+      }
+    }
+    index = idx;
+  }
+  if (index->getCoveredLength() < getFileLength()) {
+    updateIndex(*index);
+  }
+  return index;
+}
+
+ConstPacketIterator AbstractVRAFile::seek (const TimeStamp &ts) const {
+  int64_t off = getSeekIndex()->seek(ts);
+  return (off < 0)? end() : ConstPacketIterator(this, off);
+}
+
+ConstPacketIterator AbstractVRAFile::seek (int32_t streamID, const TimeStamp &ts) const {
+  int64_t off = getSeekIndex()->seek(streamID, ts);
+  return (off < 0)? end() : ConstPacketIterator(this, off);
 }
 
 void AbstractVRAFile::close () {
   if (isWrite) {
     flush(true);
   }
+  if (index != NULL) {
+    index->close();
+  }
 }
 
 void AbstractVRAFile::open () {
@@ -211,60 +389,29 @@ bool AbstractVRAFile::isFileValid0 () const {
 }
 
 int32_t AbstractVRAFile::computeCRC () const {
-  // References:
-  //   [1] VITA 49.1
-  //   [2] Warren, Henry S. Jr. "Hacker's Delight." Addison-Wesley, 2002. (ISBN 0-201-91465-4)
-  const uint32_t COEFICIENTS = 0xEDB88320; // Corresponds to CRC32 polynomial
-  uint32_t crc = 0;
-
-  // This is based on the code given in Appendix A of [1], but it has
-  // been extensively optimized. Note that to make the (COEFICIENTS * (0 or 1)) trick work
-  // we need to compute the CRC in bit-reversed order and then flip the bits at the end.
-
-  // compute over the header
-  for (int32_t off = 0; off < HEADER_LENGTH; off++) {
-    if ((off >= 16) && (off < 20)) continue; // skip CRC field
-    uint32_t val = (uint32_t)header[off];
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 7)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 6)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 5)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 4)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 3)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 2)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 1)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val     )) & 1));
-  }
-
-  // compute over the payload
-  int64_t offset = HEADER_LENGTH;
-  int64_t end    = getFileLength();
-  char    buffer[4096];
-  while (offset < end) {
-    int32_t numRead = read(offset, buffer, 4096);
-
-    for (int32_t off = 0; off < numRead; off++) {
-      uint32_t val = (uint32_t)buffer[off];
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 7)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 6)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 5)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 4)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 3)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 2)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 1)) & 1));
-      crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val     )) & 1));
+  // compute over the header (skipping the CRC field)
+  int32_t crc = VRTMath::crc32(0, header, 16);
+  int64_t end = getFileLength();
+
+  // compute over the payload (if the running CRC is out of date)
+  if ((payloadCRCLen < 0) || (HEADER_LENGTH + payloadCRCLen != end)) {
+    int64_t offset = HEADER_LENGTH;
+    char    buffer[65536];
+
+    payloadCRC    = 0;
+    payloadCRCLen = -1;
+    while (offset < end) {
+      int32_t len     = (int32_t)min(end - offset, (int64_t)sizeof(buffer));
+      int32_t numRead = read(offset, buffer, len);
+      if (numRead <= 0) {
+        throw VRTException("Error reading from %s at %" PRId64, toString().c_str(), offset);
+      }
+      payloadCRC = VRTMath::crc32(payloadCRC, buffer, numRead);
+      offset    += numRead;
     }
-    offset += numRead;
+    payloadCRCLen = max(end - HEADER_LENGTH, (int64_t)0);
   }
-
-  // Flip CRC bits as noted above, we are using the bit-shifting algorithm from Section 7-1 in
-  // [2] rather than a loop-based solution in Appendix A of [1] which is considerably slower.
-  crc = ((crc & 0x55555555) <<  1) | ((crc & 0xAAAAAAAA) >>  1);  // abcdefgh -> badcfehg (per byte)
-  crc = ((crc & 0x33333333) <<  2) | ((crc & 0xCCCCCCCC) >>  2);  // badcfehg -> dcbahgfe (per byte)
-  crc = ((crc & 0x0F0F0F0F) <<  4) | ((crc & 0xF0F0F0F0) >>  4);  // dcbahgfe -> hgfedcba (per byte)
-  crc = ((crc & 0x00FF00FF) <<  8) | ((crc & 0xFF00FF00) >>  8);  // 0123 -> 1032
-  crc = ((crc & 0x0000FFFF) << 16) | ((crc & 0xFFFF0000) >> 16);  // 1032 -> 3210
-
-  return (int32_t)crc;
+  return VRTMath::crc32Combine(crc, payloadCRC, payloadCRCLen);
 }
 
 bool AbstractVRAFile::_setVersion (int32_t ver) {
@@ -315,6 +462,23 @@ void AbstractVRAFile::flush (bool force) {
   }
 }
 
+void AbstractVRAFile::setReadAhead (int32_t windowSize, bool prefetch) {
+  if (windowSize < 0) throw VRTException("Invalid read-ahead window size %d", windowSize);
+  this->readAhead = windowSize;
+  this->prefetch  = prefetch;
+}
+
+bool AbstractVRAFile::isReadConcurrent () const {
+  return false;
+}
+
+int32_t AbstractVRAFile::readConcurrent (int64_t off, void *ptr, int32_t len) const {
+  UNUSED_VARIABLE(off);
+  UNUSED_VARIABLE(ptr);
+  UNUSED_VARIABLE(len);
+  throw VRTException("Concurrent reads not supported by %s", getClassName().c_str());
+}
+
 ConstPacketIterator AbstractVRAFile::begin () const {
   return ConstPacketIterator(this, HEADER_LENGTH);
 }
@@ -333,6 +497,37 @@ void AbstractVRAFile::gotoNextPacket (ConstPacketIterator &pi) const {
 }
 
 BasicVRTPacket* AbstractVRAFile::getThisPacket (ConstPacketIterator &pi, bool skip) const {
+  // ==== READ-AHEAD =========================================================
+  if ((pi.ahead == NULL) && (readAhead > 0)) {
+    pi.ahead = new PacketReadAhead(this, readAhead, isPrefetch());
+  }
+  if (pi.ahead != NULL) {
+    const char *ptr = pi.ahead->get(pi.offset, 4);
+    if (ptr == NULL) {
+      if (pi.offset >= getFileLength()) {
+        throw VRTException("No such element in %s", pi.toString().c_str());
+      }
+      throw VRTException("Error reading from %s at %" PRId64, toString().c_str(), pi.offset);
+    }
+    int32_t len = BasicVRTPacket::getPacketLength(ptr, 0);
+    if ((len < 4) || ((ptr = pi.ahead->get(pi.offset, len)) == NULL)) {
+      // Invalid Packet
+      throw VRTException("Error reading from %s at %" PRId64, toString().c_str(), pi.offset);
+    }
+    pi.length = len;
+
+    if (skip) {
+      return NULL;
+    }
+    else if (pi.resolve) {
+      BasicVRTPacket p(ptr, len, false);
+      return VRTConfig::getPacket(&p);
+    }
+    else {
+      return new BasicVRTPacket(ptr, len, false);
+    }
+  }
+
   if (pi.offset >= getFileLength()) {
     throw VRTException("No such element in %s", pi.toString().c_str());
   }
@@ -373,17 +568,14 @@ BasicVRTPacket* AbstractVRAFile::getThisPacket (ConstPacketIterator &pi, bool sk
   if (!skip) {
     pi.buf.resize(len);
 
-    int32_t toRead = len - 4;
-
-    do {
-      int32_t n = read(pi.offset+numRead, &pi.buf[numRead], toRead);
-      if (n < 0) {
+    while (numRead < len) {
+      int32_t n = read(pi.offset+numRead, &pi.buf[numRead], len-numRead);
+      if (n <= 0) {
         // Invalid Packet
         throw VRTException("Error reading from %s at %" PRId64, toString().c_str(), pi.offset);
       }
       numRead += n;
-      toRead  -= n;
-    } while (numRead < toRead);
+    }
 
 
     if (pi.resolve) {
@@ -398,3 +590,177 @@ BasicVRTPacket* AbstractVRAFile::getThisPacket (ConstPacketIterator &pi, bool sk
     return NULL;
   }
 }
+
+PacketReadAhead::PacketReadAhead (const AbstractVRAFile *file, int32_t size, bool prefetch) :
+  file(file),
+  size(size),
+  prefetch(prefetch),
+  buf(),
+  winBase(0),
+  winOffset(0),
+  winLength(0),
+  spare(),
+  spareOffset(-1),
+  spareLength(0),
+  reqOffset(-1),
+  reqLength(0),
+  pending(false),
+  busy(false),
+  stopping(false),
+  running(false)
+{
+  if (prefetch) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+}
+
+PacketReadAhead::~PacketReadAhead () {
+  if (prefetch) {
+    if (running) {
+      pthread_mutex_lock(&lock);
+      stopping = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      pthread_join(thread, NULL);
+    }
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+  }
+}
+
+const char* PacketReadAhead::refill (int64_t off, int32_t len) {
+  int64_t fileLength = file->getFileLength();
+  if (off + len > fileLength) return NULL;
+
+  // Any part of the requested range already in the window is carried over
+  int32_t keep = 0;
+  if ((off >= winOffset) && (off < winOffset + winLength)) {
+    keep = (int32_t)(winOffset + winLength - off);
+  }
+  const char *keepPtr = (keep > 0)? &buf[winBase + (int32_t)(off - winOffset)] : NULL;
+
+  // ==== USE PREFETCHED DATA ================================================
+  if (prefetch) {
+    waitPrefetch();
+    if ((spareLength > 0) && (spareOffset == off + keep)) {
+      if (keep > 0) memcpy(&spare[CARRY_OVER - keep], keepPtr, keep);
+      buf.swap(spare);
+      winBase     = CARRY_OVER - keep;
+      winOffset   = off;
+      winLength   = keep + spareLength;
+      spareLength = 0;
+
+      startPrefetch(winOffset + winLength, fileLength);
+      if (winLength >= len) return &buf[winBase];
+
+      // Block size is smaller than the packet, fall through to read the rest
+      keep    = winLength;
+      keepPtr = &buf[winBase];
+    }
+  }
+
+  // ==== READ DIRECTLY ======================================================
+  int32_t want = (int32_t)min((int64_t)max(size, len - keep), fileLength - (off + keep));
+  if ((int32_t)buf.size() < keep + want) {
+    vector<char> b(keep + want);
+    if (keep > 0) memcpy(&b[0], keepPtr, keep);
+    buf.swap(b);
+  }
+  else if (keep > 0) {
+    memmove(&buf[0], keepPtr, keep);
+  }
+  winBase   = 0;
+  winOffset = off;
+  winLength = keep;
+
+  while (winLength < keep + want) {
+    int32_t n = file->read(winOffset + winLength, &buf[winLength], keep + want - winLength);
+    if (n <= 0) break;
+    winLength += n;
+  }
+
+  if (prefetch) {
+    startPrefetch(winOffset + winLength, fileLength);
+  }
+  return (winLength >= len)? &buf[0] : NULL;
+}
+
+void PacketReadAhead::startPrefetch (int64_t off, int64_t fileLength) {
+  int32_t len = (int32_t)min((int64_t)size, fileLength - off);
+  if (len <= 0) return;
+
+  if ((int32_t)spare.size() < CARRY_OVER + len) {
+    spare.resize(CARRY_OVER + size);
+  }
+
+  pthread_mutex_lock(&lock);
+  if (!running) {
+    int err = pthread_create(&thread, NULL, runPrefetch, this);
+    if (err != 0) {
+      // Not fatal, just continue without prefetching
+      pthread_mutex_unlock(&lock);
+      prefetch = false;
+      pthread_cond_destroy(&cond);
+      pthread_mutex_destroy(&lock);
+      return;
+    }
+    running = true;
+  }
+  reqOffset   = off;
+  reqLength   = len;
+  spareOffset = -1;
+  spareLength = 0;
+  pending     = true;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+void PacketReadAhead::waitPrefetch () {
+  pthread_mutex_lock(&lock);
+  while (pending || busy) {
+    pthread_cond_wait(&cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void *PacketReadAhead::runPrefetch (void *arg) {
+  ((PacketReadAhead*)arg)->runPrefetch();
+  return NULL;
+}
+
+void PacketReadAhead::runPrefetch () {
+  pthread_mutex_lock(&lock);
+  while (true) {
+    while (!pending && !stopping) {
+      pthread_cond_wait(&cond, &lock);
+    }
+    if (stopping) break;
+
+    int64_t off = reqOffset;
+    int32_t len = reqLength;
+    pending = false;
+    busy    = true;
+    pthread_mutex_unlock(&lock);
+
+    // Any errors are left for the direct read to report
+    int32_t numRead = 0;
+    try {
+      while (numRead < len) {
+        int32_t n = file->readConcurrent(off + numRead, &spare[CARRY_OVER + numRead], len - numRead);
+        if (n <= 0) break;
+        numRead += n;
+      }
+    }
+    catch (VRTException e) {
+      UNUSED_VARIABLE(e);
+    }
+
+    pthread_mutex_lock(&lock);
+    spareOffset = off;
+    spareLength = numRead;
+    busy        = false;
+    pthread_cond_broadcast(&cond);
+  }
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,267 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "AsyncVRAWriter.h"
+#include <stdlib.h>   // for posix_memalign(..) / free(..)
+#include <string.h>   // for memcpy(..)
+#include <errno.h>    // Required when using errno / ERRNO_STR
+
+using namespace vrt;
+
+AsyncVRAWriter::AsyncVRAWriter (AbstractVRAFile &file, int32_t blockSize, int32_t numBlocks,
+                                OverflowPolicy policy) :
+  file(&file),
+  blockSize(blockSize),
+  numBlocks(numBlocks),
+  policy(policy),
+  blocks(NULL),
+  blockLength(NULL),
+  current(0),
+  submitted(0),
+  completed(0),
+  stopping(false),
+  failed(false),
+  error(""),
+  running(false),
+  packetsQueued(0),
+  bytesQueued(0),
+  packetsDropped(0),
+  bytesDropped(0),
+  bytesWritten(0),
+  blockedCount(0),
+  maxQueueDepth(0)
+{
+  if (blockSize < BasicVRTPacket::MAX_PACKET_LENGTH) {
+    throw VRTException("Invalid block size %d, must be at least %d", blockSize,
+                       BasicVRTPacket::MAX_PACKET_LENGTH);
+  }
+  if (numBlocks < 2) {
+    throw VRTException("Invalid number of blocks %d, must be at least 2", numBlocks);
+  }
+  if ((policy != OverflowPolicy_Block) && (policy != OverflowPolicy_Drop)) {
+    throw VRTException("Unknown OverflowPolicy (%d)", (int32_t)policy);
+  }
+
+  blocks      = new char*[numBlocks];
+  blockLength = new int32_t[numBlocks];
+  for (int32_t i = 0; i < numBlocks; i++) {
+    blocks[i]      = NULL;
+    blockLength[i] = 0;
+  }
+  for (int32_t i = 0; i < numBlocks; i++) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, BLOCK_ALIGNMENT, blockSize) != 0) {
+      for (int32_t j = 0; j < i; j++) free(blocks[j]);
+      delete[] blocks;
+      delete[] blockLength;
+      throw VRTException("Unable to allocate %d blocks of %d octets", numBlocks, blockSize);
+    }
+    blocks[i] = (char*)ptr;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&notFull, NULL);
+  pthread_cond_init(&notEmpty, NULL);
+
+  int err = pthread_create(&thread, NULL, runWriter, this);
+  if (err != 0) {
+    pthread_cond_destroy(&notEmpty);
+    pthread_cond_destroy(&notFull);
+    pthread_mutex_destroy(&lock);
+    for (int32_t i = 0; i < numBlocks; i++) free(blocks[i]);
+    delete[] blocks;
+    delete[] blockLength;
+    throw VRTException("Unable to start writer thread: %s", strerror(err));
+  }
+  running = true;
+}
+
+AsyncVRAWriter::~AsyncVRAWriter () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // can't throw from destructor
+  }
+  pthread_cond_destroy(&notEmpty);
+  pthread_cond_destroy(&notFull);
+  pthread_mutex_destroy(&lock);
+  for (int32_t i = 0; i < numBlocks; i++) free(blocks[i]);
+  delete[] blocks;
+  delete[] blockLength;
+}
+
+string AsyncVRAWriter::toString () const {
+  return Utilities::format("%s: File=%s BlockSize=%d NumBlocks=%d QueueDepth=%d "
+                           "PacketsQueued=%" PRId64 " PacketsDropped=%" PRId64
+                           " BytesWritten=%" PRId64, getClassName().c_str(),
+                           file->getURI().c_str(), blockSize, numBlocks, getQueueDepth(),
+                           packetsQueued, packetsDropped, bytesWritten);
+}
+
+bool AsyncVRAWriter::append (const BasicVRTPacket &p) {
+  string err = p.getPacketValid(false);
+  if (!isNull(err)) throw VRTException(err);
+  return append(&p.bbuf[0], p.getPacketLength());
+}
+
+bool AsyncVRAWriter::append (const void *ptr, int32_t len) {
+  checkState();
+  if ((len < 4) || (len > BasicVRTPacket::MAX_PACKET_LENGTH) ||
+      (BasicVRTPacket::getPacketLength(ptr, 0) != len)) {
+    throw VRTException("Invalid packet length %d", len);
+  }
+
+  if (current + len > blockSize) {
+    submit();
+  }
+  if (current == 0) {
+    // Starting a new block, make sure the writer thread is done with it
+    if (submitted - completed >= numBlocks) {
+      if (policy == OverflowPolicy_Drop) {
+        packetsDropped++;
+        bytesDropped += len;
+        return false;
+      }
+      waitForBlock();
+    }
+  }
+
+  char *block = blocks[submitted % numBlocks];
+  memcpy(&block[current], ptr, len);
+  current += len;
+  packetsQueued++;
+  bytesQueued += len;
+  return true;
+}
+
+void AsyncVRAWriter::flush () {
+  checkState();
+  if (current > 0) {
+    submit();
+  }
+}
+
+void AsyncVRAWriter::close () {
+  if (running) {
+    if (!failed && (current > 0)) {
+      submit();
+    }
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&notEmpty);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+    running = false;
+
+    if (!failed) {
+      try {
+        file->flush();
+      }
+      catch (VRTException e) {
+        error  = e.getMessage();
+        failed = true;
+      }
+    }
+  }
+  if (failed) {
+    throw VRTException("Error writing to %s: %s", file->getURI().c_str(), error.c_str());
+  }
+}
+
+void AsyncVRAWriter::submit () {
+  int32_t idx = (int32_t)(submitted % numBlocks);
+  blockLength[idx] = current;
+  current = 0;
+
+  // The atomic increment is a full barrier, so the block content and length are
+  // visible to the writer thread before it sees the new count.
+  int32_t depth = (int32_t)(__sync_add_and_fetch(&submitted, 1) - completed);
+  if (depth > maxQueueDepth) maxQueueDepth = depth;
+
+  pthread_mutex_lock(&lock);
+  pthread_cond_signal(&notEmpty);
+  pthread_mutex_unlock(&lock);
+}
+
+void AsyncVRAWriter::waitForBlock () {
+  blockedCount++;
+  pthread_mutex_lock(&lock);
+  while ((submitted - completed >= numBlocks) && !failed) {
+    pthread_cond_wait(&notFull, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+  checkState();
+}
+
+void AsyncVRAWriter::checkState () {
+  if (stopping) {
+    throw VRTException("Writer for %s is closed", file->getURI().c_str());
+  }
+  if (failed) {
+    pthread_mutex_lock(&lock);
+    string err = error;
+    pthread_mutex_unlock(&lock);
+    throw VRTException("Error writing to %s: %s", file->getURI().c_str(), err.c_str());
+  }
+}
+
+void *AsyncVRAWriter::runWriter (void *arg) {
+  ((AsyncVRAWriter*)arg)->runWriter();
+  return NULL;
+}
+
+void AsyncVRAWriter::runWriter () {
+  while (true) {
+    pthread_mutex_lock(&lock);
+    while ((completed == submitted) && !stopping) {
+      pthread_cond_wait(&notEmpty, &lock);
+    }
+    bool done = (completed == submitted);
+    pthread_mutex_unlock(&lock);
+    if (done) break;
+
+    // Once failed, blocks are discarded so that the producer is never left waiting
+    int32_t idx = (int32_t)(completed % numBlocks);
+    if (!failed) {
+      try {
+        file->appendPackets(blocks[idx], blockLength[idx]);
+        bytesWritten += blockLength[idx];
+      }
+      catch (VRTException e) {
+        pthread_mutex_lock(&lock);
+        error  = e.getMessage();
+        failed = true;
+        pthread_mutex_unlock(&lock);
+      }
+    }
+
+    // The atomic increment is a full barrier, so the block is no longer in use
+    // by the time the producer sees the new count.
+    __sync_add_and_fetch(&completed, 1);
+
+    pthread_mutex_lock(&lock);
+    pthread_cond_signal(&notFull);
+    pthread_mutex_unlock(&lock);
+  }
+}
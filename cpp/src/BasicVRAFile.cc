@@ -20,28 +20,12 @@
  */
 
 #include "BasicVRAFile.h"
-#include <limits.h>   // for realpath(..)
 #include <stdio.h>    // for fopen(..) / fclose(..) / et.al.
-#include <stdlib.h>   // for realpath(..)
-#include <unistd.h>   // for getcwd(..)
+#include <unistd.h>   // for fsync(..) / fdatasync(..) / pread(..)
 #include <errno.h>    // Required when using errno / ERRNO_STR
 
 using namespace vrt;
 
-// FileMode bit fields
-#define FileMode_READ       0x01
-#define FileMode_WRITE      0x02
-#define FileMode_SYNCH_DATA 0x10
-#define FileMode_SYNCH_META 0x20
-
-#ifndef PATH_MAX
-// Per the realpath(..) man page, not all systems have PATH_MAX defined. If this
-// is the case, just issue a warning and use a max of 4096. (The warning may be
-// removed in the future if this gets a lot of testing and seems fine.)
-#  warning "Using PATH_MAX=4096"
-#  define PATH_MAX 4096
-#endif
-
 /** Seeks to a position in the file with special handling for EOF. */
 static inline void fileSeek (FILE *file, string fname, int64_t off) {
   if (off >= 0) {
@@ -97,53 +81,6 @@ string operator+  (string  &s, vrt::FileMode mode) {
   return s + _toString(mode);
 }
 
-/** Converts file name to URI. */
-static string toURI (string fname) {
-  if (isNull(fname)) {
-    throw VRTException("Invalid use of null file name ''");
-  }
-  
-  // Get absolute path
-#if defined(_WIN32)
-# warning "Windows version of toURI(..) is untested"
-  // Get absolute path
-  if ((fname[0] != '/') && (fname[0] != '\\') && ((fname.size() < 3) || (fname[1] != ':')) {
-    char cwd[PATH_MAX];
-    
-    if (getcwd(cwd, PATH_MAX) == NULL) {
-      throw VRTException("Unable to get CWD: %s", ERRNO_STR);
-    }
-    fname = (fname[0] != '/')? string(cwd) + '/' + fname
-                             : string(cwd) + '\\' + fname;
-  }
-  return string("file:") + fname;
-#else
-  // Get absolute path
-  if (fname[0] != '/') {
-    char cwd[PATH_MAX];
-    
-    if (getcwd(cwd, PATH_MAX) == NULL) {
-      throw VRTException("Unable to get CWD: %s", ERRNO_STR);
-    }
-    fname = string(cwd) + '/' + fname;
-  }
-  
-  // Get the canonical path (if possible)
-# if defined(_BSD_SOURCE) || (_XOPEN_SOURCE >= 500)
-  char *resolved = realpath(fname.c_str(), NULL);
-  
-  if (resolved == NULL) {
-    throw VRTException("Unable to get real path for '%s': %s", fname.c_str(), ERRNO_STR);
-  }
-  fname = string(resolved);
-  free(resolved);
-# endif
-
-  return string("file://") + fname;
-#endif
-}
-
-
 BasicVRAFile::BasicVRAFile (string fname, FileMode fmode, bool isSetSize, bool isSetCRC, bool isStrict) :
   AbstractVRAFile(toURI(fname), ((fmode & FileMode_READ) != 0), ((fmode & FileMode_WRITE) != 0),
                   isSetSize, isSetCRC, isStrict),
@@ -255,6 +192,35 @@ int32_t BasicVRAFile::read (int64_t off, void *ptr, int32_t len) const {
   }
 }
 
+bool BasicVRAFile::isReadConcurrent () const {
+  return true;
+}
+
+int32_t BasicVRAFile::readConcurrent (int64_t off, void *ptr, int32_t len) const {
+  if (ptr == NULL) throw VRTException("Can not read from %s to NULL buffer", fname.c_str());
+  if (len <     0) throw VRTException("Can not read %d octets from %s", len, fname.c_str());
+  if (len ==    0) return 0;
+
+  // Uses pread(..) since it does not alter the file position used by read(..)
+  int f = (file == NULL)? -1 : fileno(file);
+  if (f == -1) throw VRTException("File %s is not open", fname.c_str());
+
+  ssize_t count;
+  do {
+    count = pread(f, ptr, len, off);
+  } while ((count < 0) && (errno == EINTR));
+
+  if (count > 0) {
+    return (int32_t)count;
+  }
+  else if (count == 0) {
+    return EOF;
+  }
+  else {
+    throw VRTException("Error while reading from %s: %s", fname.c_str(), ERRNO_STR);
+  }
+}
+
 void BasicVRAFile::write (int64_t off, void *ptr, int32_t len, bool flush) {
   if (!isWrite   ) throw VRTException("File is read-only");
   if (ptr == NULL) throw VRTException("Can not read from %s to NULL buffer", fname.c_str());
@@ -29,7 +29,9 @@ BasicVRLFrame::~BasicVRLFrame () {
 
 BasicVRLFrame::BasicVRLFrame () :
   bbuf(12),
-  readOnly(false)
+  readOnly(false),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   bbuf[ 0] = VRL_FAW_0;
   bbuf[ 1] = VRL_FAW_1;
@@ -47,7 +49,9 @@ BasicVRLFrame::BasicVRLFrame () :
 
 BasicVRLFrame::BasicVRLFrame (int32_t bufsize) :
   bbuf(bufsize),
-  readOnly(false)
+  readOnly(false),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   bbuf[ 0] = VRL_FAW_0;
   bbuf[ 1] = VRL_FAW_1;
@@ -66,35 +70,45 @@ BasicVRLFrame::BasicVRLFrame (int32_t bufsize) :
 BasicVRLFrame::BasicVRLFrame (const BasicVRLFrame &f) :
   VRTObject(f), // <-- Used to avoid warnings under GCC with -Wextra turned on
   bbuf(f.bbuf),
-  readOnly(f.readOnly)
+  readOnly(f.readOnly),
+  payloadCRC(f.payloadCRC),
+  payloadCRCLen(f.payloadCRCLen)
 {
   // done
 }
 
 BasicVRLFrame::BasicVRLFrame (vector<char> *buf, bool readOnly) :
   bbuf(*buf),
-  readOnly(readOnly)
+  readOnly(readOnly),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   // done
 }
 
 BasicVRLFrame::BasicVRLFrame (const vector<char> &buf, bool readOnly) :
   bbuf(buf),
-  readOnly(readOnly)
+  readOnly(readOnly),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   // done
 }
 
 BasicVRLFrame::BasicVRLFrame (const vector<char> &buf, size_t size, bool readOnly) :
   bbuf(buf.begin(), buf.begin() + size),
-  readOnly(readOnly)
+  readOnly(readOnly),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   // done
 }
 
 BasicVRLFrame::BasicVRLFrame (const void *ptr, size_t size, bool readOnly) :
   bbuf(&((const char*)ptr)[0], &((const char*)ptr)[size]),
-  readOnly(readOnly)
+  readOnly(readOnly),
+  payloadCRC(0),
+  payloadCRCLen(-1)
 {
   // done
 }
@@ -196,7 +210,16 @@ bool BasicVRLFrame::isCRCValid () const {
 
 void BasicVRLFrame::updateCRC () {
   int32_t off = getFrameLength() - TRAILER_LENGTH;
-  VRTMath::packInt(bbuf, off, computeCRC());
+  int32_t crc;
+
+  if (payloadCRCLen == off - HEADER_LENGTH) {
+    crc = VRTMath::crc32(0, &bbuf[0], HEADER_LENGTH);
+    crc = VRTMath::crc32Combine(crc, payloadCRC, payloadCRCLen);
+  }
+  else {
+    crc = computeCRC();
+  }
+  VRTMath::packInt(bbuf, off, crc);
 }
 
 void BasicVRLFrame::clearCRC () {
@@ -208,37 +231,8 @@ void BasicVRLFrame::clearCRC () {
 }
 
 int32_t BasicVRLFrame::computeCRC () const {
-  // References:
-  //   [1] VITA 49.1
-  //   [2] Warren, Henry S. Jr. "Hacker's Delight." Addison-Wesley, 2002. (ISBN 0-201-91465-4)
-  const uint32_t COEFICIENTS = 0xEDB88320; // Corresponds to CRC32 polynomial
-  uint32_t crc = 0;
-  int32_t  end = getFrameLength() - 4; // -4 since the CRC field is skipped
-
-  // This is based on the code given in Appendix A of [1], but it has
-  // been extensively optimized. Note that to make the (COEFICIENTS * (0 or 1)) trick work
-  // we need to compute the CRC in bit-reversed order and then flip the bits at the end.
-  for (int32_t off = 0; off < end; off++) {
-    int32_t val = bbuf[off];
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 7)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 6)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 5)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 4)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 3)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 2)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val >> 1)) & 1));
-    crc = (crc >> 1) ^ (COEFICIENTS * ((crc ^ (val     )) & 1));
-  }
-
-  // Flip CRC bits as noted above, we are using the bit-shifting algorithm from Section 7-1 in
-  // [2] rather than a loop-based solution in Appendix A of [1] which is considerably slower.
-  crc = ((crc & 0x55555555) <<  1) | ((crc & 0xAAAAAAAA) >>  1);  // abcdefgh -> badcfehg (per byte)
-  crc = ((crc & 0x33333333) <<  2) | ((crc & 0xCCCCCCCC) >>  2);  // badcfehg -> dcbahgfe (per byte)
-  crc = ((crc & 0x0F0F0F0F) <<  4) | ((crc & 0xF0F0F0F0) >>  4);  // dcbahgfe -> hgfedcba (per byte)
-  crc = ((crc & 0x00FF00FF) <<  8) | ((crc & 0xFF00FF00) >>  8);  // 0123 -> 1032
-  crc = ((crc & 0x0000FFFF) << 16) | ((crc & 0xFFFF0000) >> 16);  // 1032 -> 3210
-
-  return crc;
+  int32_t end = getFrameLength() - 4; // -4 since the CRC field is skipped
+  return VRTMath::crc32(0, &bbuf[0], end);
 }
 
 BasicVRLFrame BasicVRLFrame::copy () const {
@@ -261,6 +255,7 @@ int32_t BasicVRLFrame::getPacketCount () const {
 }
 
 vector<void*> BasicVRLFrame::getVRTPacketsRW () {
+  resetPayloadCRC(); // caller may modify the packets
   // This functions needs to be cleaned up... it looks this way since it
   // pre-dates some of the newer functionality, and we didn't want to spend
   // too much time revising it until we have the iterators ready for use.
@@ -363,7 +358,8 @@ int32_t BasicVRLFrame::setVRTPackets (bool fit, int32_t maxFrameLength,
   // Note that the code below may cause the old CRC to be overwritten, but since we clear it
   // via the call to setFrameLength, this should not be an issue.
   p->readPacket(&bbuf[HEADER_LENGTH], 0, plen);
-  clearCRC();
+  payloadCRC    = VRTMath::crc32(0, &bbuf[HEADER_LENGTH], plen);
+  payloadCRCLen = plen;
   setFrameLength(len);
   return 1;
 }
@@ -409,12 +405,15 @@ int32_t BasicVRLFrame::setVRTPackets (bool fit, int32_t maxFrameLength,
   // Note that the code below may cause the old CRC to be overwritten, but since we clear it
   // via the call to setFrameLength, this should not be an issue.
   int32_t off = HEADER_LENGTH;
+  payloadCRC = 0;
   for (int32_t i = 0; i < count; i++) {
     const BasicVRTPacket *p = (packets != NULL)? (&(packets->at(i))) : packetPointers->at(i);
     int32_t plen = p->getPacketLength();
     p->readPacket(&bbuf[off], 0, plen);
+    payloadCRC = VRTMath::crc32(payloadCRC, &bbuf[off], plen); // while still in cache
     off += plen;
   }
+  payloadCRCLen = off - HEADER_LENGTH;
   setFrameLength(len);
   return count;
 }
@@ -448,6 +447,42 @@ void BasicVRLFrame::setFrameLength (int32_t length) {
 }
 
 void* BasicVRLFrame::getFramePointer () {
+  resetPayloadCRC(); // caller may modify the packets
   return &bbuf[0];
 }
 
+
+BasicVRLFrame_PacketIterator BasicVRLFrame::begin () const {
+  return BasicVRLFrame_PacketIterator(*this, true);
+}
+
+BasicVRLFrame_PacketIterator BasicVRLFrame::end () const {
+  return BasicVRLFrame_PacketIterator(*this, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BasicVRLFrame_PacketIterator
+////////////////////////////////////////////////////////////////////////////////
+
+BasicVRLFrame_PacketIterator::BasicVRLFrame_PacketIterator (const BasicVRLFrame &frame, bool begin) :
+  VRTPacketViewIterator()
+{
+  int32_t frameLength = frame.getFrameLength();
+  if ((frameLength < BasicVRLFrame::MIN_FRAME_LENGTH) || (frameLength > (int32_t)frame.bbuf.size())) {
+    throw VRTException("Invalid VRL frame length %d", frameLength);
+  }
+  init(&frame.bbuf[0], BasicVRLFrame::HEADER_LENGTH, frameLength - BasicVRLFrame::TRAILER_LENGTH, begin);
+}
+
+BasicVRLFrame_PacketIterator::BasicVRLFrame_PacketIterator (const void *ptr, int32_t len, bool begin) :
+  VRTPacketViewIterator()
+{
+  if ((len < BasicVRLFrame::MIN_FRAME_LENGTH) || !BasicVRLFrame::isVRL(ptr, 0)) {
+    throw VRTException("Buffer does not contain a VRL frame");
+  }
+  int32_t frameLength = BasicVRLFrame::getFrameLength(ptr, 0);
+  if ((frameLength < BasicVRLFrame::MIN_FRAME_LENGTH) || (frameLength > len)) {
+    throw VRTException("Invalid VRL frame length %d (%d octets available)", frameLength, len);
+  }
+  init(ptr, BasicVRLFrame::HEADER_LENGTH, frameLength - BasicVRLFrame::TRAILER_LENGTH, begin);
+}
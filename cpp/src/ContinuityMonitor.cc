@@ -0,0 +1,489 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "ContinuityMonitor.h"
+#include "BasicContextPacket.h"
+#include <math.h>       // for llround(..)
+
+using namespace vrt;
+
+/** Picoseconds per second. */
+static const int64_t ONE_SEC_PS = __INT64_C(1000000000000);
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> The state of one stream in a {@link ContinuityMonitor}. */
+  struct ContinuityState {
+    ContinuityStats_t stats;         // The counters
+    int32_t           dataCount;     // Packet count of the last data packet (-1 if none)
+    int32_t           ctxCount;      // Packet count of the last context packet (-1 if none)
+    int32_t           extDataCount;  // Packet count of the last extension data packet (-1 if none)
+    int32_t           extCtxCount;   // Packet count of the last extension context packet (-1 if none)
+    int32_t           dataReject;    // Count of the last data packet taken as reordered (-1 if none)
+    int32_t           ctxReject;     // Count of the last context packet taken as reordered (-1 if none)
+    int32_t           extDataReject; // As above for extension data packets
+    int32_t           extCtxReject;  // As above for extension context packets
+    double            sampleRate;    // Sample rate (NaN if not known)
+    int32_t           itemBits;      // Item packing field size (0 if not known)
+    int32_t           wordBits;      // Processing-efficient word size (0 if link-efficient)
+    int32_t           complexMult;   // 2 for complex data, 1 otherwise
+    bool              haveTime;      // Are the time fields below set?
+    int32_t           intMode;       // Integer mode of the time stamps
+    int64_t           lastSec;       // Time stamp of the last data packet
+    int64_t           lastPS;
+    int64_t           nextSec;       // Time stamp expected for the next data packet
+    int64_t           nextPS;
+    int32_t           lastSamples;   // Number of samples in the last data packet
+  };
+} END_NAMESPACE
+
+/** Flag set in a rejected count when the rejected packet reduced the loss count. */
+static const int32_t RECOVERED = 0x10;
+
+/** Checks a packet count on its own (used when there is no usable time stamp).
+ *  @param stats  The counters to update.
+ *  @param last   The last count accepted (updated).
+ *  @param reject The last count taken as reordered (updated).
+ *  @param cnt    The packet count.
+ *  @return The classification of the packet.
+ */
+static ContinuityEvent checkCount (ContinuityStats_t &stats, int32_t &last, int32_t &reject,
+                                   int32_t cnt) {
+  int32_t skipped = (cnt - last - 1) & 0xF;
+
+  // A packet taken as reordered that is followed by the next in sequence from it was
+  // really the start of a new sequence (e.g. 8 or more packets lost)
+  if ((skipped != 0) && (reject >= 0) && (cnt == ((reject + 1) & 0xF))) {
+    stats.reordered--;
+    stats.resyncs++;
+    if ((reject & RECOVERED) != 0) stats.lostPackets++;
+    last   = cnt;
+    reject = -1;
+    return ContinuityEvent_Resync;
+  }
+
+  reject = -1;
+  if (skipped == 0) {
+    last = cnt;
+    return ContinuityEvent_None;
+  }
+  if (skipped == 15) {
+    stats.duplicates++;
+    return ContinuityEvent_Duplicate;
+  }
+  if (skipped < 8) {
+    stats.lostPackets += skipped;
+    last = cnt;
+    return ContinuityEvent_Lost;
+  }
+  stats.reordered++;
+  reject = cnt;
+  if (stats.lostPackets > 0) { // a packet counted as lost has turned up
+    stats.lostPackets--;
+    reject |= RECOVERED;
+  }
+  return ContinuityEvent_Reordered;
+}
+
+/** Gets the number of samples in a data packet, this follows
+ *  {@link BasicDataPacket#getDataLength(PayloadFormat)} but works on the raw header.
+ */
+static int32_t getSampleCount (const ContinuityState *s, const VRTPacketView &p) {
+  const char *buf     = (const char*)p.getPacketPointer();
+  int32_t     padBits = 0;
+  if (p.hasClassIdentifier()) {
+    int32_t cid = (p.hasStreamIdentifier())? 8 : 4;
+    padBits = (buf[cid] >> 3) & 0x1F;
+  }
+
+  int32_t payload = p.getPayloadLength();
+  if (s->wordBits == 0) {
+    return (((payload * 8) - padBits) / s->itemBits) / s->complexMult;
+  }
+  int32_t perWord = s->wordBits / s->itemBits;
+  int32_t words   = (payload * 8) / s->wordBits;
+  return ((perWord * words) - (padBits / s->itemBits)) / s->complexMult;
+}
+
+/** Gets the difference between two times in samples (rounded to the nearest). */
+static inline int64_t diffSamples (int64_t sec, int64_t ps, int64_t refSec, int64_t refPS,
+                                   double sampleRate) {
+  double dt = (double)(sec - refSec) + (double)(ps - refPS) / (double)ONE_SEC_PS;
+  return (int64_t)llround(dt * sampleRate);
+}
+
+ContinuityMonitor::ContinuityMonitor () :
+  states(),
+  table(),
+  lastIndex(-1),
+  invalid(0)
+{
+  // done
+}
+
+ContinuityMonitor::~ContinuityMonitor () {
+  reset();
+}
+
+string ContinuityMonitor::toString () const {
+  ContinuityStats_t t = getTotals();
+  return Utilities::format("%s: Streams=%d Packets=%" PRId64 " LostPackets=%" PRId64
+                           " LostSamples=%" PRId64 " Duplicates=%" PRId64 " Reordered=%" PRId64
+                           " Overlaps=%" PRId64 " Resyncs=%" PRId64 " Invalid=%" PRId64,
+                           getClassName().c_str(), getStreamCount(), t.packets, t.lostPackets,
+                           t.lostSamples, t.duplicates, t.reordered, t.overlaps, t.resyncs,
+                           invalid);
+}
+
+void ContinuityMonitor::reset () {
+  for (size_t i = 0; i < states.size(); i++) {
+    delete states[i];
+  }
+  states.clear();
+  table.clear();
+  lastIndex = -1;
+  invalid   = 0;
+}
+
+ContinuityState *ContinuityMonitor::getState (int64_t streamID) {
+  // Packets usually arrive in runs on the same stream, so check the last one first
+  if ((lastIndex >= 0) && (states[lastIndex]->stats.streamID == streamID)) {
+    return states[lastIndex];
+  }
+  int32_t idx = table.find(streamID);
+  if (idx >= 0) {
+    lastIndex = idx;
+    return states[idx];
+  }
+
+  ContinuityState *s = new ContinuityState();
+  memset(&s->stats, 0, sizeof(s->stats));
+  s->stats.streamID = streamID;
+  s->dataCount      = -1;
+  s->ctxCount       = -1;
+  s->extDataCount   = -1;
+  s->extCtxCount    = -1;
+  s->dataReject     = -1;
+  s->ctxReject      = -1;
+  s->extDataReject  = -1;
+  s->extCtxReject   = -1;
+  s->sampleRate     = DOUBLE_NAN;
+  s->itemBits       = 0;
+  s->wordBits       = 0;
+  s->complexMult    = 1;
+  s->haveTime       = false;
+  s->intMode        = IntegerMode_None;
+  s->lastSec        = 0;
+  s->lastPS         = 0;
+  s->nextSec        = 0;
+  s->nextPS         = 0;
+  s->lastSamples    = 0;
+  states.push_back(s);
+
+  idx       = (int32_t)states.size() - 1;
+  lastIndex = idx;
+  table.insert(streamID, idx);
+  return s;
+}
+
+/** Checks the packet count of a packet that has no time checks.
+ *  @param stats  The counters to update.
+ *  @param last   The last count accepted (-1 if none, updated).
+ *  @param reject The last count taken as reordered (updated).
+ *  @param cnt    The packet count.
+ *  @return The event.
+ */
+static ContinuityEvent checkPacketCount (ContinuityStats_t &stats, int32_t &last, int32_t &reject,
+                                         int32_t cnt) {
+  if (last < 0) {
+    last = cnt;
+    return ContinuityEvent_First;
+  }
+  return checkCount(stats, last, reject, cnt);
+}
+
+/** Counts the bits set in a CIF. */
+static inline int32_t countBits (int32_t cif) {
+  int32_t n = 0;
+  for (uint32_t v = (uint32_t)cif; v != 0; v &= v - 1) n++;
+  return n;
+}
+
+/** Checks that a context packet holds all of its CIFs and the CIF0 fields up to and
+ *  including the data payload format, which are the only ones readContext(..) uses.
+ *  These fields all have fixed lengths, so this keeps the offsets computed by
+ *  {@link BasicContextPacket} inside a packet that is truncated or malformed.
+ */
+static bool hasContextFields (const VRTPacketView &p) {
+  const char *buf = (const char*)p.getPayloadPointer();
+  int32_t     len = p.getPayloadLength();
+  if (len < 4) return false;
+
+  int32_t cif0 = VRTMath::unpackInt(buf, 0);
+  int32_t off  = 4 + countBits(cif0 & 0xFF) * 4; // CIF0 plus the other CIFs present (CIF7 last)
+  if (off > len) return false;
+
+  int32_t add  = 0;  // octets added to each field by the CIF7 attributes
+  int32_t mult = 1;  // number of values in each field given by the CIF7 attributes
+  if ((cif0 & IndicatorFields::protected_CIF0::CIF7_ENABLE_mask) != 0) {
+    int32_t cif7 = VRTMath::unpackInt(buf, off - 4);
+    add  = countBits(cif7 & IndicatorFields::protected_CIF7::CTX_4_OCTETS) * 4;
+    mult = countBits(cif7 & IndicatorFields::protected_CIF7::CTX_SAME_OCTETS);
+  }
+
+  int32_t m = cif0 & 0x7FFF8000; // reference point through data payload format
+  off += countBits(m & IndicatorFields::protected_CIF0::CTX_4_OCTETS) * (add + 4 * mult)
+       + countBits(m & IndicatorFields::protected_CIF0::CTX_8_OCTETS) * (add + 8 * mult);
+  return (off <= len);
+}
+
+/** Sets the payload format used to count the samples in a data packet. */
+static void setFormat (ContinuityState *s, double sr, const PayloadFormat &pf) {
+  int32_t bits = pf.getItemPackingFieldSize();
+  bool    pow2 = (bits == 64) || (bits == 32) || (bits == 16) || (bits == 8)
+              || (bits ==  4) || (bits ==  2) || (bits ==  1);
+  int32_t word = (pow2 || !pf.isProcessingEfficient())? 0 : ((bits <= 32)? 32 : 64);
+  int32_t mult = (pf.isComplex())? 2 : 1;
+
+  bool changed = (bits != s->itemBits) || (word != s->wordBits) || (mult != s->complexMult)
+              || !(sr == s->sampleRate);
+  s->sampleRate  = sr;
+  s->itemBits    = bits;
+  s->wordBits    = word;
+  s->complexMult = mult;
+  if (changed) s->haveTime = false; // restart the time checks with the new values
+}
+
+void ContinuityMonitor::setSampleRate (int64_t streamID, double sr, const PayloadFormat &pf) {
+  ContinuityState *s = getState(streamID);
+  if (isNull(pf) || isNull(sr) || (sr <= 0)) {
+    s->sampleRate = DOUBLE_NAN;
+    s->haveTime   = false;
+  }
+  else {
+    setFormat(s, sr, pf);
+  }
+}
+
+void ContinuityMonitor::readContext (ContinuityState *s, const VRTPacketView &p) {
+  try {
+    BasicContextPacket ctx(p.getPacketPointer(), p.getPacketLength(), true);
+    double        sr = ctx.getSampleRate();
+    PayloadFormat pf = ctx.getDataPayloadFormat();
+
+    if (isNull(sr) || (sr <= 0)) sr = s->sampleRate;
+    if (isNull(sr)) return;
+    if (!isNull(pf)) {
+      setFormat(s, sr, pf);
+    }
+    else if (s->itemBits != 0) {
+      if (!(sr == s->sampleRate)) s->haveTime = false;
+      s->sampleRate = sr;
+    }
+    else {
+      s->sampleRate = sr; // payload format not yet known
+    }
+  }
+  catch (VRTException e) {
+    // Unreadable context, keep the previous values
+    UNUSED_VARIABLE(e);
+  }
+}
+
+ContinuityEvent ContinuityMonitor::check (const void *ptr, int32_t len) {
+  if ((len < 4) || (BasicVRTPacket::getPacketLength(ptr, 0) > len)) {
+    invalid++;
+    return ContinuityEvent_None;
+  }
+  VRTPacketView p(ptr, BasicVRTPacket::getPacketLength(ptr, 0));
+  if (p.getPayloadLength() < 0) {
+    invalid++;
+    return ContinuityEvent_None;
+  }
+
+  int64_t          sid = (p.hasStreamIdentifier())? (int64_t)(uint32_t)p.getStreamIdentifier() : NO_STREAM;
+  ContinuityState *s   = getState(sid);
+  int32_t          cnt = p.getPacketCount();
+  s->stats.packets++;
+
+  // Each packet type has its own packet count sequence
+  switch (p.getPacketType()) {
+    case PacketType_UnidentifiedData:
+    case PacketType_Data:
+      return checkData(s, p);
+
+    case PacketType_UnidentifiedExtData:
+    case PacketType_ExtData:
+      return checkPacketCount(s->stats, s->extDataCount, s->extDataReject, cnt);
+
+    case PacketType_Context: {
+      // Pick up any change in the sample rate or payload format (the change indicator
+      // is bit 31 of CIF0)
+      bool changed = (p.getPayloadLength() >= 4)
+                  && ((((const char*)p.getPayloadPointer())[0] & 0x80) != 0);
+      if ((changed || isNull(s->sampleRate) || (s->itemBits == 0)) && hasContextFields(p)) {
+        readContext(s, p);
+      }
+      return checkPacketCount(s->stats, s->ctxCount, s->ctxReject, cnt);
+    }
+
+    case PacketType_ExtContext:
+      // The payload is not laid out by CIFs, so only the packet count is used
+      return checkPacketCount(s->stats, s->extCtxCount, s->extCtxReject, cnt);
+
+    default:
+      return ContinuityEvent_None;
+  }
+}
+
+ContinuityEvent ContinuityMonitor::checkData (ContinuityState *s, const VRTPacketView &p) {
+  int32_t        cnt     = p.getPacketCount();
+  IntegerMode    tsiMode = p.getIntegerMode();
+  FractionalMode tsfMode = p.getFractionalMode();
+
+  // Get the time stamp in picoseconds (if usable)
+  bool    timed = !isNull(s->sampleRate) && (s->itemBits != 0) && (tsiMode != IntegerMode_None)
+               && ((tsfMode == FractionalMode_RealTime) || (tsfMode == FractionalMode_SampleCount));
+  int64_t sec   = 0;
+  int64_t ps    = 0;
+  if (timed) {
+    sec = p.getTimeStampInteger();
+    ps  = (int64_t)p.getTimeStampFractional();
+    if (tsfMode == FractionalMode_SampleCount) {
+      ps = (int64_t)llround((double)ps * (double)ONE_SEC_PS / s->sampleRate);
+    }
+  }
+
+  ContinuityEvent ev;
+  int64_t         lost    = 0;
+  bool            advance = true;  // use this packet as the new reference?
+
+  if (s->dataCount < 0) {
+    ev = ContinuityEvent_First;
+  }
+  else if (!timed || !s->haveTime || ((int32_t)tsiMode != s->intMode)) {
+    ev = checkCount(s->stats, s->dataCount, s->dataReject, cnt);
+    if (s->dataCount != cnt) return ev; // not accepted
+  }
+  else {
+    int32_t skipped = (cnt - s->dataCount - 1) & 0xF;
+    int64_t gap     = diffSamples(sec, ps, s->nextSec, s->nextPS, s->sampleRate);
+    if (gap == 0) {
+      ev = ContinuityEvent_None;
+    }
+    else if (gap > 0) {
+      // Estimate the packets lost from the time, then take the nearest value that
+      // agrees with the packet count (the count alone can not see past 15)
+      int64_t est  = (s->lastSamples > 0)? (int64_t)llround((double)gap / s->lastSamples) : skipped;
+      int64_t diff = (skipped - est) & 0xF;
+      lost = est + ((diff < 8)? diff : diff - 16);
+      if (lost < 0) lost = 0;
+      ev = ContinuityEvent_Lost;
+      s->stats.lostSamples += gap;
+    }
+    else {
+      int64_t back = diffSamples(sec, ps, s->lastSec, s->lastPS, s->sampleRate);
+      int64_t span = 16 * (int64_t)max(s->lastSamples, 1);
+      if (back == 0) {
+        ev      = ContinuityEvent_Duplicate;
+        advance = false;
+      }
+      else if (back > 0) {
+        ev = ContinuityEvent_Overlap;
+      }
+      else if (-back <= span) {
+        ev      = ContinuityEvent_Reordered;
+        lost    = -1; // a packet counted as lost has turned up
+        advance = false;
+      }
+      else {
+        ev = ContinuityEvent_Resync;
+      }
+    }
+
+    switch (ev) {
+      case ContinuityEvent_Duplicate: s->stats.duplicates++; break;
+      case ContinuityEvent_Reordered: s->stats.reordered++;  break;
+      case ContinuityEvent_Overlap:   s->stats.overlaps++;   break;
+      case ContinuityEvent_Resync:    s->stats.resyncs++;    break;
+      default:                                               break;
+    }
+    if (lost < 0) {
+      if (s->stats.lostPackets > 0) s->stats.lostPackets--;
+    }
+    else {
+      s->stats.lostPackets += lost;
+    }
+    if (!advance) return ev;
+  }
+
+  s->dataCount  = cnt;
+  s->dataReject = -1;
+  if (timed) {
+    int32_t samples = getSampleCount(s, p);
+    int64_t nextPS  = ps + (int64_t)llround((double)samples * (double)ONE_SEC_PS / s->sampleRate);
+    s->haveTime    = true;
+    s->intMode     = tsiMode;
+    s->lastSec     = sec;
+    s->lastPS      = ps;
+    s->nextSec     = sec + nextPS / ONE_SEC_PS;
+    s->nextPS      = nextPS % ONE_SEC_PS;
+    s->lastSamples = samples;
+  }
+  else {
+    s->haveTime = false;
+  }
+  return ev;
+}
+
+vector<int64_t> ContinuityMonitor::getStreamIDs () const {
+  vector<int64_t> ids(states.size());
+  for (size_t i = 0; i < states.size(); i++) {
+    ids[i] = states[i]->stats.streamID;
+  }
+  return ids;
+}
+
+ContinuityStats_t ContinuityMonitor::getStats (int64_t streamID) const {
+  int32_t idx = table.find(streamID);
+  if (idx >= 0) return states[idx]->stats;
+
+  ContinuityStats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.streamID = streamID;
+  return stats;
+}
+
+ContinuityStats_t ContinuityMonitor::getTotals () const {
+  ContinuityStats_t t;
+  memset(&t, 0, sizeof(t));
+  t.streamID = NO_STREAM;
+  for (size_t i = 0; i < states.size(); i++) {
+    const ContinuityStats_t &s = states[i]->stats;
+    t.packets     += s.packets;
+    t.lostPackets += s.lostPackets;
+    t.lostSamples += s.lostSamples;
+    t.duplicates  += s.duplicates;
+    t.reordered   += s.reordered;
+    t.overlaps    += s.overlaps;
+    t.resyncs     += s.resyncs;
+  }
+  return t;
+}
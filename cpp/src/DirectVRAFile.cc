@@ -0,0 +1,734 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE    // for O_DIRECT / fallocate(..)
+#endif
+#include "DirectVRAFile.h"
+#include <sys/stat.h>   // for fstat(..)
+#include <sys/uio.h>    // for struct iovec
+#include <fcntl.h>      // for open(..) / fallocate(..)
+#include <unistd.h>     // for pwrite(..) / pread(..) / ftruncate(..) / fsync(..)
+#include <stdlib.h>     // for posix_memalign(..) / free(..)
+#include <string.h>     // for memcpy(..) / memset(..)
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <deque>
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+# include <sys/mman.h>
+# if defined(__NR_io_uring_setup) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#   include <linux/io_uring.h>
+#   define HAVE_IO_URING 1
+#  endif
+# endif
+#endif
+
+using namespace vrt;
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> Submits writes and reports their completion. Each write
+   *  is identified by a tag, completions may be reported in any order.
+   */
+  class DirectIOEngine {
+    public: virtual ~DirectIOEngine () { }
+
+    /** Gets the mode implemented by the engine. */
+    public: virtual DirectIOMode getMode () const = 0;
+
+    /** Submits a write. */
+    public: virtual void submit (int fd, char *ptr, int32_t len, int64_t off, int32_t tag) = 0;
+
+    /** Waits for a write to complete, returning its tag. The result is the number of
+     *  octets written or a negated errno value.
+     */
+    public: virtual int32_t wait (int32_t &result) = 0;
+  };
+} END_NAMESPACE
+
+#if defined(HAVE_IO_URING)
+/** Submits writes via io_uring (using the system calls directly so that there is
+ *  no dependency on liburing).
+ */
+class IOUringEngine : public DirectIOEngine {
+  private: int                  ringFD;
+  private: void                *sqRing;
+  private: size_t               sqRingSize;
+  private: void                *cqRing;
+  private: size_t               cqRingSize;
+  private: struct io_uring_sqe *sqes;
+  private: size_t               sqesSize;
+  private: volatile uint32_t   *sqTail;
+  private: uint32_t             sqMask;
+  private: uint32_t            *sqArray;
+  private: volatile uint32_t   *cqHead;
+  private: volatile uint32_t   *cqTail;
+  private: uint32_t             cqMask;
+  private: struct io_uring_cqe *cqes;
+  private: vector<struct iovec> iov;
+
+  public: IOUringEngine (int32_t entries) :
+    ringFD(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+    sqes((struct io_uring_sqe*)MAP_FAILED), sqesSize(0), iov(entries)
+  {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ringFD = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ringFD < 0) {
+      throw VRTException("Unable to set up io_uring: %s", ERRNO_STR);
+    }
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cqRingSize = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      sqRingSize = max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(NULL, sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                  ringFD, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) fail();
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      cqRing = sqRing;
+    }
+    else {
+      cqRing = mmap(NULL, cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                    ringFD, IORING_OFF_CQ_RING);
+      if (cqRing == MAP_FAILED) fail();
+    }
+
+    sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ|PROT_WRITE,
+                                      MAP_SHARED|MAP_POPULATE, ringFD, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) fail();
+
+    char *sq = (char*)sqRing;
+    char *cq = (char*)cqRing;
+    sqTail  = (volatile uint32_t*)(sq + p.sq_off.tail);
+    sqMask  = *(uint32_t*)(sq + p.sq_off.ring_mask);
+    sqArray = (uint32_t*)(sq + p.sq_off.array);
+    cqHead  = (volatile uint32_t*)(cq + p.cq_off.head);
+    cqTail  = (volatile uint32_t*)(cq + p.cq_off.tail);
+    cqMask  = *(uint32_t*)(cq + p.cq_off.ring_mask);
+    cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  }
+
+  public: ~IOUringEngine () {
+    release();
+  }
+
+  public: virtual DirectIOMode getMode () const {
+    return DirectIOMode_IOUring;
+  }
+
+  public: virtual void submit (int fd, char *ptr, int32_t len, int64_t off, int32_t tag) {
+    iov[tag].iov_base = ptr;
+    iov[tag].iov_len  = len;
+
+    // There are never more writes in progress than ring entries, so there is
+    // always room for this one.
+    uint32_t             tail = *sqTail;
+    uint32_t             idx  = tail & sqMask;
+    struct io_uring_sqe *sqe  = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = IORING_OP_WRITEV;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)&iov[tag];
+    sqe->len       = 1;
+    sqe->off       = (uint64_t)off;
+    sqe->user_data = (uint64_t)tag;
+    sqArray[idx]   = idx;
+    __sync_synchronize(); // entry must be visible before the tail is updated
+    *sqTail = tail + 1;
+    __sync_synchronize();
+
+    while (syscall(__NR_io_uring_enter, ringFD, 1, 0, 0, NULL, 0) < 0) {
+      if (errno != EINTR) {
+        throw VRTException("Unable to submit write: %s", ERRNO_STR);
+      }
+    }
+  }
+
+  public: virtual int32_t wait (int32_t &result) {
+    while (true) {
+      uint32_t head = *cqHead;
+      __sync_synchronize(); // tail must be read after head
+      if (head != *cqTail) {
+        struct io_uring_cqe *cqe = &cqes[head & cqMask];
+        int32_t              tag = (int32_t)cqe->user_data;
+        result = cqe->res;
+        __sync_synchronize(); // entry must be read before the head is updated
+        *cqHead = head + 1;
+        return tag;
+      }
+      if (syscall(__NR_io_uring_enter, ringFD, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+        if (errno != EINTR) {
+          throw VRTException("Unable to wait for write: %s", ERRNO_STR);
+        }
+      }
+    }
+  }
+
+  private: void fail () {
+    int err = errno;
+    release();
+    throw VRTException("Unable to map io_uring: %s", strerror(err));
+  }
+
+  private: void release () {
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    if ((cqRing != MAP_FAILED) && (cqRing != sqRing)) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (ringFD >= 0) ::close(ringFD);
+    sqes   = (struct io_uring_sqe*)MAP_FAILED;
+    cqRing = MAP_FAILED;
+    sqRing = MAP_FAILED;
+    ringFD = -1;
+  }
+};
+#endif /* HAVE_IO_URING */
+
+/** Submits writes to a pool of threads that call <tt>pwrite(..)</tt>. */
+class ThreadPoolEngine : public DirectIOEngine {
+  private: struct Request {
+    int      fd;
+    char    *ptr;
+    int32_t  len;
+    int64_t  off;
+    int32_t  tag;
+  };
+
+  private: vector<pthread_t>             threads;
+  private: pthread_mutex_t               lock;
+  private: pthread_cond_t                haveWork;
+  private: pthread_cond_t                haveDone;
+  private: deque<Request>                work;
+  private: deque<pair<int32_t,int32_t> > done;    // (tag,result)
+  private: bool                          stopping;
+
+  public: ThreadPoolEngine (int32_t numThreads) :
+    threads(),
+    work(),
+    done(),
+    stopping(false)
+  {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&haveWork, NULL);
+    pthread_cond_init(&haveDone, NULL);
+
+    for (int32_t i = 0; i < numThreads; i++) {
+      pthread_t t;
+      int err = pthread_create(&t, NULL, run, this);
+      if (err != 0) {
+        stop();
+        throw VRTException("Unable to start writer thread: %s", strerror(err));
+      }
+      threads.push_back(t);
+    }
+  }
+
+  public: ~ThreadPoolEngine () {
+    stop();
+  }
+
+  public: virtual DirectIOMode getMode () const {
+    return DirectIOMode_ThreadPool;
+  }
+
+  public: virtual void submit (int fd, char *ptr, int32_t len, int64_t off, int32_t tag) {
+    Request r;
+    r.fd  = fd;
+    r.ptr = ptr;
+    r.len = len;
+    r.off = off;
+    r.tag = tag;
+
+    pthread_mutex_lock(&lock);
+    work.push_back(r);
+    pthread_cond_signal(&haveWork);
+    pthread_mutex_unlock(&lock);
+  }
+
+  public: virtual int32_t wait (int32_t &result) {
+    pthread_mutex_lock(&lock);
+    while (done.empty()) {
+      pthread_cond_wait(&haveDone, &lock);
+    }
+    int32_t tag = done.front().first;
+    result      = done.front().second;
+    done.pop_front();
+    pthread_mutex_unlock(&lock);
+    return tag;
+  }
+
+  private: void stop () {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&haveWork);
+    pthread_mutex_unlock(&lock);
+
+    for (size_t i = 0; i < threads.size(); i++) {
+      pthread_join(threads[i], NULL);
+    }
+    threads.clear();
+    pthread_cond_destroy(&haveDone);
+    pthread_cond_destroy(&haveWork);
+    pthread_mutex_destroy(&lock);
+  }
+
+  private: static void *run (void *arg) {
+    ThreadPoolEngine *e = (ThreadPoolEngine*)arg;
+    while (true) {
+      pthread_mutex_lock(&e->lock);
+      while (e->work.empty() && !e->stopping) {
+        pthread_cond_wait(&e->haveWork, &e->lock);
+      }
+      if (e->work.empty()) {
+        pthread_mutex_unlock(&e->lock);
+        return NULL;
+      }
+      Request r = e->work.front();
+      e->work.pop_front();
+      pthread_mutex_unlock(&e->lock);
+
+      int32_t result = 0;
+      while (result < r.len) {
+        ssize_t n = pwrite(r.fd, r.ptr + result, r.len - result, r.off + result);
+        if (n > 0) {
+          result += (int32_t)n;
+        }
+        else if ((n < 0) && (errno == EINTR)) {
+          continue;
+        }
+        else {
+          result = (n < 0)? -errno : -EIO;
+          break;
+        }
+      }
+
+      pthread_mutex_lock(&e->lock);
+      e->done.push_back(make_pair(r.tag, result));
+      pthread_cond_signal(&e->haveDone);
+      pthread_mutex_unlock(&e->lock);
+    }
+  }
+};
+
+/** Rounds up to a multiple of the alignment. */
+static inline int64_t alignUp (int64_t n) {
+  return (n + DirectVRAFile::ALIGNMENT - 1) & ~((int64_t)DirectVRAFile::ALIGNMENT - 1);
+}
+
+/** Rounds down to a multiple of the alignment. */
+static inline int64_t alignDown (int64_t n) {
+  return n & ~((int64_t)DirectVRAFile::ALIGNMENT - 1);
+}
+
+DirectVRAFile::DirectVRAFile (string fname, FileMode fmode, bool isSetSize, bool isSetCRC,
+                              bool isStrict, int32_t queueDepth, int32_t bufferSize,
+                              int64_t preallocate, DirectIOMode ioMode) :
+  AbstractVRAFile(toURI(fname), ((fmode & FileMode_READ) != 0), ((fmode & FileMode_WRITE) != 0),
+                  isSetSize, isSetCRC, isStrict),
+  fname(fname),
+  mode(fmode),
+  ioMode(ioMode),
+  queueDepth(queueDepth),
+  bufferSize(bufferSize),
+  preallocate(preallocate),
+  fd(-1),
+  rfd(-1),
+  direct(false),
+  engine(NULL),
+  numBuffers(queueDepth+1),
+  buffers(NULL),
+  inFlight(NULL),
+  numInFlight(0),
+  cur(0),
+  bufStart(0),
+  bufUsed(0),
+  bufSynced(0),
+  headBlock(NULL),
+  headSaved(false),
+  headDirty(false),
+  fileLength(0),
+  syncedLength(0),
+  allocLength(0)
+{
+  if ((fmode & FileMode_WRITE) == 0) {
+    throw VRTException("DirectVRAFile requires a FileMode with write access");
+  }
+  if (queueDepth < 1) {
+    throw VRTException("Invalid queue depth %d", queueDepth);
+  }
+  if ((bufferSize < ALIGNMENT) || ((bufferSize % ALIGNMENT) != 0)) {
+    throw VRTException("Invalid buffer size %d, must be a multiple of %d", bufferSize, ALIGNMENT);
+  }
+  if (preallocate < 0) {
+    throw VRTException("Invalid preallocation size %" PRId64, preallocate);
+  }
+  open();
+}
+
+DirectVRAFile::~DirectVRAFile () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // can't throw from destructor
+  }
+  release();
+}
+
+string DirectVRAFile::toString () const {
+  return AbstractVRAFile::toString()
+       + Utilities::format(" Direct=%s IOMode=%s QueueDepth=%d BufferSize=%d",
+                           (direct)? "true" : "false",
+                           (engine == NULL)? "n/a" : (getIOMode() == DirectIOMode_IOUring)?
+                                                     "IOUring" : "ThreadPool",
+                           queueDepth, bufferSize);
+}
+
+DirectIOMode DirectVRAFile::getIOMode () const {
+  if (engine == NULL) throw VRTException("File %s is not open", fname.c_str());
+  return engine->getMode();
+}
+
+void DirectVRAFile::open () {
+  int flags = O_RDWR | O_CREAT | (((mode & FileMode_READ) != 0)? 0 : O_TRUNC);
+
+  try {
+    // Not all file systems support O_DIRECT (e.g. tmpfs), fall back to buffered I/O
+    fd     = ::open(fname.c_str(), flags | O_DIRECT, 0666);
+    direct = (fd >= 0);
+    if ((fd < 0) && (errno == EINVAL)) {
+      fd = ::open(fname.c_str(), flags, 0666);
+    }
+    if (fd < 0) {
+      throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+    }
+    rfd = ::open(fname.c_str(), O_RDONLY);
+    if (rfd < 0) {
+      throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      throw VRTException("Unable to stat %s: %s", fname.c_str(), ERRNO_STR);
+    }
+    fileLength   = st.st_size;
+    syncedLength = st.st_size;
+    allocLength  = st.st_size;
+
+#if defined(HAVE_IO_URING)
+    if (ioMode != DirectIOMode_ThreadPool) {
+      try {
+        engine = new IOUringEngine(numBuffers+1);
+      }
+      catch (VRTException e) {
+        if (ioMode == DirectIOMode_IOUring) throw e;
+      }
+    }
+#else
+    if (ioMode == DirectIOMode_IOUring) {
+      throw VRTException("Support for io_uring is not available");
+    }
+#endif
+    if (engine == NULL) {
+      engine = new ThreadPoolEngine(queueDepth);
+    }
+
+    // The final slot in buffers/inFlight is used for the head block
+    buffers  = new char*[numBuffers+1];
+    inFlight = new int32_t[numBuffers+1];
+    for (int32_t i = 0; i <= numBuffers; i++) {
+      buffers[i]  = NULL;
+      inFlight[i] = 0;
+    }
+    for (int32_t i = 0; i <= numBuffers; i++) {
+      void *ptr = NULL;
+      if (posix_memalign(&ptr, ALIGNMENT, (i < numBuffers)? bufferSize : ALIGNMENT) != 0) {
+        throw VRTException("Unable to allocate %d buffers of %d octets", numBuffers, bufferSize);
+      }
+      buffers[i] = (char*)ptr;
+    }
+    headBlock = buffers[numBuffers];
+
+    // Pick up any partial block at the end of an existing file, plus the head
+    // block (if not part of the same) so that the header can be updated
+    bufStart  = alignDown(fileLength);
+    bufUsed   = (int32_t)(fileLength - bufStart);
+    headSaved = (bufStart > 0);
+    if ((bufUsed > 0) && (pread(rfd, buffers[cur], bufUsed, bufStart) != bufUsed)) {
+      throw VRTException("Unable to read from %s: %s", fname.c_str(), ERRNO_STR);
+    }
+    if (headSaved && (pread(rfd, headBlock, ALIGNMENT, 0) != ALIGNMENT)) {
+      throw VRTException("Unable to read from %s: %s", fname.c_str(), ERRNO_STR);
+    }
+    reserve(fileLength);
+
+    AbstractVRAFile::open();
+  }
+  catch (VRTException e) {
+    release();
+    throw e;
+  }
+}
+
+void DirectVRAFile::close () {
+  if (fd >= 0) {
+    try {
+      AbstractVRAFile::close(); // <-- includes flush(true)
+      if ((preallocate > 0) && (ftruncate(fd, fileLength) != 0)) {
+        throw VRTException("Unable to truncate %s: %s", fname.c_str(), ERRNO_STR);
+      }
+    }
+    catch (VRTException e) {
+      release();
+      throw e;
+    }
+    int err = (::close(fd) == 0)? 0 : errno;
+    fd = -1;
+    release();
+    if (err != 0) {
+      throw VRTException("Unable to close %s: %s", fname.c_str(), strerror(err));
+    }
+  }
+}
+
+void DirectVRAFile::release () {
+  // No buffer can be freed while the kernel (or a writer thread) may be using it
+  while ((engine != NULL) && (numInFlight > 0)) {
+    try {
+      waitOne();
+    }
+    catch (VRTException e) {
+      UNUSED_VARIABLE(e); // already failed
+    }
+  }
+  safe_delete(engine);
+
+  if (buffers != NULL) {
+    for (int32_t i = 0; i <= numBuffers; i++) free(buffers[i]);
+    delete[] buffers;
+    buffers   = NULL;
+    headBlock = NULL;
+  }
+  if (inFlight != NULL) {
+    delete[] inFlight;
+    inFlight = NULL;
+  }
+  if (fd  >= 0) ::close(fd);
+  if (rfd >= 0) ::close(rfd);
+  fd  = -1;
+  rfd = -1;
+}
+
+void DirectVRAFile::flush (bool force) {
+  force = force || ((mode & FileMode_SYNCH_DATA) != 0); // All SYNCH_META also SYNCH_DATA
+  AbstractVRAFile::flush(force);
+  if (force) {
+    drain();
+
+    if (mode & FileMode_SYNCH_META) {
+      if (fsync(fd) != 0) {
+        throw VRTException("Unable to synch data+metadata for %s: %s", fname.c_str(), ERRNO_STR);
+      }
+    }
+    else if (mode & FileMode_SYNCH_DATA) {
+      if (fdatasync(fd) != 0) {
+        throw VRTException("Unable to synch data for %s: %s", fname.c_str(), ERRNO_STR);
+      }
+    }
+  }
+}
+
+int64_t DirectVRAFile::getFileLengthOS () const {
+  return fileLength;
+}
+
+int64_t DirectVRAFile::getFileLengthRW () const {
+  return fileLength;
+}
+
+int32_t DirectVRAFile::read (int64_t off, void *ptr, int32_t len) const {
+  if (ptr == NULL) throw VRTException("Can not read from %s to NULL buffer", fname.c_str());
+  if (len <     0) throw VRTException("Can not read %d octets from %s", len, fname.c_str());
+  if (off <     0) throw VRTException("Unable to read from %" PRId64 " in %s", off, fname.c_str());
+  if (rfd <     0) throw VRTException("File %s is not open", fname.c_str());
+  if (len ==    0) return 0;
+  if (off >= fileLength) return EOF;
+
+  // Anything still in the staging buffers needs to be written out first
+  if (headDirty || (numInFlight > 0) || (off + len > syncedLength)) {
+    const_cast<DirectVRAFile*>(this)->drain();
+  }
+
+  int32_t toRead  = (int32_t)min((int64_t)len, fileLength - off);
+  int32_t numRead = 0;
+  while (numRead < toRead) {
+    ssize_t n = pread(rfd, (char*)ptr + numRead, toRead - numRead, off + numRead);
+    if (n > 0) {
+      numRead += (int32_t)n;
+    }
+    else if ((n < 0) && (errno == EINTR)) {
+      continue;
+    }
+    else if (n == 0) {
+      break;
+    }
+    else {
+      throw VRTException("Error while reading from %s: %s", fname.c_str(), ERRNO_STR);
+    }
+  }
+  return (numRead > 0)? numRead : EOF;
+}
+
+void DirectVRAFile::write (int64_t off, void *ptr, int32_t len, bool flush) {
+  if (!isWrite   ) throw VRTException("File is read-only");
+  if (ptr == NULL) throw VRTException("Can not read from %s to NULL buffer", fname.c_str());
+  if (len <     0) throw VRTException("Can not read %d octets from %s", len, fname.c_str());
+  if (fd  <     0) throw VRTException("File %s is not open", fname.c_str());
+  if (len ==    0) return;
+
+  if ((off == EOF) || (off == fileLength)) {
+    const char *src = (const char*)ptr;
+    while (len > 0) {
+      int32_t n = min(len, bufferSize - bufUsed);
+      memcpy(&buffers[cur][bufUsed], src, n);
+      bufUsed    += n;
+      fileLength += n;
+      src        += n;
+      len        -= n;
+      if (bufUsed == bufferSize) nextBuffer();
+    }
+  }
+  else if ((off >= 0) && (off + len <= HEADER_LENGTH) && (off + len <= fileLength)) {
+    // Header updates go to the copy of the first block (if it has been written out)
+    // or to the current buffer (if not); neither is ever in use by an active write.
+    char *dst = (headSaved)? headBlock : buffers[cur];
+    memcpy(&dst[off], ptr, len);
+    headDirty = true;
+  }
+  else {
+    throw VRTException("Unable to write to %" PRId64 " in %s: Only appends and header updates "
+                       "are supported", off, fname.c_str());
+  }
+
+  // Only the header is updated here, buffered data is not written out until
+  // the buffer is full (or flush() is called) unless in one of the SYNCH modes.
+  if ((mode & FileMode_SYNCH_DATA) != 0) {
+    this->flush(flush);
+  }
+  else {
+    AbstractVRAFile::flush(flush);
+  }
+}
+
+void DirectVRAFile::submit (int32_t buf, char *ptr, int32_t len, int64_t off) {
+  inFlight[buf] = len;
+  numInFlight++;
+  try {
+    engine->submit(fd, ptr, len, off, buf);
+  }
+  catch (VRTException e) {
+    inFlight[buf] = 0;
+    numInFlight--;
+    throw e;
+  }
+}
+
+void DirectVRAFile::waitOne () {
+  int32_t result;
+  int32_t buf    = engine->wait(result);
+  int32_t expect = inFlight[buf];
+  inFlight[buf]  = 0;
+  numInFlight--;
+
+  if (result < 0) {
+    throw VRTException("Unable to write to %s: %s", fname.c_str(), strerror(-result));
+  }
+  if (result != expect) {
+    throw VRTException("Unable to write to %s: Wrote %d of %d octets", fname.c_str(), result, expect);
+  }
+}
+
+void DirectVRAFile::nextBuffer () {
+  if (bufStart == 0) {
+    memcpy(headBlock, buffers[cur], ALIGNMENT);
+    headSaved = true;
+  }
+  reserve(bufStart + bufferSize);
+  submit(cur, &buffers[cur][bufSynced], bufferSize - bufSynced, bufStart + bufSynced);
+
+  bufStart    += bufferSize;
+  bufUsed      = 0;
+  bufSynced    = 0;
+  syncedLength = bufStart;  // <-- Once numInFlight reaches 0
+  cur          = (cur + 1) % numBuffers;
+  while (inFlight[cur] != 0) {
+    waitOne();
+  }
+}
+
+void DirectVRAFile::drain () {
+  // The final block is padded out to the alignment (with zeros); when not
+  // preallocating, the file is then truncated back to the correct length.
+  int32_t end  = (int32_t)alignUp(bufUsed);
+  int32_t from = (!headSaved && headDirty)? 0 : bufSynced;
+  if (end > from) {
+    memset(&buffers[cur][bufUsed], 0, end - bufUsed);
+    reserve(bufStart + end);
+    submit(cur, &buffers[cur][from], end - from, bufStart + from);
+  }
+  while (numInFlight > 0) {
+    waitOne();
+  }
+
+  if (headSaved && headDirty) {
+    submit(numBuffers, headBlock, ALIGNMENT, 0);
+    waitOne();
+  }
+  headDirty    = false;
+  bufSynced    = (int32_t)alignDown(bufUsed);
+  syncedLength = fileLength;
+
+  if ((preallocate == 0) && (bufStart + end > fileLength)) {
+    if (ftruncate(fd, fileLength) != 0) {
+      throw VRTException("Unable to truncate %s: %s", fname.c_str(), ERRNO_STR);
+    }
+  }
+}
+
+void DirectVRAFile::reserve (int64_t len) {
+  if ((preallocate == 0) || (len <= allocLength)) return;
+
+  int64_t newLength = allocLength + preallocate;
+  while (newLength < len) newLength += preallocate;
+
+  if (fallocate(fd, 0, allocLength, newLength - allocLength) != 0) {
+    if ((errno == EOPNOTSUPP) || (errno == ENOSYS)) {
+      preallocate = 0; // not supported by the file system, just skip it
+      return;
+    }
+    throw VRTException("Unable to allocate space for %s: %s", fname.c_str(), ERRNO_STR);
+  }
+  allocLength = newLength;
+}
@@ -20,63 +20,180 @@
  */
 
 #include "HasFields.h"
-#include <stdlib.h> // for atoi(..)
+#include <cstring>
 
 using namespace vrt;
 
-/** Internal use only: A parsed field name. */
+/** Internal use only: A parsed field name. This references the characters in
+ *  the original name (rather than copying them) so no allocation is required.
+ */
 class ParsedFieldName {
-  /** Internal use only. */ public: string  first;
-  /** Internal use only. */ public: int32_t idx;
-  /** Internal use only. */ public: string  next;
+  /** Internal use only. */ public: const char *first;
+  /** Internal use only. */ public: size_t      firstLen;
+  /** Internal use only. */ public: int32_t     idx;
+  /** Internal use only. */ public: const char *next;
+  /** Internal use only. */ public: size_t      nextLen;
 
   /** Internal use only. */
-  public: ParsedFieldName (const string &name);
+  public: ParsedFieldName (const char *name, size_t len);
 };
 
-ParsedFieldName::ParsedFieldName (const string &name) :
-  first(""),
+ParsedFieldName::ParsedFieldName (const char *name, size_t len) :
+  first(name),
+  firstLen(len),
   idx(-1),
-  next("")
+  next(name+len),
+  nextLen(0)
 {
-  size_t dotIndex   = name.find(".");
-  size_t startIndex = name.find("[");
+  const char *dot   = (const char*)memchr(name, '.', len);
+  const char *start = (const char*)memchr(name, '[', len);
+
+  if ((start != NULL) && ((dot == NULL) || (start < dot))) {
+    const char *end = (const char*)memchr(start, ']', len - (start - name));
+
+    if ((end == NULL) || (end == start+1)) {
+      throw VRTException("Invalid field name '%s'", string(name,len).c_str());
+    }
+
+    idx = 0;
+    for (const char *c = start+1; c < end; c++) {
+      if ((*c < '0') || (*c > '9')) {
+        throw VRTException("Invalid field name '%s'", string(name,len).c_str());
+      }
+      idx = (idx * 10) + (*c - '0');
+    }
 
-  if ((dotIndex == string::npos) && (startIndex == string::npos)) {
-    first = name;
-    idx   = -1;
-    next  = "";
+    firstLen = start - name;
+    next     = end + 1;
+    if ((next < name+len) && (*next == '.')) next++; // "BAR[2].BAZ" -> "BAZ"
+    nextLen  = (name+len) - next;
   }
-  else if (startIndex == string::npos) {
-    first = name.substr(0,dotIndex);
-    idx   = -1;
-    next  = name.substr(dotIndex+1);
+  else if (dot != NULL) {
+    firstLen = dot - name;
+    next     = dot + 1;
+    nextLen  = (name+len) - next;
   }
-  else if ((dotIndex == string::npos) ||  (startIndex < dotIndex)) {
-    size_t endIndex = name.find("]");
+}
+
+/** Internal use only: FNV-1a hash of a field name. */
+static inline uint32_t hashFieldName (const char *name, size_t len) {
+  uint32_t h = 0x811C9DC5;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)name[i]) * 0x01000193;
+  }
+  return h;
+}
+
+/** Internal use only: Open-addressed hash index of the field names for a class.
+ *  Instances are never deleted once published since other threads may be
+ *  reading them without holding a lock.
+ */
+class FieldIndex {
+  /** Internal use only. */ public: const type_info *type;
+  /** Internal use only. */ public: int32_t          count;
+  /** Internal use only. */ public: uint32_t         mask;
+  /** Internal use only. */ public: vector<int32_t>  slots;
+  /** Internal use only. */ public: vector<uint32_t> hashes;
+  /** Internal use only. */ public: vector<string>   names;
+  /** Internal use only. */ public: FieldIndex      *next;
 
-    if ((endIndex == string::npos) || (endIndex < startIndex)) {
-      throw VRTException("Invalid field name '%s'", name.c_str());
+  /** Internal use only. */
+  public: FieldIndex (const HasFields *hf, const type_info *type) :
+    type(type),
+    count(hf->getFieldCount()),
+    mask(0),
+    next(NULL)
+  {
+    uint32_t size = 8;
+    while (size < (uint32_t)count * 2) size *= 2; // keep load factor <= 0.5
+    mask = size - 1;
+    slots.assign(size, -1);
+    hashes.resize(count);
+    names.resize(count);
+
+    for (int32_t id = 0; id < count; id++) {
+      names[id]  = hf->getFieldName(id);
+      hashes[id] = hashFieldName(names[id].c_str(), names[id].size());
+
+      uint32_t i = hashes[id] & mask;
+      while (slots[i] >= 0) i = (i + 1) & mask;
+      slots[i] = id;
     }
+  }
+
+  /** Internal use only. */
+  public: inline int32_t find (const char *name, size_t len) const {
+    uint32_t h = hashFieldName(name, len);
+    for (uint32_t i = h & mask; slots[i] >= 0; i = (i + 1) & mask) {
+      int32_t id = slots[i];
+      if ((hashes[id] == h) && (names[id].size() == len)
+                            && (memcmp(names[id].c_str(), name, len) == 0)) {
+        return id;
+      }
+    }
+    return -1;
+  }
+};
+
+/** Internal use only: Number of buckets in the index table (must be a power of 2). */
+static const size_t FIELD_INDEX_BUCKETS = 64;
+
+/** Internal use only: Per-class field indexes, hashed by type. */
+static FieldIndex * volatile fieldIndexes[FIELD_INDEX_BUCKETS];
 
-    string num = name.substr(startIndex+1,endIndex-startIndex-2);
+/** Internal use only: Lock held when adding entries to fieldIndexes. */
+static pthread_mutex_t fieldIndexLock = PTHREAD_MUTEX_INITIALIZER;
 
-    first = name.substr(0,startIndex);
-    idx   = atoi(num.c_str());
-    next  = name.substr(endIndex+1);
+/** Internal use only: Gets the field index for the given object, creating it
+ *  if necessary. Lookups are lock-free, the lock is only used when adding a
+ *  new index.
+ */
+static const FieldIndex* getFieldIndex (const HasFields *hf) {
+  const type_info *type   = &typeid(*hf);
+  size_t           bucket = (((size_t)type) >> 4) & (FIELD_INDEX_BUCKETS-1);
+
+  for (const FieldIndex *fi = fieldIndexes[bucket]; fi != NULL; fi = fi->next) {
+    if (fi->type == type) return fi;
   }
-  else {
-    first = name.substr(0,dotIndex);
-    idx   = -1;
-    next  = name.substr(dotIndex+1);
+
+  FieldIndex *index = new FieldIndex(hf, type);
+  pthread_mutex_lock(&fieldIndexLock);
+  for (const FieldIndex *fi = fieldIndexes[bucket]; fi != NULL; fi = fi->next) {
+    if (fi->type == type) {
+      // added by another thread while we were building ours
+      pthread_mutex_unlock(&fieldIndexLock);
+      delete index;
+      return fi;
+    }
   }
+  index->next = fieldIndexes[bucket];
+  __sync_synchronize(); // index must be fully visible before it is published
+  fieldIndexes[bucket] = index;
+  pthread_mutex_unlock(&fieldIndexLock);
+  return index;
 }
 
 int32_t HasFields::getFieldID (const string &name) const {
-  for (int32_t i = 0; i < getFieldCount(); i++) {
-    if (name == getFieldName(i)) return i;
+  return getFieldID(name.c_str(), name.size());
+}
+
+int32_t HasFields::getFieldID (const char *name, size_t len) const {
+  int32_t count = getFieldCount();
+
+  if (hasFixedFieldNames()) {
+    const FieldIndex *index = getFieldIndex(this);
+    if (index->count == count) {
+      int32_t id = index->find(name, len);
+      if (id >= 0) return id;
+      count = 0; // skip linear search, name is not valid
+    }
+  }
+
+  for (int32_t i = 0; i < count; i++) {
+    string n = getFieldName(i);
+    if ((n.size() == len) && (memcmp(n.c_str(), name, len) == 0)) return i;
   }
-  throw VRTException("Invalid field name '%s' in %s", name.c_str(),
+  throw VRTException("Invalid field name '%s' in %s", string(name,len).c_str(),
                      checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str());
 }
 
@@ -99,57 +216,74 @@ static inline void setValIn (Value *array, size_t i, const Value *value) {
 }
 
 Value* HasFields::getFieldByName (const string &name) const {
-  ParsedFieldName pfn(name);
-  int32_t         id  = getFieldID(pfn.first);
+  return getFieldByName(name.c_str(), name.size());
+}
+
+Value* HasFields::getFieldByName (const char *name, size_t len) const {
+  ParsedFieldName pfn(name, len);
+  int32_t         id  = getFieldID(pfn.first, pfn.firstLen);
   Value          *val = getField(id);
 
-  if (val      == NULL  ) return new Value(); // <-- null value
-  if (pfn.next == ""    ) return val;         // <-- use current value (may be null)
-  if (val->isNullValue()) return val;         // <-- null value (already allocated)
-  if (pfn.idx  >= 0     ) val = val->at(pfn.idx);
+  if (val         == NULL) return new Value(); // <-- null value
+  if (pfn.nextLen == 0   ) return val;         // <-- use current value (may be null)
+  if (val->isNullValue() ) return val;         // <-- null value (already allocated)
 
-  HasFields *hf  = val->as<HasFields*>();
+  Value *v = (pfn.idx >= 0)? val->at(pfn.idx) : val;
+
+  HasFields *hf  = v->as<HasFields*>();
   if (hf == NULL) {
     // Throw exception if trying to get a sub-field on something that doesn't
     // have sub-fields (e.g. a double). If the value was null the above code
     // will hide this error by simply returning null; but there isn't much
     // we can do to avoid this.
-    throw VRTException("Can not get '%s' in %s when %s is %s", name.c_str(),
+    string str = v->toString();
+    if (v != val) delete v;
+    delete val;
+    throw VRTException("Can not get '%s' in %s when %s is %s", string(name,len).c_str(),
                        checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                       pfn.first.c_str(), val->toString().c_str());
+                       string(pfn.first,pfn.firstLen).c_str(), str.c_str());
   }
-  return hf->getFieldByName(pfn.next);
+  Value *ret = hf->getFieldByName(pfn.next, pfn.nextLen);
+  if (v != val) delete v;
+  delete val;
+  return ret;
 }
 
 void HasFields::setFieldByName (const string &name, const Value* value) {
-  ParsedFieldName pfn(name);
-  int32_t         id = getFieldID(name);
+  setFieldByName(name.c_str(), name.size(), value);
+}
+
+void HasFields::setFieldByName (const char *name, size_t len, const Value* value) {
+  ParsedFieldName pfn(name, len);
+  int32_t         id = getFieldID(pfn.first, pfn.firstLen);
 
-  if ((pfn.idx < 0) && (pfn.next == "")) { // no next, no idx
+  if ((pfn.idx < 0) && (pfn.nextLen == 0)) { // no next, no idx
     setField(id, value);
     return;
   }
 
   if (pfn.idx < 0) { // next only, no idx
     Value     *val = getField(id);
-    HasFields *hf  = val->as<HasFields*>();
     if (val == NULL) {
-      throw VRTException("Can not set '%s' in %s when %s is %s", name.c_str(),
+      throw VRTException("Can not set '%s' in %s when %s is %s", string(name,len).c_str(),
                          checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                         pfn.first.c_str(), "null");
+                         string(pfn.first,pfn.firstLen).c_str(), "null");
     }
+    HasFields *hf  = val->as<HasFields*>();
     if (hf == NULL) {
-      throw VRTException("Can not set '%s' in %s when %s is %s", name.c_str(),
+      string str = val->toString();
+      delete val;
+      throw VRTException("Can not set '%s' in %s when %s is %s", string(name,len).c_str(),
                          checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                         pfn.first.c_str(), val->toString().c_str());
+                         string(pfn.first,pfn.firstLen).c_str(), str.c_str());
     }
-    hf->setFieldByName(pfn.next, value);
+    hf->setFieldByName(pfn.next, pfn.nextLen, value);
     setField(id, val);
     delete val;
     return;
   }
 
-  if (pfn.next == "") { // idx only, no next
+  if (pfn.nextLen == 0) { // idx only, no next
     Value *val = getField(id);
     setValIn(val, pfn.idx, value);
     setField(id, val);
@@ -160,23 +294,21 @@ void HasFields::setFieldByName (const string &name, const Value* value) {
   // idx and next
   Value *val = getField(id);
   if (val == NULL) {
-    throw VRTException("Can not set '%s' in %s when %s is %s", name.c_str(),
+    throw VRTException("Can not set '%s' in %s when %s is %s", string(name,len).c_str(),
                        checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                       pfn.first.c_str(), "null");
+                       string(pfn.first,pfn.firstLen).c_str(), "null");
   }
   Value     *v   = val->at(pfn.idx);
   HasFields *hf  = v->as<HasFields*>();
-  if (v == NULL) {
-    throw VRTException("Can not set '%s' in %s when %s[%d] is %s", name.c_str(),
-                       checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                       pfn.first.c_str(), pfn.idx, "null");
-  }
   if (hf == NULL) {
-    throw VRTException("Can not set '%s' in %s when %s[%d] is %s", name.c_str(),
+    string str = v->toString();
+    delete v;
+    delete val;
+    throw VRTException("Can not set '%s' in %s when %s[%d] is %s", string(name,len).c_str(),
                        checked_dynamic_cast<const VRTObject*>(this)->getClassName().c_str(),
-                       pfn.first.c_str(), pfn.idx, v->toString().c_str());
+                       string(pfn.first,pfn.firstLen).c_str(), pfn.idx, str.c_str());
   }
-  hf->setFieldByName(pfn.next, value);
+  hf->setFieldByName(pfn.next, pfn.nextLen, value);
   setValIn(val, pfn.idx, v);
   setField(id, val);
   delete val;
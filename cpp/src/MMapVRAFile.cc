@@ -0,0 +1,185 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "MMapVRAFile.h"
+#include <sys/mman.h>   // for mmap(..) / munmap(..) / madvise(..)
+#include <sys/stat.h>   // for fstat(..)
+#include <fcntl.h>      // for open(..)
+#include <unistd.h>     // for close(..)
+#include <string.h>     // for memcpy(..)
+#include <errno.h>      // Required when using errno / ERRNO_STR
+
+using namespace vrt;
+
+/** Converts MMapAdvice to applicable madvise(..) flags. */
+static inline int getAdviceFlags (MMapAdvice advice) {
+  switch (advice) {
+    case MMapAdvice_Normal:     return MADV_NORMAL;
+    case MMapAdvice_Sequential: return MADV_SEQUENTIAL;
+    case MMapAdvice_Random:     return MADV_RANDOM;
+    default: throw VRTException("Unknown MMapAdvice (%d)", (int32_t)advice);
+  }
+}
+
+MMapVRAFile::MMapVRAFile (string fname, MMapAdvice advice) :
+  AbstractVRAFile(toURI(fname), true, false, false, false, false),
+  fname(fname),
+  fd(-1),
+  map(NULL),
+  length(0),
+  advice(advice)
+{
+  open();
+}
+
+MMapVRAFile::~MMapVRAFile () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // can't throw from destructor
+  }
+}
+
+void MMapVRAFile::open () {
+  fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    fd = -1;
+    throw VRTException("Unable to stat %s: %s", fname.c_str(), strerror(err));
+  }
+  length = st.st_size;
+
+  if ((uint64_t)length > (uint64_t)((size_t)-1)) {
+    ::close(fd);
+    fd = -1;
+    throw VRTException("Unable to map %s: File too large for address space", fname.c_str());
+  }
+
+  if (length > 0) {
+    void *ptr = mmap(NULL, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+      int err = errno;
+      ::close(fd);
+      fd = -1;
+      throw VRTException("Unable to map %s: %s", fname.c_str(), strerror(err));
+    }
+    map = (const char*)ptr;
+    setAdvice(advice);
+  }
+  AbstractVRAFile::open();
+}
+
+void MMapVRAFile::close () {
+  if (fd >= 0) {
+    AbstractVRAFile::close();
+    if (map != NULL) {
+      munmap(const_cast<char*>(map), (size_t)length);
+      map = NULL;
+    }
+    if (::close(fd) != 0) {
+      fd = -1;
+      throw VRTException("Unable to close %s: %s", fname.c_str(), ERRNO_STR);
+    }
+    fd = -1;
+  }
+}
+
+void MMapVRAFile::setAdvice (MMapAdvice advice) {
+  int flags = getAdviceFlags(advice);
+  this->advice = advice;
+
+  // The hint is purely advisory, so failures are not treated as an error
+  if (map != NULL) {
+    madvise(const_cast<char*>(map), (size_t)length, flags);
+  }
+}
+
+void MMapVRAFile::flush (bool force) {
+  UNUSED_VARIABLE(force); // read-only, nothing to flush
+}
+
+int64_t MMapVRAFile::getFileLengthOS () const {
+  return length;
+}
+
+int64_t MMapVRAFile::getFileLengthRW () const {
+  return length;
+}
+
+int32_t MMapVRAFile::read (int64_t off, void *ptr, int32_t len) const {
+  if (ptr == NULL) throw VRTException("Can not read from %s to NULL buffer", fname.c_str());
+  if (len <     0) throw VRTException("Can not read %d octets from %s", len, fname.c_str());
+  if (off <     0) throw VRTException("Unable to read from %" PRId64 " in %s", off, fname.c_str());
+  if (map == NULL) throw VRTException("File %s is not open", fname.c_str());
+  if (len ==    0) return 0;
+  if (off >= length) return EOF;
+
+  int32_t n = (int32_t)min((int64_t)len, length - off);
+  memcpy(ptr, &map[off], n);
+  return n;
+}
+
+bool MMapVRAFile::isReadConcurrent () const {
+  return true;
+}
+
+int32_t MMapVRAFile::readConcurrent (int64_t off, void *ptr, int32_t len) const {
+  return read(off, ptr, len); // <-- read(..) does not alter any state
+}
+
+void MMapVRAFile::write (int64_t off, void *ptr, int32_t len, bool flush) {
+  UNUSED_VARIABLE(off);
+  UNUSED_VARIABLE(ptr);
+  UNUSED_VARIABLE(len);
+  UNUSED_VARIABLE(flush);
+  throw VRTException("File is read-only");
+}
+
+VRTPacketViewIterator MMapVRAFile::beginViews () const {
+  if (map == NULL) throw VRTException("File %s is not open", fname.c_str());
+  return VRTPacketViewIterator(map, HEADER_LENGTH, min(getFileLength(), length), true);
+}
+
+VRTPacketViewIterator MMapVRAFile::endViews () const {
+  if (map == NULL) throw VRTException("File %s is not open", fname.c_str());
+  return VRTPacketViewIterator(map, HEADER_LENGTH, min(getFileLength(), length), false);
+}
+
+VRTPacketView MMapVRAFile::getPacketView (int64_t off) const {
+  if (map == NULL) throw VRTException("File %s is not open", fname.c_str());
+
+  int64_t end = min(getFileLength(), length);
+  if ((off < HEADER_LENGTH) || (off+4 > end)) {
+    throw VRTException("Invalid packet offset %" PRId64 " in %s", off, fname.c_str());
+  }
+  int32_t len = BasicVRTPacket::getPacketLength(&map[off], 0);
+  if ((len < 4) || (off+len > end)) {
+    throw VRTException("Invalid packet length %d at %" PRId64 " in %s", len, off, fname.c_str());
+  }
+  return VRTPacketView(&map[off], len);
+}
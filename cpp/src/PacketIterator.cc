@@ -20,6 +20,7 @@
  */
 
 #include "PacketIterator.h"
+#include "AbstractVRAFile.h"
 
 using namespace std;
 using namespace vrt;
@@ -28,7 +29,8 @@ ConstPacketIterator::ConstPacketIterator (const PacketContainer *container, int6
   container(container),
   resolve(resolve),
   offset(offset),
-  length(__INT64_C(-1))
+  length(__INT64_C(-1)),
+  ahead(NULL)
 {
   buf = vector<char>(4);
 }
@@ -39,11 +41,28 @@ ConstPacketIterator::ConstPacketIterator (const ConstPacketIterator &pi) :
   resolve(pi.resolve),
   offset(pi.offset),
   length(pi.length),
-  buf(pi.buf)
+  buf(pi.buf),
+  ahead(NULL)
 {
   // done
 }
 
+ConstPacketIterator::~ConstPacketIterator () {
+  safe_delete(ahead);
+}
+
+ConstPacketIterator& ConstPacketIterator::operator= (const ConstPacketIterator &pi) {
+  if (this != &pi) {
+    safe_delete(ahead);
+    container = pi.container;
+    resolve   = pi.resolve;
+    offset    = pi.offset;
+    length    = pi.length;
+    buf       = pi.buf;
+  }
+  return *this;
+}
+
 string ConstPacketIterator::toString () const {
   const VRTObject *c = checked_dynamic_cast<const VRTObject*>(container);
   return getClassName() + " for " + c->toString();
@@ -66,7 +85,7 @@ ConstPacketIterator ConstPacketIterator::operator++ (int) { // postfix ++
   return pi;
 }
 
-ConstPacketIterator ConstPacketIterator::operator++ () { // prefix ++
+ConstPacketIterator& ConstPacketIterator::operator++ () { // prefix ++
   container->gotoNextPacket(*this);
   return *this;
 }
@@ -0,0 +1,304 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "PacketPacer.h"
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <string.h>     // for memset(..)
+#include <time.h>       // for clock_gettime(..) / clock_nanosleep(..)
+
+#ifndef CLOCK_TAI
+# define CLOCK_TAI 11
+#endif
+
+using namespace vrt;
+
+/** Nanoseconds per second. */
+static const int64_t ONE_SEC_NS = __INT64_C(1000000000);
+
+/** Picoseconds per nanosecond. */
+static const int64_t PS_PER_NS = __INT64_C(1000);
+
+/** Gets the system clock ID for the given pacing clock. */
+static inline clockid_t _clockID (PacingClock clock) {
+  return (clock == PacingClock_TAI)? CLOCK_TAI : CLOCK_MONOTONIC;
+}
+
+/** Gets the histogram bin for a (non-negative) timing error. */
+static inline int32_t _bin (int64_t err) {
+  if (err <= 0) return 0;
+#if defined(__GNUC__)
+  int32_t bin = 64 - __builtin_clzll((unsigned long long)err);
+#else
+  int32_t bin = 0;
+  for (uint64_t e = (uint64_t)err; e != 0; e >>= 1) bin++;
+#endif
+  return (bin < PacketPacer::NUM_BINS)? bin : PacketPacer::NUM_BINS-1;
+}
+
+PacketPacer::PacketPacer (PacingClock clock, double speed, int64_t tolerance, int64_t spinTime) :
+  clock(clock),
+  speed(speed),
+  tolerance(tolerance),
+  spinTime(spinTime),
+  offset(0),
+  maxLag(0),
+  sampleRate(DOUBLE_NAN),
+  payloadFormat(),
+  anchored(false),
+  startTime(-1),
+  anchorEpoch(IntegerMode_None),
+  anchorSeconds(0),
+  anchorPicos(0),
+  anchorClock(0),
+  haveLast(false),
+  lastDeadline(0)
+{
+  if ((clock != PacingClock_Monotonic) && (clock != PacingClock_TAI)) {
+    throw VRTException("Invalid pacing clock %d", (int32_t)clock);
+  }
+  if (isNull(speed) || (speed <= 0)) {
+    throw VRTException("Invalid replay speed %f", speed);
+  }
+  if (tolerance < 0) {
+    throw VRTException("Invalid tolerance %" PRId64 " ns", tolerance);
+  }
+  if (spinTime < 0) {
+    throw VRTException("Invalid spin time %" PRId64 " ns", spinTime);
+  }
+
+  // Make sure the clock is usable now rather than on the first wait
+  struct timespec ts;
+  if (clock_gettime(_clockID(clock), &ts) != 0) {
+    throw VRTException("Unable to read pacing clock: %s", ERRNO_STR);
+  }
+  resetStatistics();
+}
+
+string PacketPacer::toString () const {
+  return Utilities::format("%s: Clock=%s Speed=%g Tolerance=%" PRId64 "ns PacketsReleased=%" PRId64
+                           " Batches=%" PRId64 " Late=%" PRId64 " MaxLateness=%" PRId64 "ns"
+                           " MeanError=%.1fns",
+                           getClassName().c_str(), (clock == PacingClock_TAI)? "TAI" : "Monotonic",
+                           speed, tolerance, packetsReleased, batchesReleased, lateCount,
+                           maxLateness, getMeanError());
+}
+
+void PacketPacer::setSampleRate (double sr, const PayloadFormat &pf) {
+  if (!isNull(sr) && (sr <= 0)) {
+    throw VRTException("Invalid sample rate %f", sr);
+  }
+  sampleRate    = sr;
+  payloadFormat = pf;
+}
+
+void PacketPacer::reset () {
+  anchored = false;
+  haveLast = false;
+}
+
+int64_t PacketPacer::now () const {
+  struct timespec ts;
+  clock_gettime(_clockID(clock), &ts);
+  return ((int64_t)ts.tv_sec) * ONE_SEC_NS + (int64_t)ts.tv_nsec;
+}
+
+TimeStamp PacketPacer::getPacingTime (const BasicVRTPacket &p) const {
+  TimeStamp ts = p.getTimeStamp(sampleRate);
+  if (ts.getIntegerMode() == IntegerMode_None) return TimeStamp();
+  if (isNull(sampleRate)) return ts;
+
+  const BasicDataPacket *data = dynamic_cast<const BasicDataPacket*>(&p);
+  if (data == NULL) return ts;
+
+  switch (ts.getFractionalMode()) {
+    case FractionalMode_RealTime:    return data->getNextTimeStamp(sampleRate, payloadFormat);
+    case FractionalMode_SampleCount: return ts.addSamples(data->getDataLength(payloadFormat), sampleRate);
+    default:                         return ts;
+  }
+}
+
+int64_t PacketPacer::getDeadline (const BasicVRTPacket &p) {
+  return getDeadline(getPacingTime(p));
+}
+
+int64_t PacketPacer::getDeadline (const TimeStamp &ts) {
+  if (ts.getIntegerMode() == IntegerMode_None) {
+    return (haveLast)? lastDeadline : now();
+  }
+
+  // Only the RealTime fractional time stamp (or SampleCount with a known sample
+  // rate) gives a usable sub-second time, anything else paces on whole seconds.
+  FractionalMode tsfMode = ts.getFractionalMode();
+  bool           hasPS   = (tsfMode == FractionalMode_RealTime)
+                        || ((tsfMode == FractionalMode_SampleCount) && !isNull(sampleRate));
+
+  if (clock == PacingClock_TAI) {
+    if (ts.getEpoch() == TimeStamp::NULL_EPOCH) {
+      throw VRTException("Can not pace to CLOCK_TAI using a time stamp that is not GPS or UTC");
+    }
+    int64_t sec = ts.getGPSSeconds() + TimeStamp::GPS2PTP;
+    int64_t ps  = (hasPS)? (int64_t)ts.getPicoSeconds(sampleRate) : 0;
+    return sec * ONE_SEC_NS + ps / PS_PER_NS + offset;
+  }
+
+  if (!anchored) {
+    anchored      = true;
+    anchorEpoch   = ts.getIntegerMode();
+    anchorSeconds = ts.getTimeStampInteger();
+    anchorPicos   = (hasPS)? ts.getPicoSeconds(sampleRate) : 0;
+    anchorClock   = (startTime >= 0)? startTime : now();
+    return anchorClock;
+  }
+
+  uint32_t sec;
+  if (ts.getIntegerMode() == anchorEpoch) {
+    sec = ts.getTimeStampInteger();
+  }
+  else if ((anchorEpoch == IntegerMode_UTC) && (ts.getIntegerMode() == IntegerMode_GPS)) {
+    sec = ts.getSecondsUTC();
+  }
+  else if ((anchorEpoch == IntegerMode_GPS) && (ts.getIntegerMode() == IntegerMode_UTC)) {
+    sec = ts.getSecondsGPS();
+  }
+  else {
+    throw VRTException("Can not pace time stamps with integer mode %d relative to integer mode %d",
+                       (int32_t)ts.getIntegerMode(), anchorEpoch);
+  }
+
+  int64_t ps      = (hasPS)? (int64_t)ts.getPicoSeconds(sampleRate) : 0;
+  int64_t deltaNS = ((int64_t)sec - (int64_t)anchorSeconds) * ONE_SEC_NS
+                  + (ps - (int64_t)anchorPicos) / PS_PER_NS;
+
+  if (speed == 1.0) return anchorClock + deltaNS;
+  return anchorClock + (int64_t)(deltaNS / speed);
+}
+
+int64_t PacketPacer::waitUntil (int64_t deadline) {
+  clockid_t id = _clockID(clock);
+  int64_t   t  = now();
+
+  // Sleep until just before the deadline (clock_nanosleep(..) returns early if
+  // interrupted by a signal, in which case it needs to be called again)...
+  int64_t wake = deadline - spinTime;
+  while (t < wake) {
+    struct timespec req;
+    req.tv_sec  = (time_t)(wake / ONE_SEC_NS);
+    req.tv_nsec = (long)(wake % ONE_SEC_NS);
+    int status = clock_nanosleep(id, TIMER_ABSTIME, &req, NULL);
+    if ((status != 0) && (status != EINTR)) {
+      throw VRTException("Unable to sleep on pacing clock: %s", strerror(status));
+    }
+    t = now();
+  }
+
+  // ...then busy-wait the rest of the way.
+  while (t < deadline) {
+    Utilities::cpuRelax();
+    t = now();
+  }
+  return t;
+}
+
+int32_t PacketPacer::waitForBatch (const BasicVRTPacket *const *packets, int32_t n) {
+  if (n < 1) throw VRTException("Invalid number of packets %d", n);
+
+  int64_t first = getDeadline(*packets[0]);
+
+  if ((maxLag > 0) && (clock == PacingClock_Monotonic)) {
+    int64_t lag = now() - first;
+    if (lag > maxLag) {
+      // Move the schedule so this packet is due now
+      anchorClock += lag;
+      first       += lag;
+      reanchorCount++;
+    }
+  }
+
+  int64_t t     = waitUntil(first);
+  int64_t prev  = first;
+  int32_t count = 1;
+  record(t - first);
+
+  for (; count < n; count++) {
+    TimeStamp ts = getPacingTime(*packets[count]);
+    int64_t   d  = (ts.getIntegerMode() == IntegerMode_None)? prev : getDeadline(ts);
+    if (d - first > tolerance) break;
+    record(t - d);
+    prev = d;
+  }
+
+  haveLast     = true;
+  lastDeadline = prev;
+  batchesReleased++;
+  return count;
+}
+
+void PacketPacer::record (int64_t error) {
+  packetsReleased++;
+  errorSum += (double)error;
+  if (error >= 0) {
+    lateBins[_bin(error)]++;
+    if (error > tolerance  ) lateCount++;
+    if (error > maxLateness) maxLateness = error;
+  }
+  else {
+    earlyBins[_bin(-error)]++;
+  }
+}
+
+string PacketPacer::getHistogramString () const {
+  ostringstream str;
+  for (int32_t pass = 0; pass < 2; pass++) {
+    bool           early = (pass == 0);
+    const int64_t *bins  = (early)? earlyBins : lateBins;
+    // List the early bins largest first so the output reads from early to late
+    for (int32_t i = 0; i < NUM_BINS; i++) {
+      int32_t bin = (early)? NUM_BINS-1-i : i;
+      if (bins[bin] == 0) continue;
+
+      int64_t lo = (bin == 0)? 0 : (__INT64_C(1) << (bin-1));
+      int64_t hi = (__INT64_C(1) << bin);
+      if (bin == 0) {
+        str << "  on time          : " << bins[bin] << endl;
+      }
+      else if (bin == NUM_BINS-1) {
+        str << Utilities::format("  %s >= %" PRId64 " ns : %" PRId64, (early)? "early" : "late ",
+                                 lo, bins[bin]) << endl;
+      }
+      else {
+        str << Utilities::format("  %s [%" PRId64 ", %" PRId64 ") ns : %" PRId64,
+                                 (early)? "early" : "late ", lo, hi, bins[bin]) << endl;
+      }
+    }
+  }
+  return str.str();
+}
+
+void PacketPacer::resetStatistics () {
+  packetsReleased = 0;
+  batchesReleased = 0;
+  lateCount       = 0;
+  maxLateness     = 0;
+  reanchorCount   = 0;
+  errorSum        = 0.0;
+  memset(lateBins,  0, sizeof(lateBins));
+  memset(earlyBins, 0, sizeof(earlyBins));
+}
@@ -0,0 +1,331 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "PacketQueue.h"
+#include <limits.h>     // for INT_MAX
+#include <stdlib.h>     // for posix_memalign(..)
+#include <time.h>       // for timespec
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+using namespace vrt;
+
+/** Largest capacity supported. */
+static const int32_t MAX_CAPACITY = 0x40000000;
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> A slot in a {@link PacketQueue}. On pass <i>k</i> round
+   *  the queue, the slot for position <i>p</i> is ready to be written when the sequence
+   *  number is <i>p</i> and ready to be read when it is <i>p</i>+1.
+   */
+  struct PacketQueueSlot {
+    volatile uint64_t  seq;     // Sequence number
+    BasicVRTPacket    *packet;  // The packet
+    char               pad[64 - sizeof(uint64_t) - sizeof(BasicVRTPacket*)];
+  };
+} END_NAMESPACE
+
+/** Converts a timeout in milliseconds to a deadline (-1 for none). */
+static inline int64_t toDeadline (int32_t timeout) {
+  return (timeout < 0)? -1 : Utilities::monotonicTimeMillis() + timeout;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketQueue
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PacketQueue::PacketQueue (int32_t capacity) :
+  slots(NULL),
+  mask(0),
+  closed(false),
+  writePos(0),
+  readPos(0),
+  notEmpty(0),
+  emptyWaiters(0),
+  notFull(0),
+  fullWaiters(0)
+{
+  if ((capacity <= 0) || (capacity > MAX_CAPACITY)) {
+    throw VRTException("Invalid queue capacity %d", capacity);
+  }
+  uint64_t cap = 1;
+  while (cap < (uint64_t)capacity) cap <<= 1;
+
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 64, (size_t)cap * sizeof(PacketQueueSlot)) != 0) {
+    throw VRTException("Unable to allocate queue of %d packets", capacity);
+  }
+  slots = (PacketQueueSlot*)ptr;
+  mask  = cap - 1;
+  for (uint64_t i = 0; i < cap; i++) {
+    slots[i].seq    = i;
+    slots[i].packet = NULL;
+  }
+  __sync_synchronize();
+}
+
+PacketQueue::~PacketQueue () {
+  safe_free(slots);
+}
+
+string PacketQueue::toString () const {
+  return Utilities::format("%s: Capacity=%d Size=%d Closed=%s", getClassName().c_str(),
+                           getCapacity(), getSize(), (closed)? "true" : "false");
+}
+
+int32_t PacketQueue::getSize () const {
+  uint64_t r = readPos;
+  uint64_t w = writePos;
+  if (w <= r) return 0;
+  return (int32_t)min(w - r, mask + 1);
+}
+
+void PacketQueue::close () {
+  closed = true;
+  __sync_synchronize();
+  __sync_add_and_fetch(&notEmpty, 1);
+  __sync_add_and_fetch(&notFull,  1);
+  syscall(SYS_futex, &notEmpty, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  syscall(SYS_futex, &notFull,  FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void PacketQueue::signalNotEmpty (int32_t count) {
+  __sync_synchronize(); // slot must be visible before checking for waiters
+  if (emptyWaiters != 0) {
+    __sync_add_and_fetch(&notEmpty, 1);
+    syscall(SYS_futex, &notEmpty, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+  }
+}
+
+void PacketQueue::signalNotFull (int32_t count) {
+  __sync_synchronize(); // slot must be visible before checking for waiters
+  if (fullWaiters != 0) {
+    __sync_add_and_fetch(&notFull, 1);
+    syscall(SYS_futex, &notFull, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+  }
+}
+
+bool PacketQueue::offer (BasicVRTPacket *p) {
+  return (offer(&p, 1) == 1);
+}
+
+int32_t PacketQueue::offer (BasicVRTPacket *const *packets, int32_t n) {
+  if (closed || (n <= 0)) return 0;
+
+  uint64_t pos = writePos;
+  int32_t  count;
+  while (true) {
+    // Count the free slots from the current position, if the first is not free
+    // either the queue is full or another thread has just taken the position
+    for (count = 0; count < n; count++) {
+      uint64_t p = pos + count;
+      if (slots[p & mask].seq != p) break;
+    }
+    if (count == 0) {
+      uint64_t now = writePos;
+      if (now == pos) return 0; // full
+      pos = now;
+      continue;
+    }
+    uint64_t prev = __sync_val_compare_and_swap(&writePos, pos, pos + count);
+    if (prev == pos) break;
+    pos = prev;
+  }
+
+  for (int32_t i = 0; i < count; i++) {
+    slots[(pos + i) & mask].packet = packets[i];
+  }
+  __sync_synchronize(); // packets must be visible before the slots are marked as ready
+  for (int32_t i = 0; i < count; i++) {
+    slots[(pos + i) & mask].seq = pos + i + 1;
+  }
+  signalNotEmpty(count);
+  return count;
+}
+
+BasicVRTPacket *PacketQueue::poll () {
+  BasicVRTPacket *p = NULL;
+  poll(&p, 1);
+  return p;
+}
+
+int32_t PacketQueue::poll (BasicVRTPacket **packets, int32_t max) {
+  if (max <= 0) return 0;
+
+  uint64_t pos = readPos;
+  int32_t  count;
+  while (true) {
+    for (count = 0; count < max; count++) {
+      uint64_t p = pos + count;
+      if (slots[p & mask].seq != p + 1) break;
+    }
+    if (count == 0) {
+      uint64_t now = readPos;
+      if (now == pos) return 0; // empty
+      pos = now;
+      continue;
+    }
+    uint64_t prev = __sync_val_compare_and_swap(&readPos, pos, pos + count);
+    if (prev == pos) break;
+    pos = prev;
+  }
+
+  for (int32_t i = 0; i < count; i++) {
+    packets[i] = slots[(pos + i) & mask].packet;
+  }
+  __sync_synchronize(); // packets must be read before the slots are marked as free
+  for (int32_t i = 0; i < count; i++) {
+    slots[(pos + i) & mask].seq = pos + i + mask + 1;
+  }
+  signalNotFull(count);
+  return count;
+}
+
+bool PacketQueue::waitFor (bool forSpace, int64_t deadline) {
+  volatile uint32_t *futex   = (forSpace)? &notFull     : &notEmpty;
+  volatile uint32_t *waiters = (forSpace)? &fullWaiters : &emptyWaiters;
+
+  for (int32_t i = 0; i < SPIN_COUNT; i++) {
+    uint64_t pos   = (forSpace)? writePos : readPos;
+    uint64_t ready = (forSpace)? pos : pos + 1;
+    if (closed || (slots[pos & mask].seq == ready)) return true;
+    Utilities::cpuRelax();
+  }
+
+  struct timespec  ts;
+  struct timespec *tsp = NULL;
+  if (deadline >= 0) {
+    int64_t wait = deadline - Utilities::monotonicTimeMillis();
+    if (wait <= 0) return false;
+    ts.tv_sec  = (time_t)(wait / 1000);
+    ts.tv_nsec = (long)((wait % 1000) * 1000000);
+    tsp        = &ts;
+  }
+
+  uint32_t seq = *futex;
+  __sync_add_and_fetch(waiters, 1); // implies a full barrier
+  uint64_t pos   = (forSpace)? writePos : readPos;
+  uint64_t ready = (forSpace)? pos : pos + 1;
+  if (!closed && (slots[pos & mask].seq != ready)) {
+    syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, seq, tsp, NULL, 0);
+  }
+  __sync_sub_and_fetch(waiters, 1);
+  return true;
+}
+
+bool PacketQueue::put (BasicVRTPacket *p, int32_t timeout) {
+  return (put(&p, 1, timeout) == 1);
+}
+
+int32_t PacketQueue::put (BasicVRTPacket *const *packets, int32_t n, int32_t timeout) {
+  int64_t deadline = toDeadline(timeout);
+  int32_t count    = 0;
+  while (count < n) {
+    count += offer(&packets[count], n - count);
+    if ((count == n) || closed) break;
+    if (!waitFor(true, deadline)) break;
+  }
+  return count;
+}
+
+BasicVRTPacket *PacketQueue::take (int32_t timeout) {
+  BasicVRTPacket *p = NULL;
+  take(&p, 1, timeout);
+  return p;
+}
+
+int32_t PacketQueue::take (BasicVRTPacket **packets, int32_t max, int32_t timeout) {
+  int64_t deadline = toDeadline(timeout);
+  while (true) {
+    int32_t count = poll(packets, max);
+    if ((count > 0) || (max <= 0)) return count;
+    if (closed) return poll(packets, max); // packets may have been added before close()
+    if (!waitFor(false, deadline)) return 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketPool
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PacketPool::PacketPool (int32_t capacity, int32_t bufferSize) :
+  freeList(capacity),
+  bufferSize(bufferSize),
+  createdCount(0),
+  deletedCount(0)
+{
+  if ((bufferSize <= 0) || (bufferSize > BasicVRTPacket::MAX_PACKET_LENGTH)) {
+    throw VRTException("Invalid buffer size %d", bufferSize);
+  }
+}
+
+PacketPool::~PacketPool () {
+  BasicVRTPacket *p;
+  while ((p = freeList.poll()) != NULL) {
+    delete p;
+  }
+}
+
+string PacketPool::toString () const {
+  return Utilities::format("%s: BufferSize=%d Available=%d Created=%" PRId64 " Deleted=%" PRId64,
+                           getClassName().c_str(), bufferSize, getAvailable(),
+                           createdCount, deletedCount);
+}
+
+BasicVRTPacket *PacketPool::createPacket () const {
+  return new BasicVRTPacket(bufferSize);
+}
+
+BasicVRTPacket *PacketPool::newPacket () {
+  __sync_add_and_fetch(&createdCount, 1);
+  return createPacket();
+}
+
+void PacketPool::deletePacket (BasicVRTPacket *p) {
+  __sync_add_and_fetch(&deletedCount, 1);
+  delete p;
+}
+
+void PacketPool::reserve (int32_t count) {
+  count = min(count, freeList.getCapacity());
+  while (freeList.getSize() < count) {
+    BasicVRTPacket *p = newPacket();
+    if (!freeList.offer(p)) {
+      deletePacket(p);
+      break;
+    }
+  }
+}
+
+void PacketPool::get (BasicVRTPacket **packets, int32_t n) {
+  int32_t count = freeList.poll(packets, n);
+  for (int32_t i = count; i < n; i++) {
+    packets[i] = newPacket();
+  }
+}
+
+void PacketPool::release (BasicVRTPacket *const *packets, int32_t n) {
+  int32_t count = freeList.offer(packets, n);
+  for (int32_t i = count; i < n; i++) {
+    deletePacket(packets[i]);
+  }
+}
@@ -0,0 +1,335 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "Packetizer.h"
+#include <math.h>       // for floor(..) and llround(..)
+#include <string.h>     // for memcpy(..) and memmove(..)
+
+using namespace vrt;
+
+/** Number of picoseconds in a second. */
+static const int64_t PS_PER_SEC = __INT64_C(1000000000000);
+
+/** Is the sample rate a whole number of Hz? */
+static inline bool isWholeRate (double sr) {
+  return (sr == floor(sr)) && (sr < 9.0e18);
+}
+
+Packetizer::Packetizer (int32_t streamID, const PayloadFormat &pf, double sampleRate,
+                        int32_t samplesPerPacket, const TimeStamp &startTime) :
+  payloadFormat(pf),
+  sampleRate(sampleRate),
+  samplesPerPacket(samplesPerPacket),
+  complexMult(1),
+  startTime(startTime),
+  sampleIndex(0),
+  dataCount(0),
+  contextCount(0),
+  contextInterval(0),
+  sinceContext(0),
+  contextChanged(false),
+  contextSent(false),
+  dataTemplate(),
+  contextTemplate(),
+  residual(),
+  residualType(0),
+  residualCount(0),
+  dataPackets(),
+  contextPackets(),
+  dataUsed(0),
+  contextUsed(0),
+  packets(),
+  dataPacketsSent(0),
+  contextPacketsSent(0),
+  samplesSent(0)
+{
+  if (isNull(pf)) {
+    throw VRTException("Payload format can not be null");
+  }
+  if (isNull(sampleRate) || (sampleRate <= 0)) {
+    throw VRTException("Invalid sample rate %f", sampleRate);
+  }
+  complexMult = (pf.isComplex())? 2 : 1;
+
+  int32_t maxSamples = getSamplesPerPacket(pf, BasicVRTPacket::MAX_PAYLOAD_LENGTH);
+  if ((samplesPerPacket <= 0) || (samplesPerPacket > maxSamples)) {
+    throw VRTException("Invalid number of samples per packet %d (must be 1 to %d)",
+                       samplesPerPacket, maxSamples);
+  }
+
+  if (!isNull(startTime)) {
+    IntegerMode    tsi = startTime.getIntegerMode();
+    FractionalMode tsf = startTime.getFractionalMode();
+    if ((tsi != IntegerMode_UTC) && (tsi != IntegerMode_GPS)) {
+      throw VRTException("Start time must be UTC or GPS");
+    }
+    if ((tsf != FractionalMode_RealTime) && (tsf != FractionalMode_SampleCount)
+                                         && (tsf != FractionalMode_None)) {
+      throw VRTException("Start time must have a real-time, sample-count or no fractional part");
+    }
+    if ((tsf == FractionalMode_SampleCount) && !isWholeRate(sampleRate)) {
+      throw VRTException("Sample-count time stamps require a whole-number sample rate");
+    }
+  }
+
+  residual.resize(samplesPerPacket * complexMult * 8);
+
+  dataTemplate.setStreamIdentifier(streamID);
+  dataTemplate.setTimeStamp(startTime);
+
+  contextTemplate.setStreamIdentifier(streamID);
+  contextTemplate.setTimeStamp(startTime);
+  contextTemplate.setSampleRate(sampleRate);
+  contextTemplate.setDataPayloadFormat(pf);
+}
+
+Packetizer::~Packetizer () {
+  for (size_t i = 0; i < dataPackets.size(); i++) {
+    delete dataPackets[i];
+  }
+  for (size_t i = 0; i < contextPackets.size(); i++) {
+    delete contextPackets[i];
+  }
+}
+
+string Packetizer::toString () const {
+  return Utilities::format("%s: SampleRate=%f SamplesPerPacket=%d Held=%d DataPackets=%" PRId64
+                           " ContextPackets=%" PRId64 " Samples=%" PRId64,
+                           getClassName().c_str(), sampleRate, samplesPerPacket,
+                           residualCount / complexMult, dataPacketsSent, contextPacketsSent,
+                           samplesSent);
+}
+
+int32_t Packetizer::getSamplesPerPacket (const PayloadFormat &pf, int32_t payloadLength) {
+  if (isNull(pf)) throw VRTException("Payload format can not be null");
+  if (payloadLength <= 0) return 0;
+
+  int32_t bits       = pf.getItemPackingFieldSize();
+  int32_t mult       = (pf.isComplex())? 2 : 1;
+  bool    powerOfTwo = (bits == 64) || (bits == 32) || (bits == 16) || (bits == 8) ||
+                       (bits ==  4) || (bits ==  2) || (bits ==  1);
+
+  if (powerOfTwo || !pf.isProcessingEfficient()) {
+    // LinkEfficient (see BasicDataPacket::setDataLength(..))
+    int64_t totalBits = (int64_t)(payloadLength / 4) * 32;
+    return (int32_t)(totalBits / bits / mult);
+  }
+  else if (bits <= 32) {
+    return (payloadLength / 4) * (32 / bits) / mult;
+  }
+  else {
+    return (payloadLength / 8) * (64 / bits) / mult;
+  }
+}
+
+int32_t Packetizer::getMaxPayloadLength () const {
+  int64_t bits = (int64_t)samplesPerPacket * complexMult * payloadFormat.getItemPackingFieldSize();
+  return (int32_t)(((bits + 63) / 64) * 8);
+}
+
+void Packetizer::setContextInterval (int32_t packets) {
+  if (packets < 0) throw VRTException("Invalid context interval %d", packets);
+  contextInterval = packets;
+}
+
+void Packetizer::setSampleRate (double sr) {
+  if (isNull(sr) || (sr <= 0)) {
+    throw VRTException("Invalid sample rate %f", sr);
+  }
+  if (!isNull(startTime) && (startTime.getFractionalMode() == FractionalMode_SampleCount)
+                         && !isWholeRate(sr)) {
+    throw VRTException("Sample-count time stamps require a whole-number sample rate");
+  }
+  if (sr == sampleRate) return;
+
+  flush();
+
+  // Start again from the next sample so the time stamps continue exactly
+  TimeStamp next = getTimeStamp(sampleIndex);
+  if (!isNull(next) && (next.getFractionalMode() == FractionalMode_SampleCount)) {
+    // The fractional part is counted in samples, so re-scale it to the new rate
+    uint64_t tsf = (uint64_t)llround((double)next.getTimeStampFractional() * sr / sampleRate);
+    next = TimeStamp(next.getIntegerMode(), FractionalMode_SampleCount,
+                     next.getTimeStampInteger(), tsf, sr);
+  }
+  startTime   = next;
+  sampleIndex = 0;
+  sampleRate  = sr;
+
+  contextTemplate.setSampleRate(sr);
+  contextChanged = true;
+}
+
+TimeStamp Packetizer::getNextTimeStamp () const {
+  return getTimeStamp(sampleIndex);
+}
+
+TimeStamp Packetizer::getTimeStamp (int64_t index) const {
+  if (isNull(startTime) || (index == 0)) return startTime;
+
+  switch (startTime.getFractionalMode()) {
+    case FractionalMode_SampleCount:
+      return startTime.addSamples(index, sampleRate);
+
+    case FractionalMode_RealTime: {
+      // Split into whole seconds and a remainder (in samples) so the error is always
+      // under a picosecond rather than growing with the index
+      int64_t sec;
+      double  rem;
+      if (isWholeRate(sampleRate)) {
+        int64_t sr = (int64_t)sampleRate;
+        sec = index / sr;
+        rem = (double)(index % sr);
+      }
+      else {
+        sec = (int64_t)floor((double)index / sampleRate);
+        rem = (double)index - (double)sec * sampleRate;
+      }
+      int64_t ps = (int64_t)llround(rem * 1.0e12 / sampleRate);
+      if (ps >= PS_PER_SEC) {
+        sec++;
+        ps -= PS_PER_SEC;
+      }
+      return startTime.addTime(sec, ps);
+    }
+
+    default:
+      return startTime.addSeconds((int64_t)floor((double)index / sampleRate));
+  }
+}
+
+int32_t Packetizer::write (int32_t type, const void *array, int32_t len) {
+  if (len < 0) throw VRTException("Invalid length %d", len);
+  if ((len > 0) && (array == NULL)) throw VRTException("Array can not be null");
+
+  size_t      start     = packets.size();
+  int32_t     size      = type & 0xF;
+  int32_t     perPacket = samplesPerPacket * complexMult;
+  const char *ptr       = (const char*)array;
+
+  if ((residualCount > 0) && (residualType != type)) {
+    if ((residualCount % complexMult) != 0) {
+      throw VRTException("Can not change input type with half of a complex sample held over");
+    }
+    flush();
+  }
+  if (residualCount == 0) {
+    residualType = type;
+  }
+
+  // Top up any values held over from the last write
+  if (residualCount > 0) {
+    int32_t n = min(perPacket - residualCount, len);
+    memcpy(&residual[residualCount * size], ptr, n * size);
+    residualCount += n;
+    ptr           += n * size;
+    len           -= n;
+    if (residualCount < perPacket) return 0;
+
+    addPacket(type, &residual[0], perPacket);
+    residualCount = 0;
+  }
+
+  // Full packets are packed straight from the input
+  while (len >= perPacket) {
+    addPacket(type, ptr, perPacket);
+    ptr += perPacket * size;
+    len -= perPacket;
+  }
+
+  if (len > 0) {
+    memcpy(&residual[0], ptr, len * size);
+    residualCount = len;
+  }
+  return (int32_t)(packets.size() - start);
+}
+
+int32_t Packetizer::flush () {
+  int32_t n = residualCount - (residualCount % complexMult);
+  if (n == 0) return 0;
+
+  size_t start = packets.size();
+  int32_t size = residualType & 0xF;
+  addPacket(residualType, &residual[0], n);
+  residualCount -= n;
+  if (residualCount > 0) {
+    memmove(&residual[0], &residual[n * size], residualCount * size);
+  }
+  return (int32_t)(packets.size() - start);
+}
+
+void Packetizer::addPacket (int32_t type, const void *array, int32_t len) {
+  TimeStamp ts = getTimeStamp(sampleIndex);
+
+  if (!contextSent || contextChanged || ((contextInterval > 0) && (sinceContext >= contextInterval))) {
+    addContext(ts);
+  }
+
+  if (dataUsed == dataPackets.size()) {
+    BasicDataPacket *p = new BasicDataPacket();
+    p->bbuf.reserve(BasicVRTPacket::MAX_PROLOGUE_LENGTH + BasicVRTPacket::MAX_TRAILER_LENGTH
+                  + getMaxPayloadLength());
+    dataPackets.push_back(p);
+  }
+  BasicDataPacket *p = dataPackets[dataUsed++];
+
+  // The assign(..) re-uses the existing buffer, so there is no allocation here
+  p->bbuf.assign(dataTemplate.bbuf.begin(), dataTemplate.bbuf.end());
+  p->setPayloadFormat(payloadFormat);
+  p->setPacketCount(dataCount);
+  p->setTimeStamp(ts);
+
+  switch (type) {
+    case TYPE_DOUBLE: p->setDataDouble(payloadFormat, (const double *)array, len); break;
+    case TYPE_FLOAT:  p->setDataFloat( payloadFormat, (const float  *)array, len); break;
+    case TYPE_LONG:   p->setDataLong(  payloadFormat, (const int64_t*)array, len); break;
+    case TYPE_INT:    p->setDataInt(   payloadFormat, (const int32_t*)array, len); break;
+    case TYPE_SHORT:  p->setDataShort( payloadFormat, (const int16_t*)array, len); break;
+    case TYPE_BYTE:   p->setDataByte(  payloadFormat, (const int8_t *)array, len); break;
+    default: throw VRTException("Unknown input type %d", type);
+  }
+
+  dataCount = (dataCount + 1) & 0xF;
+  sinceContext++;
+  sampleIndex += len / complexMult;
+  samplesSent += len / complexMult;
+  dataPacketsSent++;
+  packets.push_back(p);
+}
+
+void Packetizer::addContext (const TimeStamp &ts) {
+  if (contextUsed == contextPackets.size()) {
+    contextPackets.push_back(new BasicContextPacket());
+  }
+  BasicContextPacket *p = contextPackets[contextUsed++];
+
+  p->bbuf.assign(contextTemplate.bbuf.begin(), contextTemplate.bbuf.end());
+  p->setPacketCount(contextCount);
+  p->setTimeStamp(ts);
+  p->setChangePacket(contextChanged || !contextSent);
+
+  contextCount   = (contextCount + 1) & 0xF;
+  sinceContext   = 0;
+  contextChanged = false;
+  contextSent    = true;
+  contextPacketsSent++;
+  packets.push_back(p);
+}
@@ -0,0 +1,487 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "ParallelVRAScanner.h"
+#include "StreamTable.h"
+#include <string.h>   // for strerror(..)
+#include <unistd.h>   // for sysconf(..) / access(..)
+
+using namespace vrt;
+
+/** Thread kinds used with runThread(..). */
+#define THREAD_BOUNDARY 0
+#define THREAD_READER   1
+#define THREAD_DELIVERY 2
+
+namespace vrt {
+  /** The argument passed to each scanner thread. */
+  struct ScanThreadArg {
+    ParallelVRAScanner *scanner;
+    int32_t             kind;
+    int32_t             worker;
+  };
+} END_NAMESPACE
+
+/** Checks the header word of a possible packet, returning the packet length if it is
+ *  plausible and 0 otherwise.
+ */
+static int32_t plausibleLength (const char *ptr) {
+  VRTPacketView p(ptr, 4);
+  if ((int32_t)p.getPacketType() > (int32_t)PacketType_ExtCommand) return 0;
+
+  int32_t len = p.getPacketLength();
+  int32_t min = p.getHeaderLength() + p.getTrailerLength()
+              + ((p.isData())? 0 : 4); // CIF0 or CAM field
+  return (len < min)? 0 : len;
+}
+
+ParallelVRAScanner::ParallelVRAScanner (const AbstractVRAFile &file, int32_t numThreads,
+                                        int32_t chunkSize, ScanOrder order) :
+  file(&file),
+  numThreads(numThreads),
+  chunkSize(chunkSize),
+  order(order),
+  numWorkers(0),
+  numSlots(0),
+  handler(NULL),
+  index(NULL),
+  fileLength(0),
+  numChunks(0),
+  nextChunk(0),
+  failed(false),
+  error(""),
+  packetsScanned(0),
+  bytesScanned(0),
+  indexBounds(0),
+  resyncBounds(0)
+{
+  if (numThreads == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    this->numThreads = (n < 1)? 1 : (int32_t)n;
+  }
+  if (this->numThreads < 1) {
+    throw VRTException("Invalid number of threads %d", numThreads);
+  }
+  if (chunkSize < BasicVRTPacket::MAX_PACKET_LENGTH) {
+    throw VRTException("Invalid chunk size %d, must be at least %d", chunkSize,
+                       BasicVRTPacket::MAX_PACKET_LENGTH);
+  }
+  switch (order) {
+    case ScanOrder_None:   numWorkers = this->numThreads; break;
+    case ScanOrder_Stream: numWorkers = this->numThreads; break;
+    case ScanOrder_File:   numWorkers = 1;                break;
+    default: throw VRTException("Unknown ScanOrder (%d)", (int32_t)order);
+  }
+  numSlots = (order == ScanOrder_None)? 0 : this->numThreads * 2;
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_mutex_init(&readLock, NULL);
+  pthread_cond_init(&cond, NULL);
+}
+
+ParallelVRAScanner::~ParallelVRAScanner () {
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&readLock);
+  pthread_mutex_destroy(&lock);
+}
+
+string ParallelVRAScanner::toString () const {
+  return Utilities::format("%s: File=%s NumThreads=%d ChunkSize=%d ScanOrder=%d "
+                           "PacketsScanned=%" PRId64 " BytesScanned=%" PRId64,
+                           getClassName().c_str(), file->getURI().c_str(), numThreads,
+                           chunkSize, (int32_t)order, packetsScanned, bytesScanned);
+}
+
+void ParallelVRAScanner::scan (VRAScanHandler &handler) {
+  this->handler  = &handler;
+  fileLength     = file->getFileLength();
+  numChunks      = (fileLength <= AbstractVRAFile::HEADER_LENGTH)? 0
+                 : (fileLength - AbstractVRAFile::HEADER_LENGTH + chunkSize - 1) / chunkSize;
+  failed         = false;
+  error          = "";
+  packetsScanned = 0;
+  bytesScanned   = 0;
+  indexBounds    = 0;
+  resyncBounds   = 0;
+
+  // Use the file's index if it has one, otherwise look for a sidecar (a stale or
+  // invalid sidecar is ignored)
+  VRAIndex *sidecar = NULL;
+  index = file->getIndex();
+  if ((index == NULL) && (file->getURI().find("file://") == 0)) {
+    string fname = VRAIndex::getIndexFileName(file->getURI().substr(7));
+    if (access(fname.c_str(), R_OK) == 0) {
+      sidecar = new VRAIndex();
+      try {
+        sidecar->read(fname);
+        index = sidecar;
+      }
+      catch (VRTException e) {
+        UNUSED_VARIABLE(e);
+      }
+    }
+  }
+  if ((index != NULL) && (index->getCoveredLength() > fileLength)) {
+    index = NULL;
+  }
+
+  // Find the chunk boundaries (the first and last are known)
+  bounds.assign(numChunks+1, -1);
+  if (numChunks > 0) {
+    bounds[0]         = AbstractVRAFile::HEADER_LENGTH;
+    bounds[numChunks] = fileLength;
+    nextChunk         = 1;
+    if (numChunks > 1) runThreads(true);
+    for (int64_t k = numChunks-1; k > 0; k--) {
+      // No boundary found in chunk k or the one found is past the next one
+      if ((bounds[k] < 0) || (bounds[k] > bounds[k+1])) bounds[k] = bounds[k+1];
+    }
+  }
+
+  // Read and deliver the chunks
+  if (!failed && (numChunks > 0)) {
+    nextChunk = 0;
+    slotData.assign(numSlots, vector<char>());
+    slotPackets.assign(numSlots, vector<int32_t>());
+    slotChunk.assign(numSlots, 0);
+    slotReady.assign(numSlots, false);
+    slotRefs.assign(numSlots, 0);
+    for (int32_t i = 0; i < numSlots; i++) {
+      slotChunk[i] = i;
+    }
+    runThreads(false);
+    slotData.clear();
+    slotPackets.clear();
+  }
+
+  safe_delete(sidecar);
+  index         = NULL;
+  this->handler = NULL;
+  if (failed) {
+    throw VRTException("Error scanning %s: %s", file->getURI().c_str(), error.c_str());
+  }
+}
+
+int64_t ParallelVRAScanner::findBoundary (int64_t chunk) {
+  int64_t start = AbstractVRAFile::HEADER_LENGTH + chunk * chunkSize;
+  int64_t limit = start + chunkSize;
+  if (limit > fileLength) limit = fileLength;
+
+  int64_t off = findIndexBoundary(start, limit);
+  if (off >= 0) {
+    __sync_add_and_fetch(&indexBounds, 1);
+    return off;
+  }
+  off = findResyncBoundary(start, limit);
+  if (off >= 0) {
+    __sync_add_and_fetch(&resyncBounds, 1);
+  }
+  return off;
+}
+
+int64_t ParallelVRAScanner::findIndexBoundary (int64_t start, int64_t limit) const {
+  if ((index == NULL) || (start >= index->getCoveredLength())) return -1;
+
+  // Binary search for the first entry at or after start, if there is none the end of
+  // the covered region is the next packet boundary
+  size_t lo = 0;
+  size_t hi = index->size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index->getEntry(mid).offset < start) lo = mid + 1;
+    else                                     hi = mid;
+  }
+  int64_t off = (lo < index->size())? index->getEntry(lo).offset : index->getCoveredLength();
+  return (off < limit)? off : -1;
+}
+
+int64_t ParallelVRAScanner::findResyncBoundary (int64_t start, int64_t limit) {
+  // Packets are always a multiple of 4 octets (as is the file header), and there must
+  // be a packet boundary within MAX_PACKET_LENGTH of any position
+  int64_t first = start + ((4 - (start & 0x3)) & 0x3);
+  int64_t last  = start + BasicVRTPacket::MAX_PACKET_LENGTH;
+  if (last > limit) last = limit;
+  if (first >= last) return -1;
+
+  int64_t winEnd = start + 2 * BasicVRTPacket::MAX_PACKET_LENGTH;
+  if (winEnd > fileLength) winEnd = fileLength;
+  vector<char> win((size_t)(winEnd - start));
+  readFully(start, &win[0], (int32_t)win.size());
+
+  int64_t offs[RESYNC_PACKETS]; // Packet offsets in the chain
+  int32_t words[RESYNC_PACKETS]; // Header words in the chain
+  int32_t sids[RESYNC_PACKETS];  // Stream IDs in the chain
+
+  for (int64_t off = first; off < last; off += 4) {
+    int64_t pos   = off;
+    int32_t count = 0;
+    while (count < RESYNC_PACKETS) {
+      if (pos == fileLength) break;        // exactly reached end of file
+      if (pos + 4 > fileLength) { count = -1; break; }
+
+      char        hdr[8];
+      const char *ptr;
+      int32_t     avail = (int32_t)(((fileLength - pos) < 8)? (fileLength - pos) : 8);
+      if (pos + avail <= winEnd) {
+        ptr = &win[(size_t)(pos - start)];
+      }
+      else {
+        readFully(pos, hdr, avail);
+        ptr = hdr;
+      }
+
+      // The packet must be plausible on its own, must not look like part of a run of
+      // identical words (as is common in a payload), and must have the same header
+      // settings as any earlier packet in the chain on the same stream
+      int32_t len = plausibleLength(ptr);
+      if ((len == 0) || (pos + len > fileLength)) { count = -1; break; }
+      words[count] = VRTMath::unpackInt(ptr, 0);
+      if ((avail == 8) && (VRTMath::unpackInt(ptr, 4) == words[count])) { count = -1; break; }
+
+      VRTPacketView p(ptr, avail);
+      sids[count] = p.getStreamIdentifier();
+      for (int32_t i = 0; i < count; i++) {
+        if ((sids[i] == sids[count]) && (((words[i] ^ words[count]) & 0xFFF00000) != 0) &&
+            ((words[i] >> 28) == (words[count] >> 28))) {
+          count = -1;
+          break;
+        }
+      }
+      if (count < 0) break;
+      offs[count] = pos;
+      pos += len;
+      count++;
+    }
+
+    // A chain starting inside a packet may pass the checks for a packet or two before
+    // landing on a real packet boundary, after which it follows the real packets; so
+    // the boundary is taken from the middle of the chain rather than the start
+    if (count > 0) return offs[count/2];
+  }
+  return -1;
+}
+
+void ParallelVRAScanner::readChunk (int64_t chunk, vector<char> &data, vector<int32_t> &packets) {
+  int64_t start = bounds[chunk];
+  int64_t end   = bounds[chunk+1];
+  if (end - start > 0x7FFFFFFF) {
+    throw VRTException("Chunk at offset %" PRId64 " is too long (%" PRId64 " octets)",
+                       start, end - start);
+  }
+  int32_t len = (int32_t)(end - start);
+
+  packets.clear();
+  if (len == 0) return;
+  if ((int32_t)data.size() < len) data.resize(len);
+  readFully(start, &data[0], len);
+
+  // Check that the packets exactly fill the chunk before any are delivered
+  int32_t off = 0;
+  while (off < len) {
+    int32_t n = (len - off < 4)? 0 : plausibleLength(&data[off]);
+    if (n == 0) {
+      throw VRTException("Invalid packet header at offset %" PRId64, start + off);
+    }
+    if (off + n > len) {
+      if (chunk == numChunks-1) {
+        throw VRTException("Packet at offset %" PRId64 " extends past end of file",
+                           start + off);
+      }
+      throw VRTException("Packet at offset %" PRId64 " crosses the chunk boundary at "
+                         "offset %" PRId64 " (index does not match file or packet "
+                         "boundary found in error)", start + off, end);
+    }
+    packets.push_back(off);
+    off += n;
+  }
+}
+
+void ParallelVRAScanner::readFully (int64_t off, void *ptr, int32_t len) {
+  char   *buf        = (char*)ptr;
+  int32_t numRead    = 0;
+  bool    concurrent = file->isReadConcurrent();
+
+  if (!concurrent) pthread_mutex_lock(&readLock);
+  try {
+    while (numRead < len) {
+      int32_t n = (concurrent)? file->readConcurrent(off + numRead, &buf[numRead], len - numRead)
+                              : file->read(off + numRead, &buf[numRead], len - numRead);
+      if (n <= 0) {
+        throw VRTException("Unable to read %d octets at offset %" PRId64, len, off);
+      }
+      numRead += n;
+    }
+  }
+  catch (VRTException e) {
+    if (!concurrent) pthread_mutex_unlock(&readLock);
+    throw e;
+  }
+  if (!concurrent) pthread_mutex_unlock(&readLock);
+}
+
+void ParallelVRAScanner::deliver (int32_t worker, int64_t chunk, const vector<char> &data,
+                                  const vector<int32_t> &packets) {
+  int64_t start   = bounds[chunk];
+  bool    byShard = (order == ScanOrder_Stream) && (numWorkers > 1);
+  int64_t count   = 0;
+  int64_t bytes   = 0;
+
+  for (size_t i = 0; (i < packets.size()) && !failed; i++) {
+    const char    *ptr = &data[packets[i]];
+    int32_t        len = BasicVRTPacket::getPacketLength(ptr, 0);
+    VRTPacketView  p(ptr, len);
+
+    if (byShard && (StreamTable::getShard(p.getStreamIdentifier(), numWorkers) != worker)) {
+      continue;
+    }
+    handler->processPacket(p, start + packets[i], worker);
+    count++;
+    bytes += len;
+  }
+  __sync_add_and_fetch(&packetsScanned, count);
+  __sync_add_and_fetch(&bytesScanned,   bytes);
+}
+
+void ParallelVRAScanner::fail (const string &err) {
+  pthread_mutex_lock(&lock);
+  if (!failed) {
+    error  = err;
+    failed = true;
+  }
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+int64_t ParallelVRAScanner::claimChunk () {
+  if (failed) return -1;
+  int64_t k = __sync_fetch_and_add(&nextChunk, 1);
+  return (k < numChunks)? k : -1;
+}
+
+void ParallelVRAScanner::runThreads (bool boundaries) {
+  int32_t numDelivery = (boundaries || (order == ScanOrder_None))? 0 : numWorkers;
+  int32_t count       = numThreads + numDelivery;
+
+  vector<pthread_t>     threads(count);
+  vector<ScanThreadArg> args(count);
+  int32_t               started = 0;
+
+  for (int32_t i = 0; i < count; i++) {
+    args[i].scanner = this;
+    args[i].kind    = (boundaries)? THREAD_BOUNDARY : (i < numThreads)? THREAD_READER : THREAD_DELIVERY;
+    args[i].worker  = (i < numThreads)? i : i - numThreads;
+
+    int err = pthread_create(&threads[i], NULL, runThread, &args[i]);
+    if (err != 0) {
+      fail(Utilities::format("Unable to start scanner thread: %s", strerror(err)));
+      break;
+    }
+    started++;
+  }
+  for (int32_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+void *ParallelVRAScanner::runThread (void *arg) {
+  ScanThreadArg      *a = (ScanThreadArg*)arg;
+  ParallelVRAScanner *s = a->scanner;
+  try {
+    switch (a->kind) {
+      case THREAD_BOUNDARY: s->runBoundaries();         break;
+      case THREAD_READER:   s->runReader(a->worker);    break;
+      case THREAD_DELIVERY: s->runDelivery(a->worker);  break;
+    }
+  }
+  catch (VRTException e) {
+    s->fail(e.getMessage());
+  }
+  catch (...) {
+    s->fail("Unknown exception in scanner thread");
+  }
+  return NULL;
+}
+
+void ParallelVRAScanner::runBoundaries () {
+  int64_t k;
+  while ((k = claimChunk()) >= 0) {
+    if (k > 0) bounds[k] = findBoundary(k);
+  }
+}
+
+void ParallelVRAScanner::runReader (int32_t worker) {
+  if (order == ScanOrder_None) {
+    // Deliver directly from a private buffer
+    vector<char>    data;
+    vector<int32_t> packets;
+    int64_t         k;
+    while ((k = claimChunk()) >= 0) {
+      readChunk(k, data, packets);
+      deliver(worker, k, data, packets);
+    }
+    return;
+  }
+
+  // Each slot is used by chunks k, k+numSlots, k+2*numSlots, ... in turn, so wait for
+  // the slot to be released by the delivery threads before reusing it
+  int64_t k;
+  while ((k = claimChunk()) >= 0) {
+    int32_t slot = (int32_t)(k % numSlots);
+
+    pthread_mutex_lock(&lock);
+    while ((slotChunk[slot] != k) && !failed) {
+      pthread_cond_wait(&cond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    if (failed) return;
+
+    readChunk(k, slotData[slot], slotPackets[slot]);
+
+    pthread_mutex_lock(&lock);
+    slotReady[slot] = true;
+    slotRefs[slot]  = numWorkers;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+void ParallelVRAScanner::runDelivery (int32_t worker) {
+  for (int64_t k = 0; k < numChunks; k++) {
+    int32_t slot = (int32_t)(k % numSlots);
+
+    pthread_mutex_lock(&lock);
+    while (((slotChunk[slot] != k) || !slotReady[slot]) && !failed) {
+      pthread_cond_wait(&cond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    if (failed) return;
+
+    deliver(worker, k, slotData[slot], slotPackets[slot]);
+
+    pthread_mutex_lock(&lock);
+    if (--slotRefs[slot] == 0) {
+      slotReady[slot]  = false;
+      slotChunk[slot] += numSlots;
+      pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+}
@@ -0,0 +1,317 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "ReorderBuffer.h"
+#include <math.h>       // for llround(..)
+#include <time.h>       // for clock_gettime(..)
+
+using namespace vrt;
+
+/** Largest number of packets that can be held. */
+static const int32_t MAX_PACKETS = 65536;
+
+/** Window used when placing packets by packet count (half the count range). */
+static const int64_t COUNT_WINDOW = 8;
+
+/** Can the packet's time stamp be used to place it? */
+static inline bool hasPacketTime (const BasicDataPacket *p) {
+  IntegerMode tsi = p->getTimeStamp().getIntegerMode();
+  return ((tsi == IntegerMode_UTC) || (tsi == IntegerMode_GPS))
+      && (p->getTimeStamp().getFractionalMode() == FractionalMode_RealTime);
+}
+
+ReorderBuffer::ReorderBuffer (int32_t maxPackets, int64_t maxLatency) :
+  slots(),
+  ready(),
+  mask(0),
+  head(0),
+  held(0),
+  headSeq(0),
+  newestSeq(-1),
+  newestCount(0),
+  maxPackets(maxPackets),
+  maxLatency(maxLatency),
+  sampleRate(DOUBLE_NAN),
+  payloadFormat(),
+  anchored(false),
+  nextTime(),
+  expectedTime(),
+  nextCount(0),
+  packetSize(0),
+  stalled(false),
+  stallStart(0),
+  lateCount(-1),
+  packetsReleased(0),
+  packetsLate(0),
+  duplicates(0),
+  gaps(0),
+  lostPackets(0),
+  lostSamples(0),
+  resyncs(0),
+  maxHeld(0)
+{
+  if ((maxPackets <= 0) || (maxPackets > MAX_PACKETS)) {
+    throw VRTException("Invalid maximum number of packets %d", maxPackets);
+  }
+  if (maxLatency < 0) {
+    throw VRTException("Invalid maximum latency %" PRId64, maxLatency);
+  }
+  int32_t size = 1;
+  while (size < maxPackets) size <<= 1;
+  slots.assign(size, (BasicDataPacket*)NULL);
+  mask = size - 1;
+}
+
+ReorderBuffer::~ReorderBuffer () {
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (slots[i] != NULL) delete slots[i];
+  }
+  for (size_t i = 0; i < ready.size(); i++) {
+    delete ready[i];
+  }
+}
+
+string ReorderBuffer::toString () const {
+  return Utilities::format("%s: Held=%d Released=%" PRId64 " Late=%" PRId64 " Duplicates=%" PRId64
+                           " Gaps=%" PRId64 " LostPackets=%" PRId64 " LostSamples=%" PRId64
+                           " Resyncs=%" PRId64 " MaxHeld=%d",
+                           getClassName().c_str(), getHeld(), packetsReleased, packetsLate,
+                           duplicates, gaps, lostPackets, lostSamples, resyncs, maxHeld);
+}
+
+int64_t ReorderBuffer::now () {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t)ts.tv_sec) * __INT64_C(1000000000) + (int64_t)ts.tv_nsec;
+}
+
+void ReorderBuffer::setSampleRate (double sr, const PayloadFormat &pf) {
+  if (isNull(sr) || isNull(pf) || (sr <= 0)) {
+    sampleRate    = DOUBLE_NAN;
+    payloadFormat = PayloadFormat();
+  }
+  else {
+    sampleRate    = sr;
+    payloadFormat = pf;
+  }
+  // The positions are taken from the time stamps once the next packet is released
+  nextTime     = TimeStamp();
+  expectedTime = TimeStamp();
+  packetSize   = 0;
+}
+
+int64_t ReorderBuffer::getTimePosition (const BasicDataPacket *p) const {
+  if (isNull(nextTime) || (packetSize <= 0) || !hasPacketTime(p)) return INT64_NULL;
+  if (p->getTimeStamp().getIntegerMode() != nextTime.getIntegerMode()) return INT64_NULL;
+
+  try {
+    int32_t samples = p->getLostSamples(nextTime, sampleRate);
+    return (int64_t)llround((double)samples / (double)packetSize);
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e);
+    return INT64_NULL;
+  }
+}
+
+int64_t ReorderBuffer::getCountPosition (int32_t cnt) const {
+  // Work from the newest packet held (or the last one released) since the packets
+  // should be within a few counts of it
+  int64_t ref      = -1;
+  int32_t refCount = (nextCount - 1) & 0xF;
+  if (newestSeq >= headSeq) {
+    ref      = newestSeq - headSeq;
+    refCount = newestCount;
+  }
+  int64_t diff = (cnt - refCount) & 0xF;
+  return (diff < COUNT_WINDOW)? ref + diff : ref + diff - 16;
+}
+
+bool ReorderBuffer::insert (BasicDataPacket *p, int64_t arrival) {
+  if (p == NULL) throw VRTException("Packet can not be null");
+
+  int32_t cnt = p->getPacketCount();
+  if (!anchored) {
+    anchored  = true;
+    nextCount = cnt;
+    if (!isNull(sampleRate) && hasPacketTime(p)) {
+      nextTime   = p->getTimeStamp();
+      packetSize = p->getDataLength(payloadFormat);
+    }
+  }
+
+  int64_t pos   = getTimePosition(p);
+  bool    timed = !isNull(pos);
+  if (!timed) pos = getCountPosition(cnt);
+
+  if (pos < 0) {
+    // A packet for a position already released (or skipped) is late, unless it is
+    // further behind than the window, in which case the source has restarted. The
+    // time stamp shows this directly; the packet count wraps, so it takes two packets
+    // in a row that follow on from each other.
+    bool restart = false;
+    if (pos < -(int64_t)slots.size()) {
+      restart   = timed || ((lateCount >= 0) && (cnt == ((lateCount + 1) & 0xF)));
+      lateCount = cnt;
+    }
+    else {
+      lateCount = -1;
+    }
+    if (!restart) {
+      packetsLate++;
+      return false;
+    }
+    // Release everything held and start again from this packet
+    flush(ready);
+    resyncs++;
+    nextCount    = cnt;
+    nextTime     = (!isNull(sampleRate) && hasPacketTime(p))? p->getTimeStamp() : TimeStamp();
+    expectedTime = TimeStamp();
+    pos          = 0;
+  }
+  lateCount = -1;
+
+  if (pos > mask) {
+    // Too far ahead: release what is held, then jump forward if still too far
+    flush(ready);
+    pos = getTimePosition(p);
+    if (isNull(pos)) pos = getCountPosition(cnt);
+    if (pos > mask) {
+      gaps++;
+      lostPackets += pos;
+      nextCount = cnt;
+      nextTime  = (!isNull(sampleRate) && hasPacketTime(p))? p->getTimeStamp() : TimeStamp();
+      pos       = 0;
+    }
+  }
+
+  int32_t slot = (head + (int32_t)pos) & mask;
+  if (slots[slot] != NULL) {
+    duplicates++;
+    return false;
+  }
+  slots[slot] = p;
+  held++;
+  if ((slots[head] == NULL) && !stalled) {
+    // First packet held up by a gap at the head, the wait starts now
+    stalled    = true;
+    stallStart = arrival;
+  }
+  if (headSeq + pos > newestSeq) {
+    newestSeq   = headSeq + pos;
+    newestCount = cnt;
+  }
+  if (getHeld() > maxHeld) maxHeld = getHeld();
+  return true;
+}
+
+void ReorderBuffer::emit (BasicDataPacket *p, vector<BasicDataPacket*> &out) {
+  bool timed = !isNull(sampleRate) && hasPacketTime(p);
+
+  if (timed && !isNull(expectedTime) && (p->getTimeStamp().getIntegerMode() == expectedTime.getIntegerMode())) {
+    try {
+      int32_t lost = p->getLostSamples(expectedTime, sampleRate);
+      if (lost > 0) lostSamples += lost;
+    }
+    catch (VRTException e) {
+      UNUSED_VARIABLE(e);
+    }
+  }
+
+  nextCount = (p->getPacketCount() + 1) & 0xF;
+  if (timed) {
+    packetSize   = p->getDataLength(payloadFormat);
+    nextTime     = p->getNextTimeStamp(sampleRate, payloadFormat);
+    expectedTime = nextTime;
+  }
+  else {
+    nextTime     = TimeStamp();
+    expectedTime = TimeStamp();
+  }
+  packetsReleased++;
+  out.push_back(p);
+}
+
+void ReorderBuffer::advance (vector<BasicDataPacket*> &out) {
+  BasicDataPacket *p = slots[head];
+  slots[head] = NULL;
+  head = (head + 1) & mask;
+  headSeq++;
+
+  if (p != NULL) {
+    held--;
+    emit(p, out);
+    return;
+  }
+
+  // Skip a missing packet, assuming it was the same size as the last one
+  lostPackets++;
+  nextCount = (nextCount + 1) & 0xF;
+  if (!isNull(nextTime)) {
+    nextTime = (packetSize > 0)? nextTime.addSamples(packetSize, sampleRate) : TimeStamp();
+  }
+}
+
+int32_t ReorderBuffer::release (vector<BasicDataPacket*> &out, int64_t now) {
+  size_t start = out.size();
+  out.insert(out.end(), ready.begin(), ready.end());
+  ready.clear();
+
+  while (held > 0) {
+    if (slots[head] != NULL) {
+      advance(out);
+      stalled = false;
+      continue;
+    }
+
+    // A missing packet is holding up the rest, wait unless a limit has been reached
+    // (if the gap was only reached now, after the one before it was filled, the
+    // wait starts now)
+    if (!stalled) {
+      stalled    = true;
+      stallStart = now;
+    }
+    if ((held < maxPackets) && (now - stallStart < maxLatency)) break;
+
+    gaps++;
+    while (slots[head] == NULL) advance(out);
+    stalled = false;
+  }
+  return (int32_t)(out.size() - start);
+}
+
+int32_t ReorderBuffer::flush (vector<BasicDataPacket*> &out) {
+  size_t start = out.size();
+  if (&out != &ready) {
+    out.insert(out.end(), ready.begin(), ready.end());
+    ready.clear();
+  }
+
+  while (held > 0) {
+    if (slots[head] == NULL) {
+      gaps++;
+      while (slots[head] == NULL) advance(out);
+    }
+    advance(out);
+  }
+  stalled = false;
+  return (int32_t)(out.size() - start);
+}
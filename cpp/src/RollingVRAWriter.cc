@@ -0,0 +1,400 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE    // for fallocate(..)
+#endif
+#include "RollingVRAWriter.h"
+#include "BasicVRAFile.h"
+#include "VRTPacketView.h"
+#include <fcntl.h>      // for open(..) / fallocate(..)
+#include <unistd.h>     // for close(..) / truncate(..) / unlink(..)
+#include <string.h>     // for strerror(..)
+#include <errno.h>      // Required when using errno / ERRNO_STR
+
+using namespace vrt;
+
+const string RollingVRAWriter::MANIFEST_EXT = ".manifest";
+
+/** Gets the file name without any leading directory. */
+static string baseName (const string &fname) {
+  size_t i = fname.rfind('/');
+  return (i == string::npos)? fname : fname.substr(i+1);
+}
+
+RollingVRAWriter::RollingVRAWriter (const string &basePath, int64_t maxLength,
+                                    double maxDuration, bool isSetCRC, bool preallocate) :
+  basePath(basePath),
+  maxLength(maxLength),
+  maxDuration(maxDuration),
+  isSetCRC(isSetCRC),
+  preallocate(preallocate && (maxLength > 0)),
+  manifestName(basePath + MANIFEST_EXT),
+  manifest(NULL),
+  current(NULL),
+  tsiMode(IntegerMode_None),
+  tsfMode(FractionalMode_None),
+  firstTSI(0),
+  firstTSF(0),
+  next(NULL),
+  nextIndex(0),
+  stopping(false),
+  failed(false),
+  error(""),
+  running(false),
+  packetsWritten(0),
+  bytesWritten(0),
+  waitCount(0)
+{
+  if ((maxLength < 0) || ((maxLength > 0) && (maxLength <= AbstractVRAFile::HEADER_LENGTH))) {
+    throw VRTException("Invalid maximum segment length %" PRId64, maxLength);
+  }
+  if (!(maxDuration >= 0)) {
+    throw VRTException("Invalid maximum segment duration %f", maxDuration);
+  }
+
+  manifest = fopen(manifestName.c_str(), "w");
+  if (manifest == NULL) {
+    throw VRTException("Unable to open %s: %s", manifestName.c_str(), ERRNO_STR);
+  }
+  fprintf(manifest, "# Segment\tFile\tStartTime\tEndTime\tPackets\tLength\n");
+  fflush(manifest);
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&cond, NULL);
+
+  // The first segment is opened here so any problem is reported immediately, the
+  // background thread then opens the next one while this one is being written
+  try {
+    next = openSegment(0);
+    takeNext();
+  }
+  catch (VRTException e) {
+    safe_delete(next);
+    fclose(manifest);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+    throw e;
+  }
+
+  int err = pthread_create(&thread, NULL, runBackground, this);
+  if (err != 0) {
+    safe_delete(current);
+    fclose(manifest);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+    throw VRTException("Unable to start background thread: %s", strerror(err));
+  }
+  running = true;
+}
+
+RollingVRAWriter::~RollingVRAWriter () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // can't throw from destructor
+  }
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&lock);
+}
+
+string RollingVRAWriter::toString () const {
+  return Utilities::format("%s: BasePath=%s MaxLength=%" PRId64 " MaxDuration=%f "
+                           "Segment=%d PacketsWritten=%" PRId64 " BytesWritten=%" PRId64,
+                           getClassName().c_str(), basePath.c_str(), maxLength,
+                           maxDuration, info.index, packetsWritten, bytesWritten);
+}
+
+void RollingVRAWriter::append (const BasicVRTPacket &p) {
+  string err = p.getPacketValid(false);
+  if (!isNull(err)) throw VRTException(err);
+  append(&p.bbuf[0], p.getPacketLength());
+}
+
+void RollingVRAWriter::append (const void *ptr, int32_t len) {
+  checkState();
+  if ((len < 4) || (len > BasicVRTPacket::MAX_PACKET_LENGTH) ||
+      (BasicVRTPacket::getPacketLength(ptr, 0) != len)) {
+    throw VRTException("Invalid packet length %d", len);
+  }
+
+  // Check the limits before writing, so each segment ends on a packet boundary
+  VRTPacketView p(ptr, len);
+  bool          timed = (p.getIntegerMode() != IntegerMode_None);
+
+  if (info.packets > 0) {
+    bool roll = (maxLength > 0) && (info.length + len > maxLength);
+
+    if (!roll && timed && (maxDuration > 0) && (tsiMode == (int32_t)p.getIntegerMode())) {
+      double dt = (double)((int64_t)p.getTimeStampInteger() - (int64_t)firstTSI);
+      if ((tsfMode == FractionalMode_RealTime) &&
+          (p.getFractionalMode() == FractionalMode_RealTime)) {
+        dt += ((double)p.getTimeStampFractional() - (double)firstTSF) / 1e12;
+      }
+      roll = (dt >= maxDuration);
+    }
+    if (roll) rollover();
+  }
+
+  current->appendPackets(ptr, len);
+  info.packets++;
+  info.length += len;
+  packetsWritten++;
+  bytesWritten += len;
+
+  if (timed) {
+    TimeStamp ts = p.getTimeStamp();
+    if (info.startTime.isNullValue()) {
+      info.startTime = ts;
+      tsiMode        = (int32_t)p.getIntegerMode();
+      tsfMode        = (int32_t)p.getFractionalMode();
+      firstTSI       = p.getTimeStampInteger();
+      firstTSF       = p.getTimeStampFractional();
+    }
+    info.endTime = ts;
+  }
+}
+
+void RollingVRAWriter::rollover () {
+  checkState();
+  if (info.packets == 0) return;
+
+  pthread_mutex_lock(&lock);
+  closing.push_back(current);
+  closingInfo.push_back(info);
+  current = NULL;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+
+  takeNext();
+}
+
+void RollingVRAWriter::flush () {
+  checkState();
+  current->flush();
+}
+
+void RollingVRAWriter::close () {
+  if (running) {
+    // Hand the current segment over to be closed along with the others
+    pthread_mutex_lock(&lock);
+    if (current != NULL) {
+      closing.push_back(current);
+      closingInfo.push_back(info);
+      current = NULL;
+    }
+    stopping = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+    running = false;
+
+    // Remove the segment opened in advance but never used
+    if (next != NULL) {
+      string fname = getSegmentFileName(nextIndex);
+      try {
+        next->close();
+      }
+      catch (VRTException e) {
+        UNUSED_VARIABLE(e);
+      }
+      safe_delete(next);
+      unlink(fname.c_str());
+    }
+    if (manifest != NULL) {
+      fclose(manifest);
+      manifest = NULL;
+    }
+  }
+  if (failed) {
+    throw VRTException("Error recording to %s: %s", basePath.c_str(), error.c_str());
+  }
+}
+
+vector<VRASegmentInfo> RollingVRAWriter::getSegments () const {
+  pthread_mutex_lock(&lock);
+  vector<VRASegmentInfo> list = finished;
+  pthread_mutex_unlock(&lock);
+  return list;
+}
+
+void RollingVRAWriter::checkState () const {
+  if (stopping) {
+    throw VRTException("Writer for %s is closed", basePath.c_str());
+  }
+  pthread_mutex_lock(&lock);
+  bool   f   = failed;
+  string err = error;
+  pthread_mutex_unlock(&lock);
+  if (f) {
+    throw VRTException("Error recording to %s: %s", basePath.c_str(), err.c_str());
+  }
+}
+
+void RollingVRAWriter::takeNext () {
+  pthread_mutex_lock(&lock);
+  if ((next == NULL) && !failed) {
+    waitCount++;
+    while ((next == NULL) && !failed) {
+      pthread_cond_wait(&cond, &lock);
+    }
+  }
+  if (next == NULL) {
+    string err = error;
+    pthread_mutex_unlock(&lock);
+    throw VRTException("Error recording to %s: %s", basePath.c_str(), err.c_str());
+  }
+  current = next;
+  next    = NULL;
+
+  info.index     = nextIndex;
+  info.fileName  = getSegmentFileName(nextIndex);
+  info.startTime = TimeStamp();
+  info.endTime   = TimeStamp();
+  info.packets   = 0;
+  info.length    = AbstractVRAFile::HEADER_LENGTH;
+  tsiMode        = IntegerMode_None;
+  tsfMode        = FractionalMode_None;
+  nextIndex++;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+AbstractVRAFile *RollingVRAWriter::openSegment (int32_t index) {
+  string fname = getSegmentFileName(index);
+
+  // BasicVRAFile requires that the file exists
+  int fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+  }
+  ::close(fd);
+
+  BasicVRAFile *file = new BasicVRAFile(fname, FileMode_Write, true, isSetCRC);
+
+#if defined(FALLOC_FL_KEEP_SIZE)
+  // Reserve the space without changing the file length (so the file remains valid
+  // while being written), this is done after the file is opened since opening it
+  // truncates it. Failure here is not an error, the space just isn't reserved.
+  if (preallocate) {
+    fd = ::open(fname.c_str(), O_WRONLY);
+    if (fd >= 0) {
+      if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, maxLength) != 0) {
+        preallocate = false; // not supported by the file system, just skip it
+      }
+      ::close(fd);
+    }
+  }
+#endif
+  return file;
+}
+
+void RollingVRAWriter::closeSegment (AbstractVRAFile *file, VRASegmentInfo &segInfo) {
+  try {
+    file->close();
+  }
+  catch (VRTException e) {
+    delete file;
+    throw e;
+  }
+  segInfo.length = file->getFileLength();
+  delete file;
+
+  // Release any reserved space past the end of the data
+  if (preallocate && (truncate(segInfo.fileName.c_str(), segInfo.length) != 0)) {
+    throw VRTException("Unable to truncate %s: %s", segInfo.fileName.c_str(), ERRNO_STR);
+  }
+
+  fprintf(manifest, "%d\t%s\t%s\t%s\t%" PRId64 "\t%" PRId64 "\n", segInfo.index,
+          baseName(segInfo.fileName).c_str(),
+          (segInfo.startTime.isNullValue())? "-" : segInfo.startTime.toString().c_str(),
+          (segInfo.endTime.isNullValue()  )? "-" : segInfo.endTime.toString().c_str(),
+          segInfo.packets, segInfo.length);
+  if (fflush(manifest) != 0) {
+    throw VRTException("Unable to write to %s: %s", manifestName.c_str(), ERRNO_STR);
+  }
+}
+
+void *RollingVRAWriter::runBackground (void *arg) {
+  ((RollingVRAWriter*)arg)->runBackground();
+  return NULL;
+}
+
+void RollingVRAWriter::runBackground () {
+  pthread_mutex_lock(&lock);
+  while (true) {
+    bool needNext = (next == NULL) && !stopping && !failed;
+    if (!needNext && closing.empty()) {
+      if (stopping) break;
+      pthread_cond_wait(&cond, &lock);
+      continue;
+    }
+
+    if (needNext) {
+      // Opening the next segment comes first, since the writer may be waiting on it
+      int32_t          index = nextIndex;
+      AbstractVRAFile *file  = NULL;
+      string           err   = "";
+      pthread_mutex_unlock(&lock);
+      try {
+        file = openSegment(index);
+      }
+      catch (VRTException e) {
+        err = e.getMessage();
+      }
+      pthread_mutex_lock(&lock);
+      if (file != NULL) {
+        next = file;
+      }
+      else if (!failed) {
+        error  = err;
+        failed = true;
+      }
+    }
+    else {
+      // Segments are closed in order, failed or not, so that none are left open
+      AbstractVRAFile *file    = closing.front();
+      VRASegmentInfo   segInfo = closingInfo.front();
+      string           err     = "";
+      pthread_mutex_unlock(&lock);
+      try {
+        closeSegment(file, segInfo);
+      }
+      catch (VRTException e) {
+        err = e.getMessage();
+      }
+      pthread_mutex_lock(&lock);
+      closing.pop_front();
+      closingInfo.pop_front();
+      if (isNull(err)) {
+        finished.push_back(segInfo);
+      }
+      else if (!failed) {
+        error  = err;
+        failed = true;
+      }
+    }
+    pthread_cond_broadcast(&cond);
+  }
+  pthread_mutex_unlock(&lock);
+}
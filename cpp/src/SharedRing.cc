@@ -0,0 +1,613 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "SharedRing.h"
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <fcntl.h>      // for open(..)
+#include <limits.h>     // for INT_MAX
+#include <signal.h>     // for kill(..)
+#include <stddef.h>     // for offsetof(..)
+#include <stdlib.h>     // for mkstemp(..)
+#include <string.h>     // for memcpy(..)
+#include <time.h>       // for timespec
+#include <unistd.h>     // for close(..)
+#include <sys/mman.h>   // for mmap(..)
+#include <sys/stat.h>   // for fstat(..)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+using namespace vrt;
+
+/** Identifies a shared ring ("VRNG") and the version of its layout. */
+static const uint32_t RING_MAGIC   = 0x56524E47;
+static const uint32_t RING_VERSION = 1;
+
+/** Length of the header preceding each packet in the data area. Packets are
+ *  padded to a multiple of this, which keeps every header 8-octet aligned.
+ */
+static const uint32_t RECORD_HEADER = 8;
+
+/** Largest capacity supported (1 GiB). */
+static const uint32_t MAX_CAPACITY = 0x40000000;
+
+/** How long the writer waits for space before checking for readers that have
+ *  gone away (or, when dropping, how often it checks while the ring is full), in
+ *  milliseconds.
+ */
+static const int32_t REAP_INTERVAL = 10;
+
+/** Reader slot states. */
+static const uint32_t SLOT_FREE    = 0;
+static const uint32_t SLOT_CLAIMED = 1; // being set up, not yet seen by the writer
+static const uint32_t SLOT_ACTIVE  = 2;
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> A reader's slot in a {@link SharedRingHeader}. Each
+   *  slot is on its own cache line so a reader updating its position does not
+   *  interfere with the others.
+   */
+  struct SharedRingSlot {
+    volatile uint32_t state;       // SLOT_FREE, SLOT_CLAIMED or SLOT_ACTIVE
+    volatile int32_t  pid;         // Process ID of the reader
+    volatile uint64_t readPos;     // Read position (everything before it is free)
+    char              pad[48];
+  };
+
+  /** <b>Internal Use Only:</b> The header at the start of the shared memory used by a
+   *  {@link SharedRingWriter}. The fields updated by the writer and by the readers are
+   *  on separate cache lines.
+   */
+  struct SharedRingHeader {
+    uint32_t          magic;          // RING_MAGIC
+    uint32_t          version;        // RING_VERSION
+    uint32_t          headerSize;     // Size of the header (offset of the data area)
+    uint32_t          capacity;       // Size of the data area
+    uint32_t          maxReaders;     // Number of reader slots
+    volatile uint32_t closed;         // Has the writer closed the ring?
+    char              pad0[40];
+    volatile uint64_t writePos;       // Published write position
+    char              pad1[56];
+    volatile uint32_t dataSeq;        // Futex incremented when data is published
+    volatile uint32_t readersWaiting; // Number of readers waiting on dataSeq
+    char              pad2[56];
+    volatile uint32_t spaceSeq;       // Futex incremented when space is freed
+    volatile uint32_t writerWaiting;  // Is the writer waiting on spaceSeq?
+    char              pad3[56];
+    SharedRingSlot    readers[1];     // The reader slots (maxReaders of them)
+  };
+} END_NAMESPACE
+
+/** Gets the space used by a packet of the given length, including its header. */
+static inline uint32_t recordSize (int32_t len) {
+  return RECORD_HEADER + (((uint32_t)len + RECORD_HEADER - 1) & ~(RECORD_HEADER - 1));
+}
+
+/** Gets the size of the header for the given number of readers. */
+static inline uint32_t headerSize (int32_t maxReaders) {
+  uint32_t page = (uint32_t)sysconf(_SC_PAGESIZE);
+  uint32_t len  = (uint32_t)(offsetof(SharedRingHeader, readers) + maxReaders * sizeof(SharedRingSlot));
+  return ((len + page - 1) / page) * page;
+}
+
+/** Waits on a futex in shared memory until woken, the value is not 'val' or the
+ *  timeout expires (timeout<0 to wait forever).
+ */
+static inline void futexWait (volatile uint32_t *addr, uint32_t val, int32_t timeout) {
+  struct timespec ts;
+  ts.tv_sec  = timeout / 1000;
+  ts.tv_nsec = (timeout % 1000) * 1000000;
+  syscall(SYS_futex, addr, FUTEX_WAIT, val, (timeout < 0)? NULL : &ts, NULL, 0);
+}
+
+/** Wakes everything waiting on a futex in shared memory. */
+static inline void futexWake (volatile uint32_t *addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/** Converts a ring name into the path of the shared memory file. */
+static string toPath (const string &name) {
+  if (name.find('/') != string::npos) return name;
+  return "/dev/shm/" + name;
+}
+
+/** Maps a ring, with the data area mapped twice so any record is contiguous. */
+static char *mapRing (int fd, uint32_t hdrSize, uint32_t capacity, size_t &mapLength) {
+  mapLength = (size_t)hdrSize + 2 * (size_t)capacity;
+
+  void *addr = mmap(NULL, mapLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    throw VRTException("Unable to reserve shared ring of %d octets: %s", capacity, ERRNO_STR);
+  }
+
+  char *ptr = (char*)addr;
+  if ((mmap(ptr,                      hdrSize,  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0      ) == MAP_FAILED) ||
+      (mmap(ptr + hdrSize,            capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, hdrSize) == MAP_FAILED) ||
+      (mmap(ptr + hdrSize + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, hdrSize) == MAP_FAILED)) {
+    int err = errno;
+    munmap(addr, mapLength);
+    throw VRTException("Unable to map shared ring of %d octets: %s", capacity, strerror(err));
+  }
+  return ptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// SharedRingWriter
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+SharedRingWriter::SharedRingWriter (const string &name, int32_t cap, int32_t maxReaders,
+                                    OverflowPolicy policy) :
+  path(""),
+  fd(-1),
+  policy(policy),
+  header(NULL),
+  data(NULL),
+  mapLength(0),
+  capacity(0),
+  maxReaders(maxReaders),
+  pending(0),
+  limit(0),
+  pendingCount(0),
+  pendingBytes(0),
+  reserved(NULL),
+  reservedLength(0),
+  packetsWritten(0),
+  bytesWritten(0),
+  packetsDropped(0),
+  waitCount(0),
+  readersRemoved(0),
+  lastReap(0)
+{
+  if ((policy != OverflowPolicy_Block) && (policy != OverflowPolicy_Drop)) {
+    throw VRTException("Unknown OverflowPolicy (%d)", (int32_t)policy);
+  }
+  if ((cap <= 0) || ((uint32_t)cap > MAX_CAPACITY)) {
+    throw VRTException("Invalid capacity %d, must be between 1 and %d", cap, (int32_t)MAX_CAPACITY);
+  }
+  if ((maxReaders <= 0) || (maxReaders > 4096)) {
+    throw VRTException("Invalid maximum number of readers %d", maxReaders);
+  }
+
+  capacity = (uint32_t)sysconf(_SC_PAGESIZE);
+  while (capacity < (uint32_t)cap) capacity <<= 1;
+  uint32_t hdrSize = headerSize(maxReaders);
+
+  if (name.empty()) {
+#if defined(SYS_memfd_create)
+    fd = (int)syscall(SYS_memfd_create, "SharedRing", 0);
+#endif
+    if (fd < 0) {
+      char tmp[] = "/dev/shm/SharedRing.XXXXXX";
+      fd = mkstemp(tmp);
+      if (fd >= 0) unlink(tmp);
+    }
+  }
+  else {
+    path = toPath(name);
+    unlink(path.c_str()); // readers of any old ring keep their own copy
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  }
+  if (fd < 0) {
+    throw VRTException("Unable to create shared ring %s: %s", path.c_str(), ERRNO_STR);
+  }
+
+  try {
+    if (ftruncate(fd, (off_t)hdrSize + capacity) != 0) {
+      throw VRTException("Unable to create shared ring of %d octets: %s", capacity, ERRNO_STR);
+    }
+    data = mapRing(fd, hdrSize, capacity, mapLength);
+  }
+  catch (VRTException e) {
+    ::close(fd);
+    fd = -1;
+    if (!path.empty()) unlink(path.c_str());
+    throw e;
+  }
+
+  // The file is new (zero-filled) so only the non-zero fields need to be set. The
+  // magic number goes in last so a reader never sees a partly set-up header.
+  header             = (SharedRingHeader*)data;
+  data              += hdrSize;
+  header->version    = RING_VERSION;
+  header->headerSize = hdrSize;
+  header->capacity   = capacity;
+  header->maxReaders = (uint32_t)maxReaders;
+  __sync_synchronize();
+  header->magic      = RING_MAGIC;
+  limit              = capacity;
+}
+
+SharedRingWriter::~SharedRingWriter () {
+  close();
+}
+
+string SharedRingWriter::toString () const {
+  return Utilities::format("%s: Path=%s Capacity=%u Readers=%d PacketsWritten=%" PRId64
+                           " PacketsDropped=%" PRId64 " WaitCount=%" PRId64,
+                           getClassName().c_str(), path.c_str(), capacity,
+                           (isOpen())? getReaderCount() : 0, packetsWritten,
+                           packetsDropped, waitCount);
+}
+
+void SharedRingWriter::close () {
+  if (fd < 0) return;
+
+  flush();
+  header->closed = 1;
+  __sync_synchronize();
+  __sync_add_and_fetch(&header->dataSeq, 1);
+  futexWake(&header->dataSeq);
+
+  munmap(header, mapLength);
+  ::close(fd);
+  if (!path.empty()) unlink(path.c_str());
+  header = NULL;
+  data   = NULL;
+  fd     = -1;
+}
+
+int32_t SharedRingWriter::getReaderCount () const {
+  int32_t count = 0;
+  for (int32_t i = 0; i < maxReaders; i++) {
+    if (header->readers[i].state == SLOT_ACTIVE) count++;
+  }
+  return count;
+}
+
+uint64_t SharedRingWriter::getMinReadPosition () {
+  // With no readers everything published is free, but not anything still
+  // pending since a reader attaching now will start with it
+  uint64_t minPos = header->writePos;
+  for (int32_t i = 0; i < maxReaders; i++) {
+    SharedRingSlot &s = header->readers[i];
+    if (s.state == SLOT_ACTIVE) {
+      uint64_t pos = s.readPos;
+      if (pos < minPos) minPos = pos;
+    }
+  }
+  return minPos;
+}
+
+int32_t SharedRingWriter::removeDeadReaders () {
+  int32_t removed = 0;
+  for (int32_t i = 0; i < maxReaders; i++) {
+    SharedRingSlot &s = header->readers[i];
+    if ((s.state == SLOT_ACTIVE) && (kill(s.pid, 0) != 0) && (errno == ESRCH)) {
+      if (__sync_bool_compare_and_swap(&s.state, SLOT_ACTIVE, SLOT_FREE)) {
+        removed++;
+      }
+    }
+  }
+  readersRemoved += removed;
+  return removed;
+}
+
+bool SharedRingWriter::waitSpace (uint32_t need) {
+  if (pending + need <= limit) return true;
+
+  __sync_synchronize(); // read positions must be read after the data was
+  limit = getMinReadPosition() + capacity;
+  if (pending + need <= limit) return true;
+
+  if (policy == OverflowPolicy_Drop) {
+    // Never wait, but still remove any readers whose process has gone away (checked
+    // at most once per interval since the ring may be full for every packet)
+    int64_t now = Utilities::monotonicTimeMillis();
+    if (now - lastReap < REAP_INTERVAL) return false;
+    lastReap = now;
+    if (removeDeadReaders() == 0) return false;
+    limit = getMinReadPosition() + capacity;
+    return (pending + need <= limit);
+  }
+
+  // The readers can not free any space until they have seen what is pending
+  flush();
+  waitCount++;
+
+  while (true) {
+    uint32_t seq = header->spaceSeq;
+    header->writerWaiting = 1;
+    __sync_synchronize(); // flag must be visible before the positions are checked
+    limit = getMinReadPosition() + capacity;
+    if (pending + need <= limit) break;
+
+    int64_t start = Utilities::monotonicTimeMillis();
+    futexWait(&header->spaceSeq, seq, REAP_INTERVAL);
+    if (Utilities::monotonicTimeMillis() - start < REAP_INTERVAL) continue;
+
+    // Timed out, remove any readers whose process has gone away
+    removeDeadReaders();
+  }
+  header->writerWaiting = 0;
+  return true;
+}
+
+char *SharedRingWriter::reserve (int32_t len) {
+  if (fd < 0) throw VRTException("Shared ring is closed");
+  if ((len < 0) || (recordSize(len) > capacity / 2)) {
+    throw VRTException("Invalid packet length %d for shared ring of %u octets", len, capacity);
+  }
+
+  if (!waitSpace(recordSize(len))) {
+    packetsDropped++;
+    reserved = NULL;
+    return NULL;
+  }
+  reserved       = data + (pending & (capacity - 1));
+  reservedLength = len;
+  return reserved + RECORD_HEADER;
+}
+
+void SharedRingWriter::commit (int32_t len) {
+  if (reserved == NULL) throw VRTException("No space reserved in shared ring");
+  if ((len < 0) || (len > reservedLength)) {
+    throw VRTException("Invalid packet length %d, only %d octets reserved", len, reservedLength);
+  }
+
+  *(uint32_t*)reserved       = (uint32_t)len;
+  *(uint32_t*)(reserved + 4) = 0;
+  pending                   += recordSize(len);
+  pendingCount              += 1;
+  pendingBytes              += len;
+  reserved                   = NULL;
+}
+
+bool SharedRingWriter::append (const void *ptr, int32_t len) {
+  char *buf = reserve(len);
+  if (buf == NULL) return false;
+  memcpy(buf, ptr, len);
+  commit(len);
+  return true;
+}
+
+void SharedRingWriter::flush () {
+  if (pendingCount == 0) return;
+
+  __sync_synchronize(); // packets must be visible before the position is updated
+  header->writePos = pending;
+  __sync_synchronize(); // position must be visible before checking for waiting readers
+
+  if (header->readersWaiting != 0) {
+    __sync_add_and_fetch(&header->dataSeq, 1);
+    futexWake(&header->dataSeq);
+  }
+  packetsWritten += pendingCount;
+  bytesWritten   += pendingBytes;
+  pendingCount    = 0;
+  pendingBytes    = 0;
+}
+
+int32_t SharedRingWriter::write (const BasicVRTPacket *const *packets, int32_t n) {
+  int32_t count = 0;
+  for (int32_t i = 0; i < n; i++) {
+    if (append(*packets[i])) count++;
+  }
+  flush();
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// SharedRingReader
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+SharedRingReader::SharedRingReader (const string &name, int32_t batchSize) :
+  header(NULL),
+  data(NULL),
+  mapLength(0),
+  capacity(0),
+  slot(-1),
+  batchSize(batchSize),
+  position(0),
+  batchEnd(0),
+  eof(false),
+  packets(),
+  lengths(),
+  packetsReceived(0),
+  bytesReceived(0)
+{
+  string path = toPath(name);
+  int    fd   = open(path.c_str(), O_RDWR);
+  if (fd < 0) {
+    throw VRTException("Unable to open shared ring %s: %s", path.c_str(), ERRNO_STR);
+  }
+  try {
+    init(fd);
+  }
+  catch (VRTException e) {
+    ::close(fd);
+    throw e;
+  }
+  ::close(fd); // mappings remain valid
+}
+
+SharedRingReader::SharedRingReader (int fd, int32_t batchSize) :
+  header(NULL),
+  data(NULL),
+  mapLength(0),
+  capacity(0),
+  slot(-1),
+  batchSize(batchSize),
+  position(0),
+  batchEnd(0),
+  eof(false),
+  packets(),
+  lengths(),
+  packetsReceived(0),
+  bytesReceived(0)
+{
+  init(fd);
+}
+
+void SharedRingReader::init (int fd) {
+  if (batchSize <= 0) {
+    throw VRTException("Invalid batch size %d", batchSize);
+  }
+
+  // Read the header first to get the size of the mapping
+  SharedRingHeader hdr;
+  struct stat      st;
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(hdr)) ||
+      (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr))) {
+    throw VRTException("Unable to read shared ring header: %s", ERRNO_STR);
+  }
+  if ((hdr.magic != RING_MAGIC) || (hdr.version != RING_VERSION)) {
+    throw VRTException("Invalid shared ring (magic=0x%08X version=%u)", hdr.magic, hdr.version);
+  }
+  if ((hdr.capacity == 0) || (hdr.capacity > MAX_CAPACITY) ||
+      ((hdr.capacity & (hdr.capacity - 1)) != 0) || (hdr.headerSize < headerSize(1)) ||
+      (hdr.headerSize < headerSize((int32_t)hdr.maxReaders)) ||
+      (st.st_size < (off_t)hdr.headerSize + (off_t)hdr.capacity)) {
+    throw VRTException("Invalid shared ring (capacity=%u headerSize=%u)", hdr.capacity, hdr.headerSize);
+  }
+
+  char *ptr = mapRing(fd, hdr.headerSize, hdr.capacity, mapLength);
+  header    = (SharedRingHeader*)ptr;
+  data      = ptr + hdr.headerSize;
+  capacity  = hdr.capacity;
+
+  // Claim a slot, starting at the write position. The position is set again once
+  // the slot is visible to the writer, any space freed by the writer before then
+  // is below that position.
+  for (uint32_t i = 0; i < header->maxReaders; i++) {
+    SharedRingSlot &s = header->readers[i];
+    if ((s.state == SLOT_FREE) && __sync_bool_compare_and_swap(&s.state, SLOT_FREE, SLOT_CLAIMED)) {
+      s.pid     = (int32_t)getpid();
+      s.readPos = header->writePos;
+      __sync_synchronize();
+      s.state   = SLOT_ACTIVE;
+      __sync_synchronize();
+      position  = header->writePos;
+      batchEnd  = position;
+      s.readPos = position;
+      slot      = (int32_t)i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    munmap(header, mapLength);
+    header = NULL;
+    data   = NULL;
+    throw VRTException("Shared ring already has the maximum number of readers");
+  }
+
+  packets.reserve(batchSize);
+  lengths.reserve(batchSize);
+}
+
+SharedRingReader::~SharedRingReader () {
+  close();
+}
+
+string SharedRingReader::toString () const {
+  return Utilities::format("%s: Capacity=%u PacketsReceived=%" PRId64 " BytesReceived=%" PRId64,
+                           getClassName().c_str(), capacity, packetsReceived, bytesReceived);
+}
+
+void SharedRingReader::close () {
+  if (header == NULL) return;
+
+  packets.clear();
+  lengths.clear();
+  header->readers[slot].state = SLOT_FREE;
+  __sync_synchronize();
+  if (header->writerWaiting != 0) {
+    __sync_add_and_fetch(&header->spaceSeq, 1);
+    futexWake(&header->spaceSeq);
+  }
+  munmap(header, mapLength);
+  header = NULL;
+  data   = NULL;
+}
+
+int64_t SharedRingReader::getBacklog () const {
+  if (header == NULL) return 0;
+  return (int64_t)(header->writePos - batchEnd);
+}
+
+void SharedRingReader::release () {
+  packets.clear();
+  lengths.clear();
+  if (batchEnd == position) return;
+
+  position = batchEnd;
+  __sync_synchronize(); // packets must be finished with before the space is freed
+  header->readers[slot].readPos = position;
+  __sync_synchronize(); // position must be visible before checking for the writer
+
+  if (header->writerWaiting != 0) {
+    __sync_add_and_fetch(&header->spaceSeq, 1);
+    futexWake(&header->spaceSeq);
+  }
+}
+
+int32_t SharedRingReader::receive (int32_t timeout) {
+  if (header == NULL) throw VRTException("Shared ring is closed");
+  release();
+
+  int64_t  deadline = (timeout > 0)? Utilities::monotonicTimeMillis() + timeout : 0;
+  uint64_t writePos;
+
+  while (true) {
+    writePos = header->writePos;
+    __sync_synchronize(); // packets must be read after the position
+    if (writePos != position) break;
+
+    if (header->closed) {
+      __sync_synchronize(); // the final packets are published before the ring is closed
+      if (header->writePos != position) continue;
+      eof = true;
+      return 0;
+    }
+
+    int32_t wait = -1;
+    if (timeout == 0) return 0;
+    if (timeout > 0) {
+      wait = (int32_t)(deadline - Utilities::monotonicTimeMillis());
+      if (wait <= 0) return 0;
+    }
+
+    uint32_t seq = header->dataSeq;
+    __sync_add_and_fetch(&header->readersWaiting, 1); // implies a full barrier
+    if ((header->writePos == position) && !header->closed) {
+      futexWait(&header->dataSeq, seq, wait);
+    }
+    __sync_sub_and_fetch(&header->readersWaiting, 1);
+  }
+
+  if (writePos - position > capacity) {
+    throw VRTException("Shared ring is corrupt (reader was overrun)");
+  }
+
+  uint64_t pos = position;
+  while ((pos < writePos) && ((int32_t)packets.size() < batchSize)) {
+    const char *rec = data + (pos & (capacity - 1));
+    uint32_t    len = *(const uint32_t*)rec;
+    if ((len > capacity / 2) || (pos + recordSize(len) > writePos)) {
+      throw VRTException("Shared ring is corrupt (invalid packet length %u)", len);
+    }
+    packets.push_back(rec + RECORD_HEADER);
+    lengths.push_back((int32_t)len);
+    bytesReceived += len;
+    pos += recordSize(len);
+  }
+  batchEnd         = pos;
+  packetsReceived += (int64_t)packets.size();
+  return (int32_t)packets.size();
+}
@@ -0,0 +1,355 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "StreamDispatcher.h"
+#include <string.h>     // for strerror(..)
+
+using namespace vrt;
+
+/** Number of packets a worker takes from its queue at a time. */
+static const int32_t WORKER_BATCH = 64;
+
+/** Does the packet's stream code include a stream identifier (i.e. is its header at
+ *  least 8 octets)? This matches {@link BasicVRTPacket#getStreamCode(const void*)}.
+ */
+static inline bool hasStreamCodeID (const char *buf) {
+  int32_t type = (buf[0] >> 4) & 0xF;
+  return (type != PacketType_UnidentifiedData) && (type != PacketType_UnidentifiedExtData);
+}
+
+/** Gets the packet type and stream identifier from the packet's stream code, so the
+ *  routing uses the same (type, stream) key as the rest of the library.
+ *  @param buf The packet (see {@link #hasStreamCodeID}).
+ *  @param sid Output, the stream identifier ({@link StreamDispatcher#NO_STREAM} if none).
+ *  @return The packet type.
+ */
+static inline int32_t getRouteKey (const char *buf, int64_t &sid) {
+  int64_t code = BasicVRTPacket::getStreamCode(buf);
+  sid = (hasStreamCodeID(buf))? (code & __INT64_C(0xFFFFFFFF)) : StreamDispatcher::NO_STREAM;
+  return (int32_t)((code >> 60) & 0xF);
+}
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> A route in a {@link StreamDispatcher}. */
+  struct DispatchRoute {
+    int64_t        streamID;   // Stream identifier (or value for a wildcard)
+    int64_t        mask;       // Stream identifier mask (wildcard only)
+    int32_t        types;      // Packet type filter
+    StreamHandler *handler;    // Handler (NULL if to a queue)
+    PacketQueue   *queue;      // Queue (NULL if to a handler)
+    int32_t        next;       // Next route for the same stream identifier (-1 if none)
+  };
+
+  /** <b>Internal Use Only:</b> A worker thread in a {@link StreamDispatcher}. */
+  struct DispatchWorker {
+    StreamDispatcher        *dispatcher; // The dispatcher
+    int32_t                  id;         // The worker number
+    PacketQueue              queue;      // The packets to process
+    vector<BasicVRTPacket*>  staged;     // Packets waiting to be put in the queue
+    pthread_t                thread;     // The thread
+    bool                     running;    // Has the thread been started?
+
+    DispatchWorker (StreamDispatcher *d, int32_t id, int32_t queueSize) :
+      dispatcher(d), id(id), queue(queueSize), staged(), running(false)
+    {
+      staged.reserve(StreamDispatcher::STAGE_SIZE);
+    }
+  };
+} END_NAMESPACE
+
+StreamDispatcher::StreamDispatcher (int32_t numWorkers, int32_t queueSize, int32_t bufferSize,
+                                    OverflowPolicy policy) :
+  routes(),
+  wildcards(),
+  table(),
+  pool(max(1, numWorkers) * max(1, queueSize), max(1, bufferSize)),
+  policy(policy),
+  workers(),
+  started(false),
+  stopped(false),
+  packetsDispatched(0),
+  packetsUnrouted(0),
+  packetsInvalid(0),
+  packetsDropped(0),
+  handlerErrors(0)
+{
+  if ((numWorkers < 0) || (numWorkers > 1024)) {
+    throw VRTException("Invalid number of workers %d", numWorkers);
+  }
+  if (queueSize <= 0) {
+    throw VRTException("Invalid queue size %d", queueSize);
+  }
+  if ((policy != OverflowPolicy_Block) && (policy != OverflowPolicy_Drop)) {
+    throw VRTException("Unknown OverflowPolicy (%d)", (int32_t)policy);
+  }
+  for (int32_t i = 0; i < numWorkers; i++) {
+    workers.push_back(new DispatchWorker(this, i, queueSize));
+  }
+}
+
+StreamDispatcher::~StreamDispatcher () {
+  stop();
+  for (size_t i = 0; i < workers.size(); i++) {
+    delete workers[i];
+  }
+  for (size_t i = 0; i < routes.size(); i++) {
+    delete routes[i];
+  }
+}
+
+string StreamDispatcher::toString () const {
+  return Utilities::format("%s: Routes=%d Workers=%d Dispatched=%" PRId64 " Unrouted=%" PRId64
+                           " Invalid=%" PRId64 " Dropped=%" PRId64 " HandlerErrors=%" PRId64,
+                           getClassName().c_str(), (int32_t)routes.size(), getNumWorkers(),
+                           packetsDispatched, packetsUnrouted, packetsInvalid, packetsDropped,
+                           (int64_t)handlerErrors);
+}
+
+void StreamDispatcher::addRoute (int64_t streamID, StreamHandler *handler, int32_t types) {
+  if (handler == NULL) throw VRTException("Handler can not be null");
+  addRoute(streamID, __INT64_C(-1), false, handler, NULL, types);
+}
+
+void StreamDispatcher::addRoute (int64_t streamID, PacketQueue *queue, int32_t types) {
+  if (queue == NULL) throw VRTException("Queue can not be null");
+  addRoute(streamID, __INT64_C(-1), false, NULL, queue, types);
+}
+
+void StreamDispatcher::addWildcardRoute (int64_t value, int64_t mask, StreamHandler *handler,
+                                         int32_t types) {
+  if (handler == NULL) throw VRTException("Handler can not be null");
+  addRoute(value, mask, true, handler, NULL, types);
+}
+
+void StreamDispatcher::addWildcardRoute (int64_t value, int64_t mask, PacketQueue *queue,
+                                         int32_t types) {
+  if (queue == NULL) throw VRTException("Queue can not be null");
+  addRoute(value, mask, true, NULL, queue, types);
+}
+
+void StreamDispatcher::addRoute (int64_t streamID, int64_t mask, bool wildcard,
+                                 StreamHandler *handler, PacketQueue *queue, int32_t types) {
+  if (started || stopped) {
+    throw VRTException("Can not add routes once the dispatcher has been started");
+  }
+  if ((streamID != NO_STREAM) && ((streamID < 0) || (streamID > __INT64_C(0xFFFFFFFF)))) {
+    throw VRTException("Invalid stream identifier %" PRId64, streamID);
+  }
+  if ((types & TYPES_ALL) == 0) {
+    throw VRTException("Invalid packet type filter 0x%X", types);
+  }
+
+  DispatchRoute *r = new DispatchRoute();
+  r->streamID = streamID;
+  r->mask     = mask;
+  r->types    = types;
+  r->handler  = handler;
+  r->queue    = queue;
+  r->next     = -1;
+  routes.push_back(r);
+
+  int32_t idx = (int32_t)routes.size() - 1;
+  if (wildcard) {
+    wildcards.push_back(idx);
+    return;
+  }
+
+  // Routes for the same stream identifier are chained in the order added
+  int32_t first = table.insert(streamID, idx);
+  if (first >= 0) {
+    DispatchRoute *last = routes[first];
+    while (last->next >= 0) last = routes[last->next];
+    last->next = idx;
+  }
+}
+
+int32_t StreamDispatcher::findRoute (int64_t streamID, int32_t type) const {
+  int32_t bit = 1 << type;
+
+  for (int32_t r = table.find(streamID); r >= 0; r = routes[r]->next) {
+    if ((routes[r]->types & bit) != 0) return r;
+  }
+
+  for (size_t i = 0; i < wildcards.size(); i++) {
+    const DispatchRoute *r = routes[wildcards[i]];
+    if ((r->types & bit) == 0) continue;
+    if (streamID == NO_STREAM) {
+      if ((r->mask == 0) || (r->streamID == NO_STREAM)) return wildcards[i];
+    }
+    else if ((streamID & r->mask) == r->streamID) {
+      return wildcards[i];
+    }
+  }
+  return -1;
+}
+
+void StreamDispatcher::start () {
+  if (started) return;
+  if (stopped) throw VRTException("Can not restart a dispatcher once stopped");
+  started = true;
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    int err = pthread_create(&workers[i]->thread, NULL, runThread, workers[i]);
+    if (err != 0) {
+      stop();
+      throw VRTException("Unable to start dispatcher thread: %s", strerror(err));
+    }
+    workers[i]->running = true;
+  }
+}
+
+void StreamDispatcher::stop () {
+  if (stopped) return;
+  stopped = true;
+  flush();
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i]->queue.close();
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (workers[i]->running) {
+      pthread_join(workers[i]->thread, NULL);
+      workers[i]->running = false;
+    }
+    // Anything left (only if the thread was never started) is returned to the pool
+    BasicVRTPacket *p;
+    while ((p = workers[i]->queue.poll()) != NULL) {
+      pool.release(p);
+    }
+  }
+}
+
+BasicVRTPacket *StreamDispatcher::copyPacket (const char *ptr, int32_t len) {
+  BasicVRTPacket *p = pool.get();
+  p->bbuf.assign(ptr, ptr + len);
+  return p;
+}
+
+void StreamDispatcher::callHandler (StreamHandler *handler, const VRTPacketView &p, int32_t worker) {
+  try {
+    handler->handlePacket(p, worker);
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e);
+    __sync_add_and_fetch(&handlerErrors, 1);
+  }
+  catch (...) {
+    __sync_add_and_fetch(&handlerErrors, 1);
+  }
+}
+
+void StreamDispatcher::route (const void *ptr, int32_t len) {
+  if (!started) start();
+
+  // Only the header word and stream identifier are read
+  const char *buf = (const char*)ptr;
+  if ((len < 4) || (BasicVRTPacket::getPacketLength(buf, 0) > len)) {
+    packetsInvalid++;
+    return;
+  }
+  len = BasicVRTPacket::getPacketLength(buf, 0);
+  if ((len < 8) && hasStreamCodeID(buf)) {
+    packetsInvalid++;
+    return;
+  }
+  int64_t sid;
+  int32_t type = getRouteKey(buf, sid);
+
+  int32_t idx = findRoute(sid, type);
+  if (idx < 0) {
+    packetsUnrouted++;
+    return;
+  }
+  const DispatchRoute *r = routes[idx];
+
+  if (r->queue != NULL) {
+    BasicVRTPacket *p = copyPacket(buf, len);
+    bool ok = (policy == OverflowPolicy_Drop)? r->queue->offer(p) : r->queue->put(p);
+    if (!ok) {
+      pool.release(p);
+      packetsDropped++;
+      return;
+    }
+  }
+  else if (workers.empty()) {
+    callHandler(r->handler, VRTPacketView(buf, len), -1);
+  }
+  else if (stopped) {
+    packetsDropped++;
+    return;
+  }
+  else {
+    DispatchWorker *w = workers[getWorker(sid)];
+    w->staged.push_back(copyPacket(buf, len));
+    if ((int32_t)w->staged.size() >= STAGE_SIZE) flushWorker(w);
+  }
+  packetsDispatched++;
+}
+
+void StreamDispatcher::flush () {
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (!workers[i]->staged.empty()) flushWorker(workers[i]);
+  }
+}
+
+void StreamDispatcher::flushWorker (DispatchWorker *w) {
+  int32_t n     = (int32_t)w->staged.size();
+  int32_t count = (policy == OverflowPolicy_Drop)? w->queue.offer(&w->staged[0], n)
+                                                 : w->queue.put(&w->staged[0], n);
+  if (count < n) {
+    // Since packets are staged in order, only the last ones in a batch are dropped
+    pool.release(&w->staged[count], n - count);
+    packetsDropped    += n - count;
+    packetsDispatched -= n - count;
+  }
+  w->staged.clear();
+}
+
+void StreamDispatcher::dispatch (const BasicVRTPacket *const *packets, int32_t n) {
+  for (int32_t i = 0; i < n; i++) {
+    route(&packets[i]->bbuf[0], packets[i]->getPacketLength());
+  }
+  flush();
+}
+
+void StreamDispatcher::runWorker (DispatchWorker *w) {
+  BasicVRTPacket *batch[WORKER_BATCH];
+  while (true) {
+    int32_t n = w->queue.take(batch, WORKER_BATCH);
+    if (n == 0) break; // closed and empty
+
+    for (int32_t i = 0; i < n; i++) {
+      const char    *buf  = &batch[i]->bbuf[0];
+      int32_t        len  = (int32_t)batch[i]->bbuf.size();
+      int64_t        sid;
+      int32_t        type = getRouteKey(buf, sid);
+      int32_t        idx  = findRoute(sid, type);
+      callHandler(routes[idx]->handler, VRTPacketView(buf, len), w->id);
+    }
+    pool.release(batch, n);
+  }
+}
+
+void *StreamDispatcher::runThread (void *arg) {
+  DispatchWorker *w = (DispatchWorker*)arg;
+  w->dispatcher->runWorker(w);
+  return NULL;
+}
@@ -0,0 +1,72 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "StreamTable.h"
+#include "Utilities.h"
+
+using namespace vrt;
+
+StreamTable::StreamTable () :
+  keys(INITIAL_SIZE, INT64_NULL),
+  values(INITIAL_SIZE, -1),
+  used(0)
+{
+  // done
+}
+
+string StreamTable::toString () const {
+  return Utilities::format("%s: Size=%d Slots=%d", getClassName().c_str(), used, (int32_t)keys.size());
+}
+
+void StreamTable::clear () {
+  keys.assign(keys.size(), INT64_NULL);
+  values.assign(values.size(), -1);
+  used = 0;
+}
+
+int32_t StreamTable::insert (int64_t streamID, int32_t value) {
+  // Keep the table no more than half full so probes stay short
+  if (2 * (used + 1) > (int32_t)keys.size()) {
+    vector<int64_t> oldKeys;
+    vector<int32_t> oldValues;
+    oldKeys.swap(keys);
+    oldValues.swap(values);
+    keys.assign(oldKeys.size() * 2, INT64_NULL);
+    values.assign(oldKeys.size() * 2, -1);
+    used = 0;
+    for (size_t i = 0; i < oldKeys.size(); i++) {
+      if (!isNull(oldKeys[i])) insert(oldKeys[i], oldValues[i]);
+    }
+  }
+
+  uint32_t mask = (uint32_t)keys.size() - 1;
+  for (uint32_t i = hash(streamID) & mask; ; i = (i + 1) & mask) {
+    if (keys[i] == streamID) {
+      return values[i];
+    }
+    if (isNull(keys[i])) {
+      keys[i]   = streamID;
+      values[i] = value;
+      used++;
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,374 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "UDPPacketReceiver.h"
+#include "BasicVRTPacket.h"
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <string.h>     // for memset(..)
+#include <stdlib.h>     // for posix_memalign(..)
+#include <unistd.h>     // for close(..)
+#include <poll.h>       // for poll(..)
+#include <net/if.h>     // for if_nametoindex(..)
+#include <netinet/in.h>
+#include <sys/uio.h>    // for struct iovec
+
+using namespace vrt;
+
+/** Alignment for the datagram buffers (one cache line). */
+static const size_t SLAB_ALIGN = 64;
+
+/** Space for the control messages received with each datagram (SO_TIMESTAMPNS and
+ *  SO_RXQ_OVFL).
+ */
+static const int32_t CONTROL_SIZE = CMSG_SPACE(sizeof(struct timespec))
+                                  + CMSG_SPACE(sizeof(uint32_t));
+
+/** Gets the interface index for a device name (0 for ""). */
+static unsigned int getInterfaceIndex (const string &device) {
+  if (device == "") return 0;
+  unsigned int idx = if_nametoindex(device.c_str());
+  if (idx == 0) {
+    throw VRTException("Unknown network device '%s': %s", device.c_str(), ERRNO_STR);
+  }
+  return idx;
+}
+
+UDPPacketReceiver::UDPPacketReceiver (int32_t _port, const string &host,
+                                      int32_t _batchSize, int32_t _bufferSize,
+                                      bool _timestamps) :
+  sock(-1),
+  family(AF_INET),
+  port(_port),
+  batchSize(_batchSize),
+  bufferSize(_bufferSize),
+  timestamps(_timestamps),
+  slab(NULL),
+  msgs(NULL),
+  iovs(NULL),
+  addrs(NULL),
+  control(NULL),
+  controlSize(CONTROL_SIZE),
+  times(NULL),
+  index(NULL),
+  count(0),
+  used(0),
+  packetsReceived(0),
+  bytesReceived(0),
+  batchCount(0),
+  invalidCount(0),
+  truncatedCount(0),
+  droppedCount(0)
+{
+  if ((port < 0) || (port > 65535)) {
+    throw VRTException("Invalid port number %d", port);
+  }
+  if (batchSize < 1) {
+    throw VRTException("Invalid batch size %d", batchSize);
+  }
+  if ((bufferSize < 4) || ((bufferSize % 4) != 0)) {
+    throw VRTException("Invalid buffer size %d, must be a positive multiple of 4", bufferSize);
+  }
+
+  // ---- Open and bind the socket -------------------------------------------
+  struct sockaddr_storage local;
+  socklen_t               localLen;
+  memset(&local, 0, sizeof(local));
+
+  InetAddress addr = (isNull(host))? InetAddress("0.0.0.0") : InetAddress(host);
+  if (addr.isIPv4()) {
+    struct sockaddr_in *sin = (struct sockaddr_in*)&local;
+    sin->sin_family = AF_INET;
+    sin->sin_port   = htons((uint16_t)port);
+    sin->sin_addr   = addr.toIPv4();
+    family          = AF_INET;
+    localLen        = sizeof(struct sockaddr_in);
+  }
+  else {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&local;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port   = htons((uint16_t)port);
+    sin6->sin6_addr   = addr.toIPv6();
+    family            = AF_INET6;
+    localLen          = sizeof(struct sockaddr_in6);
+  }
+
+  sock = socket(family, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    throw VRTException("Unable to open UDP socket: %s", ERRNO_STR);
+  }
+
+  int on = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); // allow multiple listeners
+  if (timestamps && (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0)) {
+    int err = errno;
+    ::close(sock);
+    sock = -1;
+    throw VRTException("Unable to enable SO_TIMESTAMPNS: %s", strerror(err));
+  }
+#ifdef SO_RXQ_OVFL
+  setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)); // optional, ignore errors
+#endif
+
+  if (bind(sock, (struct sockaddr*)&local, localLen) != 0) {
+    int err = errno;
+    ::close(sock);
+    sock = -1;
+    throw VRTException("Unable to bind UDP socket to %s port %d: %s",
+                       addr.getHostAddress().c_str(), port, strerror(err));
+  }
+  if (port == 0) {
+    localLen = sizeof(local);
+    getsockname(sock, (struct sockaddr*)&local, &localLen);
+    port = ntohs((family == AF_INET)? ((struct sockaddr_in* )&local)->sin_port
+                                    : ((struct sockaddr_in6*)&local)->sin6_port);
+  }
+
+  // ---- Allocate the buffers -----------------------------------------------
+  // All of the per-datagram state is allocated up front so nothing is allocated while
+  // receiving. The slab is aligned so each buffer starts on a cache line.
+  void *mem = NULL;
+  if (posix_memalign(&mem, SLAB_ALIGN, (size_t)batchSize * bufferSize) != 0) {
+    ::close(sock);
+    sock = -1;
+    throw VRTException("Unable to allocate %d receive buffers of %d octets", batchSize, bufferSize);
+  }
+  slab    = (char*)mem;
+  msgs    = new struct mmsghdr[batchSize];
+  iovs    = new struct iovec[batchSize];
+  addrs   = new struct sockaddr_storage[batchSize];
+  control = new char[(size_t)batchSize * controlSize];
+  times   = new struct timespec[batchSize];
+  index   = new int32_t[batchSize];
+
+  memset(msgs,    0, sizeof(struct mmsghdr) * batchSize);
+  memset(control, 0, (size_t)batchSize * controlSize);
+  memset(times,   0, sizeof(struct timespec) * batchSize);
+  for (int32_t i = 0; i < batchSize; i++) {
+    iovs[i].iov_base             = &slab[(size_t)i * bufferSize];
+    iovs[i].iov_len              = bufferSize;
+    msgs[i].msg_hdr.msg_iov      = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen   = 1;
+    msgs[i].msg_hdr.msg_name     = &addrs[i];
+    msgs[i].msg_hdr.msg_control  = &control[(size_t)i * controlSize];
+  }
+  used = batchSize;
+  resetHeaders();
+}
+
+UDPPacketReceiver::~UDPPacketReceiver () {
+  close();
+}
+
+string UDPPacketReceiver::toString () const {
+  return Utilities::format("%s: Port=%d BatchSize=%d BufferSize=%d PacketsReceived=%" PRId64
+                           " Invalid=%" PRId64 " Truncated=%" PRId64 " Dropped=%" PRId64,
+                           getClassName().c_str(), port, batchSize, bufferSize, packetsReceived,
+                           invalidCount, truncatedCount, droppedCount);
+}
+
+void UDPPacketReceiver::close () {
+  if (sock >= 0) {
+    ::close(sock);
+    sock = -1;
+  }
+  safe_free(slab);
+  delete[] msgs;    msgs    = NULL;
+  delete[] iovs;    iovs    = NULL;
+  delete[] addrs;   addrs   = NULL;
+  delete[] control; control = NULL;
+  delete[] times;   times   = NULL;
+  delete[] index;   index   = NULL;
+  count = 0;
+  used  = 0;
+}
+
+void UDPPacketReceiver::setReceiveBufferSize (int32_t size) {
+  if (sock < 0) throw VRTException("Receiver is closed");
+  if (size <= 0) throw VRTException("Invalid receive buffer size %d", size);
+
+  int val = size;
+#ifdef SO_RCVBUFFORCE
+  if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &val, sizeof(val)) == 0) return;
+#endif
+  if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) != 0) {
+    throw VRTException("Unable to set receive buffer size to %d: %s", size, ERRNO_STR);
+  }
+}
+
+int32_t UDPPacketReceiver::getReceiveBufferSize () const {
+  if (sock < 0) throw VRTException("Receiver is closed");
+
+  int       val = 0;
+  socklen_t len = sizeof(val);
+  if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, &len) != 0) {
+    throw VRTException("Unable to get receive buffer size: %s", ERRNO_STR);
+  }
+  return val;
+}
+
+void UDPPacketReceiver::joinGroup (const InetAddress &group, const string &device) {
+  changeGroup(group, device, true);
+}
+
+void UDPPacketReceiver::leaveGroup (const InetAddress &group, const string &device) {
+  changeGroup(group, device, false);
+}
+
+void UDPPacketReceiver::changeGroup (const InetAddress &group, const string &device, bool join) {
+  if (sock < 0) throw VRTException("Receiver is closed");
+  if (!group.isMulticastAddress()) {
+    throw VRTException("Can not join %s, it is not a multicast address",
+                       group.getHostAddress().c_str());
+  }
+
+  unsigned int ifindex = getInterfaceIndex(device);
+  int          status;
+
+  if (family == AF_INET) {
+    if (!group.isIPv4()) {
+      throw VRTException("Can not join IPv6 group %s on an IPv4 socket",
+                         group.getHostAddress().c_str());
+    }
+    struct ip_mreqn req;
+    memset(&req, 0, sizeof(req));
+    req.imr_multiaddr = group.toIPv4();
+    req.imr_ifindex   = (int)ifindex;
+    status = setsockopt(sock, IPPROTO_IP, (join)? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP,
+                        &req, sizeof(req));
+  }
+  else {
+    struct ipv6_mreq req;
+    memset(&req, 0, sizeof(req));
+    req.ipv6mr_multiaddr = group.toIPv6();
+    req.ipv6mr_interface = ifindex;
+    status = setsockopt(sock, IPPROTO_IPV6, (join)? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP,
+                        &req, sizeof(req));
+  }
+
+  if (status != 0) {
+    throw VRTException("Unable to %s multicast group %s: %s", (join)? "join" : "leave",
+                       group.getHostAddress().c_str(), ERRNO_STR);
+  }
+}
+
+int32_t UDPPacketReceiver::receive (int32_t timeout) {
+  if (sock < 0) throw VRTException("Receiver is closed");
+
+  resetHeaders();
+  count = 0;
+
+  // Try a non-blocking read first since under load there is almost always something
+  // queued; only fall back to poll(..) when the queue is empty.
+  int n;
+  for (int pass = 0; ; pass++) {
+    n = recvmmsg(sock, msgs, batchSize, MSG_DONTWAIT, NULL);
+    if (n > 0) break;
+    if (n == 0) return 0;
+
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      if (errno == EINTR) return 0;
+      throw VRTException("Error receiving on UDP port %d: %s", port, ERRNO_STR);
+    }
+    if ((timeout == 0) || (pass > 0)) return 0;
+
+    struct pollfd pfd;
+    pfd.fd      = sock;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    int status  = poll(&pfd, 1, timeout);
+    if (status == 0) return 0;
+    if (status < 0) {
+      if (errno == EINTR) return 0;
+      throw VRTException("Error waiting on UDP port %d: %s", port, ERRNO_STR);
+    }
+  }
+
+  used = n;
+  return processBatch(n);
+}
+
+int32_t UDPPacketReceiver::processBatch (int32_t n) {
+  batchCount++;
+  for (int32_t i = 0; i < n; i++) {
+    struct msghdr *hdr = &msgs[i].msg_hdr;
+    int32_t        len = (int32_t)msgs[i].msg_len;
+
+    if (hdr->msg_controllen > 0) {
+      for (struct cmsghdr *c = CMSG_FIRSTHDR(hdr); c != NULL; c = CMSG_NXTHDR(hdr, c)) {
+        if (c->cmsg_level != SOL_SOCKET) continue;
+        if (c->cmsg_type == SCM_TIMESTAMPNS) {
+          memcpy(&times[i], CMSG_DATA(c), sizeof(struct timespec));
+        }
+#ifdef SO_RXQ_OVFL
+        else if (c->cmsg_type == SO_RXQ_OVFL) {
+          uint32_t drops;
+          memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+          droppedCount = drops; // cumulative count for the socket
+        }
+#endif
+      }
+    }
+
+    if ((hdr->msg_flags & MSG_TRUNC) != 0) {
+      truncatedCount++;
+      continue;
+    }
+    if ((len < 4) || (BasicVRTPacket::getPacketLength(&slab[(size_t)i * bufferSize], 0) != len)) {
+      invalidCount++;
+      continue;
+    }
+    index[count++] = i;
+    bytesReceived += len;
+  }
+  packetsReceived += count;
+  return count;
+}
+
+void UDPPacketReceiver::resetHeaders () {
+  // The kernel updates the name/control lengths and flags, so these need to be reset
+  // before reuse, but only for the buffers actually used.
+  for (int32_t i = 0; i < used; i++) {
+    msgs[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr_storage);
+    msgs[i].msg_hdr.msg_controllen = controlSize;
+    msgs[i].msg_hdr.msg_flags      = 0;
+  }
+  used = 0;
+}
+
+int32_t UDPPacketReceiver::msgLength (int32_t b) const {
+  return (int32_t)msgs[b].msg_len;
+}
+
+InetAddress UDPPacketReceiver::getSourceAddress (int32_t i) const {
+  const struct sockaddr_storage *sa = &addrs[index[i]];
+  if (sa->ss_family == AF_INET6) {
+    return InetAddress(((const struct sockaddr_in6*)sa)->sin6_addr);
+  }
+  return InetAddress(((const struct sockaddr_in*)sa)->sin_addr);
+}
+
+int32_t UDPPacketReceiver::getSourcePort (int32_t i) const {
+  const struct sockaddr_storage *sa = &addrs[index[i]];
+  if (sa->ss_family == AF_INET6) {
+    return ntohs(((const struct sockaddr_in6*)sa)->sin6_port);
+  }
+  return ntohs(((const struct sockaddr_in*)sa)->sin_port);
+}
@@ -0,0 +1,440 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "UDPPacketSender.h"
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <string.h>     // for memset(..)
+#include <unistd.h>     // for close(..)
+#include <net/if.h>     // for if_nametoindex(..)
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>    // for struct iovec
+
+#ifndef SOL_UDP
+# define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT 103
+#endif
+
+using namespace vrt;
+
+/** The largest UDP payload for IPv4 and IPv6 (65535 less the IP and/or UDP headers). */
+static const int32_t MAX_UDP_PAYLOAD_IPv4 = 65507;
+static const int32_t MAX_UDP_PAYLOAD_IPv6 = 65527;
+
+/** Space for the control message used with each segmented send. */
+static const int32_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> One of the destinations in a {@link UDPPacketSender}. */
+  class SenderDestination {
+    public: InetAddress  host;       // The destination address
+    public: int32_t      port;       // The destination port
+    public: vector<int>  sockets;    // The socket pool
+    public: int32_t      maxPayload; // Max UDP payload for a segmented send
+    public: bool         segmented;  // Use segmentation offload?
+
+    public: SenderDestination (const InetAddress &host, int32_t port) :
+      host(host),
+      port(port),
+      sockets(),
+      maxPayload((host.isIPv4())? MAX_UDP_PAYLOAD_IPv4 : MAX_UDP_PAYLOAD_IPv6),
+      segmented(false)
+    {
+      // done
+    }
+
+    public: ~SenderDestination () {
+      for (size_t i = 0; i < sockets.size(); i++) {
+        ::close(sockets[i]);
+      }
+    }
+
+    // The sockets are owned by this instance.
+    private: SenderDestination (const SenderDestination &d);
+    private: SenderDestination& operator= (const SenderDestination &d);
+  };
+} END_NAMESPACE
+
+UDPPacketSender::UDPPacketSender (int32_t _batchSize, bool _gso) :
+  dests(),
+  batchSize(_batchSize),
+  gso(_gso),
+  sendBufferSize(0),
+  msgs(NULL),
+  iovs(NULL),
+  segs(NULL),
+  control(NULL),
+  packetsSent(0),
+  bytesSent(0),
+  callCount(0),
+  segmentedCount(0),
+  errorCount(0),
+  lastError(0)
+{
+  if ((batchSize < 1) || (batchSize > 1024)) { // 1024 = UIO_MAXIOV
+    throw VRTException("Invalid batch size %d", batchSize);
+  }
+  msgs    = new struct mmsghdr[batchSize];
+  iovs    = new struct iovec[batchSize * MAX_SEGMENTS];
+  segs    = new int32_t[batchSize];
+  control = new char[(size_t)batchSize * CONTROL_SIZE];
+  memset(msgs,    0, sizeof(struct mmsghdr) * batchSize);
+  memset(control, 0, (size_t)batchSize * CONTROL_SIZE);
+
+  // The control message is the same for every segmented send, other than the
+  // segment size, so set it up now.
+  for (int32_t i = 0; i < batchSize; i++) {
+    struct msghdr  *hdr = &msgs[i].msg_hdr;
+    hdr->msg_control    = &control[(size_t)i * CONTROL_SIZE];
+    hdr->msg_controllen = CONTROL_SIZE;
+    struct cmsghdr *c   = CMSG_FIRSTHDR(hdr);
+    c->cmsg_level       = SOL_UDP;
+    c->cmsg_type        = UDP_SEGMENT;
+    c->cmsg_len         = CMSG_LEN(sizeof(uint16_t));
+  }
+}
+
+UDPPacketSender::~UDPPacketSender () {
+  close();
+  delete[] msgs;
+  delete[] iovs;
+  delete[] segs;
+  delete[] control;
+}
+
+string UDPPacketSender::toString () const {
+  return Utilities::format("%s: NumDestinations=%d BatchSize=%d PacketsSent=%" PRId64
+                           " Segmented=%" PRId64 " Errors=%" PRId64,
+                           getClassName().c_str(), getNumDestinations(), batchSize,
+                           packetsSent, segmentedCount, errorCount);
+}
+
+void UDPPacketSender::close () {
+  for (size_t i = 0; i < dests.size(); i++) {
+    delete dests[i];
+  }
+  dests.clear();
+}
+
+int32_t UDPPacketSender::addDestination (const InetAddress &host, int32_t port, int32_t numSockets,
+                                         const string &device, int32_t ttl) {
+  if ((port <= 0) || (port > 65535)) {
+    throw VRTException("Invalid port number %d", port);
+  }
+  if (numSockets < 1) {
+    throw VRTException("Invalid number of sockets %d", numSockets);
+  }
+
+  struct sockaddr_storage remote;
+  socklen_t               remoteLen;
+  int                     family;
+  memset(&remote, 0, sizeof(remote));
+
+  if (host.isIPv4()) {
+    struct sockaddr_in *sin = (struct sockaddr_in*)&remote;
+    sin->sin_family = AF_INET;
+    sin->sin_port   = htons((uint16_t)port);
+    sin->sin_addr   = host.toIPv4();
+    family          = AF_INET;
+    remoteLen       = sizeof(struct sockaddr_in);
+  }
+  else {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&remote;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port   = htons((uint16_t)port);
+    sin6->sin6_addr   = host.toIPv6();
+    family            = AF_INET6;
+    remoteLen         = sizeof(struct sockaddr_in6);
+  }
+
+  bool         mcast   = host.isMulticastAddress();
+  unsigned int ifindex = 0;
+  if (mcast && !isNull(device)) {
+    ifindex = if_nametoindex(device.c_str());
+    if (ifindex == 0) {
+      throw VRTException("Unknown network device '%s': %s", device.c_str(), ERRNO_STR);
+    }
+  }
+
+  SenderDestination *d = new SenderDestination(host, port);
+  try {
+    for (int32_t i = 0; i < numSockets; i++) {
+      int sock = socket(family, SOCK_DGRAM, 0);
+      if (sock < 0) {
+        throw VRTException("Unable to open UDP socket: %s", ERRNO_STR);
+      }
+      d->sockets.push_back(sock);
+      setSocketOptions(sock);
+
+      int status = 0;
+      if (family == AF_INET) {
+        if (mcast && (ifindex != 0)) {
+          struct ip_mreqn req;
+          memset(&req, 0, sizeof(req));
+          req.imr_ifindex = (int)ifindex;
+          status = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &req, sizeof(req));
+        }
+        if ((status == 0) && (ttl >= 0)) {
+          int val = ttl;
+          status = setsockopt(sock, IPPROTO_IP, (mcast)? IP_MULTICAST_TTL : IP_TTL,
+                              &val, sizeof(val));
+        }
+      }
+      else {
+        if (mcast && (ifindex != 0)) {
+          int val = (int)ifindex;
+          status = setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &val, sizeof(val));
+        }
+        if ((status == 0) && (ttl >= 0)) {
+          int val = ttl;
+          status = setsockopt(sock, IPPROTO_IPV6, (mcast)? IPV6_MULTICAST_HOPS : IPV6_UNICAST_HOPS,
+                              &val, sizeof(val));
+        }
+      }
+      if (status != 0) {
+        throw VRTException("Unable to set socket options for %s port %d: %s",
+                           host.getHostAddress().c_str(), port, ERRNO_STR);
+      }
+
+      // Connecting the socket saves a route lookup on every send
+      if (connect(sock, (struct sockaddr*)&remote, remoteLen) != 0) {
+        throw VRTException("Unable to connect UDP socket to %s port %d: %s",
+                           host.getHostAddress().c_str(), port, ERRNO_STR);
+      }
+    }
+
+    // Check that segmentation offload is supported (ENOPROTOOPT if not)
+    if (gso) {
+      int       val = 0;
+      socklen_t len = sizeof(val);
+      d->segmented = (getsockopt(d->sockets[0], SOL_UDP, UDP_SEGMENT, &val, &len) == 0);
+    }
+  }
+  catch (VRTException e) {
+    delete d;
+    throw e;
+  }
+
+  dests.push_back(d);
+  return (int32_t)dests.size() - 1;
+}
+
+bool UDPPacketSender::isSegmented (int32_t dest) const {
+  if ((dest < 0) || (dest >= (int32_t)dests.size())) {
+    throw VRTException("Invalid destination number %d", dest);
+  }
+  return dests[dest]->segmented;
+}
+
+void UDPPacketSender::setSendBufferSize (int32_t size) {
+  if (size <= 0) throw VRTException("Invalid send buffer size %d", size);
+
+  sendBufferSize = size;
+  for (size_t i = 0; i < dests.size(); i++) {
+    for (size_t j = 0; j < dests[i]->sockets.size(); j++) {
+      setSocketOptions(dests[i]->sockets[j]);
+    }
+  }
+}
+
+void UDPPacketSender::setSocketOptions (int sock) {
+  if (sendBufferSize <= 0) return;
+
+  int val = sendBufferSize;
+#ifdef SO_SNDBUFFORCE
+  if (setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &val, sizeof(val)) == 0) return;
+#endif
+  if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) != 0) {
+    throw VRTException("Unable to set send buffer size to %d: %s", sendBufferSize, ERRNO_STR);
+  }
+}
+
+int UDPPacketSender::getSocket (int32_t dest, uint32_t key) const {
+  if ((dest < 0) || (dest >= (int32_t)dests.size())) return -1;
+  const vector<int> &pool = dests[dest]->sockets;
+  return (pool.size() == 1)? pool[0] : pool[key % pool.size()];
+}
+
+int32_t UDPPacketSender::send (int32_t dest, const BasicVRTPacket *const *packets, int32_t n,
+                               uint32_t key) {
+  int sock = getSocket(dest, key);
+  if (sock < 0) {
+    errorCount += n;
+    lastError   = EINVAL;
+    return 0;
+  }
+
+  int32_t sent = 0;
+  int32_t stage = batchSize * MAX_SEGMENTS;
+  for (int32_t i = 0; i < n; i += stage) {
+    int32_t count = min(stage, n - i);
+    for (int32_t j = 0; j < count; j++) {
+      const BasicVRTPacket *p = packets[i+j];
+      iovs[j].iov_base = (void*)&p->bbuf[0];
+      iovs[j].iov_len  = p->getPacketLength();
+    }
+    sent += sendVectors(dests[dest], sock, iovs, count);
+  }
+  return sent;
+}
+
+int32_t UDPPacketSender::send (int32_t dest, const BasicVRLFrame *const *frames, int32_t n,
+                               uint32_t key) {
+  int sock = getSocket(dest, key);
+  if (sock < 0) {
+    errorCount += n;
+    lastError   = EINVAL;
+    return 0;
+  }
+
+  int32_t sent = 0;
+  int32_t stage = batchSize * MAX_SEGMENTS;
+  for (int32_t i = 0; i < n; i += stage) {
+    int32_t count = min(stage, n - i);
+    for (int32_t j = 0; j < count; j++) {
+      const BasicVRLFrame *f = frames[i+j];
+      iovs[j].iov_base = (void*)&f->bbuf[0];
+      iovs[j].iov_len  = f->getFrameLength();
+    }
+    sent += sendVectors(dests[dest], sock, iovs, count);
+  }
+  return sent;
+}
+
+int32_t UDPPacketSender::send (int32_t dest, const struct iovec *iov, int32_t n, uint32_t key) {
+  int sock = getSocket(dest, key);
+  if (sock < 0) {
+    errorCount += n;
+    lastError   = EINVAL;
+    return 0;
+  }
+
+  return sendVectors(dests[dest], sock, iov, n);
+}
+
+bool UDPPacketSender::send (int32_t dest, const void *ptr, int32_t len, uint32_t key) {
+  int sock = getSocket(dest, key);
+  if (sock < 0) {
+    errorCount++;
+    lastError = EINVAL;
+    return false;
+  }
+
+  callCount++;
+  if (::send(sock, ptr, len, 0) < 0) {
+    errorCount++;
+    lastError = errno;
+    return false;
+  }
+  packetsSent++;
+  bytesSent += len;
+  return true;
+}
+
+int32_t UDPPacketSender::sendVectors (SenderDestination *d, int sock, const struct iovec *iov,
+                                      int32_t n) {
+  int32_t sent = 0; // packets sent
+  int32_t next = 0; // next packet to put in a message
+
+  while (next < n) {
+    // ---- Build the messages ------------------------------------------------
+    // With segmentation offload each run of same-length packets (up to the UDP
+    // payload limit) goes in one message with one vector per packet, otherwise each
+    // packet is its own message.
+    int32_t first   = next;
+    int32_t numMsgs = 0;
+    while ((next < n) && (numMsgs < batchSize)) {
+      size_t  len = iov[next].iov_len;
+      int32_t end = next + 1;
+
+      if (d->segmented) {
+        int32_t maxSegs = MAX_SEGMENTS; // copy since min(..) takes a reference
+        maxSegs = min(maxSegs, (int32_t)(d->maxPayload / max(len, (size_t)1)));
+        while ((end < n) && (end - next < maxSegs) && (iov[end].iov_len == len)) {
+          end++;
+        }
+      }
+
+      struct msghdr *hdr = &msgs[numMsgs].msg_hdr;
+      hdr->msg_iov    = (struct iovec*)&iov[next];
+      hdr->msg_iovlen = end - next;
+      if (end - next > 1) {
+        uint16_t segSize    = (uint16_t)len;
+        hdr->msg_control    = &control[(size_t)numMsgs * CONTROL_SIZE];
+        hdr->msg_controllen = CONTROL_SIZE;
+        memcpy(CMSG_DATA(CMSG_FIRSTHDR(hdr)), &segSize, sizeof(segSize));
+      }
+      else {
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+      }
+      segs[numMsgs++] = end - next;
+      next = end;
+    }
+
+    // ---- Send them -----------------------------------------------------------
+    int32_t done = 0;     // messages done (sent or failed)
+    int32_t pkts = first; // packets done (sent or failed)
+
+    while (done < numMsgs) {
+      callCount++;
+      int status = sendmmsg(sock, &msgs[done], numMsgs - done, 0);
+
+      if (status > 0) {
+        for (int32_t m = done; m < done + status; m++) {
+          const struct msghdr *hdr = &msgs[m].msg_hdr;
+          for (size_t v = 0; v < hdr->msg_iovlen; v++) {
+            bytesSent += hdr->msg_iov[v].iov_len;
+          }
+          if (segs[m] > 1) segmentedCount++;
+          sent += segs[m];
+          pkts += segs[m];
+        }
+        done += status;
+        continue;
+      }
+
+      int err = errno;
+      if (err == EINTR) continue;
+
+      if ((segs[done] > 1) && ((err == EINVAL) || (err == EIO) || (err == EMSGSIZE))) {
+        // Segmented send rejected (e.g. segment larger than the MTU or no checksum
+        // offload on the device), switch it off and re-send the rest individually
+        d->segmented = false;
+        packetsSent += sent;
+        return sent + sendVectors(d, sock, &iov[pkts], n - pkts);
+      }
+
+      // Skip the failed message (e.g. ECONNREFUSED reported for an earlier send or
+      // EMSGSIZE for an oversized packet) and carry on with the rest
+      errorCount += segs[done];
+      lastError   = err;
+      pkts       += segs[done];
+      done++;
+    }
+  }
+
+  packetsSent += sent;
+  return sent;
+}
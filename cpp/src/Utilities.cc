@@ -100,6 +100,16 @@ int64_t Utilities::currentTimeMillis () {
   return (sec * __INT64_C(1000)) + (ps / __INT64_C(1000000000));
 }
 
+int64_t Utilities::monotonicTimeMillis () {
+#if _POSIX_C_SOURCE >= 199309L
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#else
+  return currentTimeMillis();
+#endif
+}
+
 /** Calls the applicable sleep command. flags=0 is normal (sleep for a given
  *  duration) and flags=TIMER_ABSTIME is to sleep until a given system time.
  */
@@ -0,0 +1,288 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRAIndex.h"
+#include "AbstractVRAFile.h"
+#include <errno.h>    // Required when using errno / ERRNO_STR
+#include <string.h>   // for memcmp(..)
+
+using namespace vrt;
+
+const string VRAIndex::FILE_NAME_EXT = ".idx";
+
+static const char    INDEX_FAW[4]  = { 'V','R','A','I' };
+static const int8_t  INDEX_VERSION = 1;
+
+VRAIndex::VRAIndex (int32_t interval) :
+  interval(interval),
+  coveredLength(AbstractVRAFile::HEADER_LENGTH),
+  entries(),
+  keys(),
+  timed(),
+  byStream(),
+  counts(),
+  fname(""),
+  out(NULL)
+{
+  if (interval < 1) throw VRTException("Invalid index interval %d", interval);
+}
+
+VRAIndex::~VRAIndex () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // can't throw from destructor
+  }
+}
+
+string VRAIndex::toString () const {
+  return Utilities::format("%s: Interval=%d Entries=%d Streams=%d CoveredLength=%" PRId64,
+                           getClassName().c_str(), interval, (int32_t)entries.size(),
+                           (int32_t)byStream.size(), coveredLength);
+}
+
+void VRAIndex::clear () {
+  entries.clear();
+  keys.clear();
+  timed.clear();
+  byStream.clear();
+  counts.clear();
+  coveredLength = AbstractVRAFile::HEADER_LENGTH;
+}
+
+bool VRAIndex::add (int64_t offset, const VRTPacketView &p) {
+  int64_t end = offset + p.getPacketLength();
+  if (end > coveredLength) coveredLength = end;
+
+  if (interval > 1) {
+    int32_t &n   = counts[p.getStreamCode()];
+    bool     rec = (n == 0);
+    n = (n+1 == interval)? 0 : n+1;
+    if (!rec) return false;
+  }
+
+  VRAIndexEntry e;
+  e.offset     = offset;
+  e.classID    = p.getClassIdentifier();
+  e.tsf        = p.getTimeStampFractional();
+  e.tsi        = p.getTimeStampInteger();
+  e.streamID   = p.getStreamIdentifier();
+  e.packetType = (int8_t)p.getPacketType();
+  e.tsiMode    = (int8_t)p.getIntegerMode();
+  e.tsfMode    = (int8_t)p.getFractionalMode();
+  addEntry(e);
+
+  if (out != NULL) writeEntry(out, e);
+  return true;
+}
+
+bool VRAIndex::getTimeKey (IntegerMode tsiMode, FractionalMode tsfMode,
+                           uint32_t tsi, uint64_t tsf, TimeKey &key) {
+  if ((tsiMode != IntegerMode_UTC) && (tsiMode != IntegerMode_GPS)) return false;
+
+  try {
+    TimeStamp t(tsiMode, FractionalMode_None, tsi, 0);
+    key.first  = t.getGPSSeconds();
+    key.second = (tsfMode == FractionalMode_RealTime)? tsf : 0;
+    return true;
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e); // e.g. UTC time before 1972
+    return false;
+  }
+}
+
+void VRAIndex::addEntry (const VRAIndexEntry &e) {
+  int32_t i = (int32_t)entries.size();
+  TimeKey key(0, 0);
+  entries.push_back(e);
+
+  if (getTimeKey((IntegerMode)e.tsiMode, (FractionalMode)e.tsfMode, e.tsi, e.tsf, key)) {
+    timed.push_back(i);
+    byStream[e.streamID].push_back(i);
+  }
+  keys.push_back(key);
+}
+
+void VRAIndex::writeHeader (FILE *f) const {
+  char buf[HEADER_LENGTH];
+  memset(buf, 0, HEADER_LENGTH);
+  memcpy(buf, INDEX_FAW, 4);
+  buf[4] = INDEX_VERSION;
+  VRTMath::packInt(buf, 8, interval);
+  VRTMath::packLong(buf, 16, coveredLength);
+
+  if (fwrite(buf, 1, HEADER_LENGTH, f) != (size_t)HEADER_LENGTH) {
+    throw VRTException("Unable to write index header to %s: %s", fname.c_str(), ERRNO_STR);
+  }
+}
+
+void VRAIndex::writeEntry (FILE *f, const VRAIndexEntry &e) const {
+  char buf[ENTRY_LENGTH];
+  VRTMath::packLong(buf,  0, e.offset);
+  VRTMath::packLong(buf,  8, e.classID);
+  VRTMath::packULong(buf, 16, e.tsf);
+  VRTMath::packUInt(buf, 24, e.tsi);
+  VRTMath::packInt(buf,  28, e.streamID);
+  buf[32] = e.packetType;
+  buf[33] = e.tsiMode;
+  buf[34] = e.tsfMode;
+  memset(&buf[35], 0, 5);
+
+  if (fwrite(buf, 1, ENTRY_LENGTH, f) != (size_t)ENTRY_LENGTH) {
+    throw VRTException("Unable to write index entry to %s: %s", fname.c_str(), ERRNO_STR);
+  }
+}
+
+void VRAIndex::read (const string &fname) {
+  FILE *f = fopen(fname.c_str(), "rb");
+  if (f == NULL) {
+    throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+  }
+
+  try {
+    char hdr[HEADER_LENGTH];
+    if ((fread(hdr, 1, HEADER_LENGTH, f) != (size_t)HEADER_LENGTH) ||
+        (memcmp(hdr, INDEX_FAW, 4) != 0) || (hdr[4] != INDEX_VERSION)) {
+      throw VRTException("Invalid index file %s", fname.c_str());
+    }
+    int32_t _interval = VRTMath::unpackInt(hdr, 8);
+    int64_t _covered  = VRTMath::unpackLong(hdr, 16);
+    if (_interval < 1) {
+      throw VRTException("Invalid index file %s", fname.c_str());
+    }
+
+    clear();
+    interval      = _interval;
+    coveredLength = _covered;
+
+    char   buf[ENTRY_LENGTH*1024];
+    size_t n;
+    while ((n = fread(buf, ENTRY_LENGTH, 1024, f)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        const char   *b = &buf[i*ENTRY_LENGTH];
+        VRAIndexEntry e;
+        e.offset     = VRTMath::unpackLong(b, 0);
+        e.classID    = VRTMath::unpackLong(b, 8);
+        e.tsf        = VRTMath::unpackULong(b, 16);
+        e.tsi        = VRTMath::unpackUInt(b, 24);
+        e.streamID   = VRTMath::unpackInt(b, 28);
+        e.packetType = b[32];
+        e.tsiMode    = b[33];
+        e.tsfMode    = b[34];
+
+        // Skip any entries not covered by the header (sidecar not closed cleanly)
+        if (e.offset < coveredLength) addEntry(e);
+      }
+    }
+    if (ferror(f)) {
+      throw VRTException("Error reading from %s", fname.c_str());
+    }
+  }
+  catch (VRTException e) {
+    fclose(f);
+    throw e;
+  }
+  fclose(f);
+}
+
+void VRAIndex::write (const string &fname) {
+  close();
+  startWriting(fname);
+  close();
+}
+
+void VRAIndex::startWriting (const string &fname) {
+  close();
+
+  FILE *f = fopen(fname.c_str(), "wb");
+  if (f == NULL) {
+    throw VRTException("Unable to open %s: %s", fname.c_str(), ERRNO_STR);
+  }
+  this->fname = fname;
+  this->out   = f;
+
+  writeHeader(out);
+  for (size_t i = 0; i < entries.size(); i++) {
+    writeEntry(out, entries[i]);
+  }
+}
+
+void VRAIndex::flush () {
+  if (out == NULL) return;
+
+  // Entries must reach the file before the header claims to cover them
+  if ((fflush(out) != 0) || (fseek(out, 0, SEEK_SET) != 0)) {
+    throw VRTException("Unable to flush %s: %s", fname.c_str(), ERRNO_STR);
+  }
+  writeHeader(out);
+  if ((fflush(out) != 0) || (fseek(out, 0, SEEK_END) != 0)) {
+    throw VRTException("Unable to flush %s: %s", fname.c_str(), ERRNO_STR);
+  }
+}
+
+void VRAIndex::close () {
+  if (out == NULL) return;
+
+  try {
+    flush();
+  }
+  catch (VRTException e) {
+    fclose(out);
+    out = NULL;
+    throw e;
+  }
+  if (fclose(out) != 0) {
+    out = NULL;
+    throw VRTException("Unable to close %s: %s", fname.c_str(), ERRNO_STR);
+  }
+  out = NULL;
+}
+
+int64_t VRAIndex::seek (const TimeStamp &ts) const {
+  return seek(timed, ts);
+}
+
+int64_t VRAIndex::seek (int32_t streamID, const TimeStamp &ts) const {
+  map<int32_t,vector<int32_t> >::const_iterator it = byStream.find(streamID);
+  if (it == byStream.end()) return NOT_FOUND;
+  return seek(it->second, ts);
+}
+
+int64_t VRAIndex::seek (const vector<int32_t> &list, const TimeStamp &ts) const {
+  TimeKey key;
+  if (list.empty() || isNull(ts)) return NOT_FOUND;
+  if (!getTimeKey(ts.getIntegerMode(), ts.getFractionalMode(), ts.getTimeStampInteger(),
+                  ts.getTimeStampFractional(), key)) return NOT_FOUND;
+
+  // Binary search for the first entry at or after the time stamp, then step back one
+  // since packets before that entry (e.g. other streams, or ones not indexed) may
+  // share its time stamp; the caller scans forward from there
+  size_t lo = 0;
+  size_t hi = list.size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (keys[list[mid]] < key) lo = mid + 1;
+    else                       hi = mid;
+  }
+  return entries[list[(lo == 0)? 0 : lo-1]].offset;
+}
@@ -0,0 +1,254 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRAMergeReader.h"
+#include <string.h>   // for memcpy(..)
+#include <algorithm>  // for push_heap(..) / pop_heap(..)
+
+using namespace vrt;
+
+/** Read-ahead window used for a VRA file that does not have one set (64 KiB). */
+static const int32_t DEFAULT_WINDOW = 65536;
+
+namespace vrt {
+  /** <b>Internal Use Only:</b> One of the sources in a {@link VRAMergeReader}, along
+   *  with its pending packet.
+   */
+  class MergeSource {
+    public: const PacketContainer *container; // The source
+    public: const AbstractVRAFile *file;      // The source, if a VRA file (NULL if n/a)
+    public: PacketReadAhead       *ahead;     // Read-ahead window (VRA file only)
+    public: int64_t                offset;    // Offset of the next packet (VRA file only)
+    public: int64_t                end;       // End of the file (VRA file only)
+    public: ConstPacketIterator   *it;        // Iterator (other containers only)
+    public: ConstPacketIterator   *itEnd;     // End of iterator (other containers only)
+    public: BasicVRTPacket        *packet;    // The pending packet (other containers only)
+    public: const char            *ptr;       // The pending packet (NULL if none)
+    public: int32_t                len;       // Length of the pending packet
+    public: int64_t                seconds;   // Integer time of the pending packet
+    public: uint64_t               picos;     // Fractional time of the pending packet
+    public: bool                   timed;     // Has a time stamped packet been seen?
+
+    public: MergeSource (const PacketContainer &src) :
+      container(&src),
+      file(dynamic_cast<const AbstractVRAFile*>(&src)),
+      ahead(NULL),
+      offset(AbstractVRAFile::HEADER_LENGTH),
+      end(0),
+      it(NULL),
+      itEnd(NULL),
+      packet(NULL),
+      ptr(NULL),
+      len(0),
+      seconds(0),
+      picos(0),
+      timed(false)
+    {
+      // done
+    }
+
+    public: ~MergeSource () {
+      safe_delete(ahead);
+      safe_delete(it);
+      safe_delete(itEnd);
+      safe_delete(packet);
+    }
+
+    /** Moves on to the next packet, returns false if there is none. */
+    public: bool next () {
+      ptr = NULL;
+      len = 0;
+
+      if (file != NULL) {
+        if (ahead == NULL) {
+          int32_t size = file->getReadAhead();
+          ahead = new PacketReadAhead(file, (size > 0)? size : DEFAULT_WINDOW,
+                                      file->isPrefetch());
+          end   = file->getFileLength();
+        }
+        if (offset >= end) return false;
+
+        const char *hdr = ahead->get(offset, 4);
+        int32_t     n   = (hdr == NULL)? 0 : BasicVRTPacket::getPacketLength(hdr, 0);
+        if ((n < 4) || ((ptr = ahead->get(offset, n)) == NULL)) {
+          throw VRTException("Error reading from %s at %" PRId64, file->toString().c_str(), offset);
+        }
+        len     = n;
+        offset += n;
+        return true;
+      }
+
+      if (it == NULL) {
+        it    = new ConstPacketIterator(container->begin());
+        itEnd = new ConstPacketIterator(container->end());
+      }
+      else {
+        safe_delete(packet);
+        ++(*it);
+      }
+      if (*it == *itEnd) return false;
+
+      packet = container->getThisPacket(*it, false);
+      ptr    = &packet->bbuf[0];
+      len    = packet->getPacketLength();
+      return true;
+    }
+
+    // The read-ahead window, iterators and packet are owned by this instance.
+    private: MergeSource (const MergeSource &s);
+    private: MergeSource& operator= (const MergeSource &s);
+  };
+
+  /** Orders the heap in a {@link VRAMergeReader} so the earliest packet is first. */
+  struct MergeAfter {
+    const VRAMergeReader *reader;
+    bool (VRAMergeReader::*after)(int32_t,int32_t) const;
+
+    inline bool operator() (int32_t a, int32_t b) const {
+      return (reader->*after)(a, b);
+    }
+  };
+} END_NAMESPACE
+
+VRAMergeReader::VRAMergeReader () :
+  sources(),
+  heap(),
+  started(false),
+  current(-1),
+  tsiMode(-1),
+  packetsRead(0)
+{
+  // done
+}
+
+VRAMergeReader::~VRAMergeReader () {
+  for (size_t i = 0; i < sources.size(); i++) {
+    delete sources[i];
+  }
+}
+
+string VRAMergeReader::toString () const {
+  return Utilities::format("%s: NumSources=%d PacketsRead=%" PRId64,
+                           getClassName().c_str(), getNumSources(), packetsRead);
+}
+
+void VRAMergeReader::addSource (const PacketContainer &src) {
+  if (started) {
+    throw VRTException("Can not add a source to %s after reading has started",
+                       getClassName().c_str());
+  }
+  sources.push_back(new MergeSource(src));
+}
+
+bool VRAMergeReader::next (VRTPacketView &p) {
+  if (!started) {
+    started = true;
+    heap.reserve(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+      advance((int32_t)i);
+    }
+  }
+  else if (current >= 0) {
+    // The previous packet is no longer needed, so its source can move on
+    advance(current);
+  }
+
+  if (heap.empty()) {
+    current = -1;
+    return false;
+  }
+
+  MergeAfter cmp = { this, &VRAMergeReader::isAfter };
+  pop_heap(heap.begin(), heap.end(), cmp);
+  current = heap.back();
+  heap.pop_back();
+
+  p = VRTPacketView(sources[current]->ptr, sources[current]->len);
+  packetsRead++;
+  return true;
+}
+
+int64_t VRAMergeReader::writeTo (AbstractVRAFile &out, int32_t blockSize) {
+  if (blockSize < BasicVRTPacket::MAX_PACKET_LENGTH) {
+    throw VRTException("Invalid block size %d, must be at least %d", blockSize,
+                       BasicVRTPacket::MAX_PACKET_LENGTH);
+  }
+
+  vector<char>  block(blockSize);
+  int32_t       used  = 0;
+  int64_t       count = 0;
+  VRTPacketView p;
+
+  while (next(p)) {
+    int32_t len = p.getPacketLength();
+    if (used + len > blockSize) {
+      out.appendPackets(&block[0], used);
+      used = 0;
+    }
+    memcpy(&block[used], p.getPacketPointer(), len);
+    used += len;
+    count++;
+  }
+  if (used > 0) {
+    out.appendPackets(&block[0], used);
+  }
+  return count;
+}
+
+void VRAMergeReader::advance (int32_t src) {
+  MergeSource *s = sources[src];
+  if (!s->next()) return;
+
+  VRTPacketView v(s->ptr, s->len);
+  IntegerMode   mode = v.getIntegerMode();
+  if (mode != IntegerMode_None) {
+    uint32_t tsi   = v.getTimeStampInteger();
+    uint64_t tsf   = v.getTimeStampFractional();
+    bool     ps    = (v.getFractionalMode() == FractionalMode_RealTime);
+
+    if (tsiMode < 0) {
+      tsiMode = (int32_t)mode;
+    }
+    else if ((tsiMode != (int32_t)mode) && (mode != IntegerMode_Other)
+                                        && (tsiMode != IntegerMode_Other)) {
+      // UTC vs GPS, convert to the mode used for comparisons
+      TimeStamp ts = v.getTimeStamp();
+      ts  = (tsiMode == IntegerMode_GPS)? ts.toGPS() : ts.toUTC();
+      tsi = ts.getTimeStampInteger();
+    }
+    s->seconds = (int64_t)tsi;
+    s->picos   = (ps)? tsf : 0;
+    s->timed   = true;
+  }
+
+  MergeAfter cmp = { this, &VRAMergeReader::isAfter };
+  heap.push_back(src);
+  push_heap(heap.begin(), heap.end(), cmp);
+}
+
+bool VRAMergeReader::isAfter (int32_t a, int32_t b) const {
+  const MergeSource *x = sources[a];
+  const MergeSource *y = sources[b];
+  if (x->timed   != y->timed  ) return x->timed;   // untimed sorts first
+  if (x->seconds != y->seconds) return (x->seconds > y->seconds);
+  if (x->picos   != y->picos  ) return (x->picos   > y->picos  );
+  return (a > b);
+}
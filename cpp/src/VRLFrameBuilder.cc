@@ -0,0 +1,138 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRLFrameBuilder.h"
+#include <limits.h>   // for IOV_MAX
+#include <string.h>   // for memcpy(..)
+
+using namespace std;
+using namespace vrt;
+
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
+VRLFrameBuilder::VRLFrameBuilder (int32_t maxFrameLength, bool crc) :
+  maxFrameLength(maxFrameLength),
+  crc(crc),
+  done(false),
+  frameCount(0),
+  frameLength(BasicVRLFrame::MIN_FRAME_LENGTH),
+  payloadCRC(0),
+  iov()
+{
+  if ((maxFrameLength < BasicVRLFrame::MIN_FRAME_LENGTH + 4) ||
+      (maxFrameLength > BasicVRLFrame::MAX_FRAME_LENGTH)) {
+    throw VRTException("Illegal max frame length given (%d)", maxFrameLength);
+  }
+  iov.reserve(64);
+  iov.push_back(iovec());
+  iov[0].iov_base = header;
+  iov[0].iov_len  = BasicVRLFrame::HEADER_LENGTH;
+}
+
+string VRLFrameBuilder::toString () const {
+  return Utilities::format("%s: FrameCount=%d PacketCount=%d FrameLength=%d MaxFrameLength=%d",
+                           getClassName().c_str(), frameCount, getPacketCount(),
+                           frameLength, maxFrameLength);
+}
+
+bool VRLFrameBuilder::addPacket (const void *ptr, int32_t len) {
+  const char *buf = (const char*)ptr;
+  if ((len < 4) || ((len & 0x3) != 0)) {
+    throw VRTException("Invalid packet length %d", len);
+  }
+  if (BasicVRTPacket::getPacketLength(buf, 0) != len) {
+    throw VRTException("Packet length %d does not match length in header (%d)",
+                       len, BasicVRTPacket::getPacketLength(buf, 0));
+  }
+  if (BasicVRLFrame::MIN_FRAME_LENGTH + len > maxFrameLength) {
+    throw VRTException("Packet length %d exceeds max frame length (%d)", len, maxFrameLength);
+  }
+
+  if (done) {
+    iov.pop_back(); // remove trailer, frame is being extended
+    done = false;
+  }
+  if ((frameLength + len > maxFrameLength) || ((int32_t)iov.size() + 1 >= IOV_MAX)) {
+    return false;
+  }
+
+  struct iovec v;
+  v.iov_base = const_cast<char*>(buf);
+  v.iov_len  = len;
+  iov.push_back(v);
+
+  if (crc) payloadCRC = VRTMath::crc32(payloadCRC, buf, len);
+  frameLength += len;
+  return true;
+}
+
+void VRLFrameBuilder::setFrameCount (int32_t count) {
+  if ((count < 0) || (count > 0x00000FFF)) {
+    throw VRTException("Invalid frame count %d", count);
+  }
+  frameCount = count;
+}
+
+const vector<struct iovec>& VRLFrameBuilder::getFrame () {
+  if (done) return iov;
+
+  VRTMath::packInt(header, 0, BasicVRLFrame::VRL_FAW);
+  uint32_t word = (((uint32_t)frameCount & 0x00000FFF) << 20)
+                | (((uint32_t)frameLength >> 2) & 0x000FFFFF);
+  VRTMath::packInt(header, 4, (int32_t)word);
+
+  if (crc) {
+    int32_t c = VRTMath::crc32(0, header, BasicVRLFrame::HEADER_LENGTH);
+    c = VRTMath::crc32Combine(c, payloadCRC, frameLength - BasicVRLFrame::MIN_FRAME_LENGTH);
+    VRTMath::packInt(trailer, 0, c);
+  }
+  else {
+    VRTMath::packInt(trailer, 0, BasicVRLFrame::NO_CRC);
+  }
+
+  struct iovec v;
+  v.iov_base = trailer;
+  v.iov_len  = BasicVRLFrame::TRAILER_LENGTH;
+  iov.push_back(v);
+  done = true;
+  return iov;
+}
+
+void VRLFrameBuilder::getFrame (vector<char> &buf) {
+  const vector<struct iovec> &frame = getFrame();
+  buf.resize(frameLength);
+
+  size_t off = 0;
+  for (size_t i = 0; i < frame.size(); i++) {
+    memcpy(&buf[off], frame[i].iov_base, frame[i].iov_len);
+    off += frame[i].iov_len;
+  }
+}
+
+void VRLFrameBuilder::nextFrame () {
+  iov.resize(1); // keep header
+  done        = false;
+  frameCount  = (frameCount + 1) & 0x00000FFF;
+  frameLength = BasicVRLFrame::MIN_FRAME_LENGTH;
+  payloadCRC  = 0;
+}
@@ -0,0 +1,156 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRLFrameScanner.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace vrt;
+
+VRLFrameScanner::VRLFrameScanner (bool checkCRC) :
+  checkCRC(checkCRC),
+  inSync(true),
+  skippedBytes(0),
+  resyncCount(0),
+  framesFound(0)
+{
+  // done
+}
+
+VRLFrameScanner::VRLFrameScanner (const VRLFrameScanner &s) :
+  VRTObject(s), // <-- Used to avoid warnings under GCC with -Wextra turned on
+  checkCRC(s.checkCRC),
+  inSync(s.inSync),
+  skippedBytes(s.skippedBytes),
+  resyncCount(s.resyncCount),
+  framesFound(s.framesFound)
+{
+  // done
+}
+
+string VRLFrameScanner::toString () const {
+  return Utilities::format("%s: CheckCRC=%s FramesFound=%" PRId64 " SkippedBytes=%" PRId64
+                           " ResyncCount=%" PRId64,
+                           getClassName().c_str(), (checkCRC)? "true" : "false",
+                           framesFound, skippedBytes, resyncCount);
+}
+
+void VRLFrameScanner::resetCounters () {
+  skippedBytes = 0;
+  resyncCount  = 0;
+  framesFound  = 0;
+}
+
+int32_t VRLFrameScanner::findFAW (const void *ptr, int32_t len, int32_t off) {
+  const char *buf = (const char*)ptr;
+  int32_t     i   = (off < 0)? 0 : off;
+
+#if defined(__SSE2__)
+  // Compare 16 candidate positions at a time; a FAW starts at position n if
+  // buf[n..n+3] match, so the four compares use loads offset by 0..3.
+  const __m128i faw0 = _mm_set1_epi8(BasicVRLFrame::VRL_FAW_0);
+  const __m128i faw1 = _mm_set1_epi8(BasicVRLFrame::VRL_FAW_1);
+  const __m128i faw2 = _mm_set1_epi8(BasicVRLFrame::VRL_FAW_2);
+  const __m128i faw3 = _mm_set1_epi8(BasicVRLFrame::VRL_FAW_3);
+
+  for (; i+16+3 <= len; i += 16) {
+    __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&buf[i  ]), faw0);
+    __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&buf[i+1]), faw1);
+    __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&buf[i+2]), faw2);
+    __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&buf[i+3]), faw3);
+    int32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3)));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i+4 <= len; i++) {
+    if (BasicVRLFrame::isVRL(buf, i)) return i;
+  }
+  return NOT_FOUND;
+}
+
+bool VRLFrameScanner::isFrameValid (const void *ptr, int32_t len, int32_t off) const {
+  const char *buf   = (const char*)ptr;
+  int32_t     avail = len - off;
+
+  if ((avail < 4) || !BasicVRLFrame::isVRL(buf, off)) return false;
+  if (avail < BasicVRLFrame::HEADER_LENGTH) return true; // can't check yet
+
+  int32_t frameLength = BasicVRLFrame::getFrameLength(buf, off);
+  if (frameLength < BasicVRLFrame::MIN_FRAME_LENGTH) return false;
+
+  // Walk the packets, they must exactly fill the frame (only the part that is
+  // available can be checked if the frame is incomplete)
+  int32_t end = off + frameLength - BasicVRLFrame::TRAILER_LENGTH;
+  int32_t pkt = off + BasicVRLFrame::HEADER_LENGTH;
+  while ((pkt < end) && (pkt+4 <= len)) {
+    int32_t pktLength = BasicVRTPacket::getPacketLength(buf, pkt);
+    if (pktLength < 4) return false;
+    pkt += pktLength;
+  }
+  if (pkt > end) return false;
+  if (off + frameLength > len) return true; // incomplete frame, can't check CRC
+  if (pkt != end) return false;
+
+  if (checkCRC) {
+    int32_t crc = VRTMath::unpackInt(buf, end);
+    if ((crc != BasicVRLFrame::NO_CRC) && (crc != VRTMath::crc32(0, &buf[off], frameLength-4))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int32_t VRLFrameScanner::findFrame (const void *ptr, int32_t len, int32_t off) {
+  int32_t start = (off < 0)? 0 : off;
+  int32_t i     = start;
+
+  while (true) {
+    i = findFAW(ptr, len, i);
+
+    if (i == NOT_FOUND) {
+      // Keep last 3 octets (possible partial FAW) for the next call
+      int32_t keep = len - 3;
+      if (keep > start) {
+        skippedBytes += keep - start;
+        if (inSync) resyncCount++;
+        inSync = false;
+      }
+      return NOT_FOUND;
+    }
+    if (isFrameValid(ptr, len, i)) break;
+    i++;
+  }
+
+  if (i > start) {
+    skippedBytes += i - start;
+    if (inSync) resyncCount++;
+  }
+  if ((len - i >= BasicVRLFrame::HEADER_LENGTH) &&
+      (BasicVRLFrame::getFrameLength(ptr, i) <= len - i)) {
+    framesFound++;
+    inSync = true;
+  }
+  return i;
+}
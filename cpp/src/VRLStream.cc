@@ -0,0 +1,598 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRLStream.h"
+#include <errno.h>      // Required when using errno / ERRNO_STR
+#include <string.h>     // for memcpy(..)
+#include <stdlib.h>     // for mkstemp(..)
+#include <unistd.h>     // for close(..)
+#include <poll.h>       // for poll(..)
+#include <sys/mman.h>   // for mmap(..)
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>   // for TCP_NODELAY
+#include <linux/errqueue.h> // for struct sock_extended_err
+
+#ifndef SO_ZEROCOPY
+# define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+# define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+# define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+# define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+using namespace vrt;
+
+/** Opens a TCP connection to the given host and port. */
+static int openConnection (const InetAddress &host, int32_t port) {
+  if ((port <= 0) || (port > 65535)) {
+    throw VRTException("Invalid port number %d", port);
+  }
+
+  struct sockaddr_storage remote;
+  socklen_t               remoteLen;
+  memset(&remote, 0, sizeof(remote));
+
+  if (host.isIPv4()) {
+    struct sockaddr_in *sin = (struct sockaddr_in*)&remote;
+    sin->sin_family = AF_INET;
+    sin->sin_port   = htons((uint16_t)port);
+    sin->sin_addr   = host.toIPv4();
+    remoteLen       = sizeof(struct sockaddr_in);
+  }
+  else {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&remote;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port   = htons((uint16_t)port);
+    sin6->sin6_addr   = host.toIPv6();
+    remoteLen         = sizeof(struct sockaddr_in6);
+  }
+
+  int sock = socket(remote.ss_family, SOCK_STREAM, 0);
+  if (sock < 0) {
+    throw VRTException("Unable to open TCP socket: %s", ERRNO_STR);
+  }
+  if (connect(sock, (struct sockaddr*)&remote, remoteLen) != 0) {
+    int err = errno;
+    ::close(sock);
+    throw VRTException("Unable to connect to %s port %d: %s",
+                       host.getHostAddress().c_str(), port, strerror(err));
+  }
+  return sock;
+}
+
+/** Creates an unnamed shared memory file of the given size. */
+static int openSharedMemory (int32_t size) {
+  int fd = -1;
+#if defined(SYS_memfd_create)
+  fd = (int)syscall(SYS_memfd_create, "VRLStreamReader", 0);
+#endif
+  if (fd < 0) {
+    char name[] = "/dev/shm/VRLStreamReader.XXXXXX";
+    fd = mkstemp(name);
+    if (fd < 0) {
+      throw VRTException("Unable to create ring buffer: %s", ERRNO_STR);
+    }
+    unlink(name);
+  }
+  if (ftruncate(fd, size) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw VRTException("Unable to create ring buffer of %d octets: %s", size, strerror(err));
+  }
+  return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// VRLStreamReader
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+VRLStreamReader::VRLStreamReader (const InetAddress &host, int32_t port,
+                                  int32_t bufferSize, bool checkCRC) :
+  sock(-1),
+  closed(false),
+  eof(false),
+  size(0),
+  base(NULL),
+  head(0),
+  parsed(0),
+  tail(0),
+  scanner(checkCRC),
+  packets(),
+  lengths(),
+  framesReceived(0),
+  packetsReceived(0),
+  bytesReceived(0)
+{
+  init(bufferSize);
+  try {
+    sock = openConnection(host, port);
+  }
+  catch (VRTException e) {
+    close();
+    throw e;
+  }
+}
+
+VRLStreamReader::VRLStreamReader (int _sock, int32_t bufferSize, bool checkCRC) :
+  sock(_sock),
+  closed(false),
+  eof(false),
+  size(0),
+  base(NULL),
+  head(0),
+  parsed(0),
+  tail(0),
+  scanner(checkCRC),
+  packets(),
+  lengths(),
+  framesReceived(0),
+  packetsReceived(0),
+  bytesReceived(0)
+{
+  try {
+    init(bufferSize);
+  }
+  catch (VRTException e) {
+    close();
+    throw e;
+  }
+}
+
+VRLStreamReader::~VRLStreamReader () {
+  close();
+}
+
+void VRLStreamReader::init (int32_t bufferSize) {
+  if ((bufferSize < BasicVRLFrame::MAX_FRAME_LENGTH) || (bufferSize > 1024*1024*1024)) {
+    throw VRTException("Invalid buffer size %d, must be between %d and 1 GiB", bufferSize,
+                       BasicVRLFrame::MAX_FRAME_LENGTH);
+  }
+  int32_t page = (int32_t)sysconf(_SC_PAGESIZE);
+  size = ((bufferSize + page - 1) / page) * page;
+
+  // Reserve space for two copies and then map the same memory into each half, so
+  // any frame of up to 'size' octets starting anywhere in the first half can be
+  // read (or written) as a single contiguous block
+  int   fd   = openSharedMemory(size);
+  void *addr = mmap(NULL, 2 * (size_t)size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    int err = errno;
+    ::close(fd);
+    throw VRTException("Unable to reserve ring buffer of %d octets: %s", size, strerror(err));
+  }
+
+  char *ptr = (char*)addr;
+  if ((mmap(ptr,        size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+      (mmap(ptr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+    int err = errno;
+    munmap(addr, 2 * (size_t)size);
+    ::close(fd);
+    throw VRTException("Unable to map ring buffer of %d octets: %s", size, strerror(err));
+  }
+  ::close(fd); // mappings remain valid
+  base = ptr;
+
+  packets.reserve(1024);
+  lengths.reserve(1024);
+}
+
+string VRLStreamReader::toString () const {
+  return Utilities::format("%s: BufferSize=%d FramesReceived=%" PRId64 " PacketsReceived=%" PRId64
+                           " SkippedBytes=%" PRId64, getClassName().c_str(), size,
+                           framesReceived, packetsReceived, getSkippedBytes());
+}
+
+void VRLStreamReader::close () {
+  if (sock >= 0) {
+    ::close(sock);
+    sock = -1;
+  }
+  if (base != NULL) {
+    munmap(base, 2 * (size_t)size);
+    base = NULL;
+  }
+  packets.clear();
+  lengths.clear();
+}
+
+int32_t VRLStreamReader::receive (int32_t timeout) {
+  if (sock < 0) throw VRTException("Reader is closed");
+
+  // Release the previous batch
+  head = parsed;
+  packets.clear();
+  lengths.clear();
+  if (eof) return 0;
+
+  int64_t deadline = (timeout > 0)? Utilities::monotonicTimeMillis() + timeout : 0;
+  while (true) {
+    readData();
+    parseFrames();
+    if (!packets.empty()) break;
+
+    if (closed) {
+      eof = true;
+      break;
+    }
+    if (timeout == 0) break;
+
+    int32_t wait = -1;
+    if (timeout > 0) {
+      wait = (int32_t)(deadline - Utilities::monotonicTimeMillis());
+      if (wait <= 0) break;
+    }
+
+    struct pollfd pfd;
+    pfd.fd      = sock;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    int status  = poll(&pfd, 1, wait);
+    if (status == 0) break;
+    if (status < 0) {
+      if (errno == EINTR) break;
+      throw VRTException("Error waiting on connection: %s", ERRNO_STR);
+    }
+  }
+
+  packetsReceived += packets.size();
+  return (int32_t)packets.size();
+}
+
+int32_t VRLStreamReader::readData () {
+  int32_t space = size - (int32_t)(tail - head);
+  if ((space == 0) || closed) return 0;
+
+  // Thanks to the second mapping the free space is always contiguous
+  ssize_t n = recv(sock, base + (tail % size), space, MSG_DONTWAIT);
+  if (n > 0) {
+    tail          += n;
+    bytesReceived += n;
+    return (int32_t)n;
+  }
+  if (n == 0) {
+    closed = true;
+    return 0;
+  }
+  if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+    return 0;
+  }
+  throw VRTException("Error reading from connection: %s", ERRNO_STR);
+}
+
+void VRLStreamReader::parseFrames () {
+  while (true) {
+    int32_t avail = (int32_t)(tail - parsed);
+    if (avail < BasicVRLFrame::HEADER_LENGTH) return;
+
+    const char *buf = base + (parsed % size);
+    int32_t     off = scanner.findFrame(buf, avail, 0);
+
+    if (off == VRLFrameScanner::NOT_FOUND) {
+      // Nothing usable (the scanner leaves the last 3 octets, which could be the
+      // start of the next frame)
+      parsed += avail - 3;
+      return;
+    }
+    if (off > 0) {
+      parsed += off; // skip over invalid data
+      continue;
+    }
+    if (avail < BasicVRLFrame::HEADER_LENGTH) return;
+
+    int32_t frameLength = BasicVRLFrame::getFrameLength(buf, 0);
+    if (frameLength > avail) return; // partial frame, wait for the rest
+
+    // The scanner has already checked the packets exactly fill the frame
+    int32_t end = frameLength - BasicVRLFrame::TRAILER_LENGTH;
+    for (int32_t pkt = BasicVRLFrame::HEADER_LENGTH; pkt < end; ) {
+      int32_t len = BasicVRTPacket::getPacketLength(buf, pkt);
+      packets.push_back(buf + pkt);
+      lengths.push_back(len);
+      pkt += len;
+    }
+    framesReceived++;
+    parsed += frameLength;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// VRLStreamWriter
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+VRLStreamWriter::VRLStreamWriter (const InetAddress &host, int32_t port, int32_t _frameLength,
+                                  bool crc, bool _zeroCopy) :
+  sock(-1),
+  frameLength(_frameLength),
+  zeroCopy(_zeroCopy),
+  builder(_frameLength, crc),
+  buffers(),
+  current(0),
+  used(0),
+  pending(),
+  nextId(0),
+  doneId(0),
+  framesWritten(0),
+  packetsWritten(0),
+  bytesWritten(0),
+  zeroCopyCopied(0)
+{
+  sock = openConnection(host, port);
+  init();
+}
+
+VRLStreamWriter::VRLStreamWriter (int _sock, int32_t _frameLength, bool crc, bool _zeroCopy) :
+  sock(_sock),
+  frameLength(_frameLength),
+  zeroCopy(_zeroCopy),
+  builder(_frameLength, crc),
+  buffers(),
+  current(0),
+  used(0),
+  pending(),
+  nextId(0),
+  doneId(0),
+  framesWritten(0),
+  packetsWritten(0),
+  bytesWritten(0),
+  zeroCopyCopied(0)
+{
+  init();
+}
+
+VRLStreamWriter::~VRLStreamWriter () {
+  try {
+    close();
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e);
+  }
+  if (sock >= 0) {
+    ::close(sock);
+    sock = -1;
+  }
+}
+
+void VRLStreamWriter::init () {
+  // Frames are coalesced here, so there is no need for the kernel to hold back
+  // small writes
+  int on = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  if (zeroCopy && (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0)) {
+    zeroCopy = false; // not supported
+  }
+
+  buffers.resize((size_t)NUM_BUFFERS * frameLength);
+  pending.reserve(64);
+  for (int32_t i = 0; i < NUM_BUFFERS; i++) {
+    bufferId[i]   = 0;
+    bufferBusy[i] = false;
+  }
+}
+
+string VRLStreamWriter::toString () const {
+  return Utilities::format("%s: FrameLength=%d ZeroCopy=%s FramesWritten=%" PRId64
+                           " PacketsWritten=%" PRId64, getClassName().c_str(), frameLength,
+                           (zeroCopy)? "true" : "false", framesWritten, packetsWritten);
+}
+
+void VRLStreamWriter::close () {
+  if (sock < 0) return;
+
+  flush();
+  for (int32_t i = 0; i < NUM_BUFFERS; i++) {
+    waitBuffer(i);
+  }
+  ::close(sock);
+  sock = -1;
+}
+
+void VRLStreamWriter::append (const void *ptr, int32_t len) {
+  if (sock < 0) throw VRTException("Writer is closed");
+  if ((len < 4) || (BasicVRLFrame::MIN_FRAME_LENGTH + len > frameLength)) {
+    throw VRTException("Invalid packet length %d for max frame length %d", len, frameLength);
+  }
+
+  if (BasicVRLFrame::MIN_FRAME_LENGTH + used + len > frameLength) {
+    flush();
+  }
+
+  char *dst = getBuffer(current) + BasicVRLFrame::HEADER_LENGTH + used;
+  memcpy(dst, ptr, len);
+  if (!builder.addPacket(dst, len)) {
+    // Frame is full for some other reason (e.g. IOV_MAX reached)
+    flush();
+    dst = getBuffer(current) + BasicVRLFrame::HEADER_LENGTH;
+    memcpy(dst, ptr, len);
+    builder.addPacket(dst, len);
+  }
+  used += len;
+  packetsWritten++;
+}
+
+void VRLStreamWriter::flush () {
+  if (sock < 0) throw VRTException("Writer is closed");
+  if (builder.isEmpty()) return;
+
+  // The packets are already in place in the buffer, add the header and trailer so
+  // the whole frame can go in a single (possibly zero-copy) send
+  const vector<struct iovec> &iov = builder.getFrame();
+  int32_t                     len = builder.getFrameLength();
+  char                       *buf = getBuffer(current);
+
+  memcpy(buf, iov.front().iov_base, BasicVRLFrame::HEADER_LENGTH);
+  memcpy(buf + len - BasicVRLFrame::TRAILER_LENGTH, iov.back().iov_base,
+         BasicVRLFrame::TRAILER_LENGTH);
+
+  struct iovec whole;
+  whole.iov_base = buf;
+  whole.iov_len  = len;
+  sendFrame(&whole, 1, len, current);
+
+  builder.nextFrame();
+  used    = 0;
+  current = (current + 1) % NUM_BUFFERS;
+  waitBuffer(current);
+}
+
+void VRLStreamWriter::write (const BasicVRTPacket *const *packets, int32_t n) {
+  flush(); // appended packets go first
+
+  try {
+    for (int32_t i = 0; i < n; i++) {
+      if (!builder.addPacket(*packets[i])) {
+        sendBuilt();
+        builder.addPacket(*packets[i]);
+      }
+      packetsWritten++;
+    }
+  }
+  catch (VRTException e) {
+    // Send the packets before the invalid one, the builder must not be left holding
+    // pointers to the caller's packets
+    sendBuilt();
+    throw e;
+  }
+  sendBuilt();
+}
+
+void VRLStreamWriter::sendBuilt () {
+  if (builder.isEmpty()) return;
+
+  const vector<struct iovec> &iov = builder.getFrame();
+  sendFrame(&iov[0], (int32_t)iov.size(), builder.getFrameLength(), -1);
+  builder.nextFrame();
+}
+
+void VRLStreamWriter::sendFrame (const struct iovec *iov, int32_t cnt, int32_t len, int32_t buf) {
+  bool zc = zeroCopy && (buf >= 0);
+  int  flags = MSG_NOSIGNAL | ((zc)? MSG_ZEROCOPY : 0);
+
+  pending.assign(iov, iov + cnt);
+  size_t  first = 0;
+  int32_t left  = len;
+
+  while (left > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = &pending[first];
+    msg.msg_iovlen = pending.size() - first;
+
+    ssize_t n = sendmsg(sock, &msg, flags);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (zc && (errno == ENOBUFS)) {
+        // Too many zero-copy sends outstanding, wait for some to complete
+        readCompletions(true);
+        continue;
+      }
+      throw VRTException("Error writing to connection: %s", ERRNO_STR);
+    }
+
+    if (zc) {
+      // Each successful zero-copy send is given the next number, which is reported
+      // back once the kernel is done with the data
+      bufferId[buf]   = nextId++;
+      bufferBusy[buf] = true;
+    }
+
+    // Handle a partial write (only likely if interrupted by a signal)
+    left -= (int32_t)n;
+    while ((n > 0) && (first < pending.size())) {
+      if ((size_t)n >= pending[first].iov_len) {
+        n -= pending[first].iov_len;
+        first++;
+      }
+      else {
+        pending[first].iov_base = (char*)pending[first].iov_base + n;
+        pending[first].iov_len -= n;
+        n = 0;
+      }
+    }
+  }
+
+  framesWritten++;
+  bytesWritten += len;
+}
+
+void VRLStreamWriter::readCompletions (bool wait) {
+  while (true) {
+    char          control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EINTR) continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        throw VRTException("Error reading zero-copy completions: %s", ERRNO_STR);
+      }
+      if (!wait) return;
+
+      // Completions are signalled as POLLERR
+      struct pollfd pfd;
+      pfd.fd      = sock;
+      pfd.events  = 0;
+      pfd.revents = 0;
+      if ((poll(&pfd, 1, -1) < 0) && (errno != EINTR)) {
+        throw VRTException("Error waiting for zero-copy completions: %s", ERRNO_STR);
+      }
+      if (((pfd.revents & POLLERR) == 0) && ((pfd.revents & (POLLHUP | POLLNVAL)) != 0)) {
+        throw VRTException("Connection closed while waiting for zero-copy completions");
+      }
+      continue;
+    }
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+      if (!((c->cmsg_level == SOL_IP  ) && (c->cmsg_type == IP_RECVERR  )) &&
+          !((c->cmsg_level == SOL_IPV6) && (c->cmsg_type == IPV6_RECVERR))) continue;
+
+      const struct sock_extended_err *err = (const struct sock_extended_err*)CMSG_DATA(c);
+      if ((err->ee_errno != 0) || (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)) continue;
+
+      // Sends lo..hi (inclusive) are complete, these are reported in order
+      uint32_t lo = err->ee_info;
+      uint32_t hi = err->ee_data;
+      if ((int32_t)(hi + 1 - doneId) > 0) doneId = hi + 1;
+      if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0) zeroCopyCopied += hi - lo + 1;
+    }
+    wait = false; // got at least one, pick up any others without waiting
+  }
+}
+
+void VRLStreamWriter::waitBuffer (int32_t b) {
+  while (bufferBusy[b]) {
+    if ((int32_t)(doneId - (bufferId[b] + 1)) >= 0) {
+      bufferBusy[b] = false;
+    }
+    else {
+      readCompletions(true);
+    }
+  }
+}
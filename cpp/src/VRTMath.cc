@@ -713,6 +713,203 @@ void VRTMath::unpackRecord (const vector<char> &buf, int32_t off, Record &val) {
   val.writeBytes(&buf[off]);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// CRC-32
+////////////////////////////////////////////////////////////////////////////////
+// References:
+//   [1] VITA 49.1
+//   [2] Gopal, V. et.al. "Fast CRC Computation for Generic Polynomials Using
+//       PCLMULQDQ Instruction." Intel, 2009.
+//
+// The algorithm in Appendix A of [1] is a CRC-32 computed most-significant bit
+// first with an initial value of 0 and no final XOR. Both implementations below
+// work directly in that (non-reflected) form so no bit reversal is required.
+
+/** The CRC-32 polynomial, less the implicit x^32 term. */
+static const uint32_t CRC32_POLY = 0x04C11DB7;
+
+/** Slicing-by-8 tables, CRC32_TABLE[k][n] is the CRC of octet n followed by k zeros. */
+static uint32_t CRC32_TABLE[8][256];
+
+/** Powers of x used for combining CRCs, CRC32_X2N[k] = x^(8*2^k) mod P. */
+static uint32_t CRC32_X2N[64];
+
+/** Computes a*b mod P. */
+static uint32_t crc32MulMod (uint32_t a, uint32_t b) {
+  uint32_t r = 0;
+  for (int32_t i = 31; i >= 0; i--) {
+    r = (r << 1) ^ ((r & 0x80000000)? CRC32_POLY : 0);
+    if ((b >> i) & 1) r ^= a;
+  }
+  return r;
+}
+
+/** Computes x^n mod P. */
+static uint32_t crc32XPow (int32_t n) {
+  uint32_t c = 1;
+  for (int32_t i = 0; i < n; i++) {
+    c = (c << 1) ^ ((c & 0x80000000)? CRC32_POLY : 0);
+  }
+  return c;
+}
+
+/** Computes the CRC-32 using the slicing-by-8 tables. */
+static uint32_t crc32Table (uint32_t crc, const uint8_t *buf, size_t len) {
+  while (len >= 8) {
+    uint32_t a = crc ^ (((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16)
+                     |  ((uint32_t)buf[2] <<  8) | ((uint32_t)buf[3]      ));
+    crc = CRC32_TABLE[7][(a >> 24)       ] ^ CRC32_TABLE[6][(a >> 16) & 0xFF]
+        ^ CRC32_TABLE[5][(a >>  8) & 0xFF] ^ CRC32_TABLE[4][(a      ) & 0xFF]
+        ^ CRC32_TABLE[3][buf[4]]           ^ CRC32_TABLE[2][buf[5]]
+        ^ CRC32_TABLE[1][buf[6]]           ^ CRC32_TABLE[0][buf[7]];
+    buf += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc = (crc << 8) ^ CRC32_TABLE[0][(crc >> 24) ^ *buf];
+    buf++;
+    len--;
+  }
+  return crc;
+}
+
+/** The CRC32_PCLMUL setting can be used to disable use of the carry-less
+ *  multiply implementation on x86 (e.g. CRC32_PCLMUL=0 when testing). Even
+ *  when enabled it is only used if the processor supports it.
+ */
+#ifndef CRC32_PCLMUL
+# if defined(__x86_64__) && defined(__GNU_COMPILER) && (__GCC_VERSION >= 40900)
+#  define CRC32_PCLMUL 1
+# else
+#  define CRC32_PCLMUL 0
+# endif
+#endif
+
+#if CRC32_PCLMUL
+#include <cpuid.h>
+#include <tmmintrin.h>  // SSSE3  (_mm_shuffle_epi8)
+#include <wmmintrin.h>  // PCLMUL (_mm_clmulepi64_si128)
+
+/** Fold constants: {x^(128+64), x^128} and {x^(512+64), x^512} mod P. */
+static uint64_t CRC32_FOLD128[2];
+static uint64_t CRC32_FOLD512[2];
+
+/** Multiplies a 128-bit value by x^N (mod P) where k holds {x^(N+64), x^N}. */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc32Fold (__m128i a, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11),
+                       _mm_clmulepi64_si128(a, k, 0x00));
+}
+
+/** Computes the CRC-32 using carry-less multiply folding. The input is folded
+ *  down to a single 128-bit value that is congruent (mod P) to the input, that
+ *  value and any remaining octets are then run through the table version.
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32PCLMUL (uint32_t crc, const uint8_t *buf, size_t len) {
+  if (len < 128) return crc32Table(crc, buf, len);
+
+  const __m128i swap = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m128i k512 = _mm_set_epi64x((int64_t)CRC32_FOLD512[0], (int64_t)CRC32_FOLD512[1]);
+  const __m128i k128 = _mm_set_epi64x((int64_t)CRC32_FOLD128[0], (int64_t)CRC32_FOLD128[1]);
+
+  __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf     )), swap);
+  __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 16)), swap);
+  __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 32)), swap);
+  __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 48)), swap);
+  x0  = _mm_xor_si128(x0, _mm_set_epi32((int32_t)crc, 0, 0, 0)); // initial CRC goes in first 32 bits
+  buf += 64;
+  len -= 64;
+
+  while (len >= 64) {
+    x0 = _mm_xor_si128(crc32Fold(x0, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf     )), swap));
+    x1 = _mm_xor_si128(crc32Fold(x1, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 16)), swap));
+    x2 = _mm_xor_si128(crc32Fold(x2, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 32)), swap));
+    x3 = _mm_xor_si128(crc32Fold(x3, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + 48)), swap));
+    buf += 64;
+    len -= 64;
+  }
+
+  x0 = _mm_xor_si128(crc32Fold(x0, k128), x1);
+  x0 = _mm_xor_si128(crc32Fold(x0, k128), x2);
+  x0 = _mm_xor_si128(crc32Fold(x0, k128), x3);
+
+  while (len >= 16) {
+    x0 = _mm_xor_si128(crc32Fold(x0, k128), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)buf), swap));
+    buf += 16;
+    len -= 16;
+  }
+
+  uint8_t rem[16];
+  _mm_storeu_si128((__m128i*)rem, _mm_shuffle_epi8(x0, swap));
+  return crc32Table(crc32Table(0, rem, 16), buf, len);
+}
+
+/** Does the processor support PCLMULQDQ and SSSE3? */
+static bool hasPCLMUL () {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+  return ((ecx & bit_PCLMUL) != 0) && ((ecx & bit_SSSE3) != 0);
+}
+#endif /* CRC32_PCLMUL */
+
+/** Function type for the CRC-32 implementations. */
+typedef uint32_t (*CRC32Function)(uint32_t crc, const uint8_t *buf, size_t len);
+
+/** Initializes the CRC-32 tables and selects the implementation to use. */
+static CRC32Function initCRC32 () {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n << 24;
+    for (int32_t i = 0; i < 8; i++) {
+      c = (c << 1) ^ ((c & 0x80000000)? CRC32_POLY : 0);
+    }
+    CRC32_TABLE[0][n] = c;
+  }
+  for (int32_t k = 1; k < 8; k++) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = CRC32_TABLE[k-1][n];
+      CRC32_TABLE[k][n] = (c << 8) ^ CRC32_TABLE[0][c >> 24];
+    }
+  }
+
+  CRC32_X2N[0] = crc32XPow(8);
+  for (int32_t k = 1; k < 64; k++) {
+    CRC32_X2N[k] = crc32MulMod(CRC32_X2N[k-1], CRC32_X2N[k-1]);
+  }
+
+#if CRC32_PCLMUL
+  if (hasPCLMUL()) {
+    CRC32_FOLD128[0] = crc32XPow(128+64);
+    CRC32_FOLD128[1] = crc32XPow(128);
+    CRC32_FOLD512[0] = crc32XPow(512+64);
+    CRC32_FOLD512[1] = crc32XPow(512);
+    return crc32PCLMUL;
+  }
+#endif
+  return crc32Table;
+}
+
+/** Gets the CRC-32 implementation to use, initializing the tables on first use. */
+static inline CRC32Function getCRC32 () {
+  static const CRC32Function func = initCRC32(); // thread-safe one-time init
+  return func;
+}
+
+int32_t VRTMath::crc32 (int32_t crc, const void *ptr, size_t len) {
+  return (int32_t)getCRC32()((uint32_t)crc, (const uint8_t*)ptr, len);
+}
+
+int32_t VRTMath::crc32Combine (int32_t crcA, int32_t crcB, int64_t lenB) {
+  // With an initial value of 0 and no final XOR the CRC is linear, so
+  // CRC(A+B) = CRC(A)*x^(8*lenB) + CRC(B)  (mod P)
+  getCRC32(); // ensure tables are initialized
+  uint32_t crc = (uint32_t)crcA;
+  for (int32_t k = 0; (lenB > 0) && (k < 64); k++, lenB >>= 1) {
+    if (lenB & 1) crc = crc32MulMod(crc, CRC32_X2N[k]);
+  }
+  return (int32_t)(crc ^ (uint32_t)crcB);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 #endif /* NOT_USING_JNI */
 ////////////////////////////////////////////////////////////////////////////////
@@ -173,14 +173,12 @@ void MutexObj::unlock () {
 
 
 MutexLock::MutexLock (const VRTObject &obj) {
-  VRTObject *o = const_cast<VRTObject*>(&obj);
-  mutexObj = o->mutexObj.lock();
+  mutexObj = obj.getMutexObj()->lock();
 }
 
 MutexLock::MutexLock (const VRTObject *obj) {
   if (obj == NULL) throw VRTException("START_SYNCHRONIZED(..) called with NULL object");
-  VRTObject *o = const_cast<VRTObject*>(obj);
-  mutexObj = o->mutexObj.lock();
+  mutexObj = obj->getMutexObj()->lock();
 }
 
 void MutexLock::unlock () {
@@ -190,6 +188,22 @@ void MutexLock::unlock () {
   }
 }
 
+MutexObj* VRTObject::getMutexObj () const {
+  VRTObject *self = const_cast<VRTObject*>(this);
+  MutexObj  *m    = self->mutexObj;
+  if (m != NULL) return m;
+
+  // Two threads may race to allocate the mutex, only one of them wins and the
+  // other discards its copy.
+  m = new MutexObj();
+  MutexObj *prev = __sync_val_compare_and_swap(&self->mutexObj, (MutexObj*)NULL, m);
+  if (prev != NULL) {
+    delete m;
+    return prev;
+  }
+  return m;
+}
+
 string VRTObject::toString () const {
   char address[32];
   snprintf(address, 32, "@%p", this);
@@ -0,0 +1,133 @@
+/* ===================== COPYRIGHT NOTICE =====================
+ * This file is protected by Copyright. Please refer to the COPYRIGHT file
+ * distributed with this source distribution.
+ *
+ * This file is part of REDHAWK.
+ *
+ * REDHAWK is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * REDHAWK is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ * ============================================================
+ */
+
+#include "VRTPacketView.h"
+#include "AbstractPacketFactory.h"
+#include <string.h>   // for memcmp(..)
+
+using namespace std;
+using namespace vrt;
+
+string VRTPacketView::toString () const {
+  if (isNullValue()) return getClassName()+": <null>";
+
+  string err = getPacketValid();
+  if (err != "") return getClassName()+": <"+err+">";
+
+  int32_t sid = getStreamIdentifier();
+  return Utilities::format("%s: PacketType=%d StreamID=%s ClassID=%s PacketCount=%d PacketLength=%d",
+                           getClassName().c_str(), (int)getPacketType(),
+                           (isNull(sid))? "" : Utilities::format("%d", sid).c_str(),
+                           (hasClassIdentifier())? Utilities::toStringClassID(getClassIdentifier()).c_str() : "",
+                           getPacketCount(), getPacketLength());
+}
+
+bool VRTPacketView::equals (const VRTObject &o) const {
+  try {
+    return equals(*checked_dynamic_cast<const VRTPacketView*>(&o));
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e);
+    return false;
+  }
+}
+
+bool VRTPacketView::equals (const VRTPacketView &v) const {
+  if (isNullValue() || v.isNullValue()) return (isNullValue() && v.isNullValue());
+  int32_t n = getPacketLength();
+  return (n == v.getPacketLength()) && (memcmp(buf, v.buf, n) == 0);
+}
+
+string VRTPacketView::getPacketValid () const {
+  if (isNullValue()) return "Null packet view";
+  if (len < 4) {
+    return Utilities::format("Packet view of %d octets can not hold a VRT packet header", len);
+  }
+  int32_t n = getPacketLength();
+  if (n > len) {
+    return Utilities::format("Packet length of %d octets exceeds the %d octets available", n, len);
+  }
+  if (n < getHeaderLength() + getTrailerLength()) {
+    return Utilities::format("Packet length of %d octets is too short for the fields present", n);
+  }
+  return "";
+}
+
+BasicVRTPacket *VRTPacketView::toPacket () const {
+  if (isNullValue()) throw VRTException("Can not create a packet from a null view");
+
+  BasicVRTPacket p(buf, getPacketLength(), false);
+  return VRTConfig::getPacket(p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// VRTPacketViewIterator
+////////////////////////////////////////////////////////////////////////////////
+
+VRTPacketViewIterator::VRTPacketViewIterator () :
+  buf(NULL),
+  off(0),
+  max(0),
+  view()
+{
+  // done
+}
+
+VRTPacketViewIterator::VRTPacketViewIterator (const VRTPacketViewIterator &pi) :
+  VRTObject(pi), // <-- Used to avoid warnings under GCC with -Wextra turned on
+  buf(pi.buf),
+  off(pi.off),
+  max(pi.max),
+  view(pi.view)
+{
+  // done
+}
+
+VRTPacketViewIterator::VRTPacketViewIterator (const void *ptr, int64_t start, int64_t end, bool begin) :
+  buf(NULL),
+  off(0),
+  max(0),
+  view()
+{
+  init(ptr, start, end, begin);
+}
+
+VRTPacketViewIterator& VRTPacketViewIterator::operator= (const VRTPacketViewIterator &pi) {
+  buf  = pi.buf;
+  off  = pi.off;
+  max  = pi.max;
+  view = pi.view;
+  return *this;
+}
+
+string VRTPacketViewIterator::toString () const {
+  return Utilities::format("%s @%" PRId64 "/%" PRId64, getClassName().c_str(), off, max);
+}
+
+bool VRTPacketViewIterator::equals (const VRTObject &o) const {
+  try {
+    return equals(*checked_dynamic_cast<const VRTPacketViewIterator*>(&o));
+  }
+  catch (VRTException e) {
+    UNUSED_VARIABLE(e);
+    return false;
+  }
+}
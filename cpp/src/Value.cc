@@ -22,6 +22,7 @@
 #include "Value.h"
 #include "HasFields.h"
 #include <cstring>
+#include <stdio.h>      // required for perror(..)
 #include <sstream>
 #include <iostream>
 #include <map>
@@ -53,6 +54,8 @@ class FieldMap : public VRTObject, public HasFields {
   public: virtual string  getFieldName (int32_t id) const;
   public: virtual void    setField (int32_t id, const Value* val);
   public: virtual Value*  getField (int32_t id) const  __attribute__((warn_unused_result));
+
+  protected: virtual bool hasFixedFieldNames () const { return false; }
 };
 
 FieldMap::FieldMap (const map<string,Value*>& vals, bool owner) :
@@ -115,6 +118,67 @@ Value* FieldMap::getField (int32_t id) const  {
   return new Value(self->values[getFieldName(id)]);
 }
 
+/** <b>Internal Use Only:</b> Maximum number of released blocks cached per thread. */
+static const int32_t VALUE_CACHE_SIZE = 32;
+
+/** <b>Internal Use Only:</b> Per-thread cache of released Value blocks. */
+struct ValueCache {
+  int32_t  count;
+  void    *blocks[VALUE_CACHE_SIZE];
+};
+
+static pthread_key_t  valueCacheKey;
+static pthread_once_t valueCacheOnce = PTHREAD_ONCE_INIT;
+
+/** <b>Internal Use Only:</b> Releases a thread's cache when the thread exits. */
+static void freeValueCache (void *ptr) {
+  ValueCache *cache = (ValueCache*)ptr;
+  for (int32_t i = 0; i < cache->count; i++) {
+    ::operator delete(cache->blocks[i]);
+  }
+  delete cache;
+}
+
+/** <b>Internal Use Only:</b> Creates the thread-specific key for the caches. */
+static void initValueCache () {
+  if (pthread_key_create(&valueCacheKey, freeValueCache) != 0) {
+    perror("ERROR: Unable to create thread-specific key for Value cache");
+    throw exception();
+  }
+}
+
+/** <b>Internal Use Only:</b> Gets the current thread's cache. */
+static inline ValueCache* getValueCache () {
+  pthread_once(&valueCacheOnce, initValueCache);
+  ValueCache *cache = (ValueCache*)pthread_getspecific(valueCacheKey);
+  if (cache == NULL) {
+    cache = new ValueCache();
+    cache->count = 0;
+    pthread_setspecific(valueCacheKey, cache);
+  }
+  return cache;
+}
+
+void* Value::operator new (size_t size) {
+  if (size == sizeof(Value)) {
+    ValueCache *cache = getValueCache();
+    if (cache->count > 0) return cache->blocks[--cache->count];
+  }
+  return ::operator new(size);
+}
+
+void Value::operator delete (void *ptr, size_t size) {
+  if (ptr == NULL) return;
+  if (size == sizeof(Value)) {
+    ValueCache *cache = getValueCache();
+    if (cache->count < VALUE_CACHE_SIZE) {
+      cache->blocks[cache->count++] = ptr;
+      return;
+    }
+  }
+  ::operator delete(ptr);
+}
+
 size_t Value::npos = string::npos;
 
 Value::Value (                               ) : type('_'), owner(false) { value.xval   = 0;   init(); }